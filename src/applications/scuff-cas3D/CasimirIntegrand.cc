@@ -36,11 +36,6 @@
 #include "scuff-cas3D.h"
 #include "libscuffInternals.h"
 
-extern "C" {
-int dgetrf_(int *m, int *n, double *a, int *lda, int *ipiv, int *info);
-int zgetrf_(int *m, int *n, cdouble *a, int *lda, int *ipiv, int *info);
-}
-
 using namespace scuff;
 
 #define II cdouble(0.0,1.0)
@@ -50,19 +45,17 @@ using namespace scuff;
 /***************************************************************/
 double GetLNDetMInvMInf(SC3Data *SC3D)
 { 
-  HMatrix *M              = SC3D->M;
+  BlockSchurMatrix *M     = SC3D->M;
   int N                   = SC3D->N;
 
   double LNDet=0.0;
   if (SC3D->NewEnergyMethod==false)
    {  
      /*--------------------------------------------------------------*/
-     /*- calculation method 1  --------------------------------------*/
+     /*- calculation method 1: MInfinity is the block-diagonal part -*/
+     /*- of M, whose determinant M already knows --------------------*/
      /*--------------------------------------------------------------*/
-     HVector *MInfLUDiagonal = SC3D->MInfLUDiagonal;
-
-     for(int n=0; n<N; n++)
-      LNDet+=log( abs( MInfLUDiagonal->GetEntryD(n) / M->GetEntry(n,n) ) );
+     LNDet = -M->GetLogDet(true);
    }
   else
    {
@@ -103,7 +96,7 @@ double GetTraceMInvdM(SC3Data *SC3D, char XYZT)
   /* unpack fields from workspace structure **********************/
   /***************************************************************/
   RWGGeometry *G     = SC3D->G;
-  HMatrix *M         = SC3D->M;
+  BlockSchurMatrix *M = SC3D->M;
   HMatrix *dM        = SC3D->dM;
   HMatrix **dUBlocks = SC3D->dUBlocks;
 
@@ -130,12 +123,7 @@ double GetTraceMInvdM(SC3Data *SC3D, char XYZT)
   for(int ns=1; ns<G->NumSurfaces; ns++)
    dM->InsertBlockAdjoint(dUBlocks[ 6*(ns-1) + Mu ], G->BFIndexOffset[ns], 0);
 
-  M->LUSolve(dM);
-
-  double Trace=0.0;
-  for(int n=0; n<dM->NC; n++)
-   Trace+=dM->GetEntryD(n,n);
-  Trace*=2.0;
+  double Trace=2.0*real( M->GetTraceMInv(dM) );
 
   // paraphrasing the physicists of the 1930s, 'just because
   // something is infinite doesn't mean that it's zero.' and yet...
@@ -146,43 +134,6 @@ double GetTraceMInvdM(SC3Data *SC3D, char XYZT)
 } 
 
 
-/***************************************************************/
-/* stamp T and U blocks into the BEM matrix, then LU-factorize.*/
-/***************************************************************/
-void Factorize(SC3Data *SC3D)
-{ 
-  RWGGeometry *G = SC3D->G;
-  HMatrix *M     = SC3D->M;
-
-  /***************************************************************/
-  /* stamp blocks into M matrix                                  */
-  /***************************************************************/
-  /* T blocks */
-  int Offset;
-  for(int ns=0; ns<G->NumSurfaces; ns++)
-   { 
-     Offset=G->BFIndexOffset[ns];
-     M->InsertBlock(SC3D->TBlocks[ns], Offset, Offset);
-   };
-
-  /* U blocks */
-  int RowOffset, ColOffset;
-  for(int nb=0, ns=0; ns<G->NumSurfaces; ns++)
-   for(int nsp=ns+1; nsp<G->NumSurfaces; nsp++, nb++)
-    { 
-      RowOffset=G->BFIndexOffset[ns];
-      ColOffset=G->BFIndexOffset[nsp];
-      M->InsertBlock(SC3D->UBlocks[nb], RowOffset, ColOffset);
-      M->InsertBlockAdjoint(SC3D->UBlocks[nb], ColOffset, RowOffset);
-    };
-
-  /***************************************************************/
-  /* LU factorize                                                */
-  /***************************************************************/
-  M->LUFactorize();
-
-} 
-
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -312,59 +263,14 @@ void GetCasimirIntegrand(void *pSC3D, cdouble Omega,
    }; // for(ns=0; ns<G->NumSurfaces; ns++)
 
   /***************************************************************/
-  /* if an energy calculation was requested, compute and save    */
-  /* the diagonals of the LU factorization of the T blocks       */
-  /* (which collectively constitute the diagonal of the LU       */
-  /* factorization of the M_{\infinity} matrix).                 */
+  /* LU-factorize the T blocks (once for each set of identical   */
+  /* surfaces); the factorization is reused for all              */
+  /* transformations at this frequency.                          */
   /***************************************************************/
-  if ( SC3D->WhichQuantities & QUANTITY_ENERGY )
-   {
-     HMatrix *M=SC3D->M;
-     HVector *V=SC3D->MInfLUDiagonal;
-     for(int ns=0; ns<G->NumSurfaces; ns++)
-      { 
-        int Offset=G->BFIndexOffset[ns];
-        int NBF=G->Surfaces[ns]->NumBFs;
-
-        int nsp=G->Mate[ns];
-        if ( nsp != -1 )
-         { 
-           /* if this object has a mate, just copy the diagonals of the */
-           /* mate's LU factor                                          */
-           int MateOffset=G->BFIndexOffset[nsp];
-           memcpy(V->DV+Offset,V->DV+MateOffset,NBF*sizeof(double));
-         }
-        else
-         { 
-           /* LU factorize the matrix (non-PEC) case or cholesky-factorize */
-           /* the negative of the matrix (all-PEC case).                   */
-           /* KIND OF HACKY: we use the data buffer inside M as temporary  */
-           /* storage for the content of T; this means that we have to     */
-           /* call the lapack routines directly instead of using the nice  */
-           /* wrappers provided by libhmat.                                */
-           Log("LU-factorizing T%i at Xi=%g...",ns+1,Xi);
-           int info;
-           if (PBC)
-            { for(int nbf=0; nbf<NBF; nbf++)
-               for(int nbfp=0; nbfp<NBF; nbfp++)
-                M->ZM[nbf + nbfp*NBF] = SC3D->TBlocks[ns]->GetEntry(nbf,nbfp);
-              zgetrf_(&NBF, &NBF, M->ZM, &NBF, SC3D->ipiv, &info);
-              for(int nbf=0; nbf<NBF; nbf++)
-               V->SetEntry(Offset+nbf, abs(M->ZM[nbf+nbf*NBF]) );
-            }
-           else
-            { for(int nbf=0; nbf<NBF; nbf++)
-               for(int nbfp=0; nbfp<NBF; nbfp++)
-                M->DM[nbf + nbfp*NBF] = SC3D->TBlocks[ns]->GetEntryD(nbf,nbfp);
-              dgetrf_(&NBF, &NBF, M->DM, &NBF, SC3D->ipiv, &info);
-              for(int nbf=0; nbf<NBF; nbf++)
-               V->SetEntry(Offset+nbf, M->DM[nbf+nbf*NBF]);
-            };
-           if (info!=0)
-            Log("...FAILED with info=%i (N=%i)",info,NBF);
-         };
-      };
-   };
+  Log("LU-factorizing T blocks at Xi=%g...",Xi);
+  int info=SC3D->M->FactorizeDiagonalBlocks();
+  if (info!=0)
+   Log("...FAILED with info=%i",info);
      
   /***************************************************************/
   /* for each line in the TransFile, apply the specified         */
@@ -454,9 +360,11 @@ void GetCasimirIntegrand(void *pSC3D, cdouble Omega,
      /***************************************************************/
 
      /***************************************************************/
-     /* factorize the M matrix and compute casimir quantities       */
+     /* factorize the M matrix and compute casimir quantities; the  */
+     /* U blocks were installed in M when it was created, so only   */
+     /* the Schur complement of the T blocks is factorized here     */
      /***************************************************************/
-     Factorize(SC3D);
+     SC3D->M->LUFactorize();
      if ( SC3D->WhichQuantities & QUANTITY_ENERGY )
       EFT[ntnq++]=GetLNDetMInvMInf(SC3D);
      if ( SC3D->WhichQuantities & QUANTITY_XFORCE )
@@ -500,7 +408,7 @@ void GetCasimirIntegrand(void *pSC3D, cdouble Omega,
   /***************************************************************/
   /***************************************************************/
   if (SC3D->WriteCache)
-   { StoreCache(SC3D->WriteCache); 
+   { StoreCache(SC3D->WriteCache, G); 
      SC3D->WriteCache=0;
    };
 
@@ -145,22 +145,31 @@ SC3Data *CreateSC3Data(RWGGeometry *G, char *TransFile,
   /*--------------------------------------------------------------*/
   int N  = SC3D->N  = SC3D->G->TotalBFs;
   int N1 = SC3D->N1 = SC3D->G->Surfaces[0]->NumBFs;
-  SC3D->M           = new HMatrix(N,  N,  RealComplex);
   SC3D->dM          = new HMatrix(N,  N1, RealComplex);
   SC3D->NewEnergyMethod  = NewEnergyMethod;
 
-  if (WhichQuantities & QUANTITY_ENERGY)
-   { SC3D->MInfLUDiagonal = new HVector(G->TotalBFs);
-     SC3D->ipiv = (int *)mallocEC(N*sizeof(int));
-     if (NewEnergyMethod)
-      SC3D->MM1MInf = new HMatrix(N, N, RealComplex);
-   }
-  else
-   { SC3D->MInfLUDiagonal=0;
-     SC3D->ipiv=0;
-     SC3D->MM1MInf = 0;
+  /*--------------------------------------------------------------*/
+  /*- the full BEM matrix is never stamped together; instead, M   */
+  /*- refers to the T and U blocks, so that the T blocks are      */
+  /*- factorized once per frequency and each transformation only  */
+  /*- requires factorizing a Schur complement                     */
+  /*--------------------------------------------------------------*/
+  int *BlockSizes = (int *)mallocEC(NS*sizeof(int));
+  for(int ns=0; ns<NS; ns++)
+   BlockSizes[ns]=G->Surfaces[ns]->NumBFs;
+  SC3D->M = new BlockSchurMatrix(NS, BlockSizes, RealComplex, 'C');
+  free(BlockSizes);
+  for(int ns=0, nb=0; ns<NS; ns++)
+   { SC3D->M->SetBlock(ns, ns, SC3D->TBlocks[ns]);
+     for(int nsp=ns+1; nsp<NS; nsp++, nb++)
+      SC3D->M->SetBlock(ns, nsp, SC3D->UBlocks[nb]);
    };
 
+  if ( (WhichQuantities & QUANTITY_ENERGY) && NewEnergyMethod )
+   SC3D->MM1MInf = new HMatrix(N, N, RealComplex);
+  else
+   SC3D->MM1MInf = 0;
+
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
@@ -252,9 +252,9 @@ int main(int argc, char *argv[])
   if ( Cache!=0 && WriteCache!=0 )
    ErrExit("--cache and --writecache options are mutually exclusive");
   for (int nrc=0; nrc<nReadCache; nrc++)
-   PreloadCache( ReadCache[nrc] );
+   PreloadCache( ReadCache[nrc], G );
   if (Cache)
-   PreloadCache( Cache );
+   PreloadCache( Cache, G );
 
   if (Cache) WriteCache=Cache;
 
@@ -63,11 +63,11 @@ typedef struct SC3Data
    int NumQuantities;
    int NTNQ;
 
-   // storage for BEM matrix blocks
+   // storage for BEM matrix blocks; M refers to the T and U
+   // blocks and factorizes each T block once per frequency
    int N, N1;
-   HMatrix **TBlocks, **UBlocks, **dUBlocks, *M, *dM;
-   int *ipiv;
-   HVector *MInfLUDiagonal;
+   HMatrix **TBlocks, **UBlocks, **dUBlocks, *dM;
+   BlockSchurMatrix *M;
 
    // matrix-block-assembly accelerators for PBC geometries
    void **TAccelerators, ***UAccelerators;
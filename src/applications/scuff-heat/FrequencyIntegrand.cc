@@ -213,7 +213,7 @@ void GetFrequencyIntegrand(SHData *SHD, cdouble Omega, double *FI)
   /* any of the same surfaces                                    */
   /***************************************************************/
   if ( SHD->WriteCache ) 
-   StoreCache( SHD->WriteCache );
+   StoreCache( SHD->WriteCache, G );
 
   /***************************************************************/
   /* the SymG1 matrix can be formed and stored ahead of time     */
@@ -387,7 +387,7 @@ void GetFrequencyIntegrand(SHData *SHD, cdouble Omega, double *FI)
   /*- to dump the cache to disk again (explain me)               -*/
   /*--------------------------------------------------------------*/
   if ( SHD->WriteCache ) 
-   { StoreCache( SHD->WriteCache );
+   { StoreCache( SHD->WriteCache, G );
      SHD->WriteCache=0;
    };
 
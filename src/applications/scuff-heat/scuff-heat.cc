@@ -289,9 +289,9 @@ int main(int argc, char *argv[])
   /* may have specified                                              */
   /*******************************************************************/
   for (int nrc=0; nrc<nReadCache; nrc++)
-   PreloadCache( ReadCache[nrc] );
+   PreloadCache( ReadCache[nrc], G );
   if (Cache)
-   PreloadCache( Cache );
+   PreloadCache( Cache, G );
 
   if (Cache) WriteCache=Cache;
   SHD->WriteCache = WriteCache;
@@ -93,7 +93,8 @@ void WriteFilePreamble(char *FileName, int FileType, int LDim,
 /***************************************************************/
 /***************************************************************/
 SLDData *CreateSLDData(char *GeoFile, char *TransFile,
-                       char **EPFiles, int nEPFiles)
+                       char **EPFiles, int nEPFiles,
+                       bool PackedMatrix)
 {
   SetDefaultCD2SFormat("%.8e %.8e");
 
@@ -108,7 +109,9 @@ SLDData *CreateSLDData(char *GeoFile, char *TransFile,
   /* read in geometry and allocate BEM matrix and RHS vector     */
   /***************************************************************/
   RWGGeometry *G = Data->G = new RWGGeometry(GeoFile);
-  Data->M = G->AllocateBEMMatrix();
+  if (PackedMatrix && G->LBasis)
+   ErrExit("--PackedMatrix is not supported for periodic geometries");
+  Data->M = G->AllocateBEMMatrix(false, PackedMatrix);
 
   /***************************************************************/
   /* read in geometrical transformation file if any **************/
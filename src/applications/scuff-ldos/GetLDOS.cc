@@ -185,7 +185,10 @@ void GetLDOS(void *pData, cdouble Omega, double *kBloch,
                                        ABMBCache[nb], true);
           };
       };
-     M->LUFactorize();
+     if (G->BEMMatrixIsSymmetric(kBloch))
+      M->LDLFactorize();
+     else
+      M->LUFactorize();
      for(int nm=0; nm<NumXMatrices; nm++)
       G->GetDyadicGFs(Omega, kBloch, XMatrices[nm], M, GMatrices[nm],
                       ScatteringOnly);
@@ -211,16 +214,23 @@ void GetLDOS(void *pData, cdouble Omega, double *kBloch,
           G->AssembleBEMMatrixBlock(ns, nsp, Omega, kBloch, UBlocks[nb]);
 
         // assemble and factorize BEM matrix
+        bool Symmetric = G->BEMMatrixIsSymmetric(kBloch);
         for(int ns=0, nb=0; ns<G->NumSurfaces; ns++)
          { int RowOffset=G->BFIndexOffset[ns];
            M->InsertBlock(TBlocks[ns], RowOffset, RowOffset);
            for(int nsp=ns+1; nsp<G->NumSurfaces; nsp++, nb++)
             { int ColOffset=G->BFIndexOffset[nsp];
               M->InsertBlock(UBlocks[nb], RowOffset, ColOffset);
-              M->InsertBlockAdjoint(UBlocks[nb], ColOffset, RowOffset);
+              if (!Symmetric)
+               M->InsertBlockAdjoint(UBlocks[nb], ColOffset, RowOffset);
+              else if (M->StorageType==LHM_NORMAL)
+               M->InsertBlockTranspose(UBlocks[nb], ColOffset, RowOffset);
             };
          };
-        M->LUFactorize();
+        if (Symmetric)
+         M->LDLFactorize();
+        else
+         M->LUFactorize();
 
         // get LDOS 
         for(int nm=0; nm<NumXMatrices; nm++)
@@ -76,6 +76,7 @@ int main(int argc, char *argv[])
   char *FileBase=0;
   bool LDOSOnly=false;
   bool FullTPDGF=false;
+  bool PackedMatrix=false;
 /**/
   /* name        type    #args  max_instances  storage    count  description*/
   OptStruct OSArray[]=
@@ -102,6 +103,7 @@ int main(int argc, char *argv[])
      {"FileBase",    PA_STRING,  1, 1, (void *)&FileBase,      0,  "base name for output files"},
      {"LDOSOnly",    PA_BOOL,    0, 1, (void *)&LDOSOnly,      0,  "omit DGF components from Brillouin-zone integration"},
      {"FullTPDGF",   PA_BOOL,    0, 1, (void *)&FullTPDGF,     0,  "compute full (bare+scattered) two-point DGF (default is scattering part only)"},
+     {"PackedMatrix", PA_BOOL,   0, 1, (void *)&PackedMatrix,  0,  "store only the upper triangle of the (symmetric) BEM matrix"},
      {0,0,0,0,0,0,0}
    };
   ProcessOptions(argc, argv, OSArray);
@@ -154,7 +156,7 @@ int main(int argc, char *argv[])
   /* computational routines                                      */
   /***************************************************************/
   SLDData *Data     = CreateSLDData(GeoFile, TransFile, 
-                                    EPFiles, nEPFiles);
+                                    EPFiles, nEPFiles, PackedMatrix);
   Data->RelTol      = RelTol;
   Data->AbsTol      = AbsTol;
   Data->MaxEvals    = MaxEvals;
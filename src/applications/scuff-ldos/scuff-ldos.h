@@ -84,7 +84,8 @@ typedef struct SLDData
 void WriteFilePreamble(char *FileName, int FileType, int LDim, 
                        bool HaveGTCList, bool TwoPointDGF);
 SLDData *CreateSLDData(char *GeoFile, char *TransFile,
-                       char **EPFiles, int nEPFiles);
+                       char **EPFiles, int nEPFiles,
+                       bool PackedMatrix=false);
 
 // GetLDOS.cc
 void WriteData(SLDData *Data, cdouble Omega, double *kBloch,
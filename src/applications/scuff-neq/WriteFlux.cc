@@ -429,7 +429,7 @@ void WriteFlux(SNEQData *SNEQD, cdouble Omega, double *kBloch)
   /*- to dump the cache to disk again (explain me)               -*/
   /*--------------------------------------------------------------*/
   if ( SNEQD->WriteCache ) 
-   { StoreCache( SNEQD->WriteCache );
+   { StoreCache( SNEQD->WriteCache, G );
      SNEQD->WriteCache=0;
    };
 
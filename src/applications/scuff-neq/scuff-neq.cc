@@ -252,9 +252,9 @@ int main(int argc, char *argv[])
   /* may have specified                                              */
   /*******************************************************************/
   for (int nrc=0; nrc<nReadCache; nrc++)
-   PreloadCache( ReadCache[nrc] );
+   PreloadCache( ReadCache[nrc], G );
   if (Cache)
-   PreloadCache( Cache );
+   PreloadCache( Cache, G );
 
   if (Cache) WriteCache=Cache;
   SNEQD->WriteCache = WriteCache;
@@ -338,9 +338,9 @@ int main(int argc, char *argv[])
   if (Cache) 
    WriteCache=Cache;
   for (int nrc=0; nrc<nReadCache; nrc++)
-   PreloadCache( ReadCache[nrc] );
+   PreloadCache( ReadCache[nrc], G );
   if (Cache)
-   PreloadCache( Cache );
+   PreloadCache( Cache, G );
 
   /***************************************************************/  
   /* sweep over frequencies                                      */
@@ -368,7 +368,7 @@ int main(int argc, char *argv[])
       /*--------------------------------------------------------------*/
       /*--------------------------------------------------------------*/
       if (WriteCache)
-       { StoreCache( WriteCache );
+       { StoreCache( WriteCache, G );
          WriteCache=0;       
        };
 
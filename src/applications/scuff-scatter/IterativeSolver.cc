@@ -0,0 +1,158 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * IterativeSolver.cc -- solve the BEM system by GMRES, using the
+ *                    -- BEM matrix in block form: diagonal (T) blocks
+ *                    -- plus above-diagonal (U) blocks, with the
+ *                    -- LU-factored T blocks as preconditioner;
+ *                    -- or, with --FMM, using fast-multipole
+ *                    -- matrix-vector products
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scuff-scatter.h"
+
+/***************************************************************/
+/* if TBlocks is NULL, the caller must set BS->FMMData before  */
+/* calling IterativeSolve                                      */
+/***************************************************************/
+BlockSystem *CreateBlockSystem(RWGGeometry *G, HMatrix **TBlocks, HMatrix **UBlocks)
+{
+  BlockSystem *BS=(BlockSystem *)mallocEC(sizeof(BlockSystem));
+  BS->G=G;
+  BS->TBlocks=TBlocks;
+  BS->UBlocks=UBlocks;
+  BS->FMMData=0;
+  BS->PBlocks=0;
+  BS->Scratch=0;
+  if (TBlocks==0)
+   return BS;
+
+  int NS=G->NumSurfaces, MaxBFs=0;
+  BS->PBlocks=(HMatrix **)mallocEC(NS*sizeof(HMatrix *));
+  for(int ns=0; ns<NS; ns++)
+   { int NBF=G->Surfaces[ns]->NumBFs;
+     if (NBF>MaxBFs) MaxBFs=NBF;
+     if (G->Mate[ns]!=-1)
+      BS->PBlocks[ns]=BS->PBlocks[G->Mate[ns]];
+     else
+      BS->PBlocks[ns]=new HMatrix(NBF, NBF, TBlocks[ns]->RealComplex);
+   };
+  BS->Scratch=new HVector(MaxBFs, LHM_COMPLEX);
+  return BS;
+}
+
+/***************************************************************/
+/* copy and LU-factorize the diagonal blocks; this must be     */
+/* called each time the T blocks are reassembled               */
+/***************************************************************/
+void FactorizePreconditioner(BlockSystem *BS)
+{
+  RWGGeometry *G=BS->G;
+  Log("  LU-factorizing diagonal BEM matrix blocks...");
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   if (G->Mate[ns]==-1)
+    { BS->PBlocks[ns]->Copy(BS->TBlocks[ns]);
+      BS->PBlocks[ns]->LUFactorize();
+    };
+}
+
+/***************************************************************/
+/* Y = M*X with M in block form. The BEM matrix of a compact   */
+/* geometry is symmetric, so the below-diagonal block (nsp,ns) */
+/* is the transpose of the stored above-diagonal block (ns,nsp)*/
+/***************************************************************/
+static void BlockMatVec(HVector *X, HVector *Y, void *UserData)
+{
+  BlockSystem *BS=(BlockSystem *)UserData;
+  RWGGeometry *G=BS->G;
+  int NS=G->NumSurfaces;
+
+  if (BS->FMMData)
+   { G->ApplyBEMMatrixFMM(BS->FMMData, X, Y);
+     return;
+   };
+
+  for(int ns=0; ns<NS; ns++)
+   { int Offset=G->BFIndexOffset[ns], NBF=G->Surfaces[ns]->NumBFs;
+     HVector XBlock(NBF, LHM_COMPLEX, X->ZV + Offset);
+     HVector YBlock(NBF, LHM_COMPLEX, Y->ZV + Offset);
+     BS->TBlocks[ns]->Apply(&XBlock, &YBlock);
+   };
+
+  for(int ns=0, nb=0; ns<NS; ns++)
+   for(int nsp=ns+1; nsp<NS; nsp++, nb++)
+    { int Offset=G->BFIndexOffset[ns],   NBF=G->Surfaces[ns]->NumBFs;
+      int OffsetP=G->BFIndexOffset[nsp], NBFP=G->Surfaces[nsp]->NumBFs;
+      HMatrix *U=BS->UBlocks[nb];
+
+      HVector XP(NBFP, LHM_COMPLEX, X->ZV + OffsetP);
+      HVector Scratch(NBF, LHM_COMPLEX, BS->Scratch->ZV);
+      U->Apply(&XP, &Scratch);
+      for(int n=0; n<NBF; n++)
+       Y->ZV[Offset+n] += Scratch.ZV[n];
+
+      HVector XS(NBF, LHM_COMPLEX, X->ZV + Offset);
+      HVector ScratchP(NBFP, LHM_COMPLEX, BS->Scratch->ZV);
+      U->Apply(&XS, &ScratchP, 'T');
+      for(int n=0; n<NBFP; n++)
+       Y->ZV[OffsetP+n] += ScratchP.ZV[n];
+    };
+}
+
+/***************************************************************/
+/* Y = P^{-1}*X, P = block-diagonal part of M (per surface, or */
+/* per edge in the FMM case)                                   */
+/***************************************************************/
+static void BlockPrecond(HVector *X, HVector *Y, void *UserData)
+{
+  BlockSystem *BS=(BlockSystem *)UserData;
+  RWGGeometry *G=BS->G;
+  if (BS->FMMData)
+   { G->ApplyFMMPreconditioner(BS->FMMData, X, Y);
+     return;
+   };
+  Y->Copy(X);
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   { HVector YBlock(G->Surfaces[ns]->NumBFs, LHM_COMPLEX,
+                    Y->ZV + G->BFIndexOffset[ns]);
+     BS->PBlocks[ns]->LUSolve(&YBlock);
+   };
+}
+
+/***************************************************************/
+/* solve M*KN = RHS; returns the number of GMRES iterations,   */
+/* or -1 if the iteration did not converge                     */
+/***************************************************************/
+int IterativeSolve(BlockSystem *BS, HVector *RHS, HVector *KN,
+                   double Tol, int MaxIter)
+{
+  KN->Zero();
+  double Residual;
+  int NumIters=GMRES(RHS, KN, BlockMatVec, (void *)BS,
+                     BlockPrecond, (void *)BS, Tol, MaxIter, 100, &Residual);
+  if (NumIters<0)
+   Warn("GMRES did not converge in %i iterations (residual %.2e)",MaxIter,Residual);
+  else
+   Log("  GMRES converged in %i iterations (residual %.2e)",NumIters,Residual);
+  return NumIters;
+}
@@ -46,6 +46,7 @@
 #define MAXFVM   10    // max number of field visualization meshes
 #define MAXCACHE 10    // max number of cache files for preload
 
+#define MAXBATCHMB 1024 // default cap on memory for batched RHS vectors
 #define MAXSTR   1000
 
 /***************************************************************/
@@ -115,6 +116,19 @@ int main(int argc, char *argv[])
   char *ReadCache[MAXCACHE];         int nReadCache;
   char *WriteCache=0;
   char *LogLevel=0;
+//
+  bool UseGMRES=false;
+  double GMRESTol=1.0e-6;
+  int GMRESMaxIter=1000;
+  bool UseFMM=false;
+  int FMMLeafSize=256;
+  bool PackedMatrix=false;
+  char *Symmetry=0;
+  int RHSBatchSize=0;
+  char *OutOfCore=0;
+  double OOCMemoryGB=0.0;
+  double MixedPrecisionTol=0.0;
+  bool PipelinedLU=false;
   /* name               type    #args  max_instances  storage           count         description*/
   OptStruct OSArray[]=
    { 
@@ -169,6 +183,20 @@ int main(int argc, char *argv[])
      {"HDF5File",       PA_STRING,  1, 1,       (void *)&HDF5File,   0,             "name of HDF5 file for BEM matrix/vector export\n"},
 /**/
      {"LogLevel",       PA_STRING,  1, 1,       (void *)&LogLevel,   0,             "none | terse | verbose | verbose2\n"},
+/**/
+     {"GMRES",          PA_BOOL,    0, 1,       (void *)&UseGMRES,   0,             "solve BEM system by GMRES with block-diagonal preconditioner"},
+     {"GMRESTol",       PA_DOUBLE,  1, 1,       (void *)&GMRESTol,   0,             "relative residual tolerance for GMRES"},
+     {"GMRESMaxIter",   PA_INT,     1, 1,       (void *)&GMRESMaxIter, 0,           "maximum number of GMRES iterations"},
+     {"FMM",            PA_BOOL,    0, 1,       (void *)&UseFMM,     0,             "use fast-multipole matrix-vector products (implies --GMRES)"},
+     {"FMMLeafSize",    PA_INT,     1, 1,       (void *)&FMMLeafSize, 0,            "maximum average number of cubature points per FMM leaf box\n"},
+/**/
+     {"PackedMatrix",   PA_BOOL,    0, 1,       (void *)&PackedMatrix, 0,           "store only the upper triangle of the (symmetric) BEM matrix"},
+     {"MixedPrecision", PA_DOUBLE,  1, 1,       (void *)&MixedPrecisionTol, 0,      "LU-factorize in single precision and refine solutions to this relative residual"},
+     {"PipelinedLU",    PA_BOOL,    0, 1,       (void *)&PipelinedLU, 0,            "overlap BEM matrix assembly with LU factorization"},
+     {"Symmetry",       PA_STRING,  1, 1,       (void *)&Symmetry,   0,             "mirror planes of the geometry (e.g. 'xz,yz'), or 'auto' to detect them"},
+     {"RHSBatchSize",   PA_INT,     1, 1,       (void *)&RHSBatchSize, 0,           "max number of incident fields solved together (default: all that fit in 1 GB; 1 to disable)"},
+     {"OutOfCore",      PA_STRING,  1, 1,       (void *)&OutOfCore,  0,             "store the BEM matrix out of core, in a scratch file in this directory"},
+     {"OOCMemoryGB",    PA_DOUBLE,  1, 1,       (void *)&OOCMemoryGB, 0,            "memory (GB) for the out-of-core BEM matrix (default: half of RAM)\n"},
 /**/
      {"Cache",          PA_STRING,  1, 1,       (void *)&Cache,      0,             "read/write cache"},
      {"ReadCache",      PA_STRING,  1, MAXCACHE,(void *)ReadCache,   &nReadCache,   "read cache"},
@@ -184,6 +212,38 @@ int main(int argc, char *argv[])
   if (FileBase==0) 
    FileBase=vstrdup(GetFileBase(GeoFile));
 
+  if (UseFMM)
+   { if (HDF5File)
+      ErrExit("--FMM and --HDF5File are mutually exclusive");
+     UseGMRES=true;
+   };
+
+  if (Symmetry)
+   { if (UseGMRES)
+      ErrExit("--Symmetry is incompatible with --GMRES and --FMM");
+     if (HDF5File)
+      ErrExit("--Symmetry is incompatible with --HDF5File");
+     if (TransFile)
+      ErrExit("--Symmetry is incompatible with --TransFile");
+   };
+
+  if (MixedPrecisionTol>0.0 && (UseGMRES || Symmetry || PackedMatrix || OutOfCore))
+   ErrExit("--MixedPrecision is incompatible with --GMRES, --FMM, --Symmetry, --PackedMatrix, and --OutOfCore");
+
+  if (PipelinedLU)
+   { if (UseGMRES || Symmetry || PackedMatrix || MixedPrecisionTol>0.0 || OutOfCore)
+      ErrExit("--PipelinedLU is incompatible with --GMRES, --FMM, --Symmetry, --PackedMatrix, --MixedPrecision, and --OutOfCore");
+     if (HDF5File || TransFile)
+      ErrExit("--PipelinedLU is incompatible with --HDF5File and --TransFile");
+   };
+
+  if (OutOfCore)
+   { if (UseGMRES || Symmetry || PackedMatrix)
+      ErrExit("--OutOfCore is incompatible with --GMRES, --FMM, --Symmetry, and --PackedMatrix");
+     if (HDF5File || TransFile)
+      ErrExit("--OutOfCore is incompatible with --HDF5File and --TransFile");
+   };
+
   /*******************************************************************/
   /* process frequency-related options                               */
   /*******************************************************************/
@@ -284,17 +344,14 @@ int main(int argc, char *argv[])
   SSData MySSData, *SSD=&MySSData;
 
   RWGGeometry *G      = SSD->G   = new RWGGeometry(GeoFile);
-  HMatrix *M          = SSD->M   = G->AllocateBEMMatrix();
-  HVector *RHS        = SSD->RHS = G->AllocateRHSVector();
-  HVector *KN         = SSD->KN  = G->AllocateRHSVector();
-  double *kBloch      = SSD->kBloch = 0;
-  SSD->IF             = 0;
-  SSD->TransformLabel = 0;
-  SSD->IFLabel        = 0;
-  SSD->FileBase       = FileBase;
-
+  if (PackedMatrix && G->LBasis)
+   ErrExit("--PackedMatrix is not supported for periodic geometries");
   if (LogLevel) G->SetLogLevel(LogLevel);
 
+  // with --Symmetry the full BEM matrix is replaced by its irrep
+  // blocks (unless no symmetries were found)
+  SymmetryData *SymData = Symmetry ? G->CreateSymmetryData(Symmetry) : 0;
+
   /*--------------------------------------------------------------*/
   /*- read the transformation file if one was specified and check */
   /*- that it plays well with the specified geometry file.        */
@@ -308,6 +365,25 @@ int main(int argc, char *argv[])
   if (ErrMsg)
    ErrExit("file %s: %s",TransFile,ErrMsg);
 
+  // with more than one transformation and a direct solver, the
+  // diagonal BEM matrix blocks are LU-factorized once per frequency
+  // and each transformation only requires factorizing the Schur
+  // complement of the off-diagonal blocks (see below)
+  bool UseSchur = (NumTransformations>1 && !UseGMRES && !SymData
+                    && !HDF5File && !PackedMatrix && MixedPrecisionTol==0.0);
+
+  // with --GMRES the full BEM matrix is only needed for HDF5 export;
+  // with --OutOfCore it is stored in a scratch file instead
+  HMatrix *M          = SSD->M   = ((UseGMRES && !HDF5File) || SymData || OutOfCore || UseSchur) ? 0 : G->AllocateBEMMatrix(false, PackedMatrix);
+  OOCMatrix *OOCM     = OutOfCore ? G->AllocateOOCBEMMatrix(OutOfCore, OOCMemoryGB) : 0;
+  HVector *RHS        = SSD->RHS = G->AllocateRHSVector();
+  HVector *KN         = SSD->KN  = G->AllocateRHSVector();
+  double *kBloch      = SSD->kBloch = 0;
+  SSD->IF             = 0;
+  SSD->TransformLabel = 0;
+  SSD->IFLabel        = 0;
+  SSD->FileBase       = FileBase;
+
   /*******************************************************************/
   /* for periodic geometries, all incident field sources that are    */
   /* active at a given time must involve  single incident field      */
@@ -319,6 +395,8 @@ int main(int argc, char *argv[])
    { if ( npwPol!=1 || ngbCenter!=0 || npsLoc!=0 )
       ErrExit("for extended geometries, the incident field must be a single plane wave");
      kBloch = SSD->kBloch = kBlochBuffer;
+     if (UseGMRES)
+      ErrExit("--GMRES is not yet available for extended geometries");
    };
 
   /*******************************************************************/
@@ -330,9 +408,9 @@ int main(int argc, char *argv[])
   if (Cache) 
    WriteCache=Cache;
   for (int nrc=0; nrc<nReadCache; nrc++)
-   PreloadCache( ReadCache[nrc] );
+   PreloadCache( ReadCache[nrc], G );
   if (Cache)
-   PreloadCache( Cache );
+   PreloadCache( Cache, G );
 
   /*******************************************************************/
   /*******************************************************************/
@@ -342,12 +420,13 @@ int main(int argc, char *argv[])
    HDF5Context=HMatrix::OpenHDF5Context(HDF5File);
 
   /*******************************************************************/
-  /* if we have more than one geometrical transformation,            */
-  /* allocate storage for BEM matrix blocks                          */
+  /* if we have more than one geometrical transformation, or if we   */
+  /* are solving iteratively, allocate storage for BEM matrix blocks */
   /*******************************************************************/
   HMatrix **TBlocks=0, **UBlocks=0;
   int NS=G->NumSurfaces;
-  if (NumTransformations>1)
+  bool UseBlocks = (NumTransformations>1 || UseGMRES) && !UseFMM;
+  if (UseBlocks)
    { int NADB = NS*(NS-1)/2; // number of above-diagonal blocks
      TBlocks  = (HMatrix **)mallocEC(NS*sizeof(HMatrix *));
      UBlocks  = (HMatrix **)mallocEC(NADB*sizeof(HMatrix *));
@@ -358,17 +437,57 @@ int main(int argc, char *argv[])
          TBlocks[ns] = TBlocks[nsMate];
         else
          { int NBF=G->Surfaces[ns]->NumBFs;
-           TBlocks[ns] = new HMatrix(NBF, NBF, M->RealComplex);
+           TBlocks[ns] = new HMatrix(NBF, NBF, LHM_COMPLEX);
          };
 
         for(int nsp=ns+1; nsp<NS; nsp++, nb++)
          { int NBF=G->Surfaces[ns]->NumBFs;
            int NBFp=G->Surfaces[nsp]->NumBFs;
-           UBlocks[nb] = new HMatrix(NBF, NBFp, M->RealComplex);
+           UBlocks[nb] = new HMatrix(NBF, NBFp, LHM_COMPLEX);
          };
       };
    };
 
+  BlockSystem *BS = UseGMRES ? CreateBlockSystem(G, TBlocks, UBlocks) : 0;
+
+  BlockSchurMatrix *BSM = 0;
+  if (UseSchur)
+   { int *BlockSizes = (int *)mallocEC(NS*sizeof(int));
+     for(int ns=0; ns<NS; ns++)
+      BlockSizes[ns]=G->Surfaces[ns]->NumBFs;
+     BSM = new BlockSchurMatrix(NS, BlockSizes, LHM_COMPLEX);
+     free(BlockSizes);
+     for(int ns=0, nb=0; ns<NS; ns++)
+      { BSM->SetBlock(ns, ns, TBlocks[ns]);
+        for(int nsp=ns+1; nsp<NS; nsp++, nb++)
+         BSM->SetBlock(ns, nsp, UBlocks[nb]);
+      };
+   };
+
+  /*******************************************************************/
+  /* with a direct solver and more than one incident field, the RHS  */
+  /* vectors for batches of incident fields are assembled together   */
+  /* and solved with a single multi-RHS LUSolve (BLAS-3) instead of  */
+  /* one solve per incident field (BLAS-2); the output modules are   */
+  /* then run for each column of the solution block in turn.         */
+  /*******************************************************************/
+  HMatrix *RHSBlock=0, *KNBlock=0;
+  int NIF = IFList ? IFList->NumIFs : 0;
+  if ( NeedIncidentField && (M || OOCM || BSM) && !UseGMRES && !SymData && NIF>1 && RHSBatchSize!=1 )
+   { int NBF = G->TotalBFs;
+     if (RHSBatchSize<=0)
+      { double MBPerRHS = 2.0*NBF*sizeof(cdouble) / 1048576.0;
+        RHSBatchSize = (int)(MAXBATCHMB / MBPerRHS);
+      };
+     if (RHSBatchSize>NIF)
+      RHSBatchSize=NIF;
+     if (RHSBatchSize>1)
+      { RHSBlock = new HMatrix(NBF, RHSBatchSize, LHM_COMPLEX);
+        KNBlock  = new HMatrix(NBF, RHSBatchSize, LHM_COMPLEX);
+        Log("Solving for up to %i incident fields at once.",RHSBatchSize);
+      };
+   };
+
   /*******************************************************************/
   /* loop over frequencies *******************************************/
   /*******************************************************************/
@@ -398,12 +517,27 @@ int main(int argc, char *argv[])
      /* matrix blocks at this frequency; otherwise just assemble the    */
      /* whole matrix                                                    */
      /*******************************************************************/
-     if (NumTransformations==1)
+     if (UseFMM)
+      ; // the FMM data are assembled below, for each transformation
+     else if (SymData)
+      G->AssembleIrrepBEMMatrices(Omega, SymData);
+     else if (OOCM)
+      G->AssembleBEMMatrix(Omega, OOCM);
+     else if (PipelinedLU && NeedIncidentField)
+      G->AssembleAndFactorizeBEMMatrix(Omega, kBloch, M);
+     else if (!UseBlocks)
       G->AssembleBEMMatrix(Omega, kBloch, M);
      else
-      for(int ns=0; ns<G->NumSurfaces; ns++)
-       if (G->Mate[ns]==-1)
-        G->AssembleBEMMatrixBlock(ns, ns, Omega, kBloch, TBlocks[ns]);
+      { for(int ns=0; ns<G->NumSurfaces; ns++)
+         if (G->Mate[ns]==-1)
+          G->AssembleBEMMatrixBlock(ns, ns, Omega, kBloch, TBlocks[ns]);
+        if (BS && NeedIncidentField)
+         FactorizePreconditioner(BS);
+        if (BSM && NeedIncidentField)
+         { Log("  LU-factorizing diagonal blocks of BEM matrix...");
+           BSM->FactorizeDiagonalBlocks();
+         };
+      };
 
      /*******************************************************************/
      /* dump the scuff cache to a cache storage file if requested. note */
@@ -414,7 +548,7 @@ int main(int argc, char *argv[])
      /* for the rest of the program run.                                */
      /*******************************************************************/
      if (WriteCache)
-      { StoreCache( WriteCache );
+      { StoreCache( WriteCache, G );
         WriteCache=0;       
       };
 
@@ -434,18 +568,24 @@ int main(int argc, char *argv[])
         /*******************************************************************/
         /* assemble and insert off-diagonal blocks as necessary ************/
         /*******************************************************************/
-        if (NumTransformations>1)
+        if (UseBlocks)
          { for(int ns=0, nb=0; ns<G->NumSurfaces; ns++)
             for(int nsp=ns+1; nsp<G->NumSurfaces; nsp++, nb++)
              G->AssembleBEMMatrixBlock(ns, nsp, Omega, kBloch, UBlocks[nb]);
+         };
 
-           for(int ns=0, nb=0; ns<G->NumSurfaces; ns++)
+        bool Symmetric = G->BEMMatrixIsSymmetric(kBloch);
+        if (UseBlocks && M)
+         { for(int ns=0, nb=0; ns<G->NumSurfaces; ns++)
             { int RowOffset=G->BFIndexOffset[ns];
               M->InsertBlock(TBlocks[ns], RowOffset, RowOffset);
               for(int nsp=ns+1; nsp<G->NumSurfaces; nsp++, nb++)
                { int ColOffset=G->BFIndexOffset[nsp];
                  M->InsertBlock(UBlocks[nb], RowOffset, ColOffset);
-                 M->InsertBlockAdjoint(UBlocks[nb], ColOffset, RowOffset);
+                 if (!Symmetric)
+                  M->InsertBlockAdjoint(UBlocks[nb], ColOffset, RowOffset);
+                 else if (M->StorageType==LHM_NORMAL)
+                  M->InsertBlockTranspose(UBlocks[nb], ColOffset, RowOffset);
                };
             };
          };
@@ -465,15 +605,54 @@ int main(int argc, char *argv[])
          continue;
 
         /*******************************************************************/
-        /* LU-factorize the BEM matrix to prepare for solving scattering   */
-        /* problems                                                        */
+        /* LU-factorize the BEM matrix, or set up the FMM near-field       */
+        /* corrections, to prepare for solving scattering problems         */
         /*******************************************************************/
-        Log("  LU-factorizing BEM matrix...");
-        M->LUFactorize();
+        if (UseFMM)
+         { if (BS->FMMData && TransFile)
+            { DestroyFMMBEMData(BS->FMMData);
+              BS->FMMData=0;
+            };
+           if (BS->FMMData==0)
+            BS->FMMData=G->AllocateFMMBEMData(FMMLeafSize);
+           G->AssembleFMMBEMData(Omega, BS->FMMData);
+         }
+        else if (SymData)
+         { Log("  LDL-factorizing irrep blocks of BEM matrix...");
+           FactorizeIrrepBEMMatrices(SymData);
+         }
+        else if (OOCM)
+         { Log("  LU-factorizing out-of-core BEM matrix...");
+           OOCM->LUFactorize();
+         }
+        else if (PipelinedLU)
+         ; // the matrix was factorized during assembly
+        else if (BSM)
+         { Log("  LU-factorizing Schur complement of BEM matrix...");
+           BSM->Symmetry = Symmetric ? 'T' : 'C';
+           BSM->LUFactorize();
+         }
+        else if (!UseGMRES && MixedPrecisionTol>0.0)
+         { Log("  LU-factorizing BEM matrix in mixed precision...");
+           M->MixedLUFactorize(MixedPrecisionTol);
+         }
+        else if (!UseGMRES)
+         { // the BEM matrix is complex-symmetric unless we have a
+           // nonzero Bloch vector, in which case we need full LU
+           if (Symmetric)
+            { Log("  LDL-factorizing BEM matrix...");
+              M->LDLFactorize();
+            }
+           else
+            { Log("  LU-factorizing BEM matrix...");
+              M->LUFactorize();
+            };
+         };
 
         /***************************************************************/
         /* loop over incident fields                                   */
         /***************************************************************/
+        int BatchStart=0, BatchSize=0;
         for(int nIF=0; nIF<IFList->NumIFs; nIF++)
          { 
            IF = SSD->IF = IFList->IFs[nIF];
@@ -488,11 +667,43 @@ int main(int argc, char *argv[])
            /***************************************************************/
            /* assemble RHS vector and solve BEM system*********************/
            /***************************************************************/
-           Log("  Assembling RHS vector...");
-           G->AssembleRHSVector(Omega, kBloch, IF, KN);
-           RHS->Copy(KN); // copy RHS vector for later 
-           Log("  Solving the BEM system...");
-           M->LUSolve(KN);
+           if (RHSBlock)
+            { if ( nIF == BatchStart+BatchSize )
+               { BatchStart = nIF;
+                 BatchSize  = IFList->NumIFs - nIF;
+                 if (BatchSize > RHSBlock->NC)
+                  BatchSize = RHSBlock->NC;
+                 Log("  Assembling %i RHS vectors...",BatchSize);
+                 G->AssembleRHSVectors(Omega, kBloch, IFList->IFs + nIF, BatchSize, RHSBlock);
+                 KNBlock->Copy(RHSBlock);
+                 Log("  Solving the BEM system for %i RHS vectors...",BatchSize);
+                 if (OOCM)
+                  OOCM->LUSolve(KNBlock, BatchSize);
+                 else if (BSM)
+                  BSM->LUSolve(KNBlock, BatchSize);
+                 else
+                  M->LUSolve(KNBlock, BatchSize);
+               };
+              size_t NBF = RHS->N;
+              memcpy(RHS->ZV, RHSBlock->GetColumnPointer(nIF-BatchStart), NBF*sizeof(cdouble));
+              memcpy(KN->ZV,  KNBlock->GetColumnPointer(nIF-BatchStart),  NBF*sizeof(cdouble));
+            }
+           else
+            { Log("  Assembling RHS vector...");
+              G->AssembleRHSVector(Omega, kBloch, IF, KN);
+              RHS->Copy(KN); // copy RHS vector for later 
+              Log("  Solving the BEM system...");
+              if (UseGMRES)
+               IterativeSolve(BS, RHS, KN, GMRESTol, GMRESMaxIter);
+              else if (SymData)
+               SolveIrrepBEMSystems(SymData, KN);
+              else if (OOCM)
+               OOCM->LUSolve(KN);
+              else if (BSM)
+               BSM->LUSolve(KN);
+              else
+               M->LUSolve(KN);
+            };
    
            if (HDF5Context)
             { RHS->ExportToHDF5(HDF5Context,"RHS_%s%s%s",OmegaStr,TransformStr,IFStr);
@@ -573,6 +784,12 @@ int main(int argc, char *argv[])
   /***************************************************************/
   if (HDF5Context)
    HMatrix::CloseHDF5Context(HDF5Context);
+  if (SymData)
+   DestroySymmetryData(SymData);
+  if (OOCM) delete OOCM;
+  if (BSM) delete BSM;
+  if (RHSBlock) delete RHSBlock;
+  if (KNBlock) delete KNBlock;
   printf("Thank you for your support.\n");
    
 }
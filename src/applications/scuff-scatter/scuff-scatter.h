@@ -62,4 +62,25 @@ void ProcessEPFile(SSData *SSData, char *EPFileName);
 void VisualizeFields(SSData *SSData, 
                      char *FVMesh, char *FVMeshTransFile, char *FuncList);
 
+/***************************************************************/
+/* BEM matrix stored as diagonal (T) and above-diagonal (U)    */
+/* blocks, for the iterative (--GMRES) solver; alternatively,  */
+/* with --FMM, the matrix is not stored and FMMData is used    */
+/* for matrix-vector products                                  */
+/***************************************************************/
+typedef struct BlockSystem
+ {
+   RWGGeometry *G;
+   HMatrix **TBlocks;  // TBlocks[ns]
+   HMatrix **UBlocks;  // UBlocks[nb], nb indexes pairs ns<nsp
+   HMatrix **PBlocks;  // LU-factored copies of TBlocks
+   HVector *Scratch;
+   FMMBEMData *FMMData;
+ } BlockSystem;
+
+BlockSystem *CreateBlockSystem(RWGGeometry *G, HMatrix **TBlocks, HMatrix **UBlocks);
+void FactorizePreconditioner(BlockSystem *BS);
+int IterativeSolve(BlockSystem *BS, HVector *RHS, HVector *KN,
+                   double Tol, int MaxIter);
+
 #endif
@@ -106,7 +106,7 @@ int main(int argc, char *argv[])
   RWGGeometry *G=new RWGGeometry(GeoFileName);
   G->SetLogLevel(SCUFF_VERBOSELOGGING);
   if (Cache)
-   PreloadCache(Cache);
+   PreloadCache(Cache, G);
 
   /*--------------------------------------------------------------*/
   /* preallocate BEM matrix and RHS vector                        */
@@ -208,7 +208,7 @@ int main(int argc, char *argv[])
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   if (Cache)
-   StoreCache(Cache);
+   StoreCache(Cache, G);
   printf("Thank you for your support.\n");
   
 }
@@ -310,9 +310,9 @@ int main(int argc, char *argv[])
   if (Cache) 
    WriteCache=Cache;
   for (int nrc=0; nrc<nReadCache; nrc++)
-   PreloadCache( ReadCache[nrc] );
+   PreloadCache( ReadCache[nrc], G );
   if (Cache)
-   PreloadCache( Cache );
+   PreloadCache( Cache, G );
 
   /*******************************************************************/
   /*- create the incident field and allocate matrices and vectors    */
@@ -371,7 +371,7 @@ int main(int argc, char *argv[])
       kBloch[0] = real(kSource)*SinTheta;
       G->AssembleBEMMatrix(Omega, kBloch, M);
       if (WriteCache)
-       { StoreCache( WriteCache );
+       { StoreCache( WriteCache, G );
          WriteCache=0;
        };
       M->LUFactorize();
@@ -190,6 +190,9 @@ Interp2D::Interp2D(double *pX1Points, int pN1,
    X2Points=(double *)memdup(pX2Points, N2*sizeof(double));
    nFun=pnFun;
    LogLevel=pLogLevel;
+   MapBase=0;
+   MapSize=0;
+   ErrMsg=0;
 
    /*--------------------------------------------------------------*/ 
    /*- allocate space for the CTable, which stores all             */ 
@@ -223,6 +226,35 @@ Interp2D::Interp2D(double *pX1Points, int pN1,
 
 }
 
+/****************************************************************/
+/* construct the class from a user-supplied table of function   */
+/* values and derivatives on a nonuniform grid; the table has   */
+/* the layout described in InitInterp2D() and is not freed.     */
+/****************************************************************/
+Interp2D::Interp2D(double *PhiVDTable,
+                   double *pX1Points, int pN1,
+                   double *pX2Points, int pN2,
+                   int pnFun, int pLogLevel)
+{
+   if (pN1<2 || pN2<2)
+    ErrExit("Interp2D: grid must have 2 or more points in every dimension");
+   N1=pN1; 
+   N2=pN2;
+   X1Points=(double *)memdup(pX1Points, N1*sizeof(double));
+   X2Points=(double *)memdup(pX2Points, N2*sizeof(double));
+   nFun=pnFun;
+   LogLevel=pLogLevel;
+   MapBase=0;
+   MapSize=0;
+   ErrMsg=0;
+
+   CTable=(double *)mallocEC((N1-1)*(N2-1)*nFun*NCOEFF*sizeof(double));
+   if (!CTable)
+    ErrExit("%s:%i:out of memory",__FILE__,__LINE__);
+
+   InitInterp2D(0, 0, PhiVDTable);
+}
+
 /****************************************************************/
 /* class constructor 2: construct the class from user-supplied  */
 /* uniform grids                                                */
@@ -253,6 +285,9 @@ Interp2D::Interp2D(double pX1Min, double X1Max, int pN1,
 
    nFun=pnFun;
    LogLevel=pLogLevel;
+   MapBase=0;
+   MapSize=0;
+   ErrMsg=0;
 
    /*--------------------------------------------------------------*/ 
    /*- allocate space for the CTable (see comment above on how it  */ 
@@ -278,7 +313,7 @@ Interp2D::Interp2D(double pX1Min, double X1Max, int pN1,
 /****************************************************************/
 /* main body of class constructor for the above two entry points*/
 /****************************************************************/
-void Interp2D::InitInterp2D(Phi2D PhiFunc, void *UserData)
+void Interp2D::InitInterp2D(Phi2D PhiFunc, void *UserData, double *PhiVDTable)
 {
    if (LogLevel>=LMDI_LOGLEVEL_TERSE)
     Log("Creating interpolation grid with %i grid points...",N1*N2);
@@ -299,72 +334,77 @@ void Interp2D::InitInterp2D(Phi2D PhiFunc, void *UserData)
    /*- is a pointer to an array of NDATA doubles which are the     */
    /*- value and derivatives of function #nf at grid point (n1,n2).*/
    /*--------------------------------------------------------------*/
-   double *PhiVDTable=(double *)mallocEC(N1*N2*nFun*NDATA*sizeof(double));
-   if (!PhiVDTable)
-    ErrExit("%s:%i:out of memory",__FILE__,__LINE__);
+   bool OwnsPhiVDTable = false;
+   if (PhiVDTable==0)
+    { OwnsPhiVDTable=true;
+      PhiVDTable=(double *)mallocEC(N1*N2*nFun*NDATA*sizeof(double));
+      if (!PhiVDTable)
+       ErrExit("%s:%i:out of memory",__FILE__,__LINE__);
 
-   /*--------------------------------------------------------------*/
-   /*- fire off threads that will call the user's function to     -*/
-   /*- populate the PVDTable table.                               -*/
-   /*--------------------------------------------------------------*/
-   if (LogLevel>=LMDI_LOGLEVEL_VERBOSE)
-    Log("Computing user function at grid points...");
-   int nThread=GetNumThreads();
+      /*--------------------------------------------------------------*/
+      /*- fire off threads that will call the user's function to     -*/
+      /*- populate the PVDTable table.                               -*/
+      /*--------------------------------------------------------------*/
+      if (LogLevel>=LMDI_LOGLEVEL_VERBOSE)
+       Log("Computing user function at grid points...");
+      int nThread=GetNumThreads();
 
 #ifdef USE_PTHREAD
-   ThreadData *TDs = new ThreadData[nThread], *TD;
-   pthread_t *Threads = new pthread_t[nThread];
+      ThreadData *TDs = new ThreadData[nThread], *TD;
+      pthread_t *Threads = new pthread_t[nThread];
 #endif
-   ThreadData TD1;
-   int nt;
-
-   TD1.X1Points=X1Points;
-   TD1.X2Points=X2Points;
-   TD1.N1=N1;
-   TD1.N2=N2;
-   TD1.X1Min=X1Min;
-   TD1.X2Min=X2Min;
-   TD1.DX1=DX1;
-   TD1.DX2=DX2;
-   TD1.nFun=nFun;
-   TD1.PhiFunc=PhiFunc;
-   TD1.UserData=UserData;
-   TD1.PhiVDTable=PhiVDTable;
-   TD1.nThread=nThread;
-   TD1.LogLevel=LogLevel;
+      ThreadData TD1;
+      int nt;
+
+      TD1.X1Points=X1Points;
+      TD1.X2Points=X2Points;
+      TD1.N1=N1;
+      TD1.N2=N2;
+      TD1.X1Min=X1Min;
+      TD1.X2Min=X2Min;
+      TD1.DX1=DX1;
+      TD1.DX2=DX2;
+      TD1.nFun=nFun;
+      TD1.PhiFunc=PhiFunc;
+      TD1.UserData=UserData;
+      TD1.PhiVDTable=PhiVDTable;
+      TD1.nThread=nThread;
+      TD1.LogLevel=LogLevel;
 #ifdef USE_OPENMP
 #pragma omp parallel for firstprivate(TD1), schedule(static,1), num_threads(nThread)
 #endif
-   for(nt=0; nt<nThread; nt++)
-    {
+      for(nt=0; nt<nThread; nt++)
+       {
 #ifdef USE_PTHREAD
-      TD=&(TDs[nt]);
-      *TD = TD1;
+         TD=&(TDs[nt]);
+         *TD = TD1;
 #else
-      ThreadData *TD=&TD1;
+         ThreadData *TD=&TD1;
 #endif
-      TD->nt=nt;
+         TD->nt=nt;
 #ifdef USE_PTHREAD
-      if (nt+1 == nThread)
-	GetPhiVD_Thread((void *)TD);
-      else
-	pthread_create( &(Threads[nt]), 0, GetPhiVD_Thread, (void *)TD);
+         if (nt+1 == nThread)
+           GetPhiVD_Thread((void *)TD);
+         else
+           pthread_create( &(Threads[nt]), 0, GetPhiVD_Thread, (void *)TD);
 #else
-      GetPhiVD_Thread((void *)TD);
+         GetPhiVD_Thread((void *)TD);
 #endif
-    };
+       };
 
 #ifdef USE_PTHREAD
-   /*--------------------------------------------------------------*/
-   /*- wait for threads to terminate ------------------------------*/
-   /*--------------------------------------------------------------*/ 
-   for(nt=0; nt<nThread-1; nt++)
-    pthread_join(Threads[nt],0);
+      /*--------------------------------------------------------------*/
+      /*- wait for threads to terminate ------------------------------*/
+      /*--------------------------------------------------------------*/ 
+      for(nt=0; nt<nThread-1; nt++)
+       pthread_join(Threads[nt],0);
 
-   delete[] Threads;
-   delete[] TDs;
+      delete[] Threads;
+      delete[] TDs;
 #endif
 
+    }; // if (PhiVDTable==0)
+
    /*--------------------------------------------------------------*/
    /*- construct the matrix whose inverse maps a vector of        -*/
    /*- phi values and derivatives into polynomial coefficients.   -*/
@@ -460,7 +500,8 @@ void Interp2D::InitInterp2D(Phi2D PhiFunc, void *UserData)
    /*--------------------------------------------------------------*/
    delete C;
    delete M;
-   free(PhiVDTable);
+   if (OwnsPhiVDTable)
+    free(PhiVDTable);
    if (LogLevel>=LMDI_LOGLEVEL_VERBOSE)
     Log("...interpolation table constructed!");
 
@@ -480,6 +521,10 @@ void Interp2D::ReInitialize(Phi2D PhiFunc, void *UserData)
 /****************************************************************/
 Interp2D::Interp2D(const char *FileName)
 {
+   MapBase=0;
+   MapSize=0;
+   ErrMsg=0;
+
    if (LogLevel>=LMDI_LOGLEVEL_TERSE)
     Log("Attempting to read interpolation table from file %s...",FileName);
 
@@ -524,6 +569,56 @@ Interp2D::Interp2D(const char *FileName)
 
 }
 
+/****************************************************************/
+/* class constructor 4: map a keyed table file written by       */
+/* WriteToFile(FileName, Key, KeySize). if the file is missing, */
+/* invalid, or was written for a different key, ErrMsg is set   */
+/* and the object must not be used.                             */
+/****************************************************************/
+Interp2D::Interp2D(const char *FileName, const void *Key, size_t KeySize,
+                   bool VerifyCTable, int pLogLevel)
+{
+   LogLevel=pLogLevel;
+   MapBase=0;
+   MapSize=0;
+   ErrMsg=0;
+   X1Points=X2Points=0;
+   CTable=0;
+
+   int N[2];
+   double *XPoints[2], XMin[2], DX[2];
+   const char *Err=MapTableFile(FileName, 2, NCOEFF, Key, KeySize, VerifyCTable,
+                                N, XPoints, XMin, DX, &nFun, &CTable,
+                                &MapBase, &MapSize);
+   if (Err)
+    { ErrMsg=vstrdup("%s: %s",FileName,Err);
+      return;
+    };
+
+   N1=N[0]; X1Points=XPoints[0]; X1Min=XMin[0]; DX1=DX[0];
+   N2=N[1]; X2Points=XPoints[1]; X2Min=XMin[1]; DX2=DX[1];
+   if (LogLevel >= LMDI_LOGLEVEL_TERSE)
+    Log("Mapped interpolation table from file %s.",FileName);
+}
+
+/****************************************************************/
+/* write a keyed table file that may subsequently be mapped by  */
+/* class constructor 4; returns false on failure.               */
+/****************************************************************/
+bool Interp2D::WriteToFile(const char *FileName, const void *Key, size_t KeySize)
+{
+   int N[2] = { N1, N2 };
+   double *XPoints[2] = { X1Points, X2Points };
+   double XMin[2] = { X1Min, X2Min };
+   double DX[2] = { DX1, DX2 };
+   bool Success=WriteTableFile(FileName, 2, N, XPoints, XMin, DX,
+                               nFun, NCOEFF, CTable, Key, KeySize);
+   if (LogLevel >= LMDI_LOGLEVEL_TERSE)
+    Log("%s interpolation table to file %s.",
+         Success ? "Wrote" : "Could not write", FileName);
+   return Success;
+}
+
 /****************************************************************/
 /* write all class data to a binary file for subsequent recovery*/
 /* by the above constructor routine                             */
@@ -572,7 +667,11 @@ Interp2D::~Interp2D()
 { 
   if (X1Points) free(X1Points);
   if (X2Points) free(X2Points);
-  free(CTable);
+  if (MapBase)
+   UnmapTableFile(MapBase, MapSize);
+  else
+   free(CTable);
+  if (ErrMsg) free(ErrMsg);
 }
 
 /****************************************************************/
@@ -282,6 +282,9 @@ void Interp3D::InitInterp3D(
 
    nFun=pnFun;
    LogLevel = pLogLevel;
+   MapBase=0;
+   MapSize=0;
+   ErrMsg=0;
 
    if (LogLevel >= LMDI_LOGLEVEL_TERSE)
     Log("Creating interpolation grid with (%ix%ix%i)=%i grid points...",
@@ -507,7 +510,11 @@ void Interp3D::ReInitialize(Phi3D PhiFunc, void *UserData, double *PhiVDTable)
 /* generated by a previous call to Interp3D::WriteToFile()      */
 /****************************************************************/
 Interp3D::Interp3D(const char *FileName)
-{ 
+{
+   MapBase=0;
+   MapSize=0;
+   ErrMsg=0;
+ 
    if (LogLevel >= LMDI_LOGLEVEL_TERSE)
     Log("Attempting to read interpolation table from file %s...",FileName);
 
@@ -556,6 +563,57 @@ Interp3D::Interp3D(const char *FileName)
     Log("...success!");
 }
 
+/****************************************************************/
+/* class constructor 4: map a keyed table file written by       */
+/* WriteToFile(FileName, Key, KeySize). if the file is missing, */
+/* invalid, or was written for a different key, ErrMsg is set   */
+/* and the object must not be used.                             */
+/****************************************************************/
+Interp3D::Interp3D(const char *FileName, const void *Key, size_t KeySize,
+                   bool VerifyCTable, int pLogLevel)
+{
+   LogLevel=pLogLevel;
+   MapBase=0;
+   MapSize=0;
+   ErrMsg=0;
+   X1Points=X2Points=X3Points=0;
+   CTable=0;
+
+   int N[3];
+   double *XPoints[3], XMin[3], DX[3];
+   const char *Err=MapTableFile(FileName, 3, NCOEFF, Key, KeySize, VerifyCTable,
+                                N, XPoints, XMin, DX, &nFun, &CTable,
+                                &MapBase, &MapSize);
+   if (Err)
+    { ErrMsg=vstrdup("%s: %s",FileName,Err);
+      return;
+    };
+
+   N1=N[0]; X1Points=XPoints[0]; X1Min=XMin[0]; DX1=DX[0];
+   N2=N[1]; X2Points=XPoints[1]; X2Min=XMin[1]; DX2=DX[1];
+   N3=N[2]; X3Points=XPoints[2]; X3Min=XMin[2]; DX3=DX[2];
+   if (LogLevel >= LMDI_LOGLEVEL_TERSE)
+    Log("Mapped interpolation table from file %s.",FileName);
+}
+
+/****************************************************************/
+/* write a keyed table file that may subsequently be mapped by  */
+/* class constructor 4; returns false on failure.               */
+/****************************************************************/
+bool Interp3D::WriteToFile(const char *FileName, const void *Key, size_t KeySize)
+{
+   int N[3] = { N1, N2, N3 };
+   double *XPoints[3] = { X1Points, X2Points, X3Points };
+   double XMin[3] = { X1Min, X2Min, X3Min };
+   double DX[3] = { DX1, DX2, DX3 };
+   bool Success=WriteTableFile(FileName, 3, N, XPoints, XMin, DX,
+                               nFun, NCOEFF, CTable, Key, KeySize);
+   if (LogLevel >= LMDI_LOGLEVEL_TERSE)
+    Log("%s interpolation table to file %s.",
+         Success ? "Wrote" : "Could not write", FileName);
+   return Success;
+}
+
 /****************************************************************/
 /* write all class data to a binary file for subsequent recovery*/
 /* by the above constructor routine                             */
@@ -609,7 +667,11 @@ Interp3D::~Interp3D()
   if (X1Points) free(X1Points);
   if (X2Points) free(X2Points);
   if (X3Points) free(X3Points);
-  free(CTable);
+  if (MapBase)
+   UnmapTableFile(MapBase, MapSize);
+  else
+   free(CTable);
+  if (ErrMsg) free(ErrMsg);
 }
 
 /****************************************************************/
@@ -0,0 +1,292 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * TableFile.cc -- keyed, memory-mappable files of interpolation tables
+ *
+ * A table file stores the grid and the coefficient table (CTable)
+ * of an Interp2D or Interp3D object, together with an opaque key
+ * supplied by the caller that identifies the function that was
+ * tabulated. Files are located by a hash of the key and validated
+ * against the full key on loading, so a directory of table files
+ * acts as a persistent store of previously computed tables.
+ *
+ * On loading, the file is mapped into memory (privately, so the
+ * object may still be reinitialized) and the CTable of the object
+ * points directly into the mapping.
+ *
+ * file layout:
+ *  header | key | grid points (nonuniform grids only) | CTable
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <libhrutil.h>
+
+#include "libMDInterp.h"
+
+const char LMDITF_Signature[]="SCUFFLMDITABLE";
+#define LMDITF_VERSION   1
+#define LMDITF_ENDIANTAG 0x01020304U
+#define LMDITF_ALIGN     64 // alignment of the CTable within the file
+
+typedef struct LMDITF_Header
+ { char Signature[16];
+   uint32_t Version;
+   uint32_t EndianTag;
+   uint32_t Dimension;
+   uint32_t nFun;
+   uint32_t NCoeff;
+   uint32_t NonUniform;
+   uint32_t N[4];
+   double XMin[4];
+   double DX[4];
+   uint64_t KeySize;
+   uint64_t KeyOffset;       // byte offsets from the start of the file
+   uint64_t PointsOffset;
+   uint64_t CTableOffset;
+   uint64_t FileSize;
+   uint64_t GridChecksum;    // of the key and grid points
+   uint64_t CTableChecksum;
+   uint64_t HeaderChecksum;  // of this header with HeaderChecksum=0
+ } LMDITF_Header;
+
+/***************************************************************/
+/* 64-bit FNV-1a hash, for file names and checksums            */
+/***************************************************************/
+static uint64_t FNV1a(const void *Data, size_t Size, uint64_t Hash=14695981039346656037ULL)
+{
+  const unsigned char *p=(const unsigned char *)Data;
+  for(size_t n=0; n<Size; n++)
+   { Hash ^= p[n];
+     Hash *= 1099511628211ULL;
+   };
+  return Hash;
+}
+
+static uint64_t GetHeaderChecksum(LMDITF_Header *Header)
+{
+  LMDITF_Header Copy=*Header;
+  Copy.HeaderChecksum=0;
+  return FNV1a(&Copy, sizeof(Copy));
+}
+
+/***************************************************************/
+/* name of the file in Directory that stores the table with    */
+/* the given key; caller must free the return value            */
+/***************************************************************/
+char *GetTableFileName(const char *Directory, const char *Prefix,
+                       const void *Key, size_t KeySize)
+{
+  return vstrdup("%s/%s%016llx.lmdi", Directory ? Directory : ".",
+                 Prefix ? Prefix : "",
+                 (unsigned long long)FNV1a(Key, KeySize));
+}
+
+/***************************************************************/
+/* write a table file; returns false on failure. the file is   */
+/* written under a temporary name and renamed at the end, so   */
+/* that readers never see a partially written file and a       */
+/* mapped file of the same name stays valid.                   */
+/***************************************************************/
+bool WriteTableFile(const char *FileName, int Dimension, int *N,
+                    double **XPoints, double *XMin, double *DX,
+                    int nFun, int NCoeff, double *CTable,
+                    const void *Key, size_t KeySize)
+{
+  LMDITF_Header Header;
+  memset(&Header, 0, sizeof(Header));
+  strncpy(Header.Signature, LMDITF_Signature, sizeof(Header.Signature));
+  Header.Version    = LMDITF_VERSION;
+  Header.EndianTag  = LMDITF_ENDIANTAG;
+  Header.Dimension  = Dimension;
+  Header.nFun       = nFun;
+  Header.NCoeff     = NCoeff;
+  Header.NonUniform = XPoints[0] ? 1 : 0;
+
+  size_t NumPoints=0, CTableSize=nFun*NCoeff;
+  for(int d=0; d<Dimension; d++)
+   { Header.N[d]    = N[d];
+     Header.XMin[d] = XMin[d];
+     Header.DX[d]   = DX[d];
+     NumPoints     += N[d];
+     CTableSize    *= (N[d]-1);
+   };
+  if (!Header.NonUniform)
+   NumPoints=0;
+
+  Header.KeySize      = KeySize;
+  Header.KeyOffset    = sizeof(Header);
+  Header.PointsOffset = Header.KeyOffset + KeySize;
+  uint64_t End        = Header.PointsOffset + NumPoints*sizeof(double);
+  Header.CTableOffset = LMDITF_ALIGN*( (End + LMDITF_ALIGN - 1) / LMDITF_ALIGN );
+  Header.FileSize     = Header.CTableOffset + CTableSize*sizeof(double);
+
+  uint64_t Checksum=FNV1a(Key, KeySize);
+  if (Header.NonUniform)
+   for(int d=0; d<Dimension; d++)
+    Checksum=FNV1a(XPoints[d], N[d]*sizeof(double), Checksum);
+  Header.GridChecksum   = Checksum;
+  Header.CTableChecksum = FNV1a(CTable, CTableSize*sizeof(double));
+  Header.HeaderChecksum = GetHeaderChecksum(&Header);
+
+  char *TmpFileName=vstrdup("%s.%i.tmp", FileName, (int)getpid());
+  FILE *f=fopen(TmpFileName,"w");
+  if (!f)
+   { free(TmpFileName);
+     return false;
+   };
+
+  char Pad[LMDITF_ALIGN];
+  memset(Pad, 0, LMDITF_ALIGN);
+  bool WriteError = ( 1!=fwrite(&Header, sizeof(Header), 1, f) );
+  if (!WriteError && KeySize>0)
+   WriteError = ( 1!=fwrite(Key, KeySize, 1, f) );
+  if (Header.NonUniform)
+   for(int d=0; d<Dimension && !WriteError; d++)
+    WriteError = ( (size_t)N[d]!=fwrite(XPoints[d], sizeof(double), N[d], f) );
+  if (!WriteError && Header.CTableOffset>End)
+   WriteError = ( 1!=fwrite(Pad, Header.CTableOffset-End, 1, f) );
+  if (!WriteError)
+   WriteError = ( CTableSize!=fwrite(CTable, sizeof(double), CTableSize, f) );
+  if ( fclose(f) )
+   WriteError=true;
+
+  if ( WriteError || rename(TmpFileName, FileName) )
+   { unlink(TmpFileName);
+     free(TmpFileName);
+     return false;
+   };
+  free(TmpFileName);
+  return true;
+}
+
+/***************************************************************/
+/* map a table file into memory. on success, the return value  */
+/* is 0 and the output parameters describe the table; XPoints  */
+/* (nonuniform grids only) are malloc'ed copies, and CTable    */
+/* points into the mapping at *MapBase of size *MapSize.       */
+/* on failure, the return value is an error message.           */
+/*                                                             */
+/* the checksum of the CTable is only verified if VerifyCTable */
+/* is true, since that requires reading the whole file.        */
+/***************************************************************/
+const char *MapTableFile(const char *FileName, int Dimension, int NCoeff,
+                         const void *Key, size_t KeySize, bool VerifyCTable,
+                         int *N, double **XPoints, double *XMin, double *DX,
+                         int *nFun, double **CTable,
+                         void **MapBase, size_t *MapSize)
+{
+  int fd=open(FileName, O_RDONLY);
+  if (fd<0)
+   return "could not open file";
+
+  struct stat fileStats;
+  off_t FileSize = fstat(fd, &fileStats) ? 0 : fileStats.st_size;
+
+  LMDITF_Header Header;
+  const char *ErrMsg=0;
+  if ( FileSize < (off_t)sizeof(Header) || sizeof(Header)!=(size_t)read(fd, &Header, sizeof(Header)) )
+   ErrMsg="invalid table file";
+  else if ( strncmp(Header.Signature, LMDITF_Signature, sizeof(Header.Signature)) )
+   ErrMsg="invalid table file";
+  else if ( Header.EndianTag!=LMDITF_ENDIANTAG )
+   ErrMsg="table file was written on a machine with different byte order";
+  else if ( Header.HeaderChecksum != GetHeaderChecksum(&Header) )
+   ErrMsg="table file header is corrupted";
+  else if ( Header.Version!=LMDITF_VERSION )
+   ErrMsg="unsupported table file version";
+  else if (    Header.Dimension!=(uint32_t)Dimension
+            || Header.NCoeff!=(uint32_t)NCoeff
+            || Header.KeySize!=KeySize
+            || Header.FileSize!=(uint64_t)FileSize
+          )
+   ErrMsg="table file does not match";
+
+  void *Base=MAP_FAILED;
+  if (ErrMsg==0)
+   { Base=mmap(0, FileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+     if (Base==MAP_FAILED)
+      ErrMsg="could not map table file into memory";
+   };
+  close(fd);
+  if (ErrMsg)
+   return ErrMsg;
+
+  char *Bytes=(char *)Base;
+  size_t NumPoints=0, CTableSize=Header.nFun*NCoeff;
+  for(int d=0; d<Dimension; d++)
+   { NumPoints  += Header.N[d];
+     CTableSize *= (Header.N[d]-1);
+   };
+  if (!Header.NonUniform)
+   NumPoints=0;
+
+  uint64_t Checksum=FNV1a(Bytes + Header.KeyOffset, KeySize);
+  Checksum=FNV1a(Bytes + Header.PointsOffset, NumPoints*sizeof(double), Checksum);
+  if ( memcmp(Bytes + Header.KeyOffset, Key, KeySize) )
+   ErrMsg="table file was computed for a different key";
+  else if (    Header.CTableOffset < Header.PointsOffset + NumPoints*sizeof(double)
+            || Header.CTableOffset + CTableSize*sizeof(double) != Header.FileSize
+          )
+   ErrMsg="table file has incorrect size";
+  else if ( Checksum!=Header.GridChecksum )
+   ErrMsg="table file is corrupted";
+  else if ( VerifyCTable && FNV1a(Bytes + Header.CTableOffset, CTableSize*sizeof(double))!=Header.CTableChecksum )
+   ErrMsg="table file is corrupted";
+
+  if (ErrMsg)
+   { munmap(Base, FileSize);
+     return ErrMsg;
+   };
+
+  double *Points=(double *)(Bytes + Header.PointsOffset);
+  for(int d=0; d<Dimension; d++)
+   { N[d]    = Header.N[d];
+     XMin[d] = Header.XMin[d];
+     DX[d]   = Header.DX[d];
+     XPoints[d] = 0;
+     if (Header.NonUniform)
+      { XPoints[d]=(double *)memdup(Points, N[d]*sizeof(double));
+        Points+=N[d];
+      };
+   };
+  *nFun     = Header.nFun;
+  *CTable   = (double *)(Bytes + Header.CTableOffset);
+  *MapBase  = Base;
+  *MapSize  = FileSize;
+  return 0;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void UnmapTableFile(void *MapBase, size_t MapSize)
+{
+  munmap(MapBase, MapSize);
+}
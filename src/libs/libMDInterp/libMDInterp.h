@@ -264,6 +264,13 @@ class Interp2D
              int nFun, Phi2D PhiFunc=0, void *UserData=0,
              int LogLevel=LMDI_LOGLEVEL_TERSE);
 
+    /*--------------------------------------------------------------*/
+    /*- user-supplied data table, nonuniform grid                   */
+    /*--------------------------------------------------------------*/
+    Interp2D(double *PhiVDTable,
+             double *X1Points, int N1, double *X2Points, int N2,
+             int nFun, int LogLevel=LMDI_LOGLEVEL_TERSE);
+
     /*--------------------------------------------------------------*/
     /*- class constructor 2: construct from a user-supplied function*/
     /*- and uniform grid                                            */
@@ -277,7 +284,7 @@ class Interp2D
     /*- the body of the class constructor for the above two entry  -*/
     /*- points                                                     -*/
     /*--------------------------------------------------------------*/
-    void InitInterp2D(Phi2D PhiFunc, void *UserData);
+    void InitInterp2D(Phi2D PhiFunc, void *UserData, double *PhiVDTable=0);
 
     /*--------------------------------------------------------------*/
     /*- reinitialize an Interp2D object using the same interpolation*/
@@ -291,6 +298,14 @@ class Interp2D
     /*--------------------------------------------------------------*/
     Interp2D(const char *FileName);
 
+    /*--------------------------------------------------------------*/
+    /*- class constructor 4: map a table file previously written by */
+    /*- WriteToFile(FileName, Key, KeySize) with the same key; on   */
+    /*- failure, ErrMsg is nonzero on return (see TableFile.cc)     */
+    /*--------------------------------------------------------------*/
+    Interp2D(const char *FileName, const void *Key, size_t KeySize,
+             bool VerifyCTable=false, int LogLevel=LMDI_LOGLEVEL_TERSE);
+
     /*--------------------------------------------------------------*/
     /*- class destructor -------------------------------------------*/
     /*--------------------------------------------------------------*/
@@ -309,6 +324,7 @@ class Interp2D
     /*- that may be subsequently used to reconstruct the class     -*/
     /*--------------------------------------------------------------*/
     void WriteToFile(const char *FileName);
+    bool WriteToFile(const char *FileName, const void *Key, size_t KeySize);
 
     /*----------------------------------------------------------------*/
     /*- internal class data that should be private but i don't bother */
@@ -322,6 +338,10 @@ class Interp2D
     int LogLevel;
 
     double *CTable;
+
+    void *MapBase;  // nonzero if CTable lives in a mapped table file
+    size_t MapSize;
+    char *ErrMsg;
     
  };
 
@@ -393,6 +413,14 @@ class Interp3D
     /*--------------------------------------------------------------*/
     Interp3D(const char *FileName);
 
+    /*--------------------------------------------------------------*/
+    /*- class constructor 4: map a table file previously written by */
+    /*- WriteToFile(FileName, Key, KeySize) with the same key; on   */
+    /*- failure, ErrMsg is nonzero on return (see TableFile.cc)     */
+    /*--------------------------------------------------------------*/
+    Interp3D(const char *FileName, const void *Key, size_t KeySize,
+             bool VerifyCTable=false, int LogLevel=LMDI_LOGLEVEL_TERSE);
+
     /*--------------------------------------------------------------*/
     /*- class destructor -------------------------------------------*/
     /*--------------------------------------------------------------*/
@@ -421,6 +449,7 @@ class Interp3D
     /*- that may be subsequently used to reconstruct the class     -*/
     /*--------------------------------------------------------------*/
     void WriteToFile(const char *FileName);
+    bool WriteToFile(const char *FileName, const void *Key, size_t KeySize);
 
     /*----------------------------------------------------------------*/
     /*- internal class data that should be private but i don't bother */
@@ -433,6 +462,10 @@ class Interp3D
     int LogLevel;
 
     double *CTable;
+
+    void *MapBase;  // nonzero if CTable lives in a mapped table file
+    size_t MapSize;
+    char *ErrMsg;
     
  };
 
@@ -526,4 +559,20 @@ bool FindInterval(double X, double *XPoints, int N, double XMin, double DX,
 /***************************************************************/
 void freadEC(void *p, size_t size, size_t nmemb, FILE *f, const char *FileName); 
 
+/***************************************************************/
+/* keyed, memory-mapped table files (TableFile.cc)             */
+/***************************************************************/
+char *GetTableFileName(const char *Directory, const char *Prefix,
+                       const void *Key, size_t KeySize);
+bool WriteTableFile(const char *FileName, int Dimension, int *N,
+                    double **XPoints, double *XMin, double *DX,
+                    int nFun, int NCoeff, double *CTable,
+                    const void *Key, size_t KeySize);
+const char *MapTableFile(const char *FileName, int Dimension, int NCoeff,
+                         const void *Key, size_t KeySize, bool VerifyCTable,
+                         int *N, double **XPoints, double *XMin, double *DX,
+                         int *nFun, double **CTable,
+                         void **MapBase, size_t *MapSize);
+void UnmapTableFile(void *MapBase, size_t MapSize);
+
 #endif
@@ -373,9 +373,12 @@ void MatProp::GetEpsMu_Parsed(cdouble Omega, cdouble *pEps, cdouble *pMu)
   // Note that this is thread-safe since "w" is an indexed variable,
   // which means that the internal symbol table is not modified, but
   // we MUST pass its value as the 0th array entry in cevaluator_evaluate.
+  // The compiled programs, when present, take w as their only argument.
 
   if (pEps) {
-    if (EpsExpression) {
+    if (EpsProgram)
+      *pEps = cevaluator_program_evaluate(EpsProgram, &Omega);
+    else if (EpsExpression) {
       *pEps = cevaluator_evaluate(EpsExpression, 1,&OmegaVar,&Omega);
     }
     else
@@ -383,10 +386,25 @@ void MatProp::GetEpsMu_Parsed(cdouble Omega, cdouble *pEps, cdouble *pMu)
   }
 
   if (pMu) {
-    if (MuExpression) {
+    if (MuProgram)
+      *pMu = cevaluator_program_evaluate(MuProgram, &Omega);
+    else if (MuExpression) {
       *pMu = cevaluator_evaluate(MuExpression, 1,&OmegaVar,&Omega);
     }
     else
       *pMu = 1.0;
   }
 }
+
+/***************************************************************/
+/* compile the parsed expressions (if any) for fast evaluation;*/
+/* this must be called after any user-defined constants in the */
+/* expressions have been set, since their values are frozen    */
+/* into the compiled programs.                                 */
+/***************************************************************/
+void MatProp::CompileExpressions()
+{
+  char *OmegaVar=const_cast<char *>("w");
+  EpsProgram = EpsExpression ? cevaluator_compile(EpsExpression, 1, &OmegaVar) : 0;
+  MuProgram  = MuExpression  ? cevaluator_compile(MuExpression,  1, &OmegaVar) : 0;
+}
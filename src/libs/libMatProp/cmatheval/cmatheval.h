@@ -113,6 +113,33 @@ extern          "C" {
 	extern void    *cevaluator_derivative_z(void *cevaluator);
 
 
+        /* Compile function represented by cevaluator into a flat
+	 * program for fast repeated evaluation.  Variables are passed
+	 * by position: variable names[i] takes its value from values[i]
+	 * in the evaluation routines below; variables indexed via
+	 * cevaluator_set_var_index() but not named take their value from
+	 * their index; all other variables are frozen at their current
+	 * values, and constant subexpressions are folded.  The program
+	 * does not refer to the cevaluator (which may be destroyed
+	 * first), is thread-safe, and must be destroyed with
+	 * cevaluator_program_destroy(). */
+        extern void *cevaluator_compile(void *cevaluator, int count, char **names);
+        extern void cevaluator_program_destroy(void *program);
+
+        /* Evaluate compiled program for given argument values. */
+        extern cevaluator_complex cevaluator_program_evaluate(void *program,
+					   const cevaluator_complex *values);
+
+        /* Evaluate compiled program at n points: the arguments for
+	 * point j start at values[j*stride], and its value is stored
+	 * in results[j]. */
+        extern void cevaluator_program_evaluate_many(void *program, int n,
+					   const cevaluator_complex *values,
+					   int stride, cevaluator_complex *results);
+
+        /* Return nonzero iff compiled program depends on argument idx. */
+        extern int cevaluator_program_uses(void *program, int idx);
+
         /* Determine whether an expression can be guaranteed to be real for
 	   ALL values of the variables.  The only assumption is that
 	   variables currently set to real values are assumed to ALWAYS
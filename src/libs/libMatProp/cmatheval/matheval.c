@@ -28,6 +28,7 @@
 #include "common.h"
 #include "cmatheval.h"
 #include "node.h"
+#include "program.h"
 #include "symbol_table.h"
 
 /* Minimal length of cevaluator symbol table.  */
@@ -345,3 +346,40 @@ cevaluator_derivative_z(void *cevaluator)
 	/* Differentiate function using derivation variable "z". */
 	return cevaluator_derivative(cevaluator, "z");
 }
+
+void           *
+cevaluator_compile(void *cevaluator, int count, char **names)
+{
+	/* Compile tree representation of function. */
+	return program_create(((Evaluator *) cevaluator)->root, count,
+			      names);
+}
+
+void
+cevaluator_program_destroy(void *program)
+{
+	program_destroy((Program *) program);
+}
+
+cmplx
+cevaluator_program_evaluate(void *program, const cmplx * values)
+{
+	return program_evaluate((Program *) program, values);
+}
+
+void
+cevaluator_program_evaluate_many(void *program, int n,
+				 const cmplx * values, int stride,
+				 cmplx * results)
+{
+	program_evaluate_many((Program *) program, n, values, stride,
+			      results);
+}
+
+int
+cevaluator_program_uses(void *program, int idx)
+{
+	if (idx < 0 || idx >= ((Program *) program)->count)
+		return 0;
+	return ((Program *) program)->uses[idx];
+}
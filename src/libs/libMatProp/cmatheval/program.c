@@ -0,0 +1,345 @@
+/* 
+ * Copyright (C) 1999, 2002, 2003, 2004, 2005, 2006, 2007 Free Software
+ * Foundation, Inc.
+ * 
+ * This file is part of GNU libmatheval
+ * 
+ * GNU libmatheval is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ * 
+ * GNU libmatheval is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * program.c -- compilation of expression trees into flat programs that
+ *           -- are evaluated without recursion or symbol-table lookups,
+ *           -- optionally at many points at once
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include "common.h"
+#include "program.h"
+
+/* Number of points processed together by program_evaluate_many().  */
+#define PROGRAM_BLOCK 64
+
+/* Stack depth for which program_evaluate() needs no allocation.  */
+#define PROGRAM_STACK 32
+
+/* Largest integer exponent evaluated by repeated multiplication.  */
+#define PROGRAM_MAXIPOW 64
+
+/* Integer power by repeated squaring.  */
+static          cmplx
+ipow(cmplx x, int n)
+{
+	cmplx           result = 1.0;
+	int             m = (n < 0) ? -n : n;
+
+	for (; m; m >>= 1) {
+		if (m & 1)
+			result *= x;
+		x *= x;
+	}
+	return (n < 0) ? 1.0 / result : result;
+}
+
+/* Apply binary operation.  */
+static          cmplx
+binop(char op, cmplx x, cmplx y)
+{
+	switch (op) {
+	case '+':
+		return x + y;
+	case '-':
+		return x - y;
+	case '*':
+		return x * y;
+	case '/':
+		return x / y;
+	case '^':
+		return cpow(x, y);
+	}
+	return 0;
+}
+
+/* Append instruction to program, growing code array as necessary.  */
+static Instruction *
+emit(Program * program, int *capacity, char op)
+{
+	Instruction    *instruction;
+
+	if (program->length == *capacity) {
+		*capacity = 2 * (*capacity) + 8;
+		program->code =
+		    XREALLOC(Instruction, program->code, *capacity);
+	}
+	instruction = program->code + (program->length++);
+	instruction->op = op;
+	instruction->arg = 0;
+	instruction->function = NULL;
+	instruction->number = 0.0;
+	return instruction;
+}
+
+/* Emit code for subtree rooted at node, folding constant subexpressions:
+ * since code is emitted in postfix order, an operand is constant iff the
+ * last instruction emitted for it pushes a number.  Current and maximal
+ * stack depth are tracked through depth and program->depth.  */
+static void
+program_emit(Program * program, int *capacity, int *depth, Node * node,
+	     int count, char **names)
+{
+	Instruction    *last;
+	Record         *record;
+	int             i;
+
+	switch (node->type) {
+	case 'n':
+		emit(program, capacity, 'n')->number = node->Number;
+		break;
+
+	case 'c':
+		emit(program, capacity, 'n')->number =
+		    node->data.constant->data.value;
+		break;
+
+	case 'v':
+		record = node->data.variable;
+		for (i = 0; i < count; i++)
+			if (!strcmp(record->name, names[i]))
+				break;
+		if (i == count && record->type == 'V')
+			i = (int) record->data.index;
+		if (i < count || record->type == 'V') {
+			emit(program, capacity, 'a')->arg = i;
+			if (i < count)
+				program->uses[i] = 1;
+		} else
+			emit(program, capacity, 'n')->number =
+			    record->data.value;
+		break;
+
+	case 'f':
+		program_emit(program, capacity, depth,
+			     node->data.function.child, count, names);
+		last = program->code + program->length - 1;
+		if (last->op == 'n')
+			last->number =
+			    (*node->data.function.record->data.
+			     function) (last->number);
+		else
+			emit(program, capacity, 'f')->function =
+			    node->data.function.record->data.function;
+		return;
+
+	case 'u':
+		program_emit(program, capacity, depth,
+			     node->data.un_op.child, count, names);
+		last = program->code + program->length - 1;
+		if (last->op == 'n')
+			last->number = -last->number;
+		else
+			emit(program, capacity, '~');
+		return;
+
+	case 'b':
+		program_emit(program, capacity, depth,
+			     node->data.bin_op.left, count, names);
+		program_emit(program, capacity, depth,
+			     node->data.bin_op.right, count, names);
+		(*depth)--;
+		last = program->code + program->length - 1;
+		if (last->op == 'n' && (last - 1)->op == 'n') {
+			(last - 1)->number =
+			    binop(node->data.bin_op.operation,
+				  (last - 1)->number, last->number);
+			program->length--;
+		} else if (node->data.bin_op.operation == '^'
+			   && last->op == 'n' && cimag(last->number) == 0.0
+			   && fabs(creal(last->number)) <= PROGRAM_MAXIPOW
+			   && creal(last->number) ==
+			   floor(creal(last->number))) {
+			/* Replace constant integer exponent by repeated
+			 * multiplication. */
+			last->op = 'i';
+			last->arg = (int) creal(last->number);
+		} else
+			emit(program, capacity, node->data.bin_op.operation);
+		return;
+	}
+
+	/* Leaf node pushes one value onto the stack. */
+	if (++(*depth) > program->depth)
+		program->depth = *depth;
+}
+
+Program        *
+program_create(Node * node, int count, char **names)
+{
+	Program        *program;	/* Compiled program.  */
+	int             capacity = 0;	/* Length of code array.  */
+	int             depth = 0;	/* Current stack depth.  */
+
+	program = XMALLOC(Program, 1);
+	program->code = NULL;
+	program->length = 0;
+	program->depth = 0;
+	program->count = count;
+	program->uses = XCALLOC(int, count > 0 ? count : 1);
+	program_emit(program, &capacity, &depth, node, count, names);
+	return program;
+}
+
+void
+program_destroy(Program * program)
+{
+	XFREE(program->code);
+	XFREE(program->uses);
+	XFREE(program);
+}
+
+cmplx
+program_evaluate(Program * program, const cmplx * values)
+{
+	cmplx           buffer[PROGRAM_STACK];	/* Evaluation stack.  */
+	cmplx          *stack = buffer;
+	cmplx           result;
+	Instruction    *instruction;
+	int             n,
+	                top = -1;	/* Index of top of stack.  */
+
+	if (program->depth > PROGRAM_STACK)
+		stack = XMALLOC(cmplx, program->depth);
+
+	for (n = 0; n < program->length; n++) {
+		instruction = program->code + n;
+		switch (instruction->op) {
+		case 'n':
+			stack[++top] = instruction->number;
+			break;
+		case 'a':
+			stack[++top] = values[instruction->arg];
+			break;
+		case 'f':
+			stack[top] = (*instruction->function) (stack[top]);
+			break;
+		case '~':
+			stack[top] = -stack[top];
+			break;
+		case 'i':
+			stack[top] = ipow(stack[top], instruction->arg);
+			break;
+		default:
+			top--;
+			stack[top] =
+			    binop(instruction->op, stack[top],
+				  stack[top + 1]);
+			break;
+		}
+	}
+	result = stack[0];
+
+	if (stack != buffer)
+		XFREE(stack);
+	return result;
+}
+
+void
+program_evaluate_many(Program * program, int n, const cmplx * values,
+		      int stride, cmplx * results)
+{
+	cmplx          *stack;	/* Evaluation stack of PROGRAM_BLOCK-point
+				 * slices.  */
+	cmplx          *x,
+	               *y;
+	Instruction    *instruction;
+	int             start,
+	                m,
+	                size,
+	                i,
+	                top;
+
+	stack = XMALLOC(cmplx, PROGRAM_BLOCK * (program->depth + 1));
+
+	/* Evaluate each instruction for a whole block of points before
+	 * proceeding to the next one, so that the inner loops are simple
+	 * enough for the compiler to unroll and vectorize.  */
+	for (start = 0; start < n; start += PROGRAM_BLOCK) {
+		size = (n - start < PROGRAM_BLOCK) ? n - start : PROGRAM_BLOCK;
+		top = -1;
+		for (i = 0; i < program->length; i++) {
+			instruction = program->code + i;
+			if (instruction->op == 'n' || instruction->op == 'a')
+				top++;
+			else if (instruction->op != 'f'
+				 && instruction->op != '~'
+				 && instruction->op != 'i')
+				top--;
+			x = stack + top * PROGRAM_BLOCK;
+			y = x + PROGRAM_BLOCK;
+
+			switch (instruction->op) {
+			case 'n':
+				for (m = 0; m < size; m++)
+					x[m] = instruction->number;
+				break;
+			case 'a':
+				for (m = 0; m < size; m++)
+					x[m] =
+					    values[(start + m) * stride +
+						   instruction->arg];
+				break;
+			case 'f':
+				for (m = 0; m < size; m++)
+					x[m] = (*instruction->function) (x[m]);
+				break;
+			case '~':
+				for (m = 0; m < size; m++)
+					x[m] = -x[m];
+				break;
+			case 'i':
+				for (m = 0; m < size; m++)
+					x[m] = ipow(x[m], instruction->arg);
+				break;
+			case '+':
+				for (m = 0; m < size; m++)
+					x[m] += y[m];
+				break;
+			case '-':
+				for (m = 0; m < size; m++)
+					x[m] -= y[m];
+				break;
+			case '*':
+				for (m = 0; m < size; m++)
+					x[m] *= y[m];
+				break;
+			case '/':
+				for (m = 0; m < size; m++)
+					x[m] /= y[m];
+				break;
+			case '^':
+				for (m = 0; m < size; m++)
+					x[m] = cpow(x[m], y[m]);
+				break;
+			}
+		}
+		for (m = 0; m < size; m++)
+			results[start + m] = stack[m];
+	}
+
+	XFREE(stack);
+}
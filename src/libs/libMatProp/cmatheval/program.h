@@ -0,0 +1,73 @@
+/* 
+ * Copyright (C) 1999, 2002, 2003, 2004, 2005, 2006, 2007 Free Software
+ * Foundation, Inc.
+ * 
+ * This file is part of GNU libmatheval
+ * 
+ * GNU libmatheval is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ * 
+ * GNU libmatheval is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef PROGRAM_H
+#define PROGRAM_H 1
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "node.h"
+
+/* Single instruction of a compiled program.  Programs are evaluated on a
+ * stack machine: each instruction pops its operands from the stack and
+ * pushes its result.  */
+typedef struct {
+	char            op;	/* Instruction type ('n' to push number,
+				 * 'a' to push argument, 'f' for function,
+				 * '~' for negation, '+', '-', '*', '/' and
+				 * '^' for binary operations, 'i' for
+				 * integer power).  */
+	int             arg;	/* Argument index ('a') or exponent ('i'). */
+	cmplx           (*function) (cmplx);	/* Function ('f').  */
+	cmplx           number;	/* Number value ('n').  */
+} Instruction;
+
+/* Data structure representing compiled program.  */
+typedef struct {
+	Instruction    *code;	/* Instructions in evaluation order.  */
+	int             length;	/* Number of instructions.  */
+	int             depth;	/* Maximal stack depth during evaluation. */
+	int             count;	/* Number of positional arguments.  */
+	int            *uses;	/* uses[i] is nonzero iff program refers to
+				 * argument i.  */
+} Program;
+
+/* Compile subtree rooted at given node into program.  Variable names[i]
+ * becomes positional argument i; other indexed (threadsafe) variables
+ * become arguments at their index, and all remaining variables are
+ * frozen at their current values.  Constant subexpressions are folded. */
+Program        *program_create(Node * node, int count, char **names);
+
+/* Destroy program.  */
+void            program_destroy(Program * program);
+
+/* Evaluate program for given argument values.  */
+cmplx           program_evaluate(Program * program, const cmplx * values);
+
+/* Evaluate program at n points; arguments for point j start at
+ * values[j*stride] and its value is stored in results[j].  */
+void            program_evaluate_many(Program * program, int n,
+				      const cmplx * values, int stride,
+				      cmplx * results);
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 1999, 2002, 2003, 2004, 2005, 2006, 2007 Free Software
+ * Foundation, Inc.
+ *
+ * This file is part of GNU libmatheval
+ *
+ * GNU libmatheval is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * GNU libmatheval is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * tprogram.c -- test comparing compiled programs (cevaluator_compile)
+ *            -- evaluated at one point and at many points against the
+ *            -- tree evaluator (cevaluator_evaluate)
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "cmatheval.h"
+#include "xmath.h"
+
+/* Number of evaluation points; more than one block of
+ * program_evaluate_many() and not a multiple of the block size.  */
+#define NPOINTS 150
+
+#define TOLERANCE 1e-12
+
+/* Expressions in the variables w and x.  The constants eps0, epsf and
+ * wp are given values with cevaluator_set_var() before compilation and
+ * so are frozen into the program.  */
+static const char *expressions[] = {
+	"x^-3 + 2*w",
+	"w^(-2)*x^5 - x^(-1)",
+	"(x*w)^-4 + x^0",
+	"x^2.5 + w^x",
+	"exp(sin(x*w)) + sqrt(cos(x)^2 + 1)",
+	"log(1 + exp(-x^2))/(w + 3)",
+	"tanh(atan(x) - sinh(w/4))",
+	"epsf + (eps0-epsf)/(1-(w/wp)^2)",
+	"eps0*x^-2 + wp*epsf",
+	NULL
+};
+
+static double
+relative_error(cevaluator_complex a, cevaluator_complex b)
+{
+	double          scale = cabs(b);
+
+	if (scale < 1.0)
+		scale = 1.0;
+	return cabs(a - b) / scale;
+}
+
+int
+main(int argc, char **argv)
+{
+	char           *names[] = { (char *) "w", (char *) "x" };
+	cevaluator_complex *values,
+	               *results;
+	int             i,
+	                n,
+	                failures = 0;
+
+	values = (cevaluator_complex *) malloc(2 * NPOINTS *
+					       sizeof(cevaluator_complex));
+	results = (cevaluator_complex *) malloc(NPOINTS *
+						sizeof(cevaluator_complex));
+	for (n = 0; n < NPOINTS; n++) {
+		values[2 * n + 0] = 0.1 + 0.03 * n + I * (0.01 * (n % 7));
+		values[2 * n + 1] = 0.5 + 0.02 * n - I * (0.05 * (n % 5));
+	}
+
+	for (i = 0; expressions[i]; i++) {
+		void           *eval = cevaluator_create((char *) expressions[i]);
+		void           *program;
+		double          error = 0.0,
+		                e;
+
+		if (!eval) {
+			printf("%s: FAILED (invalid expression)\n",
+			       expressions[i]);
+			failures++;
+			continue;
+		}
+		cevaluator_set_var(eval, "eps0", 11.87);
+		cevaluator_set_var(eval, "epsf", 1.035);
+		cevaluator_set_var(eval, "wp", 6.6 + 0.5 * I);
+		program = cevaluator_compile(eval, 2, names);
+
+		cevaluator_program_evaluate_many(program, NPOINTS, values, 2,
+						 results);
+		for (n = 0; n < NPOINTS; n++) {
+			cevaluator_complex ref =
+			    cevaluator_evaluate(eval, 2, names,
+						values + 2 * n);
+			e = relative_error(cevaluator_program_evaluate
+					   (program, values + 2 * n), ref);
+			if (e > error)
+				error = e;
+			e = relative_error(results[n], ref);
+			if (e > error)
+				error = e;
+		}
+
+		printf("%s: %s (max rel error %.1e)\n", expressions[i],
+		       error < TOLERANCE ? "PASSED" : "FAILED", error);
+		if (!(error < TOLERANCE))
+			failures++;
+
+		cevaluator_program_destroy(program);
+		cevaluator_destroy(eval);
+	}
+
+	free(results);
+	free(values);
+	return failures ? 1 : 0;
+}
@@ -24,9 +24,14 @@
  * homer reid    -- 12/2009
  */
 
+#include "config.h"
+
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#if defined(USE_OPENMP) || defined(USE_PTHREAD)
+#  include <pthread.h>
+#endif
 
 #include <libhrutil.h>
 #include <libhmat.h>
@@ -76,6 +81,82 @@ MatProp *FindMPInMatPropDataBase(const char *MaterialName)
   return 0;
 }
 
+/***************************************************************/
+/* memo of the most recent GetEpsMu() result, consulted for    */
+/* materials whose eps and mu are not simply constants. the    */
+/* lock is needed because UpdateCachedEpsMuValues() in libscuff*/
+/* may be called from several threads at once.                 */
+/***************************************************************/
+typedef struct EpsMuMemo
+ { 
+   bool Valid;
+   cdouble Omega;
+   double FreqUnit;
+   cdouble Eps, Mu;
+#if defined(USE_OPENMP) || defined(USE_PTHREAD)
+   pthread_mutex_t Lock;
+#endif
+
+ } EpsMuMemo;
+
+static void *CreateEpsMuMemo()
+{
+  EpsMuMemo *Memo=(EpsMuMemo *)mallocEC(sizeof(EpsMuMemo));
+  Memo->Valid=false;
+#if defined(USE_OPENMP) || defined(USE_PTHREAD)
+  pthread_mutex_init(&(Memo->Lock), 0);
+#endif
+  return (void *)Memo;
+}
+
+static void DestroyEpsMuMemo(void *opMemo)
+{
+  if (!opMemo) return;
+#if defined(USE_OPENMP) || defined(USE_PTHREAD)
+  pthread_mutex_destroy( &(((EpsMuMemo *)opMemo)->Lock) );
+#endif
+  free(opMemo);
+}
+
+static bool GetMemoizedEpsMu(void *opMemo, cdouble Omega,
+                             cdouble *pEps, cdouble *pMu)
+{ 
+  EpsMuMemo *Memo=(EpsMuMemo *)opMemo;
+  if (!Memo) return false;
+#if defined(USE_OPENMP) || defined(USE_PTHREAD)
+  pthread_mutex_lock(&(Memo->Lock));
+#endif
+  bool Found = Memo->Valid 
+               && Memo->Omega==Omega
+               && Memo->FreqUnit==MatProp::FreqUnit;
+  if (Found)
+   { *pEps=Memo->Eps;
+     *pMu=Memo->Mu;
+   };
+#if defined(USE_OPENMP) || defined(USE_PTHREAD)
+  pthread_mutex_unlock(&(Memo->Lock));
+#endif
+  return Found;
+}
+
+static void SetMemoizedEpsMu(void *opMemo, cdouble Omega,
+                             cdouble Eps, cdouble Mu)
+{ 
+  EpsMuMemo *Memo=(EpsMuMemo *)opMemo;
+  if (!Memo) return;
+#if defined(USE_OPENMP) || defined(USE_PTHREAD)
+  pthread_mutex_lock(&(Memo->Lock));
+#endif
+  Memo->Valid=true;
+  Memo->Omega=Omega;
+  Memo->FreqUnit=MatProp::FreqUnit;
+  Memo->Eps=Eps;
+  Memo->Mu=Mu;
+#if defined(USE_OPENMP) || defined(USE_PTHREAD)
+  pthread_mutex_unlock(&(Memo->Lock));
+#endif
+}
+
 /***************************************************************/
 /* constructor entry points ************************************/
 /***************************************************************/
@@ -83,12 +164,16 @@ MatProp::MatProp()
  { Type=MP_PEC; 
    Zeroed=0;
    Name=strdupEC("PEC");
+   EpsProgram=MuProgram=0;
+   opMemo=CreateEpsMuMemo();
  }
 
 MatProp::MatProp(int pType)
  { Type=pType;
    Zeroed=0;
    Name=strdupEC("VACUUM");
+   EpsProgram=MuProgram=0;
+   opMemo=CreateEpsMuMemo();
  }
  
 MatProp::MatProp(const char *MaterialName)
@@ -149,6 +234,9 @@ MatProp::MatProp(MatProp *MP)
     };
    OwnsExpressions= true;
 
+   CompileExpressions();
+   opMemo=CreateEpsMuMemo();
+
  }
 
 /***************************************************************/
@@ -165,8 +253,10 @@ void MatProp::InitMatProp(const char *MaterialName, const char *MatPropFileName)
   Mu=1.0;
   Zeroed=0;
   EpsExpression = MuExpression = NULL;
+  EpsProgram = MuProgram = NULL;
   InterpReal = InterpImag = NULL;
   OwnsExpressions = OwnsInterpolators = false;
+  opMemo=CreateEpsMuMemo();
 
   /* assume things will go OK */
   ErrMsg=0;
@@ -292,6 +382,7 @@ void MatProp::InitMatProp(const char *MaterialName, const char *MatPropFileName)
 	   cevaluator_set_var_index(MuExpression, "w", 0);
          };
 	OwnsExpressions=true;
+        CompileExpressions();
       };
      
      return;
@@ -351,6 +442,7 @@ void MatProp::InitMatProp(const char *MaterialName, const char *MatPropFileName)
        OwnsExpressions = true;
        AddMPToMatPropDataBase(this);
      };
+    CompileExpressions();
 }
 
 /***************************************************************/
@@ -464,6 +556,10 @@ MatProp::~MatProp()
       if (MuExpression) cevaluator_destroy(MuExpression);
    };
 
+  if (EpsProgram) cevaluator_program_destroy(EpsProgram);
+  if (MuProgram) cevaluator_program_destroy(MuProgram);
+  DestroyEpsMuMemo(opMemo);
+
 }  
 
 /***************************************************************/
@@ -521,6 +617,9 @@ void MatProp::GetEpsMu(cdouble Omega, cdouble *pEps, cdouble *pMu)
    { EpsRV=Eps;
      MuRV=Mu;
    }
+  else if ( GetMemoizedEpsMu(opMemo, Omega, &EpsRV, &MuRV) )
+   { // nothing to do: EpsRV, MuRV were set by GetMemoizedEpsMu
+   }
   else if ( Type==MP_INTERP )
    { 
      double Data[4];
@@ -542,10 +641,12 @@ void MatProp::GetEpsMu(cdouble Omega, cdouble *pEps, cdouble *pMu)
       }
      else
       ErrExit("interpolated frequencies must lie on the real or imaginary axis");
+     SetMemoizedEpsMu(opMemo, Omega, EpsRV, MuRV);
    }
   else if ( Type==MP_PARSED ) 
    { 
        GetEpsMu_Parsed(Omega, &EpsRV, &MuRV);
+       SetMemoizedEpsMu(opMemo, Omega, EpsRV, MuRV);
    }; // if (Type==... )
 
   if (pEps) *pEps=EpsRV;
@@ -109,6 +109,7 @@ class MatProp
    int ReadMaterialFromFile(const char *FileName, const char *MaterialName);
    int ParseMaterialSectionInFile(FILE *f, const char *FileName, int *LineNum);
    void GetEpsMu_Parsed(cdouble Omega, cdouble *pEps, cdouble *pMu);
+   void CompileExpressions();
 
    /***************************************************************/
    /* class data **************************************************/
@@ -129,6 +130,12 @@ class MatProp
    void *EpsExpression, *MuExpression;
    bool OwnsExpressions;
 
+   // compiled versions of the above, with w as the only argument
+   void *EpsProgram, *MuProgram;
+
+   // opaque pointer to a memo of the most recent GetEpsMu() result
+   void *opMemo;
+
    // angular frequency unit (common to all instances of MatProp)
    static double FreqUnit;
 
@@ -0,0 +1,413 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * BlockSchurMatrix.cc  -- implementation of the BlockSchurMatrix class
+ *                      -- for square block matrices whose diagonal
+ *                      -- blocks are fixed while the off-diagonal
+ *                      -- blocks change many times
+ *
+ * This is the situation for BEM matrices under a list of geometrical
+ * transformations: the diagonal blocks (T blocks) depend only on
+ * frequency, while the off-diagonal blocks (U blocks) must be
+ * recomputed for each transformation.
+ *
+ * We single out a pivot block P (the largest diagonal block) and
+ * write the matrix as
+ *
+ *      | T_P    M_PR |
+ *  M = |             |
+ *      | M_RP   M_RR |
+ *
+ * where R stands for all other blocks. Then
+ *
+ *  det M   = det T_P * det S,
+ *  S       = M_RR - M_RP * X,   X = T_P^{-1} * M_PR,
+ *
+ * and M*x=b is solved by
+ *
+ *  z_P = T_P^{-1} b_P,  x_R = S^{-1} (b_R - M_RP z_P),  x_P = z_P - X x_R.
+ *
+ * T_P is LU-factorized once in FactorizeDiagonalBlocks(); after that,
+ * LUFactorize() only forms and factorizes the Schur complement S,
+ * whose dimension is N-N_P instead of N.
+ *
+ * FactorizeDiagonalBlocks() also records log|det T| for each diagonal
+ * block, so that GetLogDet() can return log|det M / det M_infinity|,
+ * where M_infinity is the block-diagonal part of M.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+
+extern "C" {
+ #include "lapack.h"
+}
+
+#include "libhmat.h"
+
+/***************************************************************/
+/* C[CRow..CRow+M, 0..NRHS] += Alpha * op(A) * B[BRow.., 0..NRHS]*/
+/* where op(A) is MxK. all matrices must be stored unpacked.    */
+/***************************************************************/
+static void AddProduct(const char *TransA, int M, int K, int NRHS,
+                       cdouble Alpha, HMatrix *A,
+                       HMatrix *B, int BRow, HMatrix *C, int CRow)
+{
+  if (M==0 || K==0 || NRHS==0)
+   return;
+
+  int LDA=A->NR, LDB=B->NR, LDC=C->NR;
+  if (A->RealComplex==LHM_REAL)
+   { double dAlpha=real(Alpha), dOne=1.0;
+     const char *dTransA = (TransA[0]=='C') ? "T" : TransA;
+     dgemm_(dTransA, "N", &M, &NRHS, &K, &dAlpha, A->DM, &LDA,
+            B->DM + BRow, &LDB, &dOne, C->DM + CRow, &LDC);
+   }
+  else
+   { cdouble zOne=1.0;
+     zgemm_(TransA, "N", &M, &NRHS, &K, &Alpha, A->ZM, &LDA,
+            B->ZM + BRow, &LDB, &zOne, C->ZM + CRow, &LDC);
+   };
+}
+
+/***************************************************************/
+/* copy rows SrcRow..SrcRow+NumRows of the first NumCols       */
+/* columns of Src into Dest, starting at row DestRow           */
+/***************************************************************/
+static void CopyRows(HMatrix *Src, int SrcRow, HMatrix *Dest, int DestRow,
+                     int NumRows, int NumCols)
+{
+  size_t EntrySize = (Src->RealComplex==LHM_REAL) ? sizeof(double) : sizeof(cdouble);
+  char *SrcData  = (char *)(Src->RealComplex==LHM_REAL ? (void *)Src->DM : (void *)Src->ZM);
+  char *DestData = (char *)(Dest->RealComplex==LHM_REAL ? (void *)Dest->DM : (void *)Dest->ZM);
+  for(int nc=0; nc<NumCols; nc++)
+   memcpy(DestData + EntrySize*( (size_t)nc*Dest->NR + DestRow ),
+          SrcData  + EntrySize*( (size_t)nc*Src->NR  + SrcRow  ),
+          NumRows*EntrySize);
+}
+
+/***************************************************************/
+/* sum of log|U_nn| over the diagonal of an LU factorization   */
+/***************************************************************/
+static double LogAbsLUDiagonal(HMatrix *LU)
+{
+  double LogDet=0.0;
+  for(int n=0; n<LU->NR; n++)
+   LogDet += log( abs( LU->GetEntry(n,n) ) );
+  return LogDet;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+BlockSchurMatrix::BlockSchurMatrix(int pNumBlocks, int *pBlockSizes,
+                                   int pRealComplex, char pSymmetry)
+{
+  NumBlocks=pNumBlocks;
+  RealComplex=pRealComplex;
+  Symmetry=pSymmetry;
+  BlockSizes   = (int *)mallocEC(NumBlocks*sizeof(int));
+  BlockOffsets = (int *)mallocEC((NumBlocks+1)*sizeof(int));
+  BlockOffsets[0]=0;
+  PBlock=0;
+  for(int nb=0; nb<NumBlocks; nb++)
+   { BlockSizes[nb]=pBlockSizes[nb];
+     BlockOffsets[nb+1]=BlockOffsets[nb] + BlockSizes[nb];
+     if (BlockSizes[nb] > BlockSizes[PBlock])
+      PBlock=nb;
+   };
+  N=BlockOffsets[NumBlocks];
+
+  /*--------------------------------------------------------------*/
+  /*- RestOffsets[nb] = offset of block nb within the Schur       */
+  /*- complement (-1 for the pivot block)                         */
+  /*--------------------------------------------------------------*/
+  RestOffsets = (int *)mallocEC(NumBlocks*sizeof(int));
+  NRest=0;
+  for(int nb=0; nb<NumBlocks; nb++)
+   { RestOffsets[nb] = (nb==PBlock) ? -1 : NRest;
+     if (nb!=PBlock) NRest+=BlockSizes[nb];
+   };
+
+  Blocks = (HMatrix **)mallocEC(NumBlocks*NumBlocks*sizeof(HMatrix *));
+  LogDetT = (double *)mallocEC(NumBlocks*sizeof(double));
+
+  int NP=BlockSizes[PBlock];
+  TPLU = new HMatrix(NP, NP, RealComplex);
+  X    = NRest ? new HMatrix(NP, NRest, RealComplex)    : 0;
+  S    = NRest ? new HMatrix(NRest, NRest, RealComplex) : 0;
+
+  DiagonalFactorized=Factorized=false;
+}
+
+BlockSchurMatrix::~BlockSchurMatrix()
+{
+  delete TPLU;
+  if (X) delete X;
+  if (S) delete S;
+  free(Blocks);
+  free(LogDetT);
+  free(RestOffsets);
+  free(BlockSizes);
+  free(BlockOffsets);
+}
+
+/***************************************************************/
+/* install block (nba,nbb). the BlockSchurMatrix only keeps a  */
+/* pointer, so the block must remain valid (and, for diagonal  */
+/* blocks, unchanged) until the next call to SetBlock() or     */
+/* FactorizeDiagonalBlocks(). installing the same HMatrix as   */
+/* more than one diagonal block means it is factorized once.   */
+/***************************************************************/
+void BlockSchurMatrix::SetBlock(int nba, int nbb, HMatrix *M)
+{
+  if ( M->NR!=BlockSizes[nba] || M->NC!=BlockSizes[nbb] )
+   ErrExit("%s:%i: block (%i,%i) has wrong size",__FILE__,__LINE__,nba,nbb);
+  if ( M->RealComplex!=RealComplex )
+   ErrExit("%s:%i: block (%i,%i) has wrong data type",__FILE__,__LINE__,nba,nbb);
+  if ( nba!=nbb && M->StorageType!=LHM_NORMAL )
+   ErrExit("%s:%i: off-diagonal blocks must be unpacked",__FILE__,__LINE__);
+
+  Blocks[nba*NumBlocks + nbb]=M;
+  if (nba==nbb)
+   DiagonalFactorized=false;
+  Factorized=false;
+}
+
+/***************************************************************/
+/* C[CRow...] += Alpha * M_{nba,nbb} * B[BRow...], where the   */
+/* block is either installed directly or obtained from block   */
+/* (nbb,nba) via Symmetry; missing blocks are zero.            */
+/***************************************************************/
+void BlockSchurMatrix::MultiplyBlock(int nba, int nbb, cdouble Alpha,
+                                     HMatrix *B, int BRow,
+                                     HMatrix *C, int CRow, int NRHS)
+{
+  HMatrix *A=Blocks[nba*NumBlocks + nbb];
+  const char *TransA="N";
+  if (A==0 && Symmetry!='N')
+   { A=Blocks[nbb*NumBlocks + nba];
+     TransA = (Symmetry=='C') ? "C" : "T";
+   };
+  if (A==0)
+   return;
+  AddProduct(TransA, BlockSizes[nba], BlockSizes[nbb], NRHS, Alpha, A, B, BRow, C, CRow);
+}
+
+/***************************************************************/
+/* stamp M_{nba,nbb} (nba!=nbb) into Dest at the given offsets */
+/***************************************************************/
+void BlockSchurMatrix::StampBlock(int nba, int nbb, HMatrix *Dest,
+                                  int RowOffset, int ColOffset)
+{
+  HMatrix *A=Blocks[nba*NumBlocks + nbb];
+  if (A)
+   Dest->InsertBlock(A, RowOffset, ColOffset);
+  else if ( (A=Blocks[nbb*NumBlocks + nba]) && Symmetry=='T' )
+   Dest->InsertBlockTranspose(A, RowOffset, ColOffset);
+  else if ( A && Symmetry=='C' )
+   Dest->InsertBlockAdjoint(A, RowOffset, ColOffset);
+  else
+   Dest->ZeroBlock(RowOffset, BlockSizes[nba], ColOffset, BlockSizes[nbb]);
+}
+
+/***************************************************************/
+/* LU-factorize the pivot diagonal block and compute log|det T|*/
+/* for all diagonal blocks. this needs to be done only once    */
+/* for all off-diagonal blocks that go with a given set of     */
+/* diagonal blocks.                                            */
+/***************************************************************/
+int BlockSchurMatrix::FactorizeDiagonalBlocks()
+{
+  for(int nb=0; nb<NumBlocks; nb++)
+   if (Blocks[nb*NumBlocks + nb]==0)
+    ErrExit("%s:%i: diagonal block %i was never set",__FILE__,__LINE__,nb);
+
+  HMatrix *TP=Blocks[PBlock*NumBlocks + PBlock];
+  TPLU->InsertBlock(TP, 0, 0);
+  int info=TPLU->LUFactorize();
+  LogDetT[PBlock]=LogAbsLUDiagonal(TPLU);
+
+  /*--------------------------------------------------------------*/
+  /*- the other diagonal blocks are factorized only to get their  */
+  /*- determinants; the storage for the Schur complement is big   */
+  /*- enough to serve as scratch space for this                   */
+  /*--------------------------------------------------------------*/
+  for(int nb=0; nb<NumBlocks; nb++)
+   { if (nb==PBlock) continue;
+     HMatrix *T=Blocks[nb*NumBlocks + nb];
+
+     int nbMate = (T==TP) ? PBlock : -1;
+     for(int nbp=0; nbMate==-1 && nbp<nb; nbp++)
+      if (Blocks[nbp*NumBlocks + nbp]==T)
+       nbMate=nbp;
+     if (nbMate!=-1)
+      { LogDetT[nb]=LogDetT[nbMate];
+        continue;
+      };
+
+     int NB=BlockSizes[nb];
+     void *Buffer = (RealComplex==LHM_REAL) ? (void *)S->DM : (void *)S->ZM;
+     HMatrix Scratch(NB, NB, RealComplex, LHM_NORMAL, Buffer);
+     Scratch.InsertBlock(T, 0, 0);
+     int ThisInfo=Scratch.LUFactorize();
+     if (ThisInfo!=0) info=ThisInfo;
+     LogDetT[nb]=LogAbsLUDiagonal(&Scratch);
+   };
+
+  DiagonalFactorized=true;
+  Factorized=false;
+  return info;
+}
+
+/***************************************************************/
+/* form and LU-factorize the Schur complement of the pivot     */
+/* block; call this after the off-diagonal blocks change.      */
+/***************************************************************/
+int BlockSchurMatrix::LUFactorize()
+{
+  int info=0;
+  if (!DiagonalFactorized)
+   info=FactorizeDiagonalBlocks();
+
+  if (NRest==0)
+   { Factorized=true;
+     return info;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- X = T_P^{-1} M_PR -------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  for(int nb=0; nb<NumBlocks; nb++)
+   if (nb!=PBlock)
+    StampBlock(PBlock, nb, X, 0, RestOffsets[nb]);
+  TPLU->LUSolve(X);
+
+  /*--------------------------------------------------------------*/
+  /*- S = M_RR - M_RP X -------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  for(int nba=0; nba<NumBlocks; nba++)
+   { if (nba==PBlock) continue;
+     for(int nbb=0; nbb<NumBlocks; nbb++)
+      { if (nbb==PBlock) continue;
+        if (nba==nbb)
+         S->InsertBlock(Blocks[nba*NumBlocks + nba], RestOffsets[nba], RestOffsets[nba]);
+        else
+         StampBlock(nba, nbb, S, RestOffsets[nba], RestOffsets[nbb]);
+      };
+     MultiplyBlock(nba, PBlock, -1.0, X, 0, S, RestOffsets[nba], NRest);
+   };
+
+  int SInfo=S->LUFactorize();
+  Factorized=true;
+  return SInfo ? SInfo : info;
+}
+
+/***************************************************************/
+/* solve M*X = B for the first nrhs columns of X (all columns  */
+/* if nrhs<=0), overwriting X (on input, B) with the solution  */
+/***************************************************************/
+int BlockSchurMatrix::LUSolve(HMatrix *XX, int nrhs)
+{
+  if (!Factorized)
+   ErrExit("%s:%i: BlockSchurMatrix::LUSolve called before LUFactorize",__FILE__,__LINE__);
+  if (XX->NR!=N || XX->RealComplex!=RealComplex || XX->StorageType!=LHM_NORMAL)
+   ErrExit("%s:%i: dimension or data type mismatch",__FILE__,__LINE__);
+  if (nrhs<=0 || nrhs>XX->NC)
+   nrhs=XX->NC;
+
+  /*--------------------------------------------------------------*/
+  /*- z_P = T_P^{-1} b_P ------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  int NP=BlockSizes[PBlock];
+  HMatrix *ZP=new HMatrix(NP, nrhs, RealComplex);
+  CopyRows(XX, BlockOffsets[PBlock], ZP, 0, NP, nrhs);
+  int info=TPLU->LUSolve(ZP);
+
+  /*--------------------------------------------------------------*/
+  /*- x_R = S^{-1} (b_R - M_RP z_P),  x_P = z_P - X x_R -----------*/
+  /*--------------------------------------------------------------*/
+  if (NRest>0)
+   { HMatrix *YR=new HMatrix(NRest, nrhs, RealComplex);
+     for(int nb=0; nb<NumBlocks; nb++)
+      if (nb!=PBlock)
+       { CopyRows(XX, BlockOffsets[nb], YR, RestOffsets[nb], BlockSizes[nb], nrhs);
+         MultiplyBlock(nb, PBlock, -1.0, ZP, 0, YR, RestOffsets[nb], nrhs);
+       };
+     int SInfo=S->LUSolve(YR);
+     if (SInfo!=0) info=SInfo;
+
+     AddProduct("N", NP, NRest, nrhs, -1.0, X, YR, 0, ZP, 0);
+
+     for(int nb=0; nb<NumBlocks; nb++)
+      if (nb!=PBlock)
+       CopyRows(YR, RestOffsets[nb], XX, BlockOffsets[nb], BlockSizes[nb], nrhs);
+     delete YR;
+   };
+
+  CopyRows(ZP, 0, XX, BlockOffsets[PBlock], NP, nrhs);
+  delete ZP;
+  return info;
+}
+
+int BlockSchurMatrix::LUSolve(HVector *XV)
+{
+  void *Data = (RealComplex==LHM_REAL) ? (void *)XV->DV : (void *)XV->ZV;
+  HMatrix XM(N, 1, RealComplex, LHM_NORMAL, Data);
+  return LUSolve(&XM);
+}
+
+/***************************************************************/
+/* log|det M|, or log|det M| - sum_nb log|det T_nb| if         */
+/* RelativeToDiagonal is true.                                 */
+/***************************************************************/
+double BlockSchurMatrix::GetLogDet(bool RelativeToDiagonal)
+{
+  if (!Factorized)
+   ErrExit("%s:%i: BlockSchurMatrix::GetLogDet called before LUFactorize",__FILE__,__LINE__);
+
+  double LogDetS = S ? LogAbsLUDiagonal(S) : 0.0;
+  if (!RelativeToDiagonal)
+   return LogDetT[PBlock] + LogDetS;
+
+  double LogDet=LogDetS;
+  for(int nb=0; nb<NumBlocks; nb++)
+   if (nb!=PBlock)
+    LogDet-=LogDetT[nb];
+  return LogDet;
+}
+
+/***************************************************************/
+/* return Tr(M^{-1} B), where B contains the leading B->NC     */
+/* columns of an NxN matrix whose remaining columns are zero.  */
+/* on return, B is overwritten with M^{-1} B.                  */
+/***************************************************************/
+cdouble BlockSchurMatrix::GetTraceMInv(HMatrix *B)
+{
+  LUSolve(B);
+  cdouble Trace=0.0;
+  for(int n=0; n<B->NC && n<N; n++)
+   Trace+=B->GetEntry(n,n);
+  return Trace;
+}
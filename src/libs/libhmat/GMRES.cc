@@ -0,0 +1,233 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * GMRES.cc -- restarted GMRES iterative solver for complex linear
+ *          -- systems defined by a user-supplied matrix-vector
+ *          -- product, with optional right preconditioning
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+
+#include "libhmat.h"
+
+/***************************************************************/
+/* helper routines for complex vectors *************************/
+/***************************************************************/
+static cdouble VecDot(int N, cdouble *X, cdouble *Y)
+{ cdouble Sum=0.0;
+  for(int n=0; n<N; n++)
+   Sum+=conj(X[n])*Y[n];
+  return Sum;
+}
+
+static double VecNorm(int N, cdouble *X)
+{ double Sum=0.0;
+  for(int n=0; n<N; n++)
+   Sum+=norm(X[n]);
+  return sqrt(Sum);
+}
+
+/***************************************************************/
+/* solve M*X = B by restarted GMRES(Restart).                  */
+/*                                                             */
+/* MatVec(X, Y, MatVecData) must compute Y = M*X.              */
+/*                                                             */
+/* If Precond is non-NULL, Precond(X, Y, PrecondData) must     */
+/* compute Y = P^{-1}*X for a preconditioner P ~ M; the        */
+/* preconditioner is applied on the right, so the residual     */
+/* that is monitored is the true residual |B-M*X|.             */
+/*                                                             */
+/* On entry X is the initial guess; on return it is the        */
+/* solution. Iteration stops when |B-M*X| < Tol*|B| or after   */
+/* MaxIter matrix-vector products.                             */
+/*                                                             */
+/* The return value is the number of iterations performed,     */
+/* or -1 if the iteration did not converge. If Residual is     */
+/* non-NULL it is set to the final relative residual.          */
+/***************************************************************/
+int GMRES(HVector *B, HVector *X,
+          GMRESMatVecFunction MatVec, void *MatVecData,
+          GMRESMatVecFunction Precond, void *PrecondData,
+          double Tol, int MaxIter, int Restart, double *Residual)
+{
+  if (B->RealComplex!=LHM_COMPLEX || X->RealComplex!=LHM_COMPLEX)
+   ErrExit("%s:%i: GMRES requires complex vectors",__FILE__,__LINE__);
+  if (B->N != X->N)
+   ErrExit("%s:%i: dimension mismatch in GMRES",__FILE__,__LINE__);
+
+  int N=B->N;
+  if (Restart<=0 || Restart>N) Restart=N;
+  if (MaxIter<=0) MaxIter=N;
+
+  /*--------------------------------------------------------------*/
+  /*- V[0..Restart] are the Krylov basis vectors, each wrapped in -*/
+  /*- an HVector so they can be passed to the user's routines;    -*/
+  /*- H is the (Restart+1)xRestart Hessenberg matrix, stored      -*/
+  /*- column-major, and CS, SN are the Givens rotations that      -*/
+  /*- reduce it to upper-triangular form                          -*/
+  /*--------------------------------------------------------------*/
+  cdouble *VBuffer=(cdouble *)mallocEC((Restart+1)*N*sizeof(cdouble));
+  HVector **V=(HVector **)mallocEC((Restart+1)*sizeof(HVector *));
+  for(int m=0; m<=Restart; m++)
+   V[m]=new HVector(N, LHM_COMPLEX, VBuffer + m*N);
+
+  HVector *W  = new HVector(N, LHM_COMPLEX);
+  HVector *PV = Precond ? new HVector(N, LHM_COMPLEX) : 0;
+
+  cdouble *H  = (cdouble *)mallocEC((Restart+1)*Restart*sizeof(cdouble));
+  cdouble *CS = (cdouble *)mallocEC(Restart*sizeof(cdouble));
+  cdouble *SN = (cdouble *)mallocEC(Restart*sizeof(cdouble));
+  cdouble *G  = (cdouble *)mallocEC((Restart+1)*sizeof(cdouble));
+  cdouble *Y  = (cdouble *)mallocEC(Restart*sizeof(cdouble));
+#define HH(i,j) H[(i) + (j)*(Restart+1)]
+
+  double BNorm=VecNorm(N, B->ZV);
+  if (BNorm==0.0)
+   { X->Zero();
+     if (Residual) *Residual=0.0;
+     BNorm=1.0; // skip the iteration below
+   };
+
+  int NumIters=0;
+  double RelRes=1.0;
+  bool Converged=false;
+  while(!Converged && NumIters<MaxIter)
+   {
+     /*--------------------------------------------------------------*/
+     /*- V[0] = (B - M*X) / |B - M*X|                               -*/
+     /*--------------------------------------------------------------*/
+     MatVec(X, V[0], MatVecData);
+     for(int n=0; n<N; n++)
+      V[0]->ZV[n] = B->ZV[n] - V[0]->ZV[n];
+     double Beta=VecNorm(N, V[0]->ZV);
+     RelRes=Beta/BNorm;
+     if (RelRes<Tol)
+      { Converged=true;
+        break;
+      };
+     for(int n=0; n<N; n++)
+      V[0]->ZV[n]/=Beta;
+     for(int k=0; k<=Restart; k++)
+      G[k]=0.0;
+     G[0]=Beta;
+
+     /*--------------------------------------------------------------*/
+     /*- Arnoldi process with modified Gram-Schmidt                 -*/
+     /*--------------------------------------------------------------*/
+     int m;
+     for(m=0; m<Restart && NumIters<MaxIter; m++)
+      {
+        NumIters++;
+        if (Precond)
+         { Precond(V[m], PV, PrecondData);
+           MatVec(PV, W, MatVecData);
+         }
+        else
+         MatVec(V[m], W, MatVecData);
+
+        for(int k=0; k<=m; k++)
+         { HH(k,m) = VecDot(N, V[k]->ZV, W->ZV);
+           for(int n=0; n<N; n++)
+            W->ZV[n] -= HH(k,m)*V[k]->ZV[n];
+         };
+        double WNorm=VecNorm(N, W->ZV);
+        HH(m+1,m)=WNorm;
+        if (WNorm!=0.0)
+         for(int n=0; n<N; n++)
+          V[m+1]->ZV[n] = W->ZV[n] / WNorm;
+
+        // apply previous Givens rotations to the new column
+        for(int k=0; k<m; k++)
+         { cdouble T = CS[k]*HH(k,m) + SN[k]*HH(k+1,m);
+           HH(k+1,m) = -conj(SN[k])*HH(k,m) + conj(CS[k])*HH(k+1,m);
+           HH(k,m)   = T;
+         };
+
+        // compute and apply a new rotation to zero out HH(m+1,m)
+        double Den=sqrt( norm(HH(m,m)) + norm(HH(m+1,m)) );
+        if (Den==0.0)
+         { CS[m]=1.0; SN[m]=0.0; }
+        else
+         { CS[m] = conj(HH(m,m)) / Den;
+           SN[m] = conj(HH(m+1,m)) / Den;
+         };
+        HH(m,m)   = CS[m]*HH(m,m) + SN[m]*HH(m+1,m);
+        HH(m+1,m) = 0.0;
+        G[m+1]    = -conj(SN[m])*G[m];
+        G[m]      = CS[m]*G[m];
+
+        RelRes=abs(G[m+1])/BNorm;
+        if (RelRes<Tol || WNorm==0.0)
+         { m++;
+           Converged=true;
+           break;
+         };
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- solve the triangular system for the update coefficients    -*/
+     /*- and add the update to X                                    -*/
+     /*--------------------------------------------------------------*/
+     for(int k=m-1; k>=0; k--)
+      { Y[k]=G[k];
+        for(int l=k+1; l<m; l++)
+         Y[k]-=HH(k,l)*Y[l];
+        Y[k]/=HH(k,k);
+      };
+     for(int n=0; n<N; n++)
+      W->ZV[n]=0.0;
+     for(int k=0; k<m; k++)
+      for(int n=0; n<N; n++)
+       W->ZV[n] += Y[k]*V[k]->ZV[n];
+     if (Precond)
+      { Precond(W, PV, PrecondData);
+        for(int n=0; n<N; n++)
+         X->ZV[n]+=PV->ZV[n];
+      }
+     else
+      for(int n=0; n<N; n++)
+       X->ZV[n]+=W->ZV[n];
+
+     Log(" GMRES: %i iterations, relative residual %.2e",NumIters,RelRes);
+   };
+#undef HH
+
+  if (Residual) *Residual=RelRes;
+
+  free(Y);
+  free(G);
+  free(SN);
+  free(CS);
+  free(H);
+  if (PV) delete PV;
+  delete W;
+  for(int m=0; m<=Restart; m++)
+   delete V[m];
+  free(V);
+  free(VBuffer);
+
+  return Converged ? NumIters : -1;
+}
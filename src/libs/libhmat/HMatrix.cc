@@ -82,6 +82,8 @@ void HMatrix::InitHMatrix(int NRows, int NCols, int pRealComplex,
    RealComplex=pRealComplex;
    StorageType=pStorageType;
    ipiv=0;
+   LDLFactored=false;
+   SPLU=0;
    lwork=0;
    work=0;
    liwork=0;
@@ -163,6 +165,8 @@ void HMatrix::ReadFromFile(const char *FileName, int FileType, const char *Optio
   DM=0;
   ZM=0;
   ipiv=0;
+  LDLFactored=false;
+  SPLU=0;
   lwork=0;
   work=0;
   liwork=0;
@@ -209,6 +213,8 @@ HMatrix::HMatrix(SMatrix *S)
    RealComplex=S->RealComplex;
    StorageType=LHM_NORMAL;
    ipiv=0;
+   LDLFactored=false;
+   SPLU=0;
    lwork=0;
    work=0;
    liwork=0;
@@ -258,6 +264,7 @@ HMatrix::~HMatrix()
     if (ZM) free(ZM);
   }
   if (ipiv) free(ipiv);
+  if (SPLU) free(SPLU);
   if (ErrMsg) free(ErrMsg);
   if (work) free(work);
 }
@@ -280,11 +287,22 @@ void HMatrix::Zero()
 void HMatrix::ZeroBlock(int RowOffset, int NumRows, int ColOffset, int NumCols)
 { 
   if (RowOffset==0 && NumRows==NR && ColOffset==0 && NumCols==NC)
-   Zero();
+   { Zero();
+     return;
+   };
 
   if ( RowOffset < 0 || (RowOffset+NumRows)>NR || ColOffset<0 || (ColOffset+NumCols)>NC )
    ErrExit("invalid call to HMatrix(%i,%i)::ZeroBlock(%i,%i,%i,%i)",NR,NC,RowOffset,NumRows,ColOffset,NumCols);
 
+  if (StorageType==LHM_NORMAL)
+   { size_t EntrySize = (RealComplex==LHM_REAL) ? sizeof(double) : sizeof(cdouble);
+     for(size_t nc=ColOffset; nc<(size_t)(ColOffset+NumCols); nc++)
+      { char *Col = (char *)(RealComplex==LHM_REAL ? (void *)DM : (void *)ZM);
+        memset(Col + (nc*NR + RowOffset)*EntrySize, 0, NumRows*EntrySize);
+      };
+     return;
+   };
+
   size_t nr, nc;
   for(nr=RowOffset; nr<(RowOffset+NumRows); nr++)
    for(nc=ColOffset; nc<(ColOffset+NumCols); nc++)
@@ -292,6 +310,39 @@ void HMatrix::ZeroBlock(int RowOffset, int NumRows, int ColOffset, int NumCols)
 
 }
 
+/***************************************************************/
+/* copy the upper triangle of a diagonal block into its lower  */
+/* triangle. the copy proceeds in square tiles so that both    */
+/* the source (traversed by rows) and the destination          */
+/* (traversed by columns) stay in cache.                       */
+/***************************************************************/
+#define CUTL_TILE 64
+void HMatrix::CopyUpperToLower(int Offset, int Size)
+{
+  if (StorageType!=LHM_NORMAL)
+   return;
+  if (Size<0)
+   Size=NR-Offset;
+  if ( Offset<0 || (Offset+Size)>NR || (Offset+Size)>NC )
+   ErrExit("invalid call to HMatrix(%i,%i)::CopyUpperToLower(%i,%i)",NR,NC,Offset,Size);
+
+  size_t LD=NR;
+  for(int nr0=0; nr0<Size; nr0+=CUTL_TILE)
+   for(int nc0=0; nc0<=nr0; nc0+=CUTL_TILE)
+    { int nr1 = (nr0+CUTL_TILE < Size) ? nr0+CUTL_TILE : Size;
+      int nc1 = (nc0+CUTL_TILE < Size) ? nc0+CUTL_TILE : Size;
+      for(int nc=nc0; nc<nc1; nc++)
+       for(int nr=(nr0>nc+1 ? nr0 : nc+1); nr<nr1; nr++)
+        { size_t iLower = (Offset+nr) + (Offset+nc)*LD;
+          size_t iUpper = (Offset+nc) + (Offset+nr)*LD;
+          if (RealComplex==LHM_REAL)
+           DM[iLower] = DM[iUpper];
+          else
+           ZM[iLower] = ZM[iUpper];
+        };
+    };
+}
+
 /***************************************************************/
 /* copy data from another matrix. ******************************/
 /* note that this copies the data (and makes sure the numbers  */
@@ -767,6 +818,69 @@ void HMatrix::AddBlock(SMatrix *B, int RowOffset, int ColOffset,
 
 }
 
+/***************************************************************/
+/* scatter-add a dense block of entries into the matrix.       */
+/*                                                             */
+/* Block is an NRB x NCB array stored in column-major order    */
+/* with leading dimension LDB; entry (i,j) of the block is     */
+/* added to entry (RowIndices[i], ColIndices[j]) of the matrix.*/
+/*                                                             */
+/* the result is the same as that of NRB*NCB calls to          */
+/* AddEntry, but the storage-type and real/complex tests are   */
+/* done once per block instead of once per entry.              */
+/*                                                             */
+/* if Fold==true, entries that would land below the diagonal   */
+/* are added at the transposed position instead; this is       */
+/* useful for assembling only the upper triangle of a          */
+/* symmetric matrix stored in LHM_NORMAL format. (for packed   */
+/* storage this happens automatically.)                        */
+/***************************************************************/
+void HMatrix::AddBlock(cdouble *Block, int NRB, int NCB, int LDB,
+                       int *RowIndices, int *ColIndices, bool Fold)
+{
+  if (LDB<NRB)
+   ErrExit("AddBlock(): invalid leading dimension %i<%i",LDB,NRB);
+
+  if (StorageType==LHM_NORMAL && Fold==false)
+   { if (RealComplex==LHM_REAL)
+      { for(int j=0; j<NCB; j++)
+         { double *Col = DM + ((size_t)ColIndices[j])*NR;
+           cdouble *BCol = Block + ((size_t)j)*LDB;
+           for(int i=0; i<NRB; i++)
+            Col[RowIndices[i]] += real(BCol[i]);
+         };
+      }
+     else
+      { for(int j=0; j<NCB; j++)
+         { cdouble *Col = ZM + ((size_t)ColIndices[j])*NR;
+           cdouble *BCol = Block + ((size_t)j)*LDB;
+           for(int i=0; i<NRB; i++)
+            Col[RowIndices[i]] += BCol[i];
+         };
+      };
+     return;
+   };
+
+  // upper-triangle-only cases: LHM_NORMAL with folding, or packed
+  bool Packed    = (StorageType!=LHM_NORMAL);
+  bool Hermitian = (StorageType==LHM_HERMITIAN);
+  for(int j=0; j<NCB; j++)
+   for(int i=0; i<NRB; i++)
+    {
+      size_t nr=RowIndices[i], nc=ColIndices[j];
+      cdouble Entry=Block[i + ((size_t)j)*LDB];
+      if (nr>nc)
+       { size_t Temp=nr; nr=nc; nc=Temp;
+         if (Hermitian) Entry=conj(Entry);
+       };
+      size_t Index = Packed ? (nr + nc*(nc+1)/2) : (nr + nc*NR);
+      if (RealComplex==LHM_REAL)
+       DM[Index] += real(Entry);
+      else
+       ZM[Index] += Entry;
+    };
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
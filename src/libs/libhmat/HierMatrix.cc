@@ -0,0 +1,767 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * HierMatrix.cc  -- implementation of the HierMatrix class for
+ *                -- hierarchical matrices (H-matrices) with
+ *                -- low-rank admissible blocks, including H-LU
+ *                -- factorization and solve
+ *
+ * Overview:
+ *
+ *  (1) A binary cluster tree is built over a set of points (for BEM
+ *      matrices, the centroids of RWG edges) by recursive bisection
+ *      along the longest bounding-box axis. Each point owns one or
+ *      more consecutive degrees of freedom (DOFs), and the tree
+ *      defines a permuted DOF ordering in which every cluster is a
+ *      contiguous index range.
+ *
+ *  (2) The block tree pairs row and column clusters. A pair is
+ *      admissible if min(diam1, diam2) <= Eta * dist(1,2); admissible
+ *      blocks are stored in low-rank form (LRMatrix), inadmissible
+ *      blocks are subdivided until one of the clusters is a leaf,
+ *      at which point they are stored densely.
+ *
+ *  (3) Assemble() fills dense leaves directly and low-rank leaves by
+ *      ACA, fetching matrix entries through a user-supplied callback.
+ *
+ *  (4) LUFactorize() computes the H-LU factorization recursively on
+ *      the 2x2 block structure:
+ *         A00 = L00*U00, A01 <- L00^{-1}*A01, A10 <- A10*U00^{-1},
+ *         A11 <- A11 - A10*A01,  A11 = L11*U11,
+ *      with the products truncated to tolerance Tol. Dense leaves on
+ *      the diagonal are factorized by LAPACK with partial pivoting
+ *      inside the leaf.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include <libhrutil.h>
+
+extern "C" {
+ #include "lapack.h"
+}
+
+#include "libhmat.h"
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
+#define HBLOCK_DENSE      0
+#define HBLOCK_LOWRANK    1
+#define HBLOCK_SUBDIVIDED 2
+
+/***************************************************************/
+/* cluster-tree construction ***********************************/
+/***************************************************************/
+typedef struct PointComparator
+ { double *Points;
+   int Axis;
+   bool operator()(int p1, int p2) const
+    { return Points[3*p1+Axis] < Points[3*p2+Axis]; }
+ } PointComparator;
+
+int HierMatrix::BuildCluster(int *PointOrder, int pStart, int pEnd,
+                             int DOFStart, double *Points, double *Radii,
+                             int *DOFOffsets)
+{
+  int nc = NumClusters++;
+  HCluster *C = Clusters + nc;
+
+  C->Start=DOFStart;
+  C->Size=0;
+  for(int i=0; i<3; i++)
+   { C->BBMin[i]=HUGE_VAL;
+     C->BBMax[i]=-HUGE_VAL;
+   };
+  for(int p=pStart; p<pEnd; p++)
+   { int np=PointOrder[p];
+     double R = Radii ? Radii[np] : 0.0;
+     for(int i=0; i<3; i++)
+      { C->BBMin[i] = fmin(C->BBMin[i], Points[3*np+i]-R);
+        C->BBMax[i] = fmax(C->BBMax[i], Points[3*np+i]+R);
+      };
+     C->Size += DOFOffsets ? DOFOffsets[np+1]-DOFOffsets[np] : 1;
+   };
+  C->Children[0]=C->Children[1]=-1;
+
+  if ( C->Size<=LeafSize || (pEnd-pStart)<2 )
+   return nc;
+
+  /*--------------------------------------------------------------*/
+  /*- split at the median along the longest bounding-box axis     */
+  /*--------------------------------------------------------------*/
+  PointComparator PC;
+  PC.Points=Points;
+  PC.Axis=0;
+  for(int i=1; i<3; i++)
+   if ( (C->BBMax[i]-C->BBMin[i]) > (C->BBMax[PC.Axis]-C->BBMin[PC.Axis]) )
+    PC.Axis=i;
+  int pMid = (pStart+pEnd)/2;
+  std::nth_element(PointOrder+pStart, PointOrder+pMid, PointOrder+pEnd, PC);
+
+  int DOFMid=DOFStart;
+  for(int p=pStart; p<pMid; p++)
+   DOFMid += DOFOffsets ? DOFOffsets[PointOrder[p]+1]-DOFOffsets[PointOrder[p]] : 1;
+
+  // note: Clusters[nc] must be re-fetched after each recursive call
+  // because C is a pointer into an array that is being filled in
+  int Child0=BuildCluster(PointOrder, pStart, pMid, DOFStart, Points, Radii, DOFOffsets);
+  int Child1=BuildCluster(PointOrder, pMid, pEnd, DOFMid, Points, Radii, DOFOffsets);
+  Clusters[nc].Children[0]=Child0;
+  Clusters[nc].Children[1]=Child1;
+  return nc;
+}
+
+/***************************************************************/
+/* block-tree construction *************************************/
+/***************************************************************/
+static double ClusterDiameter(HCluster *C)
+{
+  double D2=0.0;
+  for(int i=0; i<3; i++)
+   D2 += (C->BBMax[i]-C->BBMin[i])*(C->BBMax[i]-C->BBMin[i]);
+  return sqrt(D2);
+}
+
+static double ClusterDistance(HCluster *C1, HCluster *C2)
+{
+  double D2=0.0;
+  for(int i=0; i<3; i++)
+   { double Gap=fmax(C2->BBMin[i]-C1->BBMax[i], C1->BBMin[i]-C2->BBMax[i]);
+     if (Gap>0.0) D2+=Gap*Gap;
+   };
+  return sqrt(D2);
+}
+
+static HBlock *NewHBlock(int RowStart, int NR, int ColStart, int NC, int Type)
+{
+  HBlock *B=(HBlock *)mallocEC(sizeof(HBlock));
+  B->RowStart=RowStart;
+  B->NR=NR;
+  B->ColStart=ColStart;
+  B->NC=NC;
+  B->Type=Type;
+  return B;
+}
+
+static void DestroyHBlock(HBlock *B)
+{
+  if (B==0) return;
+  if (B->D) delete B->D;
+  if (B->L) delete B->L;
+  for(int n=0; n<4; n++)
+   DestroyHBlock(B->Children[n]);
+  free(B);
+}
+
+HBlock *HierMatrix::BuildBlock(int RowCluster, int ColCluster)
+{
+  HCluster *RC=Clusters + RowCluster, *CC=Clusters + ColCluster;
+  HBlock *B;
+
+  double Dist=ClusterDistance(RC, CC);
+  if ( Dist>0.0 && fmin(ClusterDiameter(RC), ClusterDiameter(CC)) <= Eta*Dist )
+   B=NewHBlock(RC->Start, RC->Size, CC->Start, CC->Size, HBLOCK_LOWRANK);
+  else if ( RC->Children[0]==-1 || CC->Children[0]==-1 )
+   B=NewHBlock(RC->Start, RC->Size, CC->Start, CC->Size, HBLOCK_DENSE);
+  else
+   { B=NewHBlock(RC->Start, RC->Size, CC->Start, CC->Size, HBLOCK_SUBDIVIDED);
+     for(int i=0; i<2; i++)
+      for(int j=0; j<2; j++)
+       B->Children[2*i+j]=BuildBlock(RC->Children[i], CC->Children[j]);
+     return B;
+   };
+
+  NumLeaves++;
+  return B;
+}
+
+static void CollectLeaves(HBlock *B, HBlock **Leaves, int *NumLeaves)
+{
+  if (B->Type==HBLOCK_SUBDIVIDED)
+   for(int n=0; n<4; n++)
+    CollectLeaves(B->Children[n], Leaves, NumLeaves);
+  else
+   Leaves[(*NumLeaves)++]=B;
+}
+
+/***************************************************************/
+/* HierMatrix constructor: build the cluster tree over         */
+/* NumPoints points, where point #np has coordinates           */
+/* Points[3*np + (0,1,2)], radius Radii[np] (Radii may be NULL */
+/* for point-like supports), and owns the DOFs with indices    */
+/* DOFOffsets[np] ... DOFOffsets[np+1]-1 (DOFOffsets may be    */
+/* NULL if each point owns a single DOF); then build the block */
+/* tree with admissibility parameter Eta.                      */
+/***************************************************************/
+HierMatrix::HierMatrix(int NumPoints, double *Points, double *Radii,
+                       int *DOFOffsets, int pLeafSize, double pEta)
+{
+  LeafSize = pLeafSize;
+  Eta = pEta;
+  Tol = 1.0e-6;
+  Factorized = false;
+
+  N = DOFOffsets ? DOFOffsets[NumPoints] : NumPoints;
+
+  int *PointOrder = (int *)mallocEC(NumPoints*sizeof(int));
+  for(int np=0; np<NumPoints; np++)
+   PointOrder[np]=np;
+
+  Clusters = (HCluster *)mallocEC(2*NumPoints*sizeof(HCluster));
+  NumClusters=0;
+  BuildCluster(PointOrder, 0, NumPoints, 0, Points, Radii, DOFOffsets);
+
+  Perm = (int *)mallocEC(N*sizeof(int));
+  for(int p=0, n=0; p<NumPoints; p++)
+   { int np=PointOrder[p];
+     int Start = DOFOffsets ? DOFOffsets[np]   : np;
+     int End   = DOFOffsets ? DOFOffsets[np+1] : np+1;
+     for(int nd=Start; nd<End; nd++)
+      Perm[n++]=nd;
+   };
+  free(PointOrder);
+
+  NumLeaves=0;
+  Root=BuildBlock(0,0);
+  Leaves=(HBlock **)mallocEC(NumLeaves*sizeof(HBlock *));
+  int nl=0;
+  CollectLeaves(Root, Leaves, &nl);
+}
+
+HierMatrix::~HierMatrix()
+{
+  DestroyHBlock(Root);
+  free(Leaves);
+  free(Clusters);
+  free(Perm);
+}
+
+/***************************************************************/
+/* number of cdoubles stored in all leaves                     */
+/***************************************************************/
+size_t HierMatrix::GetStorage()
+{
+  size_t Storage=0;
+  for(int nl=0; nl<NumLeaves; nl++)
+   { HBlock *B=Leaves[nl];
+     if (B->Type==HBLOCK_DENSE)
+      Storage += ((size_t)B->NR)*B->NC;
+     else if (B->L)
+      Storage += ((size_t)B->L->Rank)*(B->NR + B->NC);
+   };
+  return Storage;
+}
+
+int HierMatrix::GetMaxRank()
+{
+  int MaxRank=0;
+  for(int nl=0; nl<NumLeaves; nl++)
+   if (Leaves[nl]->Type==HBLOCK_LOWRANK && Leaves[nl]->L)
+    MaxRank = (Leaves[nl]->L->Rank > MaxRank) ? Leaves[nl]->L->Rank : MaxRank;
+  return MaxRank;
+}
+
+/***************************************************************/
+/* matrix assembly *********************************************/
+/***************************************************************/
+typedef struct LeafFetchData
+ { HBlockFetchFunction GetBlock;
+   void *UserData;
+   int NR, NC;
+   int *Rows, *Cols;
+ } LeafFetchData;
+
+static void GetLeafRow(void *UserData, int nr, cdouble *Row)
+{ LeafFetchData *Data=(LeafFetchData *)UserData;
+  Data->GetBlock(Data->UserData, 1, Data->Rows + nr, Data->NC, Data->Cols, Row);
+}
+
+static void GetLeafColumn(void *UserData, int nc, cdouble *Column)
+{ LeafFetchData *Data=(LeafFetchData *)UserData;
+  Data->GetBlock(Data->UserData, Data->NR, Data->Rows, 1, Data->Cols + nc, Column);
+}
+
+/***************************************************************/
+/* (re)compute all leaves of the matrix. GetBlock is called    */
+/* (possibly from several threads at once) with lists of       */
+/* (original, unpermuted) row and column indices and must fill */
+/* in the corresponding entries as a column-major array.       */
+/* low-rank leaves are computed by ACA to relative accuracy    */
+/* pTol, which is also the truncation tolerance used in the    */
+/* subsequent H-LU factorization; leaves for which ACA does    */
+/* not converge are stored densely.                            */
+/***************************************************************/
+void HierMatrix::Assemble(HBlockFetchFunction GetBlock, void *UserData, double pTol)
+{
+  Tol=pTol;
+  Factorized=false;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(GetNumThreads())
+#endif
+  for(int nl=0; nl<NumLeaves; nl++)
+   {
+     HBlock *B=Leaves[nl];
+     if (B->D) { delete B->D; B->D=0; }
+     if (B->L) { delete B->L; B->L=0; }
+
+     if (B->Type==HBLOCK_LOWRANK)
+      { LeafFetchData MyData, *Data=&MyData;
+        Data->GetBlock=GetBlock;
+        Data->UserData=UserData;
+        Data->NR=B->NR;
+        Data->NC=B->NC;
+        Data->Rows=Perm + B->RowStart;
+        Data->Cols=Perm + B->ColStart;
+        int MaxRank = (B->NR*B->NC) / (B->NR + B->NC);
+        B->L=ACA(B->NR, B->NC, GetLeafRow, GetLeafColumn, (void *)Data, Tol, MaxRank);
+        if (B->L)
+         continue;
+        B->Type=HBLOCK_DENSE; // ACA failed; fall back to dense storage
+      };
+
+     B->D=new HMatrix(B->NR, B->NC, LHM_COMPLEX);
+     GetBlock(UserData, B->NR, Perm + B->RowStart, B->NC, Perm + B->ColStart, B->D->ZM);
+   };
+}
+
+/***************************************************************/
+/* Y += Alpha * op(B) * X, where op(B) is B (Trans=='N') or    */
+/* its adjoint (Trans=='C'). X, Y are column-major arrays with */
+/* NRHS columns whose first rows correspond to the first       */
+/* column (row) of B for Trans=='N' ('C').                     */
+/***************************************************************/
+static void HBlockMultiply(HBlock *B, char Trans, cdouble Alpha,
+                           cdouble *X, int LDX, cdouble *Y, int LDY, int NRHS)
+{
+  cdouble zOne=1.0, zZero=0.0;
+  char TransStr[2]={Trans, 0};
+  int NR=B->NR, NC=B->NC;
+
+  if (B->Type==HBLOCK_SUBDIVIDED)
+   { for(int n=0; n<4; n++)
+      { HBlock *C=B->Children[n];
+        int RowOffset=C->RowStart - B->RowStart;
+        int ColOffset=C->ColStart - B->ColStart;
+        if (Trans=='N')
+         HBlockMultiply(C, Trans, Alpha, X+ColOffset, LDX, Y+RowOffset, LDY, NRHS);
+        else
+         HBlockMultiply(C, Trans, Alpha, X+RowOffset, LDX, Y+ColOffset, LDY, NRHS);
+      };
+   }
+  else if (B->Type==HBLOCK_DENSE)
+   { int K = (Trans=='N') ? NC : NR;
+     int M = (Trans=='N') ? NR : NC;
+     zgemm_(TransStr, "N", &M, &NRHS, &K, &Alpha, B->D->ZM, &NR, X, &LDX, &zOne, Y, &LDY);
+   }
+  else if (B->L && B->L->Rank>0)
+   { // U*V' * X = U * (V'*X),   (U*V')' * X = V * (U'*X)
+     int Rank=B->L->Rank;
+     cdouble *T=(cdouble *)mallocEC(Rank*NRHS*sizeof(cdouble));
+     cdouble *U=B->L->A->ZM, *V=B->L->B->ZM;
+     if (Trans=='N')
+      { zgemm_("C", "N", &Rank, &NRHS, &NC, &zOne, V, &NC, X, &LDX, &zZero, T, &Rank);
+        zgemm_("N", "N", &NR, &NRHS, &Rank, &Alpha, U, &NR, T, &Rank, &zOne, Y, &LDY);
+      }
+     else
+      { zgemm_("C", "N", &Rank, &NRHS, &NR, &zOne, U, &NR, X, &LDX, &zZero, T, &Rank);
+        zgemm_("N", "N", &NC, &NRHS, &Rank, &Alpha, V, &NC, T, &Rank, &zOne, Y, &LDY);
+      };
+     free(T);
+   };
+}
+
+/***************************************************************/
+/* C += U*V', where U is C->NR x K and V is C->NC x K, with    */
+/* truncation of low-rank blocks to tolerance Tol              */
+/***************************************************************/
+static void HBlockAddLowRank(HBlock *C, cdouble *U, int LDU, cdouble *V, int LDV,
+                             int K, double Tol)
+{
+  if (K==0)
+   return;
+
+  int NR=C->NR, NC=C->NC;
+  if (C->Type==HBLOCK_SUBDIVIDED)
+   { for(int n=0; n<4; n++)
+      { HBlock *CC=C->Children[n];
+        HBlockAddLowRank(CC, U + (CC->RowStart-C->RowStart), LDU,
+                             V + (CC->ColStart-C->ColStart), LDV, K, Tol);
+      };
+   }
+  else if (C->Type==HBLOCK_DENSE)
+   { cdouble zOne=1.0;
+     zgemm_("N", "C", &NR, &NC, &K, &zOne, U, &LDU, V, &LDV, &zOne, C->D->ZM, &NR);
+   }
+  else
+   { if (C->L==0)
+      C->L=new LRMatrix(NR, NC, 0);
+     int OldRank=C->L->Rank;
+     C->L->SetRank(OldRank + K);
+     for(int k=0; k<K; k++)
+      { memcpy(C->L->A->ZM + (OldRank+k)*NR, U + k*LDU, NR*sizeof(cdouble));
+        memcpy(C->L->B->ZM + (OldRank+k)*NC, V + k*LDV, NC*sizeof(cdouble));
+      };
+     C->L->Recompress(Tol);
+   };
+}
+
+/***************************************************************/
+/* the (i,j) child of a subdivided block                       */
+/***************************************************************/
+#define CHILD(B,i,j) ((B)->Children[2*(i)+(j)])
+
+/***************************************************************/
+/* C += Alpha * A * B with truncation to tolerance Tol.        */
+/* the row cluster of C is that of A, the column cluster of C  */
+/* is that of B, and the column cluster of A is the row        */
+/* cluster of B.                                               */
+/***************************************************************/
+static void HBlockMulAdd(HBlock *C, cdouble Alpha, HBlock *A, HBlock *B, double Tol)
+{
+  int NRA=A->NR, K=A->NC, NCB=B->NC;
+
+  /*--------------------------------------------------------------*/
+  /*- if A or B is a leaf, the product has low rank: write it as  */
+  /*- U*V' and add it to C                                        */
+  /*--------------------------------------------------------------*/
+  if (A->Type!=HBLOCK_SUBDIVIDED || B->Type!=HBLOCK_SUBDIVIDED)
+   {
+     cdouble *U=0, *V=0;
+     int Rank=0;
+     cdouble Alphas = conj(Alpha); // V' carries the conjugate
+
+     if (A->Type==HBLOCK_LOWRANK)
+      { // A*B = UA * (B'*VA)'
+        if (A->L==0 || A->L->Rank==0) return;
+        Rank=A->L->Rank;
+        U=(cdouble *)mallocEC(NRA*Rank*sizeof(cdouble));
+        V=(cdouble *)mallocEC(NCB*Rank*sizeof(cdouble));
+        memcpy(U, A->L->A->ZM, NRA*Rank*sizeof(cdouble));
+        HBlockMultiply(B, 'C', Alphas, A->L->B->ZM, K, V, NCB, Rank);
+      }
+     else if (B->Type==HBLOCK_LOWRANK)
+      { // A*B = (A*UB) * VB'
+        if (B->L==0 || B->L->Rank==0) return;
+        Rank=B->L->Rank;
+        U=(cdouble *)mallocEC(NRA*Rank*sizeof(cdouble));
+        V=(cdouble *)mallocEC(NCB*Rank*sizeof(cdouble));
+        HBlockMultiply(A, 'N', Alpha, B->L->A->ZM, K, U, NRA, Rank);
+        memcpy(V, B->L->B->ZM, NCB*Rank*sizeof(cdouble));
+      }
+     else if (A->Type==HBLOCK_DENSE)
+      { if (K<=NRA)
+         { // A*B = A * (B'*I)'
+           Rank=K;
+           U=(cdouble *)mallocEC(NRA*Rank*sizeof(cdouble));
+           V=(cdouble *)mallocEC(NCB*Rank*sizeof(cdouble));
+           for(int n=0; n<NRA*K; n++) U[n]=Alpha*A->D->ZM[n];
+           cdouble *I=(cdouble *)mallocEC(K*K*sizeof(cdouble));
+           for(int k=0; k<K; k++) I[k+k*K]=1.0;
+           HBlockMultiply(B, 'C', 1.0, I, K, V, NCB, K);
+           free(I);
+         }
+        else
+         { // A*B = I * (B'*A')'
+           Rank=NRA;
+           U=(cdouble *)mallocEC(NRA*Rank*sizeof(cdouble));
+           V=(cdouble *)mallocEC(NCB*Rank*sizeof(cdouble));
+           for(int k=0; k<NRA; k++) U[k+k*NRA]=1.0;
+           cdouble *AH=(cdouble *)mallocEC(K*NRA*sizeof(cdouble));
+           for(int nr=0; nr<NRA; nr++)
+            for(int nc=0; nc<K; nc++)
+             AH[nc + nr*K] = conj(A->D->ZM[nr + nc*NRA]);
+           HBlockMultiply(B, 'C', Alphas, AH, K, V, NCB, NRA);
+           free(AH);
+         };
+      }
+     else // B->Type==HBLOCK_DENSE
+      { if (K<=NCB)
+         { // A*B = (A*I) * B''
+           Rank=K;
+           U=(cdouble *)mallocEC(NRA*Rank*sizeof(cdouble));
+           V=(cdouble *)mallocEC(NCB*Rank*sizeof(cdouble));
+           cdouble *I=(cdouble *)mallocEC(K*K*sizeof(cdouble));
+           for(int k=0; k<K; k++) I[k+k*K]=Alpha;
+           HBlockMultiply(A, 'N', 1.0, I, K, U, NRA, K);
+           free(I);
+           for(int nr=0; nr<K; nr++)
+            for(int nc=0; nc<NCB; nc++)
+             V[nc + nr*NCB] = conj(B->D->ZM[nr + nc*K]);
+         }
+        else
+         { // A*B = (A*B) * I'
+           Rank=NCB;
+           U=(cdouble *)mallocEC(NRA*Rank*sizeof(cdouble));
+           V=(cdouble *)mallocEC(NCB*Rank*sizeof(cdouble));
+           HBlockMultiply(A, 'N', Alpha, B->D->ZM, K, U, NRA, NCB);
+           for(int k=0; k<NCB; k++) V[k+k*NCB]=1.0;
+         };
+      };
+
+     HBlockAddLowRank(C, U, NRA, V, NCB, Rank, Tol);
+     free(U);
+     free(V);
+     return;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- A and B both subdivided: recurse on the 2x2 block structure */
+  /*--------------------------------------------------------------*/
+  if (C->Type==HBLOCK_SUBDIVIDED)
+   { for(int i=0; i<2; i++)
+      for(int j=0; j<2; j++)
+       for(int l=0; l<2; l++)
+        HBlockMulAdd(CHILD(C,i,j), Alpha, CHILD(A,i,l), CHILD(B,l,j), Tol);
+   }
+  else if (C->Type==HBLOCK_LOWRANK)
+   { // accumulate the product in a temporary subdivided block
+     // with low-rank children, then agglomerate into C
+     HBlock *T=NewHBlock(C->RowStart, C->NR, C->ColStart, C->NC, HBLOCK_SUBDIVIDED);
+     for(int i=0; i<2; i++)
+      for(int j=0; j<2; j++)
+       { HBlock *Ai=CHILD(A,i,0), *Bj=CHILD(B,0,j);
+         CHILD(T,i,j)=NewHBlock(Ai->RowStart, Ai->NR, Bj->ColStart, Bj->NC, HBLOCK_LOWRANK);
+         for(int l=0; l<2; l++)
+          HBlockMulAdd(CHILD(T,i,j), Alpha, CHILD(A,i,l), CHILD(B,l,j), Tol);
+       };
+     for(int n=0; n<4; n++)
+      { HBlock *TC=T->Children[n];
+        if (TC->L==0 || TC->L->Rank==0) continue;
+        int Rank=TC->L->Rank;
+        cdouble *U=(cdouble *)mallocEC(C->NR*Rank*sizeof(cdouble));
+        cdouble *V=(cdouble *)mallocEC(C->NC*Rank*sizeof(cdouble));
+        int RowOffset=TC->RowStart - C->RowStart, ColOffset=TC->ColStart - C->ColStart;
+        for(int k=0; k<Rank; k++)
+         { memcpy(U + k*C->NR + RowOffset, TC->L->A->ZM + k*TC->NR, TC->NR*sizeof(cdouble));
+           memcpy(V + k*C->NC + ColOffset, TC->L->B->ZM + k*TC->NC, TC->NC*sizeof(cdouble));
+         };
+        HBlockAddLowRank(C, U, C->NR, V, C->NC, Rank, Tol);
+        free(U);
+        free(V);
+      };
+     DestroyHBlock(T);
+   }
+  else // C dense: form A*(B*I) column by column
+   { cdouble *BI=(cdouble *)mallocEC(K*NCB*sizeof(cdouble));
+     cdouble *I=(cdouble *)mallocEC(NCB*NCB*sizeof(cdouble));
+     for(int k=0; k<NCB; k++) I[k+k*NCB]=1.0;
+     HBlockMultiply(B, 'N', 1.0, I, NCB, BI, K, NCB);
+     HBlockMultiply(A, 'N', Alpha, BI, K, C->D->ZM, NRA, NCB);
+     free(I);
+     free(BI);
+   };
+}
+
+/***************************************************************/
+/* triangular solves with dense right-hand sides.              */
+/* the diagonal block L (or U) is a dense leaf holding a LAPACK */
+/* LU factorization, or a subdivided block whose diagonal      */
+/* children are themselves factorized and whose off-diagonal   */
+/* children hold the L/U factors.                              */
+/***************************************************************/
+// X <- L^{-1} X (including the row pivoting of dense leaves)
+static void SolveLower(HBlock *L, cdouble *X, int LDX, int NRHS)
+{
+  if (L->Type==HBLOCK_DENSE)
+   { int One=1, N=L->NR;
+     cdouble zOne=1.0;
+     zlaswp_(&NRHS, X, &LDX, &One, &N, L->D->ipiv, &One);
+     ztrsm_("L", "L", "N", "U", &N, &NRHS, &zOne, L->D->ZM, &N, X, &LDX);
+     return;
+   };
+
+  HBlock *L00=CHILD(L,0,0), *L10=CHILD(L,1,0), *L11=CHILD(L,1,1);
+  SolveLower(L00, X, LDX, NRHS);
+  HBlockMultiply(L10, 'N', -1.0, X, LDX, X+L00->NR, LDX, NRHS);
+  SolveLower(L11, X+L00->NR, LDX, NRHS);
+}
+
+// X <- U^{-1} X
+static void SolveUpper(HBlock *U, cdouble *X, int LDX, int NRHS)
+{
+  if (U->Type==HBLOCK_DENSE)
+   { int N=U->NR;
+     cdouble zOne=1.0;
+     ztrsm_("L", "U", "N", "N", &N, &NRHS, &zOne, U->D->ZM, &N, X, &LDX);
+     return;
+   };
+
+  HBlock *U00=CHILD(U,0,0), *U01=CHILD(U,0,1), *U11=CHILD(U,1,1);
+  SolveUpper(U11, X+U00->NR, LDX, NRHS);
+  HBlockMultiply(U01, 'N', -1.0, X+U00->NR, LDX, X, LDX, NRHS);
+  SolveUpper(U00, X, LDX, NRHS);
+}
+
+// X <- U^{-H} X
+static void SolveUpperAdjoint(HBlock *U, cdouble *X, int LDX, int NRHS)
+{
+  if (U->Type==HBLOCK_DENSE)
+   { int N=U->NR;
+     cdouble zOne=1.0;
+     ztrsm_("L", "U", "C", "N", &N, &NRHS, &zOne, U->D->ZM, &N, X, &LDX);
+     return;
+   };
+
+  HBlock *U00=CHILD(U,0,0), *U01=CHILD(U,0,1), *U11=CHILD(U,1,1);
+  SolveUpperAdjoint(U00, X, LDX, NRHS);
+  HBlockMultiply(U01, 'C', -1.0, X, LDX, X+U00->NR, LDX, NRHS);
+  SolveUpperAdjoint(U11, X+U00->NR, LDX, NRHS);
+}
+
+/***************************************************************/
+/* triangular solves with H-block right-hand sides             */
+/***************************************************************/
+// B <- L^{-1} B, where the row cluster of B is the cluster of L
+static void SolveLowerBlock(HBlock *L, HBlock *B, double Tol)
+{
+  if (B->Type==HBLOCK_DENSE)
+   SolveLower(L, B->D->ZM, B->NR, B->NC);
+  else if (B->Type==HBLOCK_LOWRANK)
+   { if (B->L && B->L->Rank>0)
+      SolveLower(L, B->L->A->ZM, B->NR, B->L->Rank);
+   }
+  else
+   for(int j=0; j<2; j++)
+    { SolveLowerBlock(CHILD(L,0,0), CHILD(B,0,j), Tol);
+      HBlockMulAdd(CHILD(B,1,j), -1.0, CHILD(L,1,0), CHILD(B,0,j), Tol);
+      SolveLowerBlock(CHILD(L,1,1), CHILD(B,1,j), Tol);
+    };
+}
+
+// B <- B * U^{-1}, where the column cluster of B is the cluster of U;
+// equivalently B' <- U^{-H} B'
+static void SolveUpperRightBlock(HBlock *U, HBlock *B, double Tol)
+{
+  if (B->Type==HBLOCK_DENSE)
+   { int NR=B->NR, NC=B->NC;
+     cdouble *BH=(cdouble *)mallocEC(NR*NC*sizeof(cdouble));
+     for(int nr=0; nr<NR; nr++)
+      for(int nc=0; nc<NC; nc++)
+       BH[nc + nr*NC] = conj(B->D->ZM[nr + nc*NR]);
+     SolveUpperAdjoint(U, BH, NC, NR);
+     for(int nr=0; nr<NR; nr++)
+      for(int nc=0; nc<NC; nc++)
+       B->D->ZM[nr + nc*NR] = conj(BH[nc + nr*NC]);
+     free(BH);
+   }
+  else if (B->Type==HBLOCK_LOWRANK)
+   { // (UB*VB')*U^{-1} = UB * (U^{-H}*VB)'
+     if (B->L && B->L->Rank>0)
+      SolveUpperAdjoint(U, B->L->B->ZM, B->NC, B->L->Rank);
+   }
+  else
+   for(int i=0; i<2; i++)
+    { SolveUpperRightBlock(CHILD(U,0,0), CHILD(B,i,0), Tol);
+      HBlockMulAdd(CHILD(B,i,1), -1.0, CHILD(B,i,0), CHILD(U,0,1), Tol);
+      SolveUpperRightBlock(CHILD(U,1,1), CHILD(B,i,1), Tol);
+    };
+}
+
+/***************************************************************/
+/* recursive H-LU factorization of a diagonal block            */
+/***************************************************************/
+static int HBlockLUFactorize(HBlock *A, double Tol)
+{
+  if (A->Type==HBLOCK_DENSE)
+   return A->D->LUFactorize();
+
+  int info=HBlockLUFactorize(CHILD(A,0,0), Tol);
+  SolveLowerBlock(CHILD(A,0,0), CHILD(A,0,1), Tol);
+  SolveUpperRightBlock(CHILD(A,0,0), CHILD(A,1,0), Tol);
+  HBlockMulAdd(CHILD(A,1,1), -1.0, CHILD(A,1,0), CHILD(A,0,1), Tol);
+  int info2=HBlockLUFactorize(CHILD(A,1,1), Tol);
+  return info ? info : info2;
+}
+
+/***************************************************************/
+/* public matrix-vector and solve routines. X, Y are in the    */
+/* original (unpermuted) DOF ordering.                         */
+/***************************************************************/
+void HierMatrix::Apply(HMatrix *X, HMatrix *Y)
+{
+  if (Factorized)
+   ErrExit("%s:%i: HierMatrix::Apply called after LUFactorize",__FILE__,__LINE__);
+  if ( X->NR!=N || Y->NR!=N || X->NC!=Y->NC
+       || X->RealComplex!=LHM_COMPLEX || Y->RealComplex!=LHM_COMPLEX )
+   ErrExit("%s:%i: dimension or data type mismatch",__FILE__,__LINE__);
+
+  int NRHS=X->NC;
+  cdouble *XP=(cdouble *)mallocEC(2*N*NRHS*sizeof(cdouble)), *YP=XP+N*NRHS;
+  for(int nc=0; nc<NRHS; nc++)
+   for(int p=0; p<N; p++)
+    XP[p + nc*N] = X->ZM[Perm[p] + nc*N];
+  HBlockMultiply(Root, 'N', 1.0, XP, N, YP, N, NRHS);
+  for(int nc=0; nc<NRHS; nc++)
+   for(int p=0; p<N; p++)
+    Y->ZM[Perm[p] + nc*N] = YP[p + nc*N];
+  free(XP);
+}
+
+void HierMatrix::Apply(HVector *X, HVector *Y)
+{
+  HMatrix XM(N, 1, LHM_COMPLEX, LHM_NORMAL, (void *)X->ZV);
+  HMatrix YM(N, 1, LHM_COMPLEX, LHM_NORMAL, (void *)Y->ZV);
+  Apply(&XM, &YM);
+}
+
+int HierMatrix::LUFactorize()
+{
+  if (Factorized)
+   ErrExit("%s:%i: HierMatrix is already factorized",__FILE__,__LINE__);
+  Factorized=true;
+  return HBlockLUFactorize(Root, Tol);
+}
+
+int HierMatrix::LUSolve(HMatrix *X)
+{
+  if (!Factorized)
+   ErrExit("%s:%i: HierMatrix::LUSolve called before LUFactorize",__FILE__,__LINE__);
+  if ( X->NR!=N || X->RealComplex!=LHM_COMPLEX )
+   ErrExit("%s:%i: dimension or data type mismatch",__FILE__,__LINE__);
+
+  int NRHS=X->NC;
+  cdouble *XP=(cdouble *)mallocEC(N*NRHS*sizeof(cdouble));
+  for(int nc=0; nc<NRHS; nc++)
+   for(int p=0; p<N; p++)
+    XP[p + nc*N] = X->ZM[Perm[p] + nc*N];
+  SolveLower(Root, XP, N, NRHS);
+  SolveUpper(Root, XP, N, NRHS);
+  for(int nc=0; nc<NRHS; nc++)
+   for(int p=0; p<N; p++)
+    X->ZM[Perm[p] + nc*N] = XP[p + nc*N];
+  free(XP);
+  return 0;
+}
+
+int HierMatrix::LUSolve(HVector *X)
+{
+  HMatrix XM(N, 1, LHM_COMPLEX, LHM_NORMAL, (void *)X->ZV);
+  return LUSolve(&XM);
+}
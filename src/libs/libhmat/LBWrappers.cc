@@ -29,6 +29,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <math.h>
+#include <float.h>
 
 #include <libhrutil.h>
 
@@ -154,6 +155,8 @@ int HMatrix::LUFactorize()
 
   if (ipiv==0)
    ipiv=(int *)mallocEC(NR*sizeof(int));
+  LDLFactored=false;
+  ClearMixedLU();
 
   if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
    dgetrf_(&NR, &NC, DM, &NR, ipiv, &info); 
@@ -169,6 +172,304 @@ int HMatrix::LUFactorize()
   return info;
 }
 
+/***************************************************************/
+/* left-looking LU factorization by column panels. panel #p    */
+/* consists of columns PanelStart[p]...PanelStart[p+1]-1. a    */
+/* panel is ready to be factorized once the updates from all   */
+/* previous panels have been applied to it, and its update     */
+/* from a previous panel only requires that panel to have been */
+/* factorized, so different panels may be updated and          */
+/* factorized concurrently as long as these dependencies are   */
+/* respected.                                                  */
+/*                                                             */
+/* the row interchanges chosen in each panel are applied to    */
+/* the later panels as part of their updates, but to the       */
+/* earlier panels (the columns of L) only in FinishPanelLU(),  */
+/* so that factorized panels are never modified while they may */
+/* be read by the updates of other panels.                     */
+/***************************************************************/
+void HMatrix::InitPanelLU()
+{
+  if ( NR!=NC || RealComplex!=LHM_COMPLEX || StorageType!=LHM_NORMAL )
+   ErrExit("%s:%i: panel LU factorization requires a square complex matrix",__FILE__,__LINE__);
+
+  if (ipiv==0)
+   ipiv=(int *)mallocEC(NR*sizeof(int));
+  LDLFactored=false;
+  ClearMixedLU();
+}
+
+/***************************************************************/
+/* factorize the panel of NumCols columns starting at column   */
+/* Col, assuming the updates from all previous panels have     */
+/* been applied. the pivot indices are stored in ipiv relative */
+/* to the full matrix, as for LUFactorize(). the return value  */
+/* is the LAPACK info code relative to the full matrix.        */
+/***************************************************************/
+int HMatrix::PanelLUFactorize(int Col, int NumCols)
+{
+  int M=NR-Col, info;
+  zgetrf_(&M, &NumCols, ZM + Col + ((size_t)Col)*NR, &NR, ipiv + Col, &info);
+  for(int n=0; n<NumCols; n++)
+   ipiv[Col+n] += Col;
+  return info>0 ? info + Col : info;
+}
+
+/***************************************************************/
+/* apply the update from the factorized panel of PNumCols      */
+/* columns starting at column PCol to the panel of NumCols     */
+/* columns starting at column Col > PCol                       */
+/***************************************************************/
+void HMatrix::PanelLUUpdate(int PCol, int PNumCols, int Col, int NumCols)
+{
+  cdouble *A = ZM + ((size_t)Col)*NR;
+  int K1=PCol+1, K2=PCol+PNumCols, One=1;
+  zlaswp_(&NumCols, A, &NR, &K1, &K2, ipiv, &One);
+
+  cdouble *LKK = ZM + PCol + ((size_t)PCol)*NR;
+  cdouble zOne=1.0, zMinusOne=-1.0;
+  ztrsm_("L", "L", "N", "U", &PNumCols, &NumCols, &zOne, LKK, &NR, A + PCol, &NR);
+
+  int M=NR - (PCol+PNumCols);
+  if (M>0)
+   zgemm_("N", "N", &M, &NumCols, &PNumCols, &zMinusOne,
+          LKK + PNumCols, &NR, A + PCol, &NR, &zOne,
+          A + PCol + PNumCols, &NR);
+}
+
+/***************************************************************/
+/* apply the row interchanges chosen in each panel to the      */
+/* columns of all earlier panels                               */
+/***************************************************************/
+void HMatrix::FinishPanelLU(int NumPanels, int *PanelStart)
+{
+  int One=1;
+  for(int np=0; np<NumPanels-1; np++)
+   { int Col=PanelStart[np], NumCols=PanelStart[np+1]-Col;
+     int K1=PanelStart[np+1]+1, K2=NR;
+     zlaswp_(&NumCols, ZM + ((size_t)Col)*NR, &NR, &K1, &K2, ipiv, &One);
+   };
+}
+
+/***************************************************************/
+/* replace the matrix with its Bunch-Kaufman (LDL^T)           */
+/* factorization, for matrices that are symmetric but not      */
+/* hermitian (such as the BEM matrix of a reciprocal geometry).*/
+/* for normal storage only the upper triangle is referenced,   */
+/* so the lower triangle need not be filled in; for packed     */
+/* storage this is the same as LUFactorize().                  */
+/***************************************************************/
+int HMatrix::LDLFactorize()
+{ 
+  if (NR!=NC)
+   ErrExit("LDLFactorize() called on non-square matrix");
+
+  if (StorageType!=LHM_NORMAL)
+   return LUFactorize();
+
+  if (ipiv==0)
+   ipiv=(int *)mallocEC(NR*sizeof(int));
+  LDLFactored=true;
+  ClearMixedLU();
+
+  int info, lworkOptimal, MinusOne=-1;
+  if ( RealComplex==LHM_REAL )
+   { double dlworkOptimal;
+     dsytrf_("U", &NR, DM, &NR, ipiv, &dlworkOptimal, &MinusOne, &info);
+     lworkOptimal=(int)dlworkOptimal;
+     if (lworkOptimal > lwork)
+      { if (work) free(work);
+        work=mallocEC(lworkOptimal*sizeof(double));
+        lwork=lworkOptimal;
+      };
+     dsytrf_("U", &NR, DM, &NR, ipiv, (double *)work, &lwork, &info);
+   }
+  else
+   { cdouble zlworkOptimal;
+     zsytrf_("U", &NR, ZM, &NR, ipiv, &zlworkOptimal, &MinusOne, &info);
+     lworkOptimal=(int)real(zlworkOptimal);
+     if (lworkOptimal > lwork)
+      { if (work) free(work);
+        work=mallocEC(lworkOptimal*sizeof(cdouble));
+        lwork=lworkOptimal;
+      };
+     zsytrf_("U", &NR, ZM, &NR, ipiv, (cdouble *)work, &lwork, &info);
+   };
+
+  return info;
+}
+
+/***************************************************************/
+/* mixed-precision LU factorization: factorize a single-       */
+/* precision copy of the matrix (sgetrf / cgetrf), leaving the */
+/* matrix itself intact for computing residuals. subsequent    */
+/* LUSolve()s refine the single-precision solutions until the  */
+/* relative residual is below Tol, and fall back to the usual  */
+/* full-precision factorization if the refinement stalls.      */
+/*                                                             */
+/* if the matrix cannot be represented in single precision, or */
+/* its single-precision copy is singular, this is the same as  */
+/* LUFactorize().                                              */
+/***************************************************************/
+int HMatrix::MixedLUFactorize(double Tol)
+{
+  if ( NR!=NC || StorageType!=LHM_NORMAL )
+   ErrExit("MixedLUFactorize() requires a square matrix with normal storage");
+
+  if (ipiv==0)
+   ipiv=(int *)mallocEC(NR*sizeof(int));
+  LDLFactored=false;
+  ClearMixedLU();
+
+  size_t N2=((size_t)NR)*NR;
+  int info=0;
+  bool Overflow=false;
+  if (RealComplex==LHM_REAL)
+   { float *A=(float *)mallocEC(N2*sizeof(float));
+     for(size_t n=0; n<N2 && !Overflow; n++)
+      { Overflow = fabs(DM[n]) > FLT_MAX;
+        A[n] = (float)DM[n];
+      };
+     if (!Overflow)
+      sgetrf_(&NR, &NC, A, &NR, ipiv, &info);
+     SPLU=(void *)A;
+   }
+  else
+   { cfloat *A=(cfloat *)mallocEC(N2*sizeof(cfloat));
+     for(size_t n=0; n<N2 && !Overflow; n++)
+      { Overflow = fabs(real(ZM[n])) > FLT_MAX || fabs(imag(ZM[n])) > FLT_MAX;
+        A[n] = cfloat( (float)real(ZM[n]), (float)imag(ZM[n]) );
+      };
+     if (!Overflow)
+      cgetrf_(&NR, &NC, A, &NR, ipiv, &info);
+     SPLU=(void *)A;
+   };
+
+  if (Overflow || info!=0)
+   return LUFactorize();
+
+  SPTol=Tol;
+  return 0;
+}
+
+void HMatrix::ClearMixedLU()
+{
+  if (SPLU) free(SPLU);
+  SPLU=0;
+}
+
+/***************************************************************/
+/* solve for the nrhs columns of X (leading dimension NR) using */
+/* a mixed-precision factorization, as described above        */
+/***************************************************************/
+#define SP_MAXITER 30
+
+int HMatrix::MixedLUSolve(void *X, char Trans, int nrhs)
+{
+  int info;
+  size_t NX = ((size_t)NR)*nrhs;
+  bool Real = (RealComplex==LHM_REAL);
+  size_t Size = Real ? sizeof(double) : sizeof(cdouble);
+  char TransStr[2]={Trans,0};
+
+  // B = copy of the RHS, R = residual, S = single-precision correction
+  void *B = mallocEC(NX*Size);
+  void *R = mallocEC(NX*Size);
+  void *S = mallocEC(NX*Size/2);
+  memcpy(B, X, NX*Size);
+
+  double dOne=1.0, dMinusOne=-1.0;
+  cdouble zOne=1.0, zMinusOne=-1.0;
+  double *DX=(double *)X, *DB=(double *)B, *DR=(double *)R;
+  cdouble *ZX=(cdouble *)X, *ZB=(cdouble *)B, *ZR=(cdouble *)R;
+  float *SS=(float *)S;
+  cfloat *CS=(cfloat *)S;
+
+  // norms of the RHS columns, for the relative residual
+  double *BNorm=(double *)mallocEC(nrhs*sizeof(double));
+  for(int nc=0; nc<nrhs; nc++)
+   { BNorm[nc]=0.0;
+     for(int nr=0; nr<NR; nr++)
+      BNorm[nc] = fmax(BNorm[nc], Real ? fabs(DB[nr + nc*NR]) : abs(ZB[nr + nc*NR]));
+   };
+
+  // X = 0 initially, so that the first residual is just B
+  memset(X, 0, NX*Size);
+  memcpy(R, B, NX*Size);
+
+  bool Converged=false;
+  double Residual, LastResidual=HUGE_VAL;
+  for(int Iter=0; Iter<=SP_MAXITER; Iter++)
+   {
+     /*--------------------------------------------------------------*/
+     /*- relative residual: max over columns of |R|_inf / |B|_inf    */
+     /*--------------------------------------------------------------*/
+     Residual=0.0;
+     for(int nc=0; nc<nrhs; nc++)
+      { double RNorm=0.0;
+        for(int nr=0; nr<NR; nr++)
+         RNorm = fmax(RNorm, Real ? fabs(DR[nr + nc*NR]) : abs(ZR[nr + nc*NR]));
+        if (RNorm>0.0)
+         Residual = fmax(Residual, RNorm / BNorm[nc]);
+      };
+     if (Residual<=SPTol)
+      { Converged=true;
+        break;
+      };
+     if ( Residual > 0.5*LastResidual || Iter==SP_MAXITER )
+      break; // stalled
+     LastResidual=Residual;
+
+     /*--------------------------------------------------------------*/
+     /*- solve for the correction in single precision, X += S        */
+     /*--------------------------------------------------------------*/
+     if (Real)
+      { for(size_t n=0; n<NX; n++)
+         SS[n]=(float)DR[n];
+        sgetrs_(TransStr, &NR, &nrhs, (float *)SPLU, &NR, ipiv, SS, &NR, &info);
+        for(size_t n=0; n<NX; n++)
+         DX[n]+=(double)SS[n];
+      }
+     else
+      { for(size_t n=0; n<NX; n++)
+         CS[n]=cfloat( (float)real(ZR[n]), (float)imag(ZR[n]) );
+        cgetrs_(TransStr, &NR, &nrhs, (cfloat *)SPLU, &NR, ipiv, CS, &NR, &info);
+        for(size_t n=0; n<NX; n++)
+         ZX[n]+=cdouble( real(CS[n]), imag(CS[n]) );
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- R = B - op(A)*X in full precision                           */
+     /*--------------------------------------------------------------*/
+     memcpy(R, B, NX*Size);
+     if (Real)
+      dgemm_(TransStr, "N", &NR, &nrhs, &NC, &dMinusOne, DM, &NR, DX, &NR, &dOne, DR, &NR);
+     else
+      zgemm_(TransStr, "N", &NR, &nrhs, &NC, &zMinusOne, ZM, &NR, ZX, &NR, &zOne, ZR, &NR);
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- if the refinement stalled, replace the mixed-precision      */
+  /*- factorization with a full-precision one and start over      */
+  /*--------------------------------------------------------------*/
+  info=0;
+  if (!Converged)
+   { Warn("mixed-precision LU refinement stalled at residual %.1e (tolerance %.1e); refactorizing in full precision",Residual,SPTol);
+     memcpy(X, B, NX*Size);
+     LUFactorize();
+     if (Real)
+      dgetrs_(TransStr, &NR, &nrhs, DM, &NR, ipiv, DX, &NR, &info);
+     else
+      zgetrs_(TransStr, &NR, &nrhs, ZM, &NR, ipiv, ZX, &NR, &info);
+   };
+
+  free(BNorm);
+  free(S);
+  free(R);
+  free(B);
+  return info;
+}
+
 /***************************************************************/
 /* solve linear system using LU factorization ******************/
 /***************************************************************/
@@ -185,7 +486,14 @@ int HMatrix::LUSolve(HVector *X)
   if (ipiv==0)  
    ErrExit("LUFactorize() must be called before LUSolve()");
 
-  if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
+  if (SPLU)
+   return MixedLUSolve(RealComplex==LHM_REAL ? (void *)X->DV : (void *)X->ZV, 'N', 1);
+
+  if ( LDLFactored && RealComplex==LHM_REAL )
+   dsytrs_("U", &NR, &iOne, DM, &NR, ipiv, X->DV, &NR, &info);
+  else if ( LDLFactored )
+   zsytrs_("U", &NR, &iOne, ZM, &NR, ipiv, X->ZV, &NR, &info);
+  else if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
    dgetrs_("N", &NR, &iOne, DM, &NR, ipiv, X->DV, &NR, &info);
   else if ( RealComplex==LHM_REAL && StorageType==LHM_SYMMETRIC )
    dsptrs_("U", &NR, &iOne, DM, ipiv, X->DV, &NR, &info);
@@ -217,9 +525,21 @@ int HMatrix::LUSolve(HMatrix *X, char Trans, int nrhs)
    ErrExit("too many RHSs requested in LUSolve");
   if (ipiv==0)  
    ErrExit("LUFactorize() must be called before LUSolve()");
-  if ( Trans!='N' && StorageType!=LHM_NORMAL )
-   ErrExit("transposed LU-solves not available for packed matrices");
-if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
+  if (SPLU)
+   return MixedLUSolve(RealComplex==LHM_REAL ? (void *)X->DM : (void *)X->ZM, Trans, nrhs);
+  if ( Trans!='N' && (StorageType!=LHM_NORMAL || LDLFactored) )
+   { // symmetric matrices are their own transposes
+     if ( Trans=='T' && (StorageType==LHM_SYMMETRIC || LDLFactored) )
+      Trans='N';
+     else
+      ErrExit("transposed LU-solves not available for packed or LDL-factorized matrices");
+   };
+
+  if ( LDLFactored && RealComplex==LHM_REAL )
+   dsytrs_("U", &NR, &nrhs, DM, &NR, ipiv, X->DM, &NR, &info);
+  else if ( LDLFactored )
+   zsytrs_("U", &NR, &nrhs, ZM, &NR, ipiv, X->ZM, &NR, &info);
+  else if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
    dgetrs_(&Trans, &NR, &nrhs, DM, &NR, ipiv, X->DM, &NR, &info);
   else if ( RealComplex==LHM_REAL && StorageType==LHM_SYMMETRIC )
    dsptrs_("U", &NR, &nrhs, DM, ipiv, X->DM, &NR, &info);
@@ -263,6 +583,33 @@ int HMatrix::LUInvert()
   if (ipiv==0)  
    ErrExit("LUFactorize() must be called before LUInvert()");
 
+  // the inverse is computed from a full-precision factorization
+  if (SPLU)
+   LUFactorize();
+
+  if (LDLFactored)
+   { // xsytri only fills in the upper triangle of the inverse
+     if (RealComplex==LHM_REAL)
+      { if (NR > lwork)
+         { if (work) free(work);
+           work=mallocEC(NR*sizeof(double));
+           lwork=NR;
+         };
+        dsytri_("U", &NR, DM, &NR, ipiv, (double *)work, &info);
+      }
+     else
+      { if (2*NR > lwork)
+         { if (work) free(work);
+           work=mallocEC(2*NR*sizeof(cdouble));
+           lwork=2*NR;
+         };
+        zsytri_("U", &NR, ZM, &NR, ipiv, (cdouble *)work, &info);
+      };
+     CopyUpperToLower();
+     LDLFactored=false;
+     return info;
+   };
+
   int MinusOne=-1;
   if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
    {
@@ -913,6 +1260,10 @@ double HMatrix::GetRCond(double ANorm, bool UseInfinityNorm)
   char *Norm = const_cast<char *> (UseInfinityNorm ? "I" : "1");
   double RCond;
 
+  // the estimate requires a full-precision factorization
+  if (SPLU)
+   LUFactorize();
+
   /***************************************************************/
   /***************************************************************/
   /***************************************************************/
@@ -934,7 +1285,10 @@ double HMatrix::GetRCond(double ANorm, bool UseInfinityNorm)
 
      double *rwork=(double *)work;
      int info;
-     dgecon_(Norm, &NR, DM, &NR, &ANorm, &RCond, rwork, (int *)iwork, &info);
+     if (LDLFactored)
+      dsycon_("U", &NR, DM, &NR, ipiv, &ANorm, &RCond, rwork, (int *)iwork, &info);
+     else
+      dgecon_(Norm, &NR, DM, &NR, &ANorm, &RCond, rwork, (int *)iwork, &info);
    }
   else // (RealComplex==LHM_COMPLEX)
    {
@@ -951,7 +1305,10 @@ double HMatrix::GetRCond(double ANorm, bool UseInfinityNorm)
      double *work2  = rwork + 2*NR;
      cdouble *zwork = (cdouble *)work2;
      int info;
-     zgecon_(Norm, &NR, ZM, &NR, &ANorm, &RCond, zwork, rwork, &info);
+     if (LDLFactored)
+      zsycon_("U", &NR, ZM, &NR, ipiv, &ANorm, &RCond, zwork, &info);
+     else
+      zgecon_(Norm, &NR, ZM, &NR, &ANorm, &RCond, zwork, rwork, &info);
 
    };
 
@@ -0,0 +1,334 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * LRBlockMatrix.cc  -- implementation of the LRBlockMatrix class for
+ *                   -- square block matrices whose off-diagonal
+ *                   -- blocks may be stored in low-rank form
+ *
+ * The linear solver uses the Woodbury identity: writing the matrix
+ * as M = D + Atilde*Btilde', where D is the block-diagonal part and
+ * the columns of Atilde, Btilde are the (embedded) factors of all
+ * low-rank off-diagonal blocks, we have
+ *
+ *  M^{-1} = D^{-1} - Z * C^{-1} * Btilde' * D^{-1},
+ *
+ *  Z = D^{-1}*Atilde,  C = 1 + Btilde'*Z,
+ *
+ * so that factorization costs one LU factorization per diagonal
+ * block plus one of the (TotalRank x TotalRank) capacitance matrix C.
+ *
+ * If any off-diagonal block is stored densely, LUFactorize() just
+ * expands the full matrix and factorizes it in the usual way.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+
+#include "libhmat.h"
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+LRBlockMatrix::LRBlockMatrix(int pNumBlocks, int *pBlockSizes)
+{
+  NumBlocks=pNumBlocks;
+  BlockSizes   = (int *)mallocEC(NumBlocks*sizeof(int));
+  BlockOffsets = (int *)mallocEC((NumBlocks+1)*sizeof(int));
+  BlockOffsets[0]=0;
+  for(int nb=0; nb<NumBlocks; nb++)
+   { BlockSizes[nb]=pBlockSizes[nb];
+     BlockOffsets[nb+1]=BlockOffsets[nb] + BlockSizes[nb];
+   };
+  N=BlockOffsets[NumBlocks];
+
+  DBlocks  = (HMatrix **)mallocEC(NumBlocks*NumBlocks*sizeof(HMatrix *));
+  LRBlocks = (LRMatrix **)mallocEC(NumBlocks*NumBlocks*sizeof(LRMatrix *));
+
+  TotalRank=0;
+  Z=BTilde=Capacitance=DenseLU=0;
+  Factorized=false;
+}
+
+LRBlockMatrix::~LRBlockMatrix()
+{
+  for(int nb=0; nb<NumBlocks*NumBlocks; nb++)
+   { if (DBlocks[nb])  delete DBlocks[nb];
+     if (LRBlocks[nb]) delete LRBlocks[nb];
+   };
+  free(DBlocks);
+  free(LRBlocks);
+  free(BlockSizes);
+  free(BlockOffsets);
+  ClearFactorization();
+}
+
+void LRBlockMatrix::ClearFactorization()
+{
+  if (Z) delete Z;
+  if (BTilde) delete BTilde;
+  if (Capacitance) delete Capacitance;
+  if (DenseLU) delete DenseLU;
+  Z=BTilde=Capacitance=DenseLU=0;
+  TotalRank=0;
+  Factorized=false;
+}
+
+/***************************************************************/
+/* install a block, taking ownership of the HMatrix/LRMatrix.  */
+/* diagonal blocks must be dense.                              */
+/***************************************************************/
+void LRBlockMatrix::SetBlock(int nba, int nbb, HMatrix *M)
+{
+  if ( M->NR!=BlockSizes[nba] || M->NC!=BlockSizes[nbb] )
+   ErrExit("%s:%i: block (%i,%i) has wrong size",__FILE__,__LINE__,nba,nbb);
+  if ( M->RealComplex!=LHM_COMPLEX || M->StorageType!=LHM_NORMAL )
+   ErrExit("%s:%i: LRBlockMatrix blocks must be complex, unpacked",__FILE__,__LINE__);
+
+  int nb = nba*NumBlocks + nbb;
+  if (DBlocks[nb])  delete DBlocks[nb];
+  if (LRBlocks[nb]) delete LRBlocks[nb];
+  DBlocks[nb]=M;
+  LRBlocks[nb]=0;
+  ClearFactorization();
+}
+
+void LRBlockMatrix::SetBlock(int nba, int nbb, LRMatrix *L)
+{
+  if (nba==nbb)
+   ErrExit("%s:%i: diagonal blocks of LRBlockMatrix must be dense",__FILE__,__LINE__);
+  if ( L->NR!=BlockSizes[nba] || L->NC!=BlockSizes[nbb] )
+   ErrExit("%s:%i: block (%i,%i) has wrong size",__FILE__,__LINE__,nba,nbb);
+
+  int nb = nba*NumBlocks + nbb;
+  if (DBlocks[nb])  delete DBlocks[nb];
+  if (LRBlocks[nb]) delete LRBlocks[nb];
+  DBlocks[nb]=0;
+  LRBlocks[nb]=L;
+  ClearFactorization();
+}
+
+/***************************************************************/
+/* number of cdoubles stored in all blocks                     */
+/***************************************************************/
+size_t LRBlockMatrix::GetStorage()
+{
+  size_t Storage=0;
+  for(int nb=0; nb<NumBlocks*NumBlocks; nb++)
+   { if (DBlocks[nb])
+      Storage += ((size_t)DBlocks[nb]->NR)*DBlocks[nb]->NC;
+     if (LRBlocks[nb])
+      Storage += ((size_t)LRBlocks[nb]->Rank)*(LRBlocks[nb]->NR + LRBlocks[nb]->NC);
+   };
+  return Storage;
+}
+
+/***************************************************************/
+/* expand into a dense NxN matrix                              */
+/***************************************************************/
+HMatrix *LRBlockMatrix::GetDense(HMatrix *M)
+{
+  if ( M && (M->NR!=N || M->NC!=N || M->RealComplex!=LHM_COMPLEX) )
+   { Warn("wrong-size matrix passed to GetDense (reallocating)");
+     M=0;
+   };
+  if (M==0)
+   M=new HMatrix(N, N, LHM_COMPLEX);
+
+  M->Zero();
+  for(int nba=0; nba<NumBlocks; nba++)
+   for(int nbb=0; nbb<NumBlocks; nbb++)
+    { int nb = nba*NumBlocks + nbb;
+      if (DBlocks[nb])
+       M->InsertBlock(DBlocks[nb], BlockOffsets[nba], BlockOffsets[nbb]);
+      else if (LRBlocks[nb])
+       LRBlocks[nb]->AddToHMatrix(M, BlockOffsets[nba], BlockOffsets[nbb]);
+    };
+  return M;
+}
+
+/***************************************************************/
+/* Y = M*X for the unfactorized matrix; X, Y are NxNRHS        */
+/***************************************************************/
+void LRBlockMatrix::Apply(HMatrix *X, HMatrix *Y)
+{
+  if (Factorized)
+   ErrExit("%s:%i: LRBlockMatrix::Apply called after LUFactorize",__FILE__,__LINE__);
+  if ( X->NR!=N || Y->NR!=N || X->NC!=Y->NC )
+   ErrExit("%s:%i: dimension mismatch",__FILE__,__LINE__);
+
+  int NRHS=X->NC;
+  Y->Zero();
+  for(int nbb=0; nbb<NumBlocks; nbb++)
+   {
+     HMatrix *XB=new HMatrix(BlockSizes[nbb], NRHS, LHM_COMPLEX);
+     X->ExtractBlock(BlockOffsets[nbb], 0, XB);
+
+     for(int nba=0; nba<NumBlocks; nba++)
+      { int nb = nba*NumBlocks + nbb;
+        if (DBlocks[nb]==0 && LRBlocks[nb]==0)
+         continue;
+        HMatrix *YB=new HMatrix(BlockSizes[nba], NRHS, LHM_COMPLEX);
+        if (DBlocks[nb])
+         DBlocks[nb]->Multiply(XB, YB);
+        else
+         LRBlocks[nb]->Apply(XB, YB);
+        Y->AddBlock(YB, BlockOffsets[nba], 0);
+        delete YB;
+      };
+     delete XB;
+   };
+}
+
+void LRBlockMatrix::Apply(HVector *X, HVector *Y)
+{
+  HMatrix XM(N, 1, LHM_COMPLEX, LHM_NORMAL, (void *)X->ZV);
+  HMatrix YM(N, 1, LHM_COMPLEX, LHM_NORMAL, (void *)Y->ZV);
+  Apply(&XM, &YM);
+}
+
+/***************************************************************/
+/* overwrite the diagonal blocks with their LU factorizations  */
+/* and precompute the Woodbury data. As for HMatrix, the       */
+/* unfactorized matrix is not available after this.           */
+/***************************************************************/
+int LRBlockMatrix::LUFactorize()
+{
+  ClearFactorization();
+
+  /*--------------------------------------------------------------*/
+  /*- any dense off-diagonal block: just factorize in full        */
+  /*--------------------------------------------------------------*/
+  bool AllLowRank=true;
+  for(int nba=0; nba<NumBlocks; nba++)
+   { if (DBlocks[nba*NumBlocks + nba]==0)
+      ErrExit("%s:%i: LRBlockMatrix diagonal block %i not set",__FILE__,__LINE__,nba);
+     for(int nbb=0; nbb<NumBlocks; nbb++)
+      if (nba!=nbb && DBlocks[nba*NumBlocks + nbb])
+       AllLowRank=false;
+   };
+
+  if (!AllLowRank)
+   { DenseLU=GetDense();
+     Factorized=true;
+     return DenseLU->LUFactorize();
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- factorize diagonal blocks ----------------------------------*/
+  /*--------------------------------------------------------------*/
+  int info=0;
+  for(int nb=0; nb<NumBlocks; nb++)
+   { int ThisInfo=DBlocks[nb*NumBlocks + nb]->LUFactorize();
+     if (ThisInfo!=0) info=ThisInfo;
+   };
+  Factorized=true;
+
+  for(int nb=0; nb<NumBlocks*NumBlocks; nb++)
+   if (LRBlocks[nb])
+    TotalRank+=LRBlocks[nb]->Rank;
+  if (TotalRank==0)
+   return info;
+
+  /*--------------------------------------------------------------*/
+  /*- assemble Z = D^{-1} Atilde and Btilde one low-rank block at */
+  /*- a time; block (nba,nbb) contributes Rank columns, nonzero   */
+  /*- only in block row nba of Z and block row nbb of Btilde      */
+  /*--------------------------------------------------------------*/
+  Z=new HMatrix(N, TotalRank, LHM_COMPLEX);
+  BTilde=new HMatrix(N, TotalRank, LHM_COMPLEX);
+  Z->Zero();
+  BTilde->Zero();
+  int Col=0;
+  for(int nba=0; nba<NumBlocks; nba++)
+   for(int nbb=0; nbb<NumBlocks; nbb++)
+    { LRMatrix *L=LRBlocks[nba*NumBlocks + nbb];
+      if (L==0 || L->Rank==0) continue;
+      HMatrix *ZB=new HMatrix(L->A);
+      DBlocks[nba*NumBlocks + nba]->LUSolve(ZB);
+      Z->InsertBlock(ZB, BlockOffsets[nba], Col);
+      BTilde->InsertBlock(L->B, BlockOffsets[nbb], Col);
+      delete ZB;
+      Col+=L->Rank;
+    };
+
+  /*--------------------------------------------------------------*/
+  /*- capacitance matrix C = 1 + Btilde'*Z ------------------------*/
+  /*--------------------------------------------------------------*/
+  Capacitance=new HMatrix(TotalRank, TotalRank, LHM_COMPLEX);
+  BTilde->Multiply(Z, Capacitance, "--transA C");
+  for(int n=0; n<TotalRank; n++)
+   Capacitance->AddEntry(n, n, 1.0);
+  int CInfo=Capacitance->LUFactorize();
+  return CInfo ? CInfo : info;
+}
+
+/***************************************************************/
+/* solve M*X = B, overwriting X (on input, B) with the solution */
+/***************************************************************/
+int LRBlockMatrix::LUSolve(HMatrix *X)
+{
+  if (!Factorized)
+   ErrExit("%s:%i: LRBlockMatrix::LUSolve called before LUFactorize",__FILE__,__LINE__);
+  if (X->NR!=N || X->RealComplex!=LHM_COMPLEX)
+   ErrExit("%s:%i: dimension or data type mismatch",__FILE__,__LINE__);
+
+  if (DenseLU)
+   return DenseLU->LUSolve(X);
+
+  /*--------------------------------------------------------------*/
+  /*- Y = D^{-1} B, block by block ---------------------------------*/
+  /*--------------------------------------------------------------*/
+  int NRHS=X->NC, info=0;
+  for(int nb=0; nb<NumBlocks; nb++)
+   { HMatrix *XB=new HMatrix(BlockSizes[nb], NRHS, LHM_COMPLEX);
+     X->ExtractBlock(BlockOffsets[nb], 0, XB);
+     int ThisInfo=DBlocks[nb*NumBlocks + nb]->LUSolve(XB);
+     if (ThisInfo!=0) info=ThisInfo;
+     X->InsertBlock(XB, BlockOffsets[nb], 0);
+     delete XB;
+   };
+  if (TotalRank==0)
+   return info;
+
+  /*--------------------------------------------------------------*/
+  /*- X = Y - Z * C^{-1} * Btilde' * Y -----------------------------*/
+  /*--------------------------------------------------------------*/
+  HMatrix *T=new HMatrix(TotalRank, NRHS, LHM_COMPLEX);
+  BTilde->Multiply(X, T, "--transA C");
+  Capacitance->LUSolve(T);
+  HMatrix *ZT=new HMatrix(N, NRHS, LHM_COMPLEX);
+  Z->Multiply(T, ZT);
+  int NN=N*NRHS;
+  for(int n=0; n<NN; n++)
+   X->ZM[n] -= ZT->ZM[n];
+  delete ZT;
+  delete T;
+  return info;
+}
+
+int LRBlockMatrix::LUSolve(HVector *X)
+{
+  HMatrix XM(N, 1, LHM_COMPLEX, LHM_NORMAL, (void *)X->ZV);
+  return LUSolve(&XM);
+}
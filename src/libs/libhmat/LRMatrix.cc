@@ -0,0 +1,426 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * LRMatrix.cc  -- implementation of the LRMatrix class for
+ *              -- low-rank matrices stored in factored form,
+ *              -- plus an adaptive-cross-approximation (ACA)
+ *              -- routine for constructing them
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+
+extern "C" {
+ #include "lapack.h"
+}
+
+#include "libhmat.h"
+
+/***************************************************************/
+/* LRMatrix constructors and destructor ************************/
+/***************************************************************/
+LRMatrix::LRMatrix(int pNR, int pNC, int pRank)
+{
+  NR=pNR;
+  NC=pNC;
+  Rank=0;
+  A=B=0;
+  SetRank(pRank);
+}
+
+LRMatrix::LRMatrix(LRMatrix *L)
+{
+  NR=L->NR;
+  NC=L->NC;
+  Rank=0;
+  A=B=0;
+  SetRank(L->Rank);
+  if (Rank>0)
+   { A->Copy(L->A);
+     B->Copy(L->B);
+   };
+}
+
+LRMatrix::~LRMatrix()
+{
+  if (A) delete A;
+  if (B) delete B;
+}
+
+/***************************************************************/
+/* change the rank of the matrix, preserving the leading       */
+/* min(OldRank, NewRank) columns of the A and B factors and    */
+/* zeroing any new columns                                     */
+/***************************************************************/
+void LRMatrix::SetRank(int NewRank)
+{
+  if (NewRank==Rank)
+   return;
+
+  HMatrix *NewA=0, *NewB=0;
+  if (NewRank>0)
+   { NewA=new HMatrix(NR, NewRank, LHM_COMPLEX);
+     NewB=new HMatrix(NC, NewRank, LHM_COMPLEX);
+     NewA->Zero();
+     NewB->Zero();
+     int KeepRank = (Rank < NewRank ? Rank : NewRank);
+     if (KeepRank>0)
+      { memcpy(NewA->ZM, A->ZM, NR*KeepRank*sizeof(cdouble));
+        memcpy(NewB->ZM, B->ZM, NC*KeepRank*sizeof(cdouble));
+      };
+   };
+
+  if (A) delete A;
+  if (B) delete B;
+  A=NewA;
+  B=NewB;
+  Rank=NewRank;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+cdouble LRMatrix::GetEntry(int nr, int nc)
+{
+  cdouble Sum=0.0;
+  for(int k=0; k<Rank; k++)
+   Sum += A->ZM[nr + k*NR] * conj(B->ZM[nc + k*NC]);
+  return Sum;
+}
+
+/***************************************************************/
+/* Y = U*X, or Y += U*X if Accumulate==true.                   */
+/***************************************************************/
+void LRMatrix::Apply(HVector *X, HVector *Y, bool Accumulate)
+{
+  if ( X->N!=NC || Y->N!=NR || X->RealComplex!=LHM_COMPLEX || Y->RealComplex!=LHM_COMPLEX )
+   ErrExit("%s:%i: dimension or data type mismatch",__FILE__,__LINE__);
+
+  if (!Accumulate)
+   Y->Zero();
+  if (Rank==0)
+   return;
+
+  cdouble *T = (cdouble *)mallocEC(Rank*sizeof(cdouble));
+  cdouble zOne=1.0, zZero=0.0;
+  int IncX=1;
+  zgemv_("C", &NC, &Rank, &zOne, B->ZM, &NC, X->ZV, &IncX, &zZero, T, &IncX);
+  zgemv_("N", &NR, &Rank, &zOne, A->ZM, &NR, T, &IncX, &zOne, Y->ZV, &IncX);
+  free(T);
+}
+
+/***************************************************************/
+/* multiple-RHS version: X is NC x NRHS, Y is NR x NRHS        */
+/***************************************************************/
+void LRMatrix::Apply(HMatrix *X, HMatrix *Y, bool Accumulate)
+{
+  if (    X->NR!=NC || Y->NR!=NR || X->NC!=Y->NC
+       || X->StorageType!=LHM_NORMAL || Y->StorageType!=LHM_NORMAL
+       || X->RealComplex!=LHM_COMPLEX || Y->RealComplex!=LHM_COMPLEX )
+   ErrExit("%s:%i: dimension or data type mismatch",__FILE__,__LINE__);
+
+  if (!Accumulate)
+   Y->Zero();
+  if (Rank==0)
+   return;
+
+  int NRHS=X->NC;
+  cdouble *T = (cdouble *)mallocEC(Rank*NRHS*sizeof(cdouble));
+  cdouble zOne=1.0, zZero=0.0;
+  zgemm_("C", "N", &Rank, &NRHS, &NC, &zOne, B->ZM, &NC, X->ZM, &NC, &zZero, T, &Rank);
+  zgemm_("N", "N", &NR, &NRHS, &Rank, &zOne, A->ZM, &NR, T, &Rank, &zOne, Y->ZM, &NR);
+  free(T);
+}
+
+/***************************************************************/
+/* add the (expanded) matrix A*B' into the NRxNC subblock of M */
+/* whose upper-left corner is at (RowOffset, ColOffset)        */
+/***************************************************************/
+void LRMatrix::AddToHMatrix(HMatrix *M, int RowOffset, int ColOffset)
+{
+  if (Rank==0)
+   return;
+
+  HMatrix *Dense=new HMatrix(NR, NC, LHM_COMPLEX);
+  A->Multiply(B, Dense, "--transB C");
+
+  if ( M->StorageType==LHM_NORMAL && M->RealComplex==LHM_COMPLEX )
+   M->AddBlock(Dense, RowOffset, ColOffset);
+  else
+   for(int nc=0; nc<NC; nc++)
+    for(int nr=0; nr<NR; nr++)
+     M->AddEntry(RowOffset+nr, ColOffset+nc, Dense->ZM[nr + nc*NR]);
+
+  delete Dense;
+}
+
+/***************************************************************/
+/* replace U with its (non-conjugate) transpose.               */
+/* U = A*B'  ==> U^T = conj(B) * conj(A)'                      */
+/***************************************************************/
+void LRMatrix::Transpose()
+{
+  HMatrix *Temp=A; A=B; B=Temp;
+  int iTemp=NR; NR=NC; NC=iTemp;
+  if (Rank==0)
+   return;
+  for(int n=0; n<NR*Rank; n++) A->ZM[n]=conj(A->ZM[n]);
+  for(int n=0; n<NC*Rank; n++) B->ZM[n]=conj(B->ZM[n]);
+}
+
+/***************************************************************/
+/* overwrite the MxK matrix X with the M x min(M,K) matrix Q   */
+/* of its thin QR factorization, and write the min(M,K) x K    */
+/* upper-trapezoidal matrix R into the (caller-allocated)      */
+/* array R.                                                    */
+/***************************************************************/
+static void ThinQR(int M, int K, cdouble *X, cdouble *R)
+{
+  int MK = (M<K ? M : K);
+  int info, lwork=-1;
+  cdouble *Tau = (cdouble *)mallocEC(MK*sizeof(cdouble));
+  cdouble WorkSize;
+  zgeqrf_(&M, &K, X, &M, Tau, &WorkSize, &lwork, &info);
+  lwork = (int)real(WorkSize);
+  if (lwork<K) lwork=K;
+  cdouble *Work = (cdouble *)mallocEC(lwork*sizeof(cdouble));
+  zgeqrf_(&M, &K, X, &M, Tau, Work, &lwork, &info);
+  if (info!=0)
+   ErrExit("%s:%i: zgeqrf failed (info=%i)",__FILE__,__LINE__,info);
+
+  for(int nc=0; nc<K; nc++)
+   for(int nr=0; nr<MK; nr++)
+    R[nr + nc*MK] = (nr<=nc) ? X[nr + nc*M] : 0.0;
+
+  zungqr_(&M, &MK, &MK, X, &M, Tau, Work, &lwork, &info);
+  if (info!=0)
+   ErrExit("%s:%i: zungqr failed (info=%i)",__FILE__,__LINE__,info);
+
+  free(Work);
+  free(Tau);
+}
+
+/***************************************************************/
+/* reduce the rank of the matrix by discarding singular values */
+/* smaller than Tol times the largest singular value. This is  */
+/* done in O((NR+NC) Rank^2) time by computing thin QR         */
+/* factorizations of A and B and then the SVD of the small     */
+/* core matrix R_A * R_B'.                                     */
+/***************************************************************/
+void LRMatrix::Recompress(double Tol)
+{
+  if (Rank==0)
+   return;
+
+  int KA = (NR<Rank ? NR : Rank);
+  int KB = (NC<Rank ? NC : Rank);
+  int KS = (KA<KB ? KA : KB);
+
+  // thin QR factorizations of A and B
+  HMatrix *QA=new HMatrix(A), *QB=new HMatrix(B);
+  cdouble *RA = (cdouble *)mallocEC(KA*Rank*sizeof(cdouble));
+  cdouble *RB = (cdouble *)mallocEC(KB*Rank*sizeof(cdouble));
+  ThinQR(NR, Rank, QA->ZM, RA);
+  ThinQR(NC, Rank, QB->ZM, RB);
+
+  // core matrix C = RA * RB' and its SVD C = W * Sigma * VT
+  cdouble zOne=1.0, zZero=0.0;
+  cdouble *C = (cdouble *)mallocEC(KA*KB*sizeof(cdouble));
+  zgemm_("N", "C", &KA, &KB, &Rank, &zOne, RA, &KA, RB, &KB, &zZero, C, &KA);
+
+  double *Sigma = (double *)mallocEC(KS*sizeof(double));
+  double *RWork = (double *)mallocEC(5*KS*sizeof(double));
+  cdouble *W    = (cdouble *)mallocEC(KA*KS*sizeof(cdouble));
+  cdouble *VT   = (cdouble *)mallocEC(KS*KB*sizeof(cdouble));
+  int info, lwork=-1;
+  cdouble WorkSize;
+  zgesvd_("S", "S", &KA, &KB, C, &KA, Sigma, W, &KA, VT, &KS,
+          &WorkSize, &lwork, RWork, &info);
+  lwork = (int)real(WorkSize);
+  cdouble *Work = (cdouble *)mallocEC(lwork*sizeof(cdouble));
+  zgesvd_("S", "S", &KA, &KB, C, &KA, Sigma, W, &KA, VT, &KS,
+          Work, &lwork, RWork, &info);
+  if (info!=0)
+   ErrExit("%s:%i: zgesvd failed (info=%i)",__FILE__,__LINE__,info);
+
+  // new rank = number of singular values above threshold
+  int NewRank=0;
+  while( NewRank<KS && Sigma[NewRank] > Tol*Sigma[0] )
+   NewRank++;
+
+  // new factors: A <- QA * W_r * Sigma_r,  B <- QB * V_r
+  for(int k=0; k<NewRank; k++)
+   for(int n=0; n<KA; n++)
+    W[n + k*KA]*=Sigma[k];
+  SetRank(0);
+  SetRank(NewRank);
+  if (NewRank>0)
+   { zgemm_("N", "N", &NR, &NewRank, &KA, &zOne, QA->ZM, &NR, W, &KA, &zZero, A->ZM, &NR);
+     zgemm_("N", "C", &NC, &NewRank, &KB, &zOne, QB->ZM, &NC, VT, &KS, &zZero, B->ZM, &NC);
+   };
+
+  free(Work);
+  free(VT);
+  free(W);
+  free(RWork);
+  free(Sigma);
+  free(C);
+  free(RB);
+  free(RA);
+  delete QB;
+  delete QA;
+}
+
+/***************************************************************/
+/* adaptive cross approximation with partial pivoting.         */
+/*                                                             */
+/* GetRow(UserData, nr, Row) must fill in the NC entries of    */
+/* row #nr of the matrix; GetColumn(UserData, nc, Column) must */
+/* fill in the NR entries of column #nc.                       */
+/*                                                             */
+/* The iteration terminates when the norms of the two most     */
+/* recent rank-1 updates fall below Tol times the (estimated)  */
+/* Frobenius norm of the approximation so far, after which the */
+/* result is recompressed to the same tolerance.               */
+/*                                                             */
+/* If the iteration has not converged after MaxRank steps      */
+/* (MaxRank==0 means min(NR,NC)/2), the return value is NULL;  */
+/* callers should then fall back to computing the block in     */
+/* full.                                                       */
+/***************************************************************/
+LRMatrix *ACA(int NR, int NC, LRFetchFunction GetRow,
+              LRFetchFunction GetColumn, void *UserData,
+              double Tol, int MaxRank)
+{
+  int MinNRNC = (NR<NC ? NR : NC);
+  if (MaxRank<=0)
+   MaxRank = (MinNRNC+1)/2;
+  if (MaxRank>MinNRNC)
+   MaxRank = MinNRNC;
+
+  LRMatrix *L=new LRMatrix(NR, NC, MaxRank);
+  cdouble *UU = L->A->ZM;  // column k is u_k
+  cdouble *VV = L->B->ZM;  // column k is conj(v_k)
+
+  bool *RowUsed = (bool *)mallocEC(NR*sizeof(bool));
+  memset(RowUsed, 0, NR*sizeof(bool));
+  cdouble *Row = (cdouble *)mallocEC(NC*sizeof(cdouble));
+
+  double Norm2=0.0;   // squared Frobenius norm of the approximant
+  bool Converged=false;
+  int Rank=0, NumRowsTried=0, nr=0, NumSmallUpdates=0;
+  while( !Converged && Rank<MaxRank && NumRowsTried<NR )
+   {
+     /*--------------------------------------------------------------*/
+     /*- get the residual of row #nr and find its largest entry      */
+     /*--------------------------------------------------------------*/
+     RowUsed[nr]=true;
+     NumRowsTried++;
+     GetRow(UserData, nr, Row);
+     for(int k=0; k<Rank; k++)
+      { cdouble Unk=UU[nr + k*NR];
+        for(int nc=0; nc<NC; nc++)
+         Row[nc] -= Unk*conj(VV[nc + k*NC]);
+      };
+
+     int ncMax=0;
+     double MaxAbs=0.0;
+     for(int nc=0; nc<NC; nc++)
+      if ( abs(Row[nc]) > MaxAbs )
+       { MaxAbs=abs(Row[nc]); ncMax=nc; }
+
+     if (MaxAbs==0.0)
+      { // this row is already reproduced exactly; if it was the
+        // first row, the residual may still be nonzero elsewhere,
+        // so try the next unused row
+        if (Rank==0 && NumRowsTried==NR)
+         Converged=true; // the block is identically zero
+        for(nr=0; nr<NR && RowUsed[nr]; nr++)
+         ;
+        continue;
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- v_k = residual row scaled by its pivot; u_k = residual of   */
+     /*- column #ncMax                                               */
+     /*--------------------------------------------------------------*/
+     cdouble *U=UU + Rank*NR, *V=VV + Rank*NC;
+     cdouble Pivot = Row[ncMax];
+     for(int nc=0; nc<NC; nc++)
+      V[nc] = conj(Row[nc] / Pivot);
+
+     GetColumn(UserData, ncMax, U);
+     for(int k=0; k<Rank; k++)
+      { cdouble Vnk=conj(VV[ncMax + k*NC]);
+        for(int n=0; n<NR; n++)
+         U[n] -= UU[n + k*NR]*Vnk;
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- update the Frobenius-norm estimate                          */
+     /*- ||S_k||^2 = ||S_{k-1}||^2 + 2 Re sum (u_l'u_k)(v_k'v_l)     */
+     /*-             + |u_k|^2 |v_k|^2                               */
+     /*--------------------------------------------------------------*/
+     int One=1;
+     double U2=real(zdotc_(&NR, U, &One, U, &One));
+     double V2=real(zdotc_(&NC, V, &One, V, &One));
+     for(int k=0; k<Rank; k++)
+      Norm2 += 2.0*real(   zdotc_(&NR, UU + k*NR, &One, U, &One)
+                         * zdotc_(&NC, V, &One, VV + k*NC, &One) );
+     Norm2 += U2*V2;
+     Rank++;
+
+     // a single small update can be an accident of the pivot
+     // choice, so we require two in a row
+     if ( U2*V2 <= Tol*Tol*Norm2 )
+      NumSmallUpdates++;
+     else
+      NumSmallUpdates=0;
+     if (NumSmallUpdates==2)
+      Converged=true;
+
+     /*--------------------------------------------------------------*/
+     /*- next pivot row is the largest entry of u_k among the rows   */
+     /*- not yet used                                                */
+     /*--------------------------------------------------------------*/
+     MaxAbs=-1.0;
+     for(int n=0; n<NR; n++)
+      if ( !RowUsed[n] && abs(U[n])>MaxAbs )
+       { MaxAbs=abs(U[n]); nr=n; }
+     if (MaxAbs<0.0)
+      break;
+   };
+
+  free(Row);
+  free(RowUsed);
+
+  if (!Converged && NumRowsTried<NR)
+   { delete L;
+     return 0;
+   };
+
+  L->SetRank(Rank);
+  L->Recompress(Tol);
+  return L;
+}
@@ -0,0 +1,375 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * OOCMatrix.cc  -- implementation of the OOCMatrix class for square
+ *               -- complex matrices stored out of core
+ *
+ * The matrix is padded to NP=NT*NB rows and columns (NB = tile size,
+ * with the padding filled in as the identity) and stored column-major
+ * in a scratch file, which is unlinked as soon as it is created so
+ * that it disappears when the OOCMatrix is destroyed or the process
+ * exits. Each tile column (NB consecutive matrix columns) is thus a
+ * contiguous NP x NB region of the file.
+ *
+ * LUFactorize() is a left-looking blocked LU factorization with
+ * partial pivoting. The matrix is processed in super-panels of as many
+ * tile columns as fit in the memory budget; for each super-panel,
+ *
+ *  (1) the updates from all previously factorized tile columns are
+ *      applied, streaming those tile columns (below the diagonal)
+ *      through a one-tile-column buffer, and
+ *
+ *  (2) the super-panel itself is factorized in core, one tile column
+ *      at a time, right-looking within the super-panel.
+ *
+ * Row interchanges are only applied to the columns to the right of the
+ * tile column that chose them, so the L factor of each tile column is
+ * stored in the row order that held when it was factorized; LUSolve()
+ * applies the interchanges in the same interleaved order. Thus each
+ * tile column is read once per later super-panel during factorization,
+ * and the whole file is read twice per LUSolve().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <libhrutil.h>
+
+extern "C" {
+ #include "lapack.h"
+}
+
+#include "libhmat.h"
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#define OOC_DEFAULT_TILESIZE 256
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+OOCMatrix::OOCMatrix(int pN, const char *ScratchDir, size_t pMemoryBudget, int TileSize)
+{
+  N  = pN;
+  NB = (TileSize>0 ? TileSize : OOC_DEFAULT_TILESIZE);
+  if (NB>N) NB=N;
+  NT = (N + NB - 1) / NB;
+  NP = NT*NB;
+
+  /*--------------------------------------------------------------*/
+  /*- the default memory budget is half the physical memory      -*/
+  /*--------------------------------------------------------------*/
+  MemoryBudget=pMemoryBudget;
+  if (MemoryBudget==0)
+   MemoryBudget = ((size_t)sysconf(_SC_PHYS_PAGES)) * ((size_t)sysconf(_SC_PAGE_SIZE)) / 2;
+
+  // the budget must accommodate at least two tile columns
+  size_t TileColumnBytes = ((size_t)NP)*NB*sizeof(cdouble);
+  if (MemoryBudget < 2*TileColumnBytes)
+   ErrExit("%s:%i: memory budget of %lu MB is too small for out-of-core matrix (need %lu MB)",
+            __FILE__,__LINE__,(unsigned long)(MemoryBudget>>20),
+            (unsigned long)((2*TileColumnBytes)>>20));
+  PanelTiles = (int)(MemoryBudget / TileColumnBytes) - 1;
+  if (PanelTiles>NT) PanelTiles=NT;
+
+  /*--------------------------------------------------------------*/
+  /*- create and unlink the scratch file                         -*/
+  /*--------------------------------------------------------------*/
+  if (ScratchDir==0)
+   ScratchDir=getenv("TMPDIR");
+  if (ScratchDir==0)
+   ScratchDir="/tmp";
+  char *FileName=vstrdup("%s/scuff-ooc-XXXXXX",ScratchDir);
+  fd=mkstemp(FileName);
+  if (fd<0)
+   ErrExit("%s:%i: could not create scratch file in %s (%s)",
+            __FILE__,__LINE__,ScratchDir,strerror(errno));
+  unlink(FileName);
+
+  off_t FileSize = ((off_t)NP)*((off_t)NP)*((off_t)sizeof(cdouble));
+  if ( ftruncate(fd, FileSize) )
+   ErrExit("%s:%i: could not size scratch file %s to %lu GB (%s)",
+            __FILE__,__LINE__,FileName,(unsigned long)(FileSize>>30),strerror(errno));
+
+  Log("Out-of-core %ix%i matrix: %lu GB scratch file in %s, %i tile columns of width %i, %i in memory",
+       N,N,(unsigned long)(FileSize>>30),ScratchDir,NT,NB,PanelTiles);
+  free(FileName);
+
+  ipiv=(int *)mallocEC(NP*sizeof(int));
+  Factorized=false;
+}
+
+OOCMatrix::~OOCMatrix()
+{
+  close(fd);
+  free(ipiv);
+}
+
+/***************************************************************/
+/* read (write) rows Row0..Row0+NumRows-1 of columns           */
+/* Col0..Col0+NumCols-1 of the padded matrix from (to) the     */
+/* scratch file, to (from) a column-major buffer with leading  */
+/* dimension LDB                                               */
+/***************************************************************/
+void OOCMatrix::TransferBlock(bool Write, int Row0, int NumRows,
+                              int Col0, int NumCols, cdouble *Buffer, int LDB)
+{
+  // whole columns are contiguous in the file and may be
+  // transferred in a single chunk
+  if (NumRows==NP && LDB==NP)
+   { NumRows*=NumCols;
+     NumCols=1;
+   };
+
+  for(int nc=0; nc<NumCols; nc++)
+   { char *Data   = (char *)(Buffer + ((size_t)nc)*LDB);
+     size_t Size  = ((size_t)NumRows)*sizeof(cdouble);
+     off_t Offset = ( ((off_t)(Col0+nc))*NP + Row0 ) * ((off_t)sizeof(cdouble));
+     while(Size>0)
+      { ssize_t Done = Write ? pwrite(fd, Data, Size, Offset) : pread(fd, Data, Size, Offset);
+        if (Done<0 && errno==EINTR)
+         continue;
+        if (Done<=0)
+         ErrExit("%s:%i: %s error on out-of-core scratch file (%s)",__FILE__,__LINE__,
+                  Write ? "write" : "read", Done<0 ? strerror(errno) : "unexpected end of file");
+        Data+=Done;
+        Size-=Done;
+        Offset+=Done;
+      };
+   };
+}
+
+void OOCMatrix::ReadBlock(int Row0, int NumRows, int Col0, int NumCols, cdouble *Buffer, int LDB)
+ { TransferBlock(false, Row0, NumRows, Col0, NumCols, Buffer, LDB); }
+
+void OOCMatrix::WriteBlock(int Row0, int NumRows, int Col0, int NumCols, cdouble *Buffer, int LDB)
+ { TransferBlock(true, Row0, NumRows, Col0, NumCols, Buffer, LDB); }
+
+/***************************************************************/
+/* fetch function used by Copy(): UserData is the HMatrix      */
+/***************************************************************/
+static void GetHMatrixBlock(void *UserData, int NR, int *Rows, int NC, int *Cols,
+                            cdouble *Block)
+{
+  HMatrix *M=(HMatrix *)UserData;
+  for(int nc=0; nc<NC; nc++)
+   for(int nr=0; nr<NR; nr++)
+    Block[nr + nc*NR] = M->GetEntry(Rows[nr], Cols[nc]);
+}
+
+/***************************************************************/
+/* (re)compute all entries of the matrix, one super-panel of   */
+/* tile columns at a time. GetBlock is called once per NBxNB   */
+/* tile, from several threads at once.                         */
+/***************************************************************/
+void OOCMatrix::Assemble(HBlockFetchFunction GetBlock, void *UserData)
+{
+  Factorized=false;
+
+  int *Indices=(int *)mallocEC(N*sizeof(int));
+  for(int n=0; n<N; n++)
+   Indices[n]=n;
+
+  cdouble *A=(cdouble *)mallocEC(((size_t)NP)*PanelTiles*NB*sizeof(cdouble));
+  for(int J0=0; J0<NT; J0+=PanelTiles)
+   {
+     int NumTiles = (J0+PanelTiles > NT) ? NT-J0 : PanelTiles;
+     int Col0     = J0*NB;
+     LogPercent(J0, NT);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(GetNumThreads())
+#endif
+     for(int nt=0; nt<NT*NumTiles; nt++)
+      { int it = nt%NT, jt = nt/NT;
+        int R0 = it*NB, C0 = Col0 + jt*NB;
+        int NR = (R0+NB > N) ? N-R0 : NB;
+        int NC = (C0+NB > N) ? N-C0 : NB;
+        cdouble *Tile = A + R0 + ((size_t)jt)*NB*NP;
+
+        // padding rows and columns are those of the identity matrix
+        for(int nc=0; nc<NB; nc++)
+         for(int nr=0; nr<NB; nr++)
+          Tile[nr + ((size_t)nc)*NP] = (nr>=NR || nc>=NC) && (R0+nr==C0+nc) ? 1.0 : 0.0;
+
+        if (NR<=0 || NC<=0)
+         continue;
+        cdouble *Block=(cdouble *)mallocEC(NR*NC*sizeof(cdouble));
+        GetBlock(UserData, NR, Indices+R0, NC, Indices+C0, Block);
+        for(int nc=0; nc<NC; nc++)
+         memcpy(Tile + ((size_t)nc)*NP, Block + nc*NR, NR*sizeof(cdouble));
+        free(Block);
+      };
+
+     WriteBlock(0, NP, Col0, NumTiles*NB, A, NP);
+   };
+
+  free(A);
+  free(Indices);
+}
+
+void OOCMatrix::Copy(HMatrix *M)
+{
+  if ( M->NR!=N || M->NC!=N )
+   ErrExit("%s:%i: dimension mismatch in OOCMatrix::Copy",__FILE__,__LINE__);
+  Assemble(GetHMatrixBlock, (void *)M);
+}
+
+/***************************************************************/
+/* LU-factorize the matrix in place on disk, as described at   */
+/* the top of this file. the return value is as for LAPACK's   */
+/* zgetrf: zero on success, or the (1-based) index of the      */
+/* first exactly-zero pivot.                                   */
+/***************************************************************/
+int OOCMatrix::LUFactorize()
+{
+  cdouble One=1.0, MinusOne=-1.0;
+  int IOne=1, Info=0;
+
+  cdouble *A=(cdouble *)mallocEC(((size_t)NP)*PanelTiles*NB*sizeof(cdouble));
+  cdouble *L=(cdouble *)mallocEC(((size_t)NP)*NB*sizeof(cdouble));
+
+  for(int J0=0; J0<NT; J0+=PanelTiles)
+   {
+     int NumTiles = (J0+PanelTiles > NT) ? NT-J0 : PanelTiles;
+     int W        = NumTiles*NB;
+     LogPercent(J0, NT);
+
+     ReadBlock(0, NP, J0*NB, W, A, NP);
+
+     /*--------------------------------------------------------------*/
+     /*- (1) left-looking: apply the row interchanges and updates    */
+     /*-     from all previously factorized tile columns             */
+     /*--------------------------------------------------------------*/
+     for(int k=0; k<J0; k++)
+      { int R0=k*NB, M=NP-R0, MB=M-NB;
+        int k1=R0+1, k2=R0+NB;
+        ReadBlock(R0, M, R0, NB, L, M);
+        zlaswp_(&W, A, &NP, &k1, &k2, ipiv, &IOne);
+        ztrsm_("L", "L", "N", "U", &NB, &W, &One, L, &M, A+R0, &NP);
+        if (MB>0)
+         zgemm_("N", "N", &MB, &W, &NB, &MinusOne, L+NB, &M, A+R0, &NP, &One, A+R0+NB, &NP);
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- (2) factorize the super-panel in core, one tile column at a -*/
+     /*-     time; interchanges are applied only to the right        -*/
+     /*--------------------------------------------------------------*/
+     for(int t=0; t<NumTiles; t++)
+      { int k=J0+t, R0=k*NB, M=NP-R0, MB=M-NB, WR=(NumTiles-t-1)*NB;
+        int k1=R0+1, k2=R0+NB, info;
+        cdouble *Akk = A + R0 + ((size_t)t)*NB*NP;
+        zgetrf_(&M, &NB, Akk, &NP, ipiv+R0, &info);
+        if (info>0 && Info==0)
+         Info=R0+info;
+        for(int n=0; n<NB; n++)
+         ipiv[R0+n]+=R0;
+        if (WR==0)
+         continue;
+
+        cdouble *AR = A + ((size_t)(t+1))*NB*NP;
+        zlaswp_(&WR, AR, &NP, &k1, &k2, ipiv, &IOne);
+        ztrsm_("L", "L", "N", "U", &NB, &WR, &One, Akk, &NP, AR+R0, &NP);
+        if (MB>0)
+         zgemm_("N", "N", &MB, &WR, &NB, &MinusOne, Akk+NB, &NP, AR+R0, &NP, &One, AR+R0+NB, &NP);
+      };
+
+     WriteBlock(0, NP, J0*NB, W, A, NP);
+   };
+
+  free(L);
+  free(A);
+  Factorized=true;
+  return Info;
+}
+
+/***************************************************************/
+/* solve for the first nrhs columns of X, streaming the        */
+/* factorized matrix from disk one tile column at a time       */
+/***************************************************************/
+int OOCMatrix::LUSolve(HMatrix *X, int nrhs)
+{
+  if (!Factorized)
+   ErrExit("%s:%i: OOCMatrix::LUSolve called before LUFactorize",__FILE__,__LINE__);
+  if ( X->NR!=N || nrhs>X->NC || X->RealComplex!=LHM_COMPLEX )
+   ErrExit("%s:%i: dimension mismatch in OOCMatrix::LUSolve",__FILE__,__LINE__);
+  if (nrhs<=0)
+   return 0;
+
+  cdouble One=1.0, MinusOne=-1.0;
+  int IOne=1;
+
+  cdouble *B=(cdouble *)mallocEC(((size_t)NP)*nrhs*sizeof(cdouble));
+  cdouble *T=(cdouble *)mallocEC(((size_t)NP)*NB*sizeof(cdouble));
+  for(int nc=0; nc<nrhs; nc++)
+   { memcpy(B + ((size_t)nc)*NP, X->ZM + ((size_t)nc)*N, N*sizeof(cdouble));
+     for(int nr=N; nr<NP; nr++)
+      B[((size_t)nc)*NP + nr]=0.0;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- forward substitution, interleaved with row interchanges     */
+  /*--------------------------------------------------------------*/
+  for(int k=0; k<NT; k++)
+   { int R0=k*NB, M=NP-R0, MB=M-NB;
+     int k1=R0+1, k2=R0+NB;
+     ReadBlock(R0, M, R0, NB, T, M);
+     zlaswp_(&nrhs, B, &NP, &k1, &k2, ipiv, &IOne);
+     ztrsm_("L", "L", "N", "U", &NB, &nrhs, &One, T, &M, B+R0, &NP);
+     if (MB>0)
+      zgemm_("N", "N", &MB, &nrhs, &NB, &MinusOne, T+NB, &M, B+R0, &NP, &One, B+R0+NB, &NP);
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- back substitution                                           */
+  /*--------------------------------------------------------------*/
+  for(int k=NT-1; k>=0; k--)
+   { int R0=k*NB, M=R0+NB;
+     ReadBlock(0, M, R0, NB, T, M);
+     ztrsm_("L", "U", "N", "N", &NB, &nrhs, &One, T+R0, &M, B+R0, &NP);
+     if (R0>0)
+      zgemm_("N", "N", &R0, &nrhs, &NB, &MinusOne, T, &M, B+R0, &NP, &One, B, &NP);
+   };
+
+  for(int nc=0; nc<nrhs; nc++)
+   memcpy(X->ZM + ((size_t)nc)*N, B + ((size_t)nc)*NP, N*sizeof(cdouble));
+
+  free(T);
+  free(B);
+  return 0;
+}
+
+int OOCMatrix::LUSolve(HMatrix *X)
+ { return LUSolve(X, X->NC); }
+
+int OOCMatrix::LUSolve(HVector *X)
+{
+  if ( X->N!=N || X->RealComplex!=LHM_COMPLEX )
+   ErrExit("%s:%i: dimension mismatch in OOCMatrix::LUSolve",__FILE__,__LINE__);
+  HMatrix XMatrix(N, 1, X->ZV);
+  return LUSolve(&XMatrix, 1);
+}
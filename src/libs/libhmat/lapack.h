@@ -5148,6 +5148,10 @@ void zgemv_(const char *TRANS, int *M, int *N, cdouble *Alpha,
             cdouble *A, int *lda, cdouble *X, int *incx, cdouble *beta,
             cdouble *Y, int *incy);
 
+void ztrsm_(const char *SIDE, const char *UPLO, const char *TRANSA,
+            const char *DIAG, int *M, int *N, cdouble *ALPHA,
+            cdouble *A, int *LDA, cdouble *B, int *LDB);
+
 #endif /* __CLAPACK_H */
 
 #ifdef __cplusplus
@@ -255,6 +255,12 @@ class HMatrix
 
    void Zero();
    void ZeroBlock(int RowOffset, int NumRows, int ColOffset, int NumCols);
+
+   /* copy the upper triangle of the square diagonal block of size */
+   /* Size starting at (Offset,Offset) into its lower triangle      */
+   /* (without conjugation); Size<0 means the whole matrix. does    */
+   /* nothing for packed storage.                                   */
+   void CopyUpperToLower(int Offset=0, int Size=-1);
    void Adjoint();   // conjugate transpose 
    void Transpose(); // non-conjugate transpose
 
@@ -271,6 +277,11 @@ class HMatrix
    void AddBlockAdjoint(HMatrix *B, int RowOffset, int ColOffset);
    void AddBlock(SMatrix *B, int RowOffset, int ColOffset,
                  cdouble ScaleFactor=1.0);
+   // scatter-add a dense column-major block into the given rows and
+   // columns; Fold=true adds sub-diagonal entries at the transposed
+   // position (for upper-triangle assembly of symmetric matrices)
+   void AddBlock(cdouble *Block, int NRB, int NCB, int LDB,
+                 int *RowIndices, int *ColIndices, bool Fold=false);
 
    // sort of the inverse of InsertBlock
    void ExtractBlock(int RowOffset, int ColOffset, HMatrix *B);
@@ -312,6 +323,35 @@ class HMatrix
    int LUSolve(HMatrix *X, char Trans, int nrhs);
    int LUInvert();
 
+   /* Bunch-Kaufman factorization of a symmetric (not hermitian) */
+   /* matrix (xsytrf / xsptrf); only the upper triangle is       */
+   /* referenced. subsequent calls to LUSolve() use this         */
+   /* factorization.                                             */
+   int LDLFactorize();
+
+   /* mixed-precision LU factorization: a single-precision copy  */
+   /* of the matrix is factorized (sgetrf / cgetrf) and the      */
+   /* matrix itself is left intact; subsequent calls to          */
+   /* LUSolve() refine the solution to relative residual Tol,    */
+   /* refactorizing in full precision if the refinement stalls.  */
+   int MixedLUFactorize(double Tol=1.0e-8);
+
+   /* helpers for MixedLUFactorize() */
+   void ClearMixedLU();
+   int MixedLUSolve(void *X, char Trans, int nrhs);
+
+   /* building blocks for a left-looking LU factorization by     */
+   /* column panels, for callers that schedule the panel         */
+   /* operations themselves (complex, normal storage only).      */
+   /* call InitPanelLU(); then, for each panel in order, apply   */
+   /* PanelLUUpdate() for all previous panels in order and then  */
+   /* PanelLUFactorize(); finally call FinishPanelLU(). the      */
+   /* result is the same factorization as from LUFactorize().    */
+   void InitPanelLU();
+   int PanelLUFactorize(int Col, int NumCols);
+   void PanelLUUpdate(int PCol, int PNumCols, int Col, int NumCols);
+   void FinishPanelLU(int NumPanels, int *PanelStart);
+
    /* routines for cholesky-factorizing, solving, inverting */
    /* (xpotrf, xpotrs, xpotri) */
    int CholFactorize();
@@ -349,6 +389,9 @@ class HMatrix
    int RealComplex;
    int StorageType;
    int *ipiv;
+   bool LDLFactored; // true if ipiv refers to an LDLFactorize() factorization
+   void *SPLU;       // single-precision LU factors from MixedLUFactorize(), or 0
+   double SPTol;     // refinement tolerance for MixedLUFactorize()
 
    // pointers to the actual data storage. only one of these is 
    // used in a given instance so if i wanted to save 8 bytes i 
@@ -478,4 +521,274 @@ class SMatrix
     int MakeEntry(int nr, int nc, bool force_new); // internal function to allocate entries
  };
 
+/***************************************************************/
+/* LRMatrix class definition: an NR x NC complex matrix of     */
+/* rank Rank stored in factored form, U = A*B', where A is     */
+/* NR x Rank and B is NC x Rank.                               */
+/***************************************************************/
+class LRMatrix
+ {
+  public:
+
+    LRMatrix(int NR, int NC, int Rank=0);
+    LRMatrix(LRMatrix *L); // copy constructor
+    ~LRMatrix();
+
+    // change the rank, keeping the leading columns of A, B
+    void SetRank(int NewRank);
+
+    cdouble GetEntry(int nr, int nc);
+
+    // Y = U*X (or Y += U*X if Accumulate==true)
+    void Apply(HVector *X, HVector *Y, bool Accumulate=false);
+    void Apply(HMatrix *X, HMatrix *Y, bool Accumulate=false);
+
+    // add the expanded matrix into a subblock of M
+    void AddToHMatrix(HMatrix *M, int RowOffset=0, int ColOffset=0);
+
+    // non-conjugate transpose
+    void Transpose();
+
+    // discard singular values below Tol * (largest singular value)
+    void Recompress(double Tol);
+
+    int NR, NC, Rank;
+    HMatrix *A, *B;
+ };
+
+// callback used by ACA to fetch row or column #n of the matrix
+// being approximated; Values has NC (row) or NR (column) entries
+typedef void (*LRFetchFunction)(void *UserData, int n, cdouble *Values);
+
+// adaptive cross approximation; returns NULL if the iteration
+// has not converged to tolerance Tol within MaxRank steps
+LRMatrix *ACA(int NR, int NC, LRFetchFunction GetRow,
+              LRFetchFunction GetColumn, void *UserData,
+              double Tol=1.0e-6, int MaxRank=0);
+
+/***************************************************************/
+/* LRBlockMatrix class definition: a square complex matrix     */
+/* partitioned into NumBlocks x NumBlocks blocks, each of      */
+/* which is stored densely (HMatrix) or in low-rank form       */
+/* (LRMatrix). Diagonal blocks must be dense.                  */
+/***************************************************************/
+class LRBlockMatrix
+ {
+  public:
+
+    LRBlockMatrix(int NumBlocks, int *BlockSizes);
+    ~LRBlockMatrix();
+
+    // install block (nba,nbb); the LRBlockMatrix takes ownership
+    void SetBlock(int nba, int nbb, HMatrix *M);
+    void SetBlock(int nba, int nbb, LRMatrix *L);
+
+    // number of cdoubles stored in all blocks
+    size_t GetStorage();
+
+    // expand into a dense NxN matrix
+    HMatrix *GetDense(HMatrix *M=0);
+
+    // Y = M*X
+    void Apply(HVector *X, HVector *Y);
+    void Apply(HMatrix *X, HMatrix *Y);
+
+    // LU-factorize in place and solve, as for HMatrix
+    int LUFactorize();
+    int LUSolve(HVector *X);
+    int LUSolve(HMatrix *X);
+
+    int NumBlocks, N;
+    int *BlockSizes, *BlockOffsets;
+    HMatrix **DBlocks;    // DBlocks[nba*NumBlocks + nbb]
+    LRMatrix **LRBlocks;  // LRBlocks[nba*NumBlocks + nbb]
+
+ private:
+    void ClearFactorization();
+    bool Factorized;
+    int TotalRank;
+    HMatrix *Z, *BTilde, *Capacitance, *DenseLU;
+ };
+
+/***************************************************************/
+/* BlockSchurMatrix class definition: a square block matrix    */
+/* whose diagonal blocks stay fixed while its off-diagonal     */
+/* blocks change, as for BEM matrices under a list of          */
+/* geometrical transformations. the largest diagonal block is  */
+/* LU-factorized once; LUFactorize() then factorizes only its  */
+/* Schur complement.                                           */
+/***************************************************************/
+class BlockSchurMatrix
+ {
+  public:
+
+    // Symmetry = 'T' or 'C' if a missing block (nba,nbb) is the
+    // transpose or adjoint of block (nbb,nba); 'N' if it is zero
+    BlockSchurMatrix(int NumBlocks, int *BlockSizes,
+                     int RealComplex=LHM_COMPLEX, char Symmetry='T');
+    ~BlockSchurMatrix();
+
+    // install block (nba,nbb); the BlockSchurMatrix does not
+    // take ownership
+    void SetBlock(int nba, int nbb, HMatrix *M);
+
+    // call after the diagonal blocks change
+    int FactorizeDiagonalBlocks();
+
+    // call after the off-diagonal blocks change
+    int LUFactorize();
+    int LUSolve(HVector *X);
+    int LUSolve(HMatrix *X, int nrhs=0);
+
+    // log|det M|, optionally relative to the block-diagonal part
+    double GetLogDet(bool RelativeToDiagonal=false);
+
+    // Tr(M^{-1} B); B is overwritten with M^{-1} B
+    cdouble GetTraceMInv(HMatrix *B);
+
+    int NumBlocks, N, RealComplex;
+    int *BlockSizes, *BlockOffsets;
+    char Symmetry;
+    HMatrix **Blocks;      // Blocks[nba*NumBlocks + nbb]
+
+ private:
+    void MultiplyBlock(int nba, int nbb, cdouble Alpha,
+                       HMatrix *B, int BRow, HMatrix *C, int CRow, int NRHS);
+    void StampBlock(int nba, int nbb, HMatrix *Dest, int RowOffset, int ColOffset);
+    int PBlock, NRest;     // pivot block, size of Schur complement
+    int *RestOffsets;      // offsets of non-pivot blocks within S
+    double *LogDetT;       // log|det T| for each diagonal block
+    HMatrix *TPLU, *X, *S;
+    bool DiagonalFactorized, Factorized;
+ };
+
+/***************************************************************/
+/* HierMatrix class definition: an NxN complex hierarchical    */
+/* matrix (H-matrix) over a binary cluster tree, with low-rank */
+/* (LRMatrix) admissible blocks and dense inadmissible leaves. */
+/***************************************************************/
+typedef struct HCluster
+ { int Start, Size;             // DOF range in permuted ordering
+   double BBMin[3], BBMax[3];   // bounding box
+   int Children[2];             // -1 for leaf clusters
+ } HCluster;
+
+typedef struct HBlock
+ { int RowStart, NR, ColStart, NC; // in permuted ordering
+   int Type;                       // dense, low-rank, or subdivided
+   HMatrix *D;
+   LRMatrix *L;
+   struct HBlock *Children[4];     // (0,0), (0,1), (1,0), (1,1)
+ } HBlock;
+
+// callback used to fetch the NRxNC block of matrix entries with
+// the given (unpermuted) row and column indices, column-major
+typedef void (*HBlockFetchFunction)(void *UserData,
+                                    int NR, int *Rows, int NC, int *Cols,
+                                    cdouble *Block);
+
+class HierMatrix
+ {
+  public:
+
+    // build cluster and block trees; point #np is at Points[3*np],
+    // has radius Radii[np] and owns DOFs DOFOffsets[np]..DOFOffsets[np+1]-1
+    HierMatrix(int NumPoints, double *Points, double *Radii=0,
+               int *DOFOffsets=0, int LeafSize=64, double Eta=2.0);
+    ~HierMatrix();
+
+    // (re)compute all leaves; Tol is the ACA / truncation tolerance
+    void Assemble(HBlockFetchFunction GetBlock, void *UserData,
+                  double Tol=1.0e-6);
+
+    // number of cdoubles stored, and largest low-rank-block rank
+    size_t GetStorage();
+    int GetMaxRank();
+
+    // Y = M*X (before factorization)
+    void Apply(HVector *X, HVector *Y);
+    void Apply(HMatrix *X, HMatrix *Y);
+
+    // H-LU factorization in place, and solve
+    int LUFactorize();
+    int LUSolve(HVector *X);
+    int LUSolve(HMatrix *X);
+
+    int N;
+    int *Perm;   // Perm[p] = original index of permuted DOF #p
+    int LeafSize;
+    double Eta, Tol;
+
+    int NumClusters;
+    HCluster *Clusters;   // Clusters[0] is the root
+    HBlock *Root;
+    int NumLeaves;
+    HBlock **Leaves;
+
+ private:
+    int BuildCluster(int *PointOrder, int pStart, int pEnd, int DOFStart,
+                     double *Points, double *Radii, int *DOFOffsets);
+    HBlock *BuildBlock(int RowCluster, int ColCluster);
+    bool Factorized;
+ };
+
+/***************************************************************/
+/* OOCMatrix class definition: an NxN complex matrix stored    */
+/* out of core, in a scratch file, for matrices too large to   */
+/* fit in memory. the matrix is assembled in NBxNB tiles and   */
+/* LU-factorized in place on disk, keeping no more than        */
+/* MemoryBudget bytes of it in memory at any time.             */
+/***************************************************************/
+class OOCMatrix
+ {
+  public:
+
+    // ScratchDir defaults to $TMPDIR or /tmp, MemoryBudget (in
+    // bytes) to half the physical memory, TileSize to 256
+    OOCMatrix(int N, const char *ScratchDir=0, size_t MemoryBudget=0,
+              int TileSize=0);
+    ~OOCMatrix();
+
+    // (re)compute all entries; GetBlock is called once per tile,
+    // from several threads at once
+    void Assemble(HBlockFetchFunction GetBlock, void *UserData);
+
+    // copy a dense NxN matrix
+    void Copy(HMatrix *M);
+
+    // LU-factorize in place and solve, as for HMatrix
+    int LUFactorize();
+    int LUSolve(HVector *X);
+    int LUSolve(HMatrix *X);
+    int LUSolve(HMatrix *X, int nrhs);
+
+    int N;            // dimension
+    int NB, NT, NP;   // tile size, number of tile rows/columns, padded dimension
+    int PanelTiles;   // number of tile columns held in memory at once
+    size_t MemoryBudget;
+
+ private:
+    void TransferBlock(bool Write, int Row0, int NumRows, int Col0, int NumCols,
+                       cdouble *Buffer, int LDB);
+    void ReadBlock(int Row0, int NumRows, int Col0, int NumCols, cdouble *Buffer, int LDB);
+    void WriteBlock(int Row0, int NumRows, int Col0, int NumCols, cdouble *Buffer, int LDB);
+    int fd;
+    int *ipiv;
+    bool Factorized;
+ };
+
+/***************************************************************/
+/* restarted GMRES solver for M*X=B, with M (and an optional   */
+/* right preconditioner P^{-1}) supplied as routines computing */
+/* Y = M*X (Y = P^{-1}*X); returns the number of iterations,   */
+/* or -1 if the iteration failed to converge                   */
+/***************************************************************/
+typedef void (*GMRESMatVecFunction)(HVector *X, HVector *Y, void *UserData);
+
+int GMRES(HVector *B, HVector *X,
+          GMRESMatVecFunction MatVec, void *MatVecData,
+          GMRESMatVecFunction Precond=0, void *PrecondData=0,
+          double Tol=1.0e-6, int MaxIter=1000, int Restart=100,
+          double *Residual=0);
+
 #endif
@@ -0,0 +1,115 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * tAddBlock.cc -- check that HMatrix::AddBlock(cdouble *Block, ...)
+ *              -- gives the same result as entry-by-entry AddEntry
+ *              -- for all storage types
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libhmat.h"
+
+#define II cdouble(0.0,1.0)
+
+/***************************************************************/
+/* add a random block to M1 via AddEntry and to M2 via         */
+/* AddBlock, then return the largest discrepancy               */
+/***************************************************************/
+double TestAddBlock(int N, int RealComplex, int StorageType, bool Fold)
+{
+  HMatrix *M1 = new HMatrix(N, N, RealComplex, StorageType);
+  HMatrix *M2 = new HMatrix(N, N, RealComplex, StorageType);
+  M1->Zero();
+  M2->Zero();
+
+  int NRB=N/2, NCB=N/3, LDB=NRB+3;
+  cdouble *Block = new cdouble[LDB*NCB];
+  int *RowIndices = new int[NRB];
+  int *ColIndices = new int[NCB];
+  for(int i=0; i<NRB; i++)
+   RowIndices[i] = (7*i + 3) % N;
+  for(int j=0; j<NCB; j++)
+   ColIndices[j] = (5*j + 1) % N;
+  for(int n=0; n<LDB*NCB; n++)
+   Block[n] = cdouble(drand48(), drand48());
+
+  for(int j=0; j<NCB; j++)
+   for(int i=0; i<NRB; i++)
+    { int nr=RowIndices[i], nc=ColIndices[j];
+      // (for packed storage AddEntry already folds on its own)
+      if (Fold && StorageType==LHM_NORMAL && nr>nc)
+       M1->AddEntry(nc, nr, Block[i + j*LDB]);
+      else
+       M1->AddEntry(nr, nc, Block[i + j*LDB]);
+    };
+  M2->AddBlock(Block, NRB, NCB, LDB, RowIndices, ColIndices, Fold);
+
+  double MaxDiff=0.0;
+  for(int nr=0; nr<N; nr++)
+   for(int nc=0; nc<N; nc++)
+    MaxDiff=fmax(MaxDiff, abs(M1->GetEntry(nr,nc) - M2->GetEntry(nr,nc)));
+
+  delete M1;
+  delete M2;
+  delete[] Block;
+  delete[] RowIndices;
+  delete[] ColIndices;
+  return MaxDiff;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+  int N=37;
+  /* name, type, #args, max_instances, storage, count, description*/
+  OptStruct OSArray[]=
+   { {"N",        PA_INT,     1, 1, (void *)&N,        0,  "matrix dimension"},
+     {0,0,0,0,0,0,0}
+   };
+  ProcessOptions(argc, argv, OSArray);
+
+  srand48(0);
+
+  int NumFailed=0;
+  const char *RCNames[2]={"real","complex"};
+  const char *STNames[3]={"normal","symmetric","hermitian"};
+  for(int RealComplex=LHM_REAL; RealComplex<=LHM_COMPLEX; RealComplex++)
+   for(int StorageType=LHM_NORMAL; StorageType<=LHM_HERMITIAN; StorageType++)
+    for(int Fold=0; Fold<=1; Fold++)
+     { 
+       if (RealComplex==LHM_REAL && StorageType==LHM_HERMITIAN)
+        continue;
+       double MaxDiff=TestAddBlock(N, RealComplex, StorageType, Fold);
+       bool Failed = (MaxDiff > 1.0e-12);
+       printf("%-8s %-10s Fold=%i: max diff %e %s\n",
+               RCNames[RealComplex],STNames[StorageType],Fold,MaxDiff,
+               Failed ? "FAILED" : "ok");
+       if (Failed) NumFailed++;
+     };
+
+  return NumFailed==0 ? 0 : 1;
+}
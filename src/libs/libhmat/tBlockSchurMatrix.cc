@@ -0,0 +1,222 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * tBlockSchurMatrix.cc -- check BlockSchurMatrix solves, log-determinants
+ *                      -- and traces against a dense LU factorization
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libhmat.h"
+
+#define TOL 1.0e-10
+
+static cdouble RandomEntry(int RealComplex)
+{ return cdouble(drand48()-0.5, RealComplex==LHM_REAL ? 0.0 : drand48()-0.5); }
+
+static double RelDiff(HMatrix *X, HMatrix *XRef)
+{
+  double MaxDiff=0.0, MaxX=0.0;
+  for(int nr=0; nr<X->NR; nr++)
+   for(int nc=0; nc<X->NC; nc++)
+    { MaxDiff=fmax(MaxDiff, abs(X->GetEntry(nr,nc) - XRef->GetEntry(nr,nc)));
+      MaxX=fmax(MaxX, abs(XRef->GetEntry(nr,nc)));
+    };
+  return MaxDiff/MaxX;
+}
+
+static double LogDetLU(HMatrix *LU)
+{
+  double LogDet=0.0;
+  for(int n=0; n<LU->NR; n++)
+   LogDet+=log(abs(LU->GetEntry(n,n)));
+  return LogDet;
+}
+
+/***************************************************************/
+/* build a block matrix whose off-diagonal blocks below the    */
+/* diagonal are the transposes ('T') or adjoints ('C') of      */
+/* those above it; if Mated, all diagonal blocks of the same   */
+/* size share a single HMatrix. The off-diagonal blocks are    */
+/* then replaced and the matrix refactorized without touching  */
+/* the diagonal blocks, as for a new geometric transformation. */
+/***************************************************************/
+static bool RunTest(int RealComplex, char Symmetry, int NumBlocks,
+                    int *BlockSizes, bool Mated)
+{
+  BlockSchurMatrix *BSM=new BlockSchurMatrix(NumBlocks, BlockSizes, RealComplex, Symmetry);
+  int N=BSM->N, *Offsets=BSM->BlockOffsets;
+
+  /*--------------------------------------------------------------*/
+  /*- diagonal blocks: diagonally dominant; in the real case,     */
+  /*- symmetric and in packed storage                             */
+  /*--------------------------------------------------------------*/
+  HMatrix **T=(HMatrix **)mallocEC(NumBlocks*sizeof(HMatrix *));
+  bool *OwnsT=(bool *)mallocEC(NumBlocks*sizeof(bool));
+  for(int nb=0; nb<NumBlocks; nb++)
+   { int NBS=BlockSizes[nb];
+     T[nb]=0;
+     if (Mated)
+      for(int nbp=0; nbp<nb && T[nb]==0; nbp++)
+       if (BlockSizes[nbp]==NBS) T[nb]=T[nbp];
+     OwnsT[nb]=(T[nb]==0);
+     if (OwnsT[nb])
+      { bool Packed = (RealComplex==LHM_REAL);
+        T[nb]=new HMatrix(NBS, NBS, RealComplex, Packed ? LHM_SYMMETRIC : LHM_NORMAL);
+        for(int nr=0; nr<NBS; nr++)
+         for(int nc=(Packed ? nr : 0); nc<NBS; nc++)
+          T[nb]->SetEntry(nr, nc, RandomEntry(RealComplex) + (nr==nc ? 3.0 : 0.0));
+      };
+     BSM->SetBlock(nb, nb, T[nb]);
+   };
+  BSM->FactorizeDiagonalBlocks();
+
+  double LogDetT=0.0;
+  for(int nb=0; nb<NumBlocks; nb++)
+   { HMatrix *TLU=new HMatrix(BlockSizes[nb], BlockSizes[nb], RealComplex);
+     TLU->InsertBlock(T[nb], 0, 0);
+     TLU->LUFactorize();
+     LogDetT+=LogDetLU(TLU);
+     delete TLU;
+   };
+
+  int NumOffDiag=NumBlocks*(NumBlocks-1)/2;
+  HMatrix **U=(HMatrix **)mallocEC((NumOffDiag+1)*sizeof(HMatrix *));
+  for(int nb=0, nu=0; nb<NumBlocks; nb++)
+   for(int nbp=nb+1; nbp<NumBlocks; nbp++, nu++)
+    { U[nu]=new HMatrix(BlockSizes[nb], BlockSizes[nbp], RealComplex);
+      BSM->SetBlock(nb, nbp, U[nu]);
+    };
+
+  bool Success=true;
+  for(int Round=0; Round<2; Round++)
+   {
+     /*--------------------------------------------------------------*/
+     /*- new off-diagonal blocks, and the dense equivalent of BSM    */
+     /*--------------------------------------------------------------*/
+     HMatrix *M=new HMatrix(N, N, RealComplex);
+     for(int nb=0, nu=0; nb<NumBlocks; nb++)
+      { M->InsertBlock(T[nb], Offsets[nb], Offsets[nb]);
+        for(int nbp=nb+1; nbp<NumBlocks; nbp++, nu++)
+         { for(int nr=0; nr<U[nu]->NR; nr++)
+            for(int nc=0; nc<U[nu]->NC; nc++)
+             U[nu]->SetEntry(nr, nc, RandomEntry(RealComplex));
+           M->InsertBlock(U[nu], Offsets[nb], Offsets[nbp]);
+           if (Symmetry=='T')
+            M->InsertBlockTranspose(U[nu], Offsets[nbp], Offsets[nb]);
+           else
+            M->InsertBlockAdjoint(U[nu], Offsets[nbp], Offsets[nb]);
+         };
+      };
+     BSM->LUFactorize();
+     M->LUFactorize();
+
+     /*--------------------------------------------------------------*/
+     /*- solves with several right-hand sides and with a vector      */
+     /*--------------------------------------------------------------*/
+     HMatrix *B=new HMatrix(N, N, RealComplex);
+     for(int nr=0; nr<N; nr++)
+      for(int nc=0; nc<N; nc++)
+       B->SetEntry(nr, nc, RandomEntry(RealComplex));
+
+     HMatrix *XRef=new HMatrix(B);
+     M->LUSolve(XRef);
+
+     HMatrix *X=new HMatrix(B);
+     BSM->LUSolve(X, 3);
+     HMatrix XRef3(N, 3, RealComplex), X3(N, 3, RealComplex);
+     XRef->ExtractBlock(0, 0, &XRef3);
+     X->ExtractBlock(0, 0, &X3);
+     double SolveDiff=RelDiff(&X3, &XRef3);
+
+     HVector *XV=new HVector(N, RealComplex);
+     for(int n=0; n<N; n++)
+      XV->SetEntry(n, B->GetEntry(n,0));
+     BSM->LUSolve(XV);
+     HMatrix XV1(N, 1, RealComplex, LHM_NORMAL, RealComplex==LHM_REAL ? (void *)XV->DV : (void *)XV->ZV);
+     HMatrix XRef1(N, 1, RealComplex);
+     XRef->ExtractBlock(0, 0, &XRef1);
+     SolveDiff=fmax(SolveDiff, RelDiff(&XV1, &XRef1));
+
+     /*--------------------------------------------------------------*/
+     /*- log-determinants and Tr(M^{-1} B)                           */
+     /*--------------------------------------------------------------*/
+     double LogDet=LogDetLU(M);
+     double LogDetDiff = fmax( fabs(BSM->GetLogDet(false) - LogDet),
+                               fabs(BSM->GetLogDet(true)  - (LogDet-LogDetT)) );
+     cdouble TraceRef=0.0;
+     for(int n=0; n<N; n++)
+      TraceRef+=XRef->GetEntry(n,n);
+     X->Copy(B);
+     double TraceDiff = abs(BSM->GetTraceMInv(X) - TraceRef) / abs(TraceRef);
+
+     bool Failed = ( SolveDiff>TOL || LogDetDiff>TOL*fabs(LogDet) || TraceDiff>TOL );
+     printf("%-7s %c %i blocks%s, round %i: solve %.1e, logdet %.1e, trace %.1e %s\n",
+             RealComplex==LHM_REAL ? "real" : "complex", Symmetry, NumBlocks,
+             Mated ? " (mated)" : "        ", Round,
+             SolveDiff, LogDetDiff, TraceDiff, Failed ? "FAILED" : "ok");
+     if (Failed) Success=false;
+
+     delete XV;
+     delete X;
+     delete XRef;
+     delete B;
+     delete M;
+   };
+
+  for(int nu=0; nu<NumOffDiag; nu++)
+   delete U[nu];
+  free(U);
+  for(int nb=0; nb<NumBlocks; nb++)
+   if (OwnsT[nb]) delete T[nb];
+  free(OwnsT);
+  free(T);
+  delete BSM;
+  return Success;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+  SetLogFileName("tBlockSchurMatrix.log");
+  srand48(0);
+
+  int Sizes2[2] = {60, 90};
+  int Sizes3[3] = {50, 80, 50};
+  int Sizes4[4] = {40, 70, 40, 30};
+
+  int NumFailed=0;
+  for(int RealComplex=LHM_REAL; RealComplex<=LHM_COMPLEX; RealComplex++)
+   for(int ns=0; ns<2; ns++)
+    { char Symmetry = (ns==0 ? 'T' : 'C');
+      if (!RunTest(RealComplex, Symmetry, 2, Sizes2, false)) NumFailed++;
+      if (!RunTest(RealComplex, Symmetry, 3, Sizes3, false)) NumFailed++;
+      if (!RunTest(RealComplex, Symmetry, 3, Sizes3, true))  NumFailed++;
+      if (!RunTest(RealComplex, Symmetry, 4, Sizes4, true))  NumFailed++;
+    };
+
+  return NumFailed==0 ? 0 : 1;
+}
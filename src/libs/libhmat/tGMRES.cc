@@ -0,0 +1,137 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * tGMRES.cc -- check GMRES, with and without a block-diagonal
+ *           -- preconditioner, against a dense LU solve
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libhmat.h"
+
+/***************************************************************/
+/* block-diagonal preconditioner: LU-factored diagonal blocks  */
+/***************************************************************/
+typedef struct PrecondData
+ { int NumBlocks, BlockSize;
+   HMatrix **Blocks;
+ } PrecondData;
+
+static void MatVec(HVector *X, HVector *Y, void *UserData)
+{ ((HMatrix *)UserData)->Apply(X, Y); }
+
+static void Precond(HVector *X, HVector *Y, void *UserData)
+{
+  PrecondData *PD=(PrecondData *)UserData;
+  Y->Copy(X);
+  for(int nb=0; nb<PD->NumBlocks; nb++)
+   { HVector YBlock(PD->BlockSize, LHM_COMPLEX, Y->ZV + nb*PD->BlockSize);
+     PD->Blocks[nb]->LUSolve(&YBlock);
+   };
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+  int BlockSize=100;
+  int NumBlocks=4;
+  double Coupling=0.3;
+  double Tol=1.0e-10;
+  /* name, type, #args, max_instances, storage, count, description*/
+  OptStruct OSArray[]=
+   { {"BlockSize", PA_INT,    1, 1, (void *)&BlockSize, 0, "diagonal block size"},
+     {"NumBlocks", PA_INT,    1, 1, (void *)&NumBlocks, 0, "number of diagonal blocks"},
+     {"Coupling",  PA_DOUBLE, 1, 1, (void *)&Coupling,  0, "strength of off-diagonal coupling"},
+     {"Tol",       PA_DOUBLE, 1, 1, (void *)&Tol,       0, "GMRES tolerance"},
+     {0,0,0,0,0,0,0}
+   };
+  ProcessOptions(argc, argv, OSArray);
+
+  /*--------------------------------------------------------------*/
+  /*- random matrix with strong, poorly-conditioned diagonal      */
+  /*- blocks and weaker off-diagonal coupling                     */
+  /*--------------------------------------------------------------*/
+  srand48(0);
+  int N=NumBlocks*BlockSize;
+  HMatrix *M=new HMatrix(N, N, LHM_COMPLEX);
+  for(int nr=0; nr<N; nr++)
+   for(int nc=0; nc<N; nc++)
+    { cdouble Z=cdouble(drand48()-0.5, drand48()-0.5) / sqrt((double)BlockSize);
+      if (nr/BlockSize != nc/BlockSize)
+       Z*=Coupling;
+      else if (nr==nc)
+       Z+=0.1*(1.0 + nr%BlockSize);
+      M->SetEntry(nr, nc, Z);
+    };
+
+  PrecondData MyPD, *PD=&MyPD;
+  PD->NumBlocks=NumBlocks;
+  PD->BlockSize=BlockSize;
+  PD->Blocks=(HMatrix **)mallocEC(NumBlocks*sizeof(HMatrix *));
+  for(int nb=0; nb<NumBlocks; nb++)
+   { PD->Blocks[nb]=new HMatrix(BlockSize, BlockSize, LHM_COMPLEX);
+     M->ExtractBlock(nb*BlockSize, nb*BlockSize, PD->Blocks[nb]);
+     PD->Blocks[nb]->LUFactorize();
+   };
+
+  HVector *X=new HVector(N, LHM_COMPLEX);
+  HVector *B=new HVector(N, LHM_COMPLEX);
+  for(int n=0; n<N; n++)
+   X->SetEntry(n, cdouble(drand48()-0.5, drand48()-0.5));
+  M->Apply(X, B);
+
+  /*--------------------------------------------------------------*/
+  /*- solve with and without preconditioning                      */
+  /*--------------------------------------------------------------*/
+  int NumFailed=0;
+  HVector *XG=new HVector(N, LHM_COMPLEX);
+  for(int UsePrecond=0; UsePrecond<2; UsePrecond++)
+   { XG->Zero();
+     double Residual;
+     int NumIters=GMRES(B, XG, MatVec, (void *)M,
+                        UsePrecond ? Precond : 0, (void *)PD,
+                        Tol, 10*N, 50, &Residual);
+     double MaxDiff=0.0, MaxX=0.0;
+     for(int n=0; n<N; n++)
+      { MaxDiff=fmax(MaxDiff, abs(XG->ZV[n]-X->ZV[n]));
+        MaxX=fmax(MaxX, abs(X->ZV[n]));
+      };
+     bool Failed = (NumIters<0 || MaxDiff > 1.0e4*Tol*MaxX);
+     printf("%-15s: %4i iterations, residual %.2e, rel. diff %.2e %s\n",
+             UsePrecond ? "preconditioned" : "plain",
+             NumIters, Residual, MaxDiff/MaxX, Failed ? "FAILED" : "ok");
+     if (Failed) NumFailed++;
+   };
+
+  delete XG;
+  delete B;
+  delete X;
+  for(int nb=0; nb<NumBlocks; nb++)
+   delete PD->Blocks[nb];
+  free(PD->Blocks);
+  delete M;
+  return NumFailed==0 ? 0 : 1;
+}
@@ -0,0 +1,159 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * tHierMatrix.cc -- check HierMatrix assembly, matrix-vector product,
+ *                -- and H-LU solve for a Helmholtz-kernel matrix on
+ *                -- points scattered over the surfaces of two spheres
+ *                -- against dense results
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libhmat.h"
+
+#define II cdouble(0.0,1.0)
+
+typedef struct KernelData
+ { double *X;
+   double k, Diag;
+   int DOFsPerPoint;
+ } KernelData;
+
+static cdouble Kernel(KernelData *KD, int n1, int n2)
+{
+  int np1=n1/KD->DOFsPerPoint, np2=n2/KD->DOFsPerPoint;
+  if (np1==np2)
+   return n1==n2 ? KD->Diag : 0.5*KD->Diag;
+  double *X1=KD->X + 3*np1, *X2=KD->X + 3*np2;
+  double r=sqrt( (X1[0]-X2[0])*(X1[0]-X2[0])
+                +(X1[1]-X2[1])*(X1[1]-X2[1])
+                +(X1[2]-X2[2])*(X1[2]-X2[2]) );
+  return exp(II*KD->k*r)/r;
+}
+
+static void GetBlock(void *UserData, int NR, int *Rows, int NC, int *Cols,
+                     cdouble *Block)
+{
+  KernelData *KD=(KernelData *)UserData;
+  for(int nc=0; nc<NC; nc++)
+   for(int nr=0; nr<NR; nr++)
+    Block[nr + nc*NR]=Kernel(KD, Rows[nr], Cols[nc]);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+  int NumPoints=1000;
+  int LeafSize=32;
+  double Tol=1.0e-8;
+  /* name, type, #args, max_instances, storage, count, description*/
+  OptStruct OSArray[]=
+   { {"NumPoints", PA_INT,    1, 1, (void *)&NumPoints, 0, "number of points"},
+     {"LeafSize",  PA_INT,    1, 1, (void *)&LeafSize,  0, "cluster-tree leaf size"},
+     {"Tol",       PA_DOUBLE, 1, 1, (void *)&Tol,       0, "ACA / truncation tolerance"},
+     {0,0,0,0,0,0,0}
+   };
+  ProcessOptions(argc, argv, OSArray);
+
+  /*--------------------------------------------------------------*/
+  /*- random points on two unit spheres, two DOFs per point       */
+  /*--------------------------------------------------------------*/
+  srand48(0);
+  KernelData MyKD, *KD=&MyKD;
+  KD->X=(double *)mallocEC(3*NumPoints*sizeof(double));
+  KD->k=1.0;
+  KD->Diag=0.5*NumPoints;
+  KD->DOFsPerPoint=2;
+  for(int np=0; np<NumPoints; np++)
+   { double CosTheta=2.0*drand48()-1.0, Phi=2.0*M_PI*drand48();
+     double SinTheta=sqrt(1.0-CosTheta*CosTheta);
+     KD->X[3*np+0] = SinTheta*cos(Phi) + (np%2 ? 3.0 : 0.0);
+     KD->X[3*np+1] = SinTheta*sin(Phi);
+     KD->X[3*np+2] = CosTheta;
+   };
+  int *DOFOffsets=(int *)mallocEC((NumPoints+1)*sizeof(int));
+  for(int np=0; np<=NumPoints; np++)
+   DOFOffsets[np]=2*np;
+  int N=2*NumPoints;
+
+  HierMatrix *H=new HierMatrix(NumPoints, KD->X, 0, DOFOffsets, LeafSize);
+  H->Assemble(GetBlock, (void *)KD, Tol);
+  printf("%i clusters, %i leaves, max rank %i, storage %lu / %lu\n",
+          H->NumClusters, H->NumLeaves, H->GetMaxRank(),
+          (unsigned long)H->GetStorage(), ((unsigned long)N)*N);
+
+  HMatrix *M=new HMatrix(N, N, LHM_COMPLEX);
+  int *Indices=(int *)mallocEC(N*sizeof(int));
+  for(int n=0; n<N; n++) Indices[n]=n;
+  GetBlock((void *)KD, N, Indices, N, Indices, M->ZM);
+
+  /*--------------------------------------------------------------*/
+  /*- matrix-vector product                                       */
+  /*--------------------------------------------------------------*/
+  HVector *X=new HVector(N, LHM_COMPLEX);
+  HVector *Y1=new HVector(N, LHM_COMPLEX);
+  HVector *Y2=new HVector(N, LHM_COMPLEX);
+  for(int n=0; n<N; n++)
+   X->SetEntry(n, cdouble(drand48()-0.5, drand48()-0.5));
+  M->Apply(X, Y1);
+  H->Apply(X, Y2);
+
+  int NumFailed=0;
+  double MaxDiff=0.0, MaxY=0.0;
+  for(int n=0; n<N; n++)
+   { MaxDiff=fmax(MaxDiff, abs(Y1->ZV[n]-Y2->ZV[n]));
+     MaxY=fmax(MaxY, abs(Y1->ZV[n]));
+   };
+  bool Failed = (MaxDiff > 1.0e3*Tol*MaxY);
+  printf("Apply:   rel. diff %e %s\n", MaxDiff/MaxY, Failed ? "FAILED" : "ok");
+  if (Failed) NumFailed++;
+
+  /*--------------------------------------------------------------*/
+  /*- H-LU solve of the dense matrix-vector product should give   */
+  /*- back X                                                      */
+  /*--------------------------------------------------------------*/
+  H->LUFactorize();
+  H->LUSolve(Y1);
+  MaxDiff=0.0;
+  double MaxX=0.0;
+  for(int n=0; n<N; n++)
+   { MaxDiff=fmax(MaxDiff, abs(Y1->ZV[n]-X->ZV[n]));
+     MaxX=fmax(MaxX, abs(X->ZV[n]));
+   };
+  Failed = (MaxDiff > 1.0e3*Tol*MaxX);
+  printf("LUSolve: rel. diff %e %s\n", MaxDiff/MaxX, Failed ? "FAILED" : "ok");
+  if (Failed) NumFailed++;
+
+  delete X;
+  delete Y1;
+  delete Y2;
+  delete M;
+  delete H;
+  free(Indices);
+  free(DOFOffsets);
+  free(KD->X);
+  return NumFailed==0 ? 0 : 1;
+}
@@ -0,0 +1,153 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * tLDLSolve.cc -- compare the LDLFactorize() and packed-storage
+ *              -- solvers for symmetric matrices against LUFactorize()
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <libhrutil.h>
+#include "libhmat.h"
+
+#if defined(_WIN32)
+#  define srand48 srand
+#  define drand48 my_drand48
+static double my_drand48(void) {
+  return rand() * 1.0 / RAND_MAX;
+}
+#endif
+
+/***************************************************************/
+/* max |X_ij - Y_ij| / max |Y_ij| ******************************/
+/***************************************************************/
+double RelDiff(HMatrix *X, HMatrix *Y)
+{
+  double MaxDiff=0.0, MaxY=0.0;
+  for(int nr=0; nr<X->NR; nr++)
+   for(int nc=0; nc<X->NC; nc++)
+    { MaxDiff = fmax(MaxDiff, abs(X->GetEntry(nr,nc) - Y->GetEntry(nr,nc)));
+      MaxY    = fmax(MaxY, abs(Y->GetEntry(nr,nc)));
+    };
+  return MaxDiff / MaxY;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{ 
+  /*--------------------------------------------------------------*/
+  /*- process options  -------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  int N=1000;
+  int NRHS=10;
+  int Complex=0;
+  /* name               type    #args  max_instances  storage           count         description*/
+  OptStruct OSArray[]=
+   { {"N",       PA_INT,     1, 1, (void *)&N,       0, "dimension "},
+     {"NRHS",    PA_INT,     1, 1, (void *)&NRHS,    0, "number of right-hand sides"},
+     {"Complex", PA_BOOL,    0, 1, (void *)&Complex, 0, "complex-valued matrix"},
+     {0,0,0,0,0,0,0}
+   };
+  ProcessOptions(argc, argv, OSArray);
+
+  int RC = Complex ? LHM_COMPLEX : LHM_REAL;
+  cdouble II = Complex ? cdouble(0.0,1.0) : cdouble(0.0,0.0);
+  srand48(time(0));
+
+  /*--------------------------------------------------------------*/
+  /*- MFull is a random symmetric (not hermitian) matrix; MUpper  */
+  /*- has the same upper triangle but garbage below the diagonal; */
+  /*- MPacked has the same entries in packed storage.             */
+  /*--------------------------------------------------------------*/
+  printf("Creating random symmetric %ix%i matrices ... \n",N,N);
+  HMatrix *MFull   = new HMatrix(N, N, RC);
+  HMatrix *MUpper  = new HMatrix(N, N, RC);
+  HMatrix *MPacked = new HMatrix(N, N, RC, LHM_SYMMETRIC);
+  for(int nr=0; nr<N; nr++)
+   for(int nc=nr; nc<N; nc++)
+    { cdouble Entry = drand48() + II*drand48();
+      if (nr==nc) Entry += (double)N;
+      MFull->SetEntry(nr, nc, Entry);
+      MFull->SetEntry(nc, nr, Entry);
+      MUpper->SetEntry(nr, nc, Entry);
+      if (nc>nr) MUpper->SetEntry(nc, nr, -1.0e10);
+      MPacked->SetEntry(nr, nc, Entry);
+    };
+
+  HMatrix *B = new HMatrix(N, NRHS, RC);
+  for(int nr=0; nr<N; nr++)
+   for(int nc=0; nc<NRHS; nc++)
+    B->SetEntry(nr, nc, drand48() + II*drand48());
+  HMatrix *XLU     = new HMatrix(B);
+  HMatrix *XLDL    = new HMatrix(B);
+  HMatrix *XPacked = new HMatrix(B);
+
+  /*--------------------------------------------------------------*/
+  /*- check CopyUpperToLower ------------------------------------*/
+  /*--------------------------------------------------------------*/
+  HMatrix *MCopy = new HMatrix(MUpper);
+  MCopy->CopyUpperToLower();
+  printf("CopyUpperToLower: rel diff %e\n",RelDiff(MCopy, MFull));
+  delete MCopy;
+
+  /*--------------------------------------------------------------*/
+  /*- solve by all three methods --------------------------------*/
+  /*--------------------------------------------------------------*/
+  printf("LU-factorizing full matrix...");
+  Tic();
+  MFull->LUFactorize();
+  printf("...%.3f s\n",Toc());
+  MFull->LUSolve(XLU);
+
+  printf("LDL-factorizing upper triangle...");
+  Tic();
+  MUpper->LDLFactorize();
+  printf("...%.3f s\n",Toc());
+  MUpper->LUSolve(XLDL);
+
+  printf("Factorizing packed matrix...");
+  Tic();
+  MPacked->LUFactorize();
+  printf("...%.3f s\n",Toc());
+  MPacked->LUSolve(XPacked);
+
+  double E1=RelDiff(XLDL, XLU), E2=RelDiff(XPacked, XLU);
+  printf("LDL    vs. LU: rel diff %e\n",E1);
+  printf("packed vs. LU: rel diff %e\n",E2);
+
+  /*--------------------------------------------------------------*/
+  /*- check inversion from the LDL factorization ----------------*/
+  /*--------------------------------------------------------------*/
+  MFull->LUInvert();
+  MUpper->LUInvert();
+  double E3=RelDiff(MUpper, MFull);
+  printf("LDL    vs. LU inverse: rel diff %e\n",E3);
+
+  if ( E1>1.0e-8 || E2>1.0e-8 || E3>1.0e-8 )
+   { printf("FAILED\n");
+     return 1;
+   };
+  printf("PASSED\n");
+  return 0;
+}
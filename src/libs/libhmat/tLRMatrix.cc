@@ -0,0 +1,188 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * tLRMatrix.cc -- check ACA compression of a smooth Helmholtz-kernel
+ *              -- block and the LRBlockMatrix Apply / LUSolve routines
+ *              -- against their dense counterparts
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libhmat.h"
+
+#define II cdouble(0.0,1.0)
+
+/***************************************************************/
+/* point clouds: NumClusters clusters of N points each, the    */
+/* clusters centered at (4*nc, 0, 0) in a unit cube            */
+/***************************************************************/
+typedef struct KernelData
+ { double *XA, *XB;
+   int NA, NB;
+   double k;
+ } KernelData;
+
+static cdouble Kernel(KernelData *KD, int na, int nb)
+{
+  double *XA=KD->XA + 3*na, *XB=KD->XB + 3*nb;
+  double r=sqrt( (XA[0]-XB[0])*(XA[0]-XB[0])
+                +(XA[1]-XB[1])*(XA[1]-XB[1])
+                +(XA[2]-XB[2])*(XA[2]-XB[2]) );
+  return exp(II*KD->k*r)/r;
+}
+
+static void GetRow(void *UserData, int nr, cdouble *Row)
+{ KernelData *KD=(KernelData *)UserData;
+  for(int nc=0; nc<KD->NB; nc++)
+   Row[nc]=Kernel(KD, nr, nc);
+}
+
+static void GetColumn(void *UserData, int nc, cdouble *Column)
+{ KernelData *KD=(KernelData *)UserData;
+  for(int nr=0; nr<KD->NA; nr++)
+   Column[nr]=Kernel(KD, nr, nc);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+  int N=120;
+  int NumClusters=3;
+  double Tol=1.0e-8;
+  /* name, type, #args, max_instances, storage, count, description*/
+  OptStruct OSArray[]=
+   { {"N",        PA_INT,     1, 1, (void *)&N,           0,  "points per cluster"},
+     {"NumClusters", PA_INT,  1, 1, (void *)&NumClusters, 0,  "number of clusters"},
+     {"Tol",      PA_DOUBLE,  1, 1, (void *)&Tol,         0,  "ACA tolerance"},
+     {0,0,0,0,0,0,0}
+   };
+  ProcessOptions(argc, argv, OSArray);
+
+  srand48(0);
+  double *X=(double *)mallocEC(3*N*NumClusters*sizeof(double));
+  for(int n=0; n<N*NumClusters; n++)
+   { X[3*n+0] = 4.0*(n/N) + drand48();
+     X[3*n+1] = drand48();
+     X[3*n+2] = drand48();
+   };
+
+  int NumFailed=0;
+
+  /*--------------------------------------------------------------*/
+  /*- assemble the block matrix with ACA off-diagonal blocks      */
+  /*--------------------------------------------------------------*/
+  int *BlockSizes=(int *)mallocEC(NumClusters*sizeof(int));
+  for(int nb=0; nb<NumClusters; nb++)
+   BlockSizes[nb]=N;
+  LRBlockMatrix *LRB=new LRBlockMatrix(NumClusters, BlockSizes);
+  HMatrix *M=new HMatrix(N*NumClusters, N*NumClusters, LHM_COMPLEX);
+  KernelData MyKD, *KD=&MyKD;
+  KD->NA=KD->NB=N;
+  KD->k=1.5;
+  for(int nba=0; nba<NumClusters; nba++)
+   for(int nbb=0; nbb<NumClusters; nbb++)
+    { KD->XA = X + 3*N*nba;
+      KD->XB = X + 3*N*nbb;
+      if (nba==nbb)
+       { HMatrix *D=new HMatrix(N, N, LHM_COMPLEX);
+         for(int nr=0; nr<N; nr++)
+          for(int nc=0; nc<N; nc++)
+           D->SetEntry(nr, nc, nr==nc ? 10.0*N : Kernel(KD,nr,nc));
+         M->InsertBlock(D, N*nba, N*nbb);
+         LRB->SetBlock(nba, nbb, D);
+         continue;
+       };
+
+      for(int nr=0; nr<N; nr++)
+       for(int nc=0; nc<N; nc++)
+        M->SetEntry(N*nba+nr, N*nbb+nc, Kernel(KD,nr,nc));
+
+      LRMatrix *L=ACA(N, N, GetRow, GetColumn, (void *)KD, Tol);
+      if (L==0)
+       { printf("block (%i,%i): ACA did not converge FAILED\n",nba,nbb);
+         NumFailed++;
+         continue;
+       };
+
+      double MaxErr=0.0, MaxVal=0.0;
+      for(int nr=0; nr<N; nr++)
+       for(int nc=0; nc<N; nc++)
+        { cdouble Exact=Kernel(KD,nr,nc);
+          MaxErr=fmax(MaxErr, abs(Exact - L->GetEntry(nr,nc)));
+          MaxVal=fmax(MaxVal, abs(Exact));
+        };
+      bool Failed = (MaxErr > 100.0*Tol*MaxVal);
+      printf("block (%i,%i): rank %3i, rel. error %e %s\n",
+              nba,nbb,L->Rank,MaxErr/MaxVal, Failed ? "FAILED" : "ok");
+      if (Failed) NumFailed++;
+      LRB->SetBlock(nba, nbb, L);
+    };
+  printf("storage: %lu of %i entries\n",
+          (unsigned long)LRB->GetStorage(), N*N*NumClusters*NumClusters);
+
+  /*--------------------------------------------------------------*/
+  /*- compare matvec and linear solve against dense versions      */
+  /*--------------------------------------------------------------*/
+  int NT=N*NumClusters;
+  HVector *XV=new HVector(NT, LHM_COMPLEX);
+  HVector *Y1=new HVector(NT, LHM_COMPLEX);
+  HVector *Y2=new HVector(NT, LHM_COMPLEX);
+  for(int n=0; n<NT; n++)
+   XV->SetEntry(n, cdouble(drand48()-0.5, drand48()-0.5));
+
+  M->Apply(XV, Y1);
+  LRB->Apply(XV, Y2);
+  double MaxDiff=0.0, MaxY=0.0;
+  for(int n=0; n<NT; n++)
+   { MaxDiff=fmax(MaxDiff, abs(Y1->ZV[n]-Y2->ZV[n]));
+     MaxY=fmax(MaxY, abs(Y1->ZV[n]));
+   };
+  bool Failed = (MaxDiff > 1.0e3*Tol*MaxY);
+  printf("Apply:   rel. diff %e %s\n",MaxDiff/MaxY, Failed ? "FAILED" : "ok");
+  if (Failed) NumFailed++;
+
+  M->LUFactorize();
+  LRB->LUFactorize();
+  M->LUSolve(Y1);
+  LRB->LUSolve(Y2);
+  MaxDiff=MaxY=0.0;
+  for(int n=0; n<NT; n++)
+   { MaxDiff=fmax(MaxDiff, abs(Y1->ZV[n]-Y2->ZV[n]));
+     MaxY=fmax(MaxY, abs(Y1->ZV[n]));
+   };
+  Failed = (MaxDiff > 1.0e3*Tol*MaxY);
+  printf("LUSolve: rel. diff %e %s\n",MaxDiff/MaxY, Failed ? "FAILED" : "ok");
+  if (Failed) NumFailed++;
+
+  delete XV;
+  delete Y1;
+  delete Y2;
+  delete M;
+  delete LRB;
+  free(BlockSizes);
+  free(X);
+  return NumFailed==0 ? 0 : 1;
+}
@@ -0,0 +1,153 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * tMixedLU.cc -- check mixed-precision LU factorization with iterative
+ *             -- refinement: the residual must reach the requested
+ *             -- tolerance, and an ill-conditioned matrix must fall
+ *             -- back to the full-precision LU solution
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libhmat.h"
+
+/***************************************************************/
+/* relative residual max_nc |B - A*X|_inf / |B|_inf            */
+/***************************************************************/
+static double GetResidual(HMatrix *A, HMatrix *X, HMatrix *B)
+{
+  double Residual=0.0;
+  for(int nc=0; nc<B->NC; nc++)
+   { double RNorm=0.0, BNorm=0.0;
+     for(int nr=0; nr<A->NR; nr++)
+      { cdouble AX=0.0;
+        for(int k=0; k<A->NC; k++)
+         AX += A->GetEntry(nr,k) * X->GetEntry(k,nc);
+        RNorm=fmax(RNorm, abs(B->GetEntry(nr,nc) - AX));
+        BNorm=fmax(BNorm, abs(B->GetEntry(nr,nc)));
+      };
+     Residual=fmax(Residual, RNorm/BNorm);
+   };
+  return Residual;
+}
+
+static double RelDiff(HMatrix *X, HMatrix *XRef)
+{
+  double MaxDiff=0.0, MaxX=0.0;
+  for(int nr=0; nr<X->NR; nr++)
+   for(int nc=0; nc<X->NC; nc++)
+    { MaxDiff=fmax(MaxDiff, abs(X->GetEntry(nr,nc) - XRef->GetEntry(nr,nc)));
+      MaxX=fmax(MaxX, abs(XRef->GetEntry(nr,nc)));
+    };
+  return MaxDiff/MaxX;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+  int N=200;
+  int NRHS=2;
+  double Tol=1.0e-12;
+  /* name, type, #args, max_instances, storage, count, description*/
+  OptStruct OSArray[]=
+   { {"N",    PA_INT,    1, 1, (void *)&N,    0, "matrix dimension"},
+     {"NRHS", PA_INT,    1, 1, (void *)&NRHS, 0, "number of right-hand sides"},
+     {"Tol",  PA_DOUBLE, 1, 1, (void *)&Tol,  0, "refinement tolerance"},
+     {0,0,0,0,0,0,0}
+   };
+  ProcessOptions(argc, argv, OSArray);
+  SetLogFileName("tMixedLU.log");
+
+  srand48(0);
+  int NumFailed=0;
+  for(int RealComplex=LHM_REAL; RealComplex<=LHM_COMPLEX; RealComplex++)
+   for(int IllConditioned=0; IllConditioned<2; IllConditioned++)
+    {
+      /*--------------------------------------------------------------*/
+      /*- random matrix; in the ill-conditioned case the last row     */
+      /*- nearly duplicates the one before it, so that cond(A) is     */
+      /*- far beyond what single-precision refinement can handle      */
+      /*--------------------------------------------------------------*/
+      bool Real = (RealComplex==LHM_REAL);
+      HMatrix *A=new HMatrix(N, N, RealComplex);
+      for(int nr=0; nr<N; nr++)
+       for(int nc=0; nc<N; nc++)
+        A->SetEntry(nr, nc, cdouble(drand48()-0.5, Real ? 0.0 : drand48()-0.5));
+      if (IllConditioned)
+       for(int nc=0; nc<N; nc++)
+        A->SetEntry(N-1, nc, A->GetEntry(N-2,nc)
+                              + 1.0e-9*cdouble(drand48()-0.5, Real ? 0.0 : drand48()-0.5));
+
+      HMatrix *B=new HMatrix(N, NRHS, RealComplex);
+      for(int nr=0; nr<N; nr++)
+       for(int nc=0; nc<NRHS; nc++)
+        B->SetEntry(nr, nc, cdouble(drand48()-0.5, Real ? 0.0 : drand48()-0.5));
+
+      // reference solution from full-precision LU
+      HMatrix *XRef=new HMatrix(B);
+      HMatrix *ALU=new HMatrix(A);
+      ALU->LUFactorize();
+      ALU->LUSolve(XRef);
+
+      /*--------------------------------------------------------------*/
+      /*- mixed-precision factorization and solve                     */
+      /*--------------------------------------------------------------*/
+      HMatrix *AMixed=new HMatrix(A);
+      AMixed->MixedLUFactorize(Tol);
+      bool WasMixed = (AMixed->SPLU!=0);
+      HMatrix *X=new HMatrix(B);
+      int Info=AMixed->LUSolve(X);
+      bool FellBack = (AMixed->SPLU==0);
+
+      double Residual=GetResidual(A, X, B);
+      double Diff=RelDiff(X, XRef);
+
+      // a well-conditioned system must converge in mixed precision to
+      // the requested residual; an ill-conditioned one must be handed
+      // off to the full-precision LU and reproduce its solution
+      bool Failed;
+      if (IllConditioned)
+       Failed = ( Info!=0 || !FellBack || Diff>1.0e-12 );
+      else
+       Failed = ( Info!=0 || !WasMixed || FellBack || Residual>Tol );
+
+      printf("%-7s %-17s: %s, residual %.2e, rel. diff %.2e %s\n",
+              Real ? "real" : "complex",
+              IllConditioned ? "ill-conditioned" : "well-conditioned",
+              FellBack ? "full precision" : "mixed precision",
+              Residual, Diff, Failed ? "FAILED" : "ok");
+      if (Failed) NumFailed++;
+
+      delete X;
+      delete AMixed;
+      delete ALU;
+      delete XRef;
+      delete B;
+      delete A;
+    };
+
+  return NumFailed==0 ? 0 : 1;
+}
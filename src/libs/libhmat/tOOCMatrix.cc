@@ -0,0 +1,124 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * tOOCMatrix.cc -- check out-of-core LU factorization and solve
+ *               -- against the in-core HMatrix routines
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libhmat.h"
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+static double RelDiff(cdouble *X, cdouble *XRef, int N)
+{
+  double MaxDiff=0.0, MaxX=0.0;
+  for(int n=0; n<N; n++)
+   { MaxDiff=fmax(MaxDiff, abs(X[n]-XRef[n]));
+     MaxX=fmax(MaxX, abs(XRef[n]));
+   };
+  return MaxDiff/MaxX;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+  int N=300;          // deliberately not a multiple of TileSize
+  int TileSize=64;
+  int NRHS=3;
+  /* name, type, #args, max_instances, storage, count, description*/
+  OptStruct OSArray[]=
+   { {"N",        PA_INT, 1, 1, (void *)&N,        0, "matrix dimension"},
+     {"TileSize", PA_INT, 1, 1, (void *)&TileSize, 0, "out-of-core tile size"},
+     {"NRHS",     PA_INT, 1, 1, (void *)&NRHS,     0, "number of right-hand sides"},
+     {0,0,0,0,0,0,0}
+   };
+  ProcessOptions(argc, argv, OSArray);
+  SetLogFileName("tOOCMatrix.log");
+
+  /*--------------------------------------------------------------*/
+  /*- random matrix and right-hand sides; reference solution from */
+  /*- the in-core LU                                              */
+  /*--------------------------------------------------------------*/
+  srand48(0);
+  HMatrix *M=new HMatrix(N, N, LHM_COMPLEX);
+  for(int nr=0; nr<N; nr++)
+   for(int nc=0; nc<N; nc++)
+    M->SetEntry(nr, nc, cdouble(drand48()-0.5, drand48()-0.5));
+
+  HMatrix *B=new HMatrix(N, NRHS, LHM_COMPLEX);
+  for(int nr=0; nr<N; nr++)
+   for(int nc=0; nc<NRHS; nc++)
+    B->SetEntry(nr, nc, cdouble(drand48()-0.5, drand48()-0.5));
+
+  HMatrix *XRef=new HMatrix(B);
+  HMatrix *MLU=new HMatrix(M);
+  MLU->LUFactorize();
+  MLU->LUSolve(XRef);
+
+  /*--------------------------------------------------------------*/
+  /*- out-of-core solve with a budget of two tile columns in core */
+  /*- (several super-panels) and with the whole matrix in core    */
+  /*--------------------------------------------------------------*/
+  int NT = (N + TileSize - 1)/TileSize;
+  size_t TileColumnBytes = ((size_t)NT)*TileSize*TileSize*sizeof(cdouble);
+  size_t Budgets[2] = { 3*TileColumnBytes, (NT+1)*TileColumnBytes };
+
+  int NumFailed=0;
+  HMatrix *X=new HMatrix(N, NRHS, LHM_COMPLEX);
+  HVector *XV=new HVector(N, LHM_COMPLEX);
+  for(int nb=0; nb<2; nb++)
+   { OOCMatrix *MOOC=new OOCMatrix(N, 0, Budgets[nb], TileSize);
+     MOOC->Copy(M);
+     int Info=MOOC->LUFactorize();
+
+     X->Copy(B);
+     MOOC->LUSolve(X);
+     double DiffM=RelDiff(X->ZM, XRef->ZM, N*NRHS);
+
+     for(int n=0; n<N; n++)
+      XV->ZV[n]=B->GetEntry(n,0);
+     MOOC->LUSolve(XV);
+     double DiffV=RelDiff(XV->ZV, XRef->ZM, N);
+
+     bool Failed = (Info!=0 || DiffM>1.0e-10 || DiffV>1.0e-10);
+     printf("N=%i, tile %i, %i/%i tile columns in core: rel. diff %.2e (matrix), %.2e (vector) %s\n",
+             N, MOOC->NB, MOOC->PanelTiles, MOOC->NT, DiffM, DiffV,
+             Failed ? "FAILED" : "ok");
+     if (Failed) NumFailed++;
+     delete MOOC;
+   };
+
+  delete XV;
+  delete X;
+  delete MLU;
+  delete XRef;
+  delete B;
+  delete M;
+  return NumFailed==0 ? 0 : 1;
+}
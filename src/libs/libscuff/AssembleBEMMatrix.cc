@@ -33,8 +33,6 @@
 #include <math.h>
 #include <libhmat.h>
 #include <libhrutil.h>
-#include <sys/stat.h>
-#include <unistd.h>
 
 #include "libscuff.h"
 #include "libscuffInternals.h"
@@ -114,196 +112,6 @@ void StampInNeighborBlock(HMatrix *B, HMatrix **GradB,
    };
 }
 
-/***************************************************************/
-/* this is a simple quick-and-dirty mechanism for saving       */
-/* and retrieving diagonal T-matrix blocks to disk.            */
-/***************************************************************/
-#define TBCOP_READ  0
-#define TBCOP_WRITE 1
-bool TBlockCacheOp(int Op, RWGGeometry *G, int ns,
-                   cdouble Omega, double *kBloch,
-                   HMatrix *M, int RowOffset, int ColOffset)
-{
-  char *Dir = getenv("SCUFF_TBLOCK_PATH");
-  if (Dir==0 && Op==TBCOP_READ)
-   Dir = getenv("SCUFF_TBLOCK_READPATH");
-  if (!Dir) return false;
-
-  /*--------------------------------------------------------------*/
-  /*--------------------------------------------------------------*/
-  /*--------------------------------------------------------------*/
-  char K4VStr[50];
-  if (imag(Omega)==0.0)
-   sprintf(K4VStr,"%.6e",real(Omega));
-  else if (real(Omega)==0.0)
-   sprintf(K4VStr,"%.6eI",imag(Omega));
-  else 
-   sprintf(K4VStr,"%.6e+%.6eI",real(Omega),imag(Omega));
-  if (G->LDim>=1)
-   vstrappend(K4VStr,"_%.6e",kBloch[0]);
-  if (G->LDim>=2)
-   vstrappend(K4VStr,"_%.6e",kBloch[1]);
-
-  RWGSurface *S=G->Surfaces[ns];
-  int nr1=S->RegionIndices[0];
-  int nr2=S->RegionIndices[1];
-  if (G->RegionMPs[nr1]->Zeroed)
-   strcat(K4VStr,"_Interior");
-  else if (nr2!=-1 && G->RegionMPs[nr2]->Zeroed)
-   strcat(K4VStr,"_Exterior");
-    
-  char *FileBase = GetFileBase(S->MeshFileName); 
-  int MeshTag    = S->MeshTag;
-  char FileName[200];
-  if (MeshTag != -1)
-   snprintf(FileName,200,"%s/%s_%i_%s.hdf5",Dir,FileBase,MeshTag,K4VStr);
-  else
-   snprintf(FileName,200,"%s/%s_%s.hdf5",Dir,FileBase,K4VStr);
-
-  /***************************************************************/
-  /***************************************************************/
-  /***************************************************************/
-  int NBF        = G->Surfaces[ns]->NumBFs;
-  bool IsComplex = (M->RealComplex==LHM_COMPLEX);
-  off_t DataSize = NBF*NBF*(IsComplex ? sizeof(double) : sizeof(cdouble) );
-
-  /***************************************************************/
-  /* if the block we are reading/writing is a proper subblock of */
-  /* M, then we will need to allocate an HMatrix for just that   */
-  /* block, but we hold off on doing that until necessary        */
-  /***************************************************************/
-  HMatrix *B=0;
-  bool OwnsB=false;
-  if ( RowOffset==0 && ColOffset==0 && (M->NR==NBF) && (M->NC==NBF) )
-   B=M;
-
-  bool Success=false;
-  FILE *f=0;
-  if (Op==TBCOP_READ)	
-   {
-     Log("Attempting to read T-block (%s,%s) from file %s...",FileBase,z2s(Omega),FileName);
-     struct stat st;
-     int Status=stat(FileName, &st);
-     f=fopen(FileName,"r");
-     if (Status!=0 || f==0)
-      Log("...could not access file");
-     else if (st.st_size!=DataSize)
-      Log("...file had incorrect size %lu (should be %lu)",st.st_size,DataSize);
-     else 
-      { 
-        if (B==0)
-         { OwnsB=true;
-           B=new HMatrix(NBF,NBF,M->RealComplex);
-           if (B->ErrMsg)
-            { Log("...could not allocate matrix (%s)",B->ErrMsg);
-              delete B;
-              fclose(f);
-              return false;
-            };
-         };
-
-        void *DataBuffer = (IsComplex ? ((void *)(B->ZM)) : ((void *)(B->DM)));
-        ssize_t SizeToRead = (ssize_t)DataSize;
-        ssize_t SizeRead = read(fileno(f), DataBuffer, SizeToRead);
-        Success = (SizeRead==SizeToRead);
-        if (Success)
-         { Log("...success!");
-           if (OwnsB)
-            M->InsertBlock(B, RowOffset, ColOffset);
-         }
-        else
-         Log("...failed to read full size (%lu)",SizeToRead);
-      };
-   }
-  else //(Op==TBCOP_WRITE)
-   { 
-     Log("Attempting to write T-block (%s,%s) to file %s...",FileBase,z2s(Omega),FileName);
-     if (B==0)
-      { OwnsB=true;
-        B=new HMatrix(NBF,NBF,M->RealComplex);
-        if (B->ErrMsg)
-         { Log("...could not allocate matrix (%s)",B->ErrMsg);
-           delete B;
-           return false;
-         };
-        M->ExtractBlock(RowOffset, ColOffset, B);
-      };
-     void *DataBuffer = (IsComplex ? ((void *)(B->ZM)) : ((void *)(B->DM)));
-     f=fopen(FileName,"w");
-     if (!f) 
-      Log("...could not access file");
-     else if (DataSize != write(fileno(f), DataBuffer, DataSize))
-      Log("...failed to write full file");
-     else
-      { Log("...success!");
-        Success=true;
-      };
-   };
-
-  if (B && OwnsB) delete B;
-  if (f) fclose(f);
-  return Success; 
-}
-
-
-#if 0 // old HDF5 approach which is memory-inefficient
-  if (Op==TBCOP_READ)
-{
-     bool AbortOnIOErrorSave=HMatrix::AbortOnIOError;
-     HMatrix::AbortOnIOError=false;
-
-     HMatrix *MFile=M;
-     bool OwnsMFile=false;
-     if (RowOffset==0 && ColOffset==0 && M->NR==NBFs && M->NC==NBFs)
-      M->ImportFromHDF5(FileName,"T",false);
-     else
-      { MFile=new HMatrix(FileName,LHM_HDF5,"T");
-        OwnsMFile=true;
-      };
-     bool Success = (MFile->ErrMsg == 0);
-     if (Success)
-      { Log("...success!");
-        if (OwnsMFile)
-         M->InsertBlock(MFile, RowOffset, ColOffset);
-      }
-     else 
-      { Log("...failed: %s",MFile->ErrMsg);
-        if (!OwnsMFile) 
-         { free(M->ErrMsg);
-           M->ErrMsg=0;
-         };
-      };
-     if (OwnsMFile) delete MFile;
-     HMatrix::AbortOnIOError=AbortOnIOErrorSave;
-     return Success;
-   }
-  else if (Op==TBCOP_WRITE)
-   { 
-      HMatrix *MFile;
-      bool OwnsMFile=false;
-      bool AbortOnIOErrorSave=HMatrix::AbortOnIOError;
-      HMatrix::AbortOnIOError=false;
-      if (RowOffset==0 && ColOffset==0 && M->NR==NBFs && M->NC==NBFs)
-       MFile=M;
-      else
-       { MFile = new HMatrix(NBFs, NBFs, M->RealComplex);
-         OwnsMFile=true;
-         M->ExtractBlock(RowOffset, ColOffset, MFile);
-       };
-      MFile->ExportToHDF5(FileName,"T");
-      Log("Writing T-block (%s,%s) to file %s...",FileBase,z2s(Omega),FileName);
-      if (MFile->ErrMsg)
-       { Log("...failed! %s",MFile->ErrMsg);
-         free(MFile->ErrMsg);
-         MFile->ErrMsg=0;
-       };
-      if (OwnsMFile) delete MFile;
-      HMatrix::AbortOnIOError=AbortOnIOErrorSave;
-   };
-  return false; // never get here 
-}
-#endif
-
 /***************************************************************/
 /* KBIMBCache = 'kBloch-independent matrix-block cache.'       */
 /***************************************************************/
@@ -419,7 +227,7 @@ void RWGGeometry::AssembleBEMMatrixBlock(int nsa, int nsb,
 
   if (    nsa==nsb
        && GradM==0
-       && TBlockCacheOp(TBCOP_READ, this, nsa, Omega, kBloch, M, RowOffset, ColOffset)
+       && ReadTBlock(this, nsa, Omega, kBloch, M, RowOffset, ColOffset)
      ) return;
 
   if (LogLevel>=SCUFF_VERBOSELOGGING)
@@ -446,7 +254,7 @@ void RWGGeometry::AssembleBEMMatrixBlock(int nsa, int nsb,
      Args->ColOffset=ColOffset;
      GetSurfaceSurfaceInteractions(Args);
      if (nsa==nsb)
-      TBlockCacheOp(TBCOP_WRITE, this, nsa, Omega, kBloch, M, RowOffset, ColOffset);
+      WriteTBlock(this, nsa, Omega, kBloch, M, RowOffset, ColOffset);
      return;
    };
 
@@ -595,7 +403,7 @@ done:
   Args->OmitRegion1  = false;
   Args->OmitRegion2  = (nr2==-1);
 
-  Args->GBA1=CreateRegionGBA(nr1, Omega, kBloch, nsa, nsb);
+  Args->GBA1=CreateRegionGBA(nr1, Omega, kBloch, nsa, nsb, true);
   if (Args->GBA1==0)
    { if (LogLevel>=SCUFF_VERBOSELOGGING)
       Log("Skipping interpolation table for region %i",nr1);
@@ -603,7 +411,7 @@ done:
    }
 
   if ( !(Args->OmitRegion2) )
-   { Args->GBA2=CreateRegionGBA(nr2, Omega, kBloch, nsa, nsb);
+   { Args->GBA2=CreateRegionGBA(nr2, Omega, kBloch, nsa, nsb, true);
      if (Args->GBA2==0)
       { if (LogLevel>=SCUFF_VERBOSELOGGING)
          Log("Skipping interpolation table for region %i",nr2);
@@ -616,11 +424,8 @@ done:
   if ( Args->OmitRegion1==false || Args->OmitRegion2==false )
    GetSurfaceSurfaceInteractions(Args);
 
-  if (Args->GBA1) DestroyGBarAccelerator(Args->GBA1);
-  if (Args->GBA2) DestroyGBarAccelerator(Args->GBA2);
-
   if (nsa==nsb)
-   TBlockCacheOp(TBCOP_WRITE, this, nsa, Omega, kBloch, M, RowOffset, ColOffset);
+   WriteTBlock(this, nsa, Omega, kBloch, M, RowOffset, ColOffset);
 
 }
 
@@ -774,6 +579,41 @@ HMatrix *RWGGeometry::AssembleBEMMatrix(cdouble Omega, double *kBloch, HMatrix *
   // the overall BEM matrix is symmetric as long as we 
   // don't have a nonzero bloch wavevector.
   bool MatrixIsSymmetric = ( !kBloch || (kBloch[0]==0.0 && kBloch[1]==0.0) );
+  if ( M->StorageType!=LHM_NORMAL && !BEMMatrixIsSymmetric(kBloch) )
+   ErrExit("packed storage requested for non-symmetric BEM matrix");
+
+  /***************************************************************/
+  /* in the PBC case, size the pooled GBar accelerator for each  */
+  /* region up front to cover all surface pairs bounding that    */
+  /* region. otherwise the table obtained for the first block    */
+  /* would be extended (and rebuilt) by later blocks, and blocks */
+  /* assembled before and after the extension would see slightly */
+  /* different interpolants, so that the matrix would depend on  */
+  /* whether the pool was already warm.                          */
+  /***************************************************************/
+  if (LBasis)
+   for(int nr=0; nr<NumRegions; nr++)
+    { double RMax[3]={-1.0e89, -1.0e89, -1.0e89};
+      double RMin[3]={+1.0e89, +1.0e89, +1.0e89};
+      bool HavePair=false;
+      for(int ns=0; ns<NumSurfaces; ns++)
+       for(int nsp=0; nsp<NumSurfaces; nsp++)
+        { int CRIndices[2];
+          double Signs[2];
+          int NumCommonRegions
+           =CountCommonRegions(Surfaces[ns], Surfaces[nsp], CRIndices, Signs);
+          if (    (NumCommonRegions<1 || CRIndices[0]!=nr)
+               && (NumCommonRegions<2 || CRIndices[1]!=nr)
+             ) continue;
+          HavePair=true;
+          for(int Mu=0; Mu<3; Mu++)
+           { RMax[Mu]=fmax(RMax[Mu], Surfaces[ns]->RMax[Mu] - Surfaces[nsp]->RMin[Mu]);
+             RMin[Mu]=fmin(RMin[Mu], Surfaces[ns]->RMin[Mu] - Surfaces[nsp]->RMax[Mu]);
+           };
+        };
+      if (HavePair)
+       CreateRegionGBA(nr, Omega, kBloch, RMin, RMax, true, true);
+    };
 
   /***************************************************************/
   /* loop over all pairs of objects to assemble the diagonal and */
@@ -808,11 +648,7 @@ HMatrix *RWGGeometry::AssembleBEMMatrix(cdouble Omega, double *kBloch, HMatrix *
   /* slightly redundant because it re-fills-in those entries.    */
   /***************************************************************/
   if (MatrixIsSymmetric && M->StorageType==LHM_NORMAL)
-   { 
-     for(int nr=1; nr<TotalBFs; nr++)
-      for(int nc=0; nc<nr; nc++)
-       M->SetEntry(nr, nc, M->GetEntry(nc, nr) );
-   };
+   M->CopyUpperToLower();
 
   if (UseHRWGFunctions && NumMMJs>0 )
    ApplyMMJTransformation(M, 0);
@@ -829,6 +665,28 @@ HMatrix *RWGGeometry::AssembleBEMMatrix(cdouble Omega, HMatrix *M)
   return AssembleBEMMatrix(Omega, 0, M); 
 }
 
+/***************************************************************/
+/* returns true if the BEM matrix at the given Bloch vector is */
+/* complex-symmetric (M^T = M), in which case it may be stored */
+/* in packed form and factorized by LDLFactorize() instead of  */
+/* LUFactorize(). this is the case unless we have a nonzero    */
+/* Bloch vector or the (non-symmetric) MMJ transformation is   */
+/* in effect.                                                  */
+/***************************************************************/
+bool RWGGeometry::BEMMatrixIsSymmetric(double *kBloch)
+{
+  if ( kBloch && (kBloch[0]!=0.0 || (LDim>1 && kBloch[1]!=0.0)) )
+   return false;
+
+  if ( UseHRWGFunctions && NumMMJs>0 )
+   { char *s=getenv("SCUFF_MMJ_ALGORITHM");
+     if (s && s[0]!='0')
+      return false;
+   };
+
+  return true;
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
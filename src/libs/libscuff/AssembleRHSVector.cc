@@ -424,6 +424,74 @@ HVector *RWGGeometry::AssembleRHSVector(cdouble Omega, double *kBloch,
   return RHS;
 }
 
+/***************************************************************/
+/* Assemble the RHS vectors for NIF incident fields at once:   */
+/* column #nif of RHS is the RHS vector for IFs[nif] (which    */
+/* may itself be a chain of IncFields). the work for all       */
+/* incident fields is distributed over a single pool of tasks, */
+/* which keeps all threads busy even for small geometries.     */
+/***************************************************************/
+HMatrix *RWGGeometry::AssembleRHSVectors(cdouble Omega, double *kBloch,
+                                         IncField **IFs, int NIF, HMatrix *RHS)
+{
+  if ( RHS && (RHS->NR!=TotalBFs || RHS->NC<NIF || RHS->RealComplex!=LHM_COMPLEX) )
+   { Warn("wrong-size RHS matrix passed to AssembleRHSVectors (reallocating)");
+     RHS=0;
+   };
+  if (RHS==NULL)
+   RHS=new HMatrix(TotalBFs, NIF, LHM_COMPLEX);
+
+  RHS->Zero();
+
+  /* incident fields are prepared serially, since this updates */
+  /* the cached material properties of the geometry            */
+  int *NIFChain = new int[NIF];
+  for(int nif=0; nif<NIF; nif++)
+   NIFChain[nif]=UpdateIncFields(IFs[nif], Omega, kBloch);
+
+#ifdef USE_PTHREAD
+  for(int nif=0; nif<NIF; nif++)
+   { HVector RHSColumn(TotalBFs, LHM_COMPLEX, RHS->GetColumnPointer(nif));
+     AssembleRHSVector(Omega, kBloch, IFs[nif], &RHSColumn);
+   };
+#else
+  int NumTasks, NumThreads = GetNumThreads();
+#ifndef USE_OPENMP
+  NumThreads=NumTasks=1;
+#else
+  NumTasks=NumThreads*100;
+  if (NumTasks < NIF)
+   NumTasks=1;
+  else
+   NumTasks=(NumTasks + NIF - 1)/NIF;
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int n=0; n<NIF*NumTasks; n++)
+   { 
+     int nif = n / NumTasks;
+     HVector RHSColumn(TotalBFs, LHM_COMPLEX, RHS->GetColumnPointer(nif));
+
+     ThreadData TD1;
+     TD1.G=this;
+     TD1.IF=IFs[nif];
+     TD1.NIF=NIFChain[nif];
+     TD1.RHS=&RHSColumn;
+     TD1.nt=n % NumTasks;
+     TD1.NumTasks=NumTasks;
+     AssembleRHS_Thread((void *)&TD1);
+   };
+
+  if (UseHRWGFunctions && NumMMJs>0 )
+   for(int nif=0; nif<NIF; nif++)
+    { HVector RHSColumn(TotalBFs, LHM_COMPLEX, RHS->GetColumnPointer(nif));
+      ApplyMMJTransformation(0, &RHSColumn);
+    };
+#endif
+
+  delete[] NIFChain;
+  return RHS;
+}
+
 /***************************************************************/
 /* non-PBC entry point for AssembleRHSVector                   */
 /***************************************************************/
@@ -0,0 +1,638 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * CompressedBEMMatrix.cc -- libscuff routines for assembling BEM matrices
+ *                        -- whose off-diagonal (surface-surface) blocks
+ *                        -- are stored in low-rank form, computed by
+ *                        -- adaptive cross approximation (ACA) from
+ *                        -- individual rows and columns of the block
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <libhmat.h>
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
+#define II cdouble(0,1)
+
+// a pair of surfaces is a candidate for ACA compression if the
+// smaller of their bounding-box diameters is no larger than
+// ACA_ETA times the distance between their bounding boxes
+#define ACA_ETA 2.0
+
+namespace scuff {
+
+/***************************************************************/
+/* data passed to the row/column fetch routines called by ACA  */
+/***************************************************************/
+typedef struct ACABlockData
+ {
+   RWGSurface *Sa, *Sb;
+   bool SaIsPEC, SbIsPEC;
+   int BFPEA, BFPEB;       // basis functions per edge
+   cdouble kA, PreFac1A, PreFac2A, PreFac3A;
+   cdouble kB, PreFac1B, PreFac2B, PreFac3B;
+   bool HaveRegionB;
+
+   // GetEdgeEdgeInteractions returns all BFPEA x BFPEB entries
+   // for an edge pair at once, so we keep the most recently
+   // computed edge row / edge column around for the next fetch
+   int LastRowEdge, LastColumnEdge;
+   cdouble *RowBuffer;     // BFPEA x Sb->NumBFs
+   cdouble *ColumnBuffer;  // Sa->NumBFs x BFPEB
+
+   int NumThreads;
+ } ACABlockData;
+
+/***************************************************************/
+/* get the BFPEA x BFPEB matrix entries for a single edge pair */
+/* as Entries[x + 2*y]; the prefactors are as in GSSIThread    */
+/***************************************************************/
+static void GetEdgePairEntries(ACABlockData *Data, int nea, int neb,
+                               cdouble Entries[4])
+{
+  GetEEIArgStruct MyGetEEIArgs, *GetEEIArgs=&MyGetEEIArgs;
+  InitGetEEIArgs(GetEEIArgs);
+  GetEEIArgs->Sa  = Data->Sa;
+  GetEEIArgs->Sb  = Data->Sb;
+  GetEEIArgs->nea = nea;
+  GetEEIArgs->neb = neb;
+  GetEEIArgs->k   = Data->kA;
+  GetEdgeEdgeInteractions(GetEEIArgs);
+  cdouble *GC=GetEEIArgs->GC;
+
+  Entries[0] = Data->PreFac1A*GC[0];
+  Entries[1] = Entries[2] = Entries[3] = 0.0;
+  if ( Data->SaIsPEC && !Data->SbIsPEC )
+   Entries[2] = Data->PreFac2A*GC[1];
+  else if ( !Data->SaIsPEC && Data->SbIsPEC )
+   Entries[1] = Data->PreFac2A*GC[1];
+  else if ( !Data->SaIsPEC && !Data->SbIsPEC )
+   { Entries[1] = Entries[2] = Data->PreFac2A*GC[1];
+     Entries[3] = Data->PreFac3A*GC[0];
+   };
+
+  if ( Data->HaveRegionB )
+   { GetEEIArgs->k = Data->kB;
+     GetEdgeEdgeInteractions(GetEEIArgs);
+     Entries[0] += Data->PreFac1B*GC[0];
+     Entries[1] += Data->PreFac2B*GC[1];
+     Entries[2] += Data->PreFac2B*GC[1];
+     Entries[3] += Data->PreFac3B*GC[0];
+   };
+}
+
+/***************************************************************/
+/* fill in the surface-pair fields of an ACABlockData, assuming */
+/* the cached epsilon and mu values are up to date. returns the */
+/* number of regions common to the two surfaces.               */
+/***************************************************************/
+static int InitACABlockData(RWGGeometry *G, int nsa, int nsb, cdouble Omega,
+                            ACABlockData *Data)
+{
+  RWGSurface *Sa=G->Surfaces[nsa], *Sb=G->Surfaces[nsb];
+  Data->Sa=Sa;
+  Data->Sb=Sb;
+  Data->SaIsPEC = (Sa->IsPEC==1);
+  Data->SbIsPEC = (Sb->IsPEC==1);
+  Data->BFPEA = Data->SaIsPEC ? 1 : 2;
+  Data->BFPEB = Data->SbIsPEC ? 1 : 2;
+
+  double Signs[2];
+  int CommonRegions[2];
+  int NumCommonRegions=CountCommonRegions(Sa, Sb, CommonRegions, Signs);
+  if (NumCommonRegions==0)
+   return 0;
+
+  cdouble EpsA=G->EpsTF[CommonRegions[0]], MuA=G->MuTF[CommonRegions[0]];
+  Data->kA       = csqrt2(EpsA*MuA)*Omega;
+  Data->PreFac1A =  Signs[0]*II*MuA*Omega;
+  Data->PreFac2A = -Signs[0]*II*Data->kA;
+  Data->PreFac3A = -Signs[0]*II*EpsA*Omega;
+
+  Data->HaveRegionB = (NumCommonRegions==2 && !Data->SaIsPEC && !Data->SbIsPEC);
+  if (Data->HaveRegionB)
+   { cdouble EpsB=G->EpsTF[CommonRegions[1]], MuB=G->MuTF[CommonRegions[1]];
+     Data->kB       = csqrt2(EpsB*MuB)*Omega;
+     Data->PreFac1B =  Signs[1]*II*MuB*Omega;
+     Data->PreFac2B = -Signs[1]*II*Data->kB;
+     Data->PreFac3B = -Signs[1]*II*EpsB*Omega;
+   };
+
+  return NumCommonRegions;
+}
+
+/***************************************************************/
+/* row / column fetch routines passed to ACA()                 */
+/***************************************************************/
+static void GetACARow(void *UserData, int nr, cdouble *Row)
+{
+  ACABlockData *Data = (ACABlockData *)UserData;
+  int BFPEA=Data->BFPEA, BFPEB=Data->BFPEB;
+  int nea = nr / BFPEA;
+
+  if (nea!=Data->LastRowEdge)
+   { cdouble *RowBuffer=Data->RowBuffer;
+     int NumEdgesB=Data->Sb->NumEdges;
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,16), num_threads(Data->NumThreads)
+#endif
+     for(int neb=0; neb<NumEdgesB; neb++)
+      { cdouble Entries[4];
+        GetEdgePairEntries(Data, nea, neb, Entries);
+        for(int x=0; x<BFPEA; x++)
+         for(int y=0; y<BFPEB; y++)
+          RowBuffer[x + BFPEA*(BFPEB*neb+y)] = Entries[x+2*y];
+      };
+     Data->LastRowEdge=nea;
+   };
+
+  int x = nr % BFPEA, NC=Data->Sb->NumBFs;
+  for(int nc=0; nc<NC; nc++)
+   Row[nc] = Data->RowBuffer[x + BFPEA*nc];
+}
+
+static void GetACAColumn(void *UserData, int nc, cdouble *Column)
+{
+  ACABlockData *Data = (ACABlockData *)UserData;
+  int BFPEA=Data->BFPEA, BFPEB=Data->BFPEB;
+  int NR=Data->Sa->NumBFs;
+  int neb = nc / BFPEB;
+
+  if (neb!=Data->LastColumnEdge)
+   { cdouble *ColumnBuffer=Data->ColumnBuffer;
+     int NumEdgesA=Data->Sa->NumEdges;
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,16), num_threads(Data->NumThreads)
+#endif
+     for(int nea=0; nea<NumEdgesA; nea++)
+      { cdouble Entries[4];
+        GetEdgePairEntries(Data, nea, neb, Entries);
+        for(int x=0; x<BFPEA; x++)
+         for(int y=0; y<BFPEB; y++)
+          ColumnBuffer[BFPEA*nea+x + NR*y] = Entries[x+2*y];
+      };
+     Data->LastColumnEdge=neb;
+   };
+
+  int y = nc % BFPEB;
+  memcpy(Column, Data->ColumnBuffer + NR*y, NR*sizeof(cdouble));
+}
+
+/***************************************************************/
+/* return true if surfaces nsa, nsb are far enough apart for   */
+/* their interaction block to be a candidate for compression   */
+/***************************************************************/
+static bool IsACAAdmissible(RWGSurface *Sa, RWGSurface *Sb)
+{
+  double Dist2=0.0, DiamA2=0.0, DiamB2=0.0;
+  for(int i=0; i<3; i++)
+   { double Gap = fmax(Sb->RMin[i] - Sa->RMax[i], Sa->RMin[i] - Sb->RMax[i]);
+     if (Gap>0.0) Dist2+=Gap*Gap;
+     DiamA2 += (Sa->RMax[i]-Sa->RMin[i])*(Sa->RMax[i]-Sa->RMin[i]);
+     DiamB2 += (Sb->RMax[i]-Sb->RMin[i])*(Sb->RMax[i]-Sb->RMin[i]);
+   };
+  return fmin(DiamA2, DiamB2) <= ACA_ETA*ACA_ETA*Dist2;
+}
+
+/***************************************************************/
+/* compute a low-rank approximation U = A*B' to the BEM matrix */
+/* block for surfaces nsa, nsb (nsa!=nsb) of a compact         */
+/* geometry by adaptive cross approximation.                   */
+/*                                                             */
+/* If MaxRank is 0, it defaults to the largest rank for which  */
+/* the low-rank form takes less storage than half the dense    */
+/* block. If ACA does not converge to tolerance Tol before     */
+/* reaching MaxRank, the return value is NULL and the caller   */
+/* should use AssembleBEMMatrixBlock() instead.                */
+/***************************************************************/
+LRMatrix *RWGGeometry::AssembleBEMMatrixBlockACA(int nsa, int nsb, cdouble Omega,
+                                                 double Tol, int MaxRank)
+{
+  if (LBasis!=0)
+   ErrExit("%s:%i: ACA not available for periodic geometries",__FILE__,__LINE__);
+  if (nsa==nsb)
+   ErrExit("%s:%i: ACA not available for diagonal blocks",__FILE__,__LINE__);
+  if (Substrate)
+   return 0;
+
+  RWGSurface *Sa=Surfaces[nsa], *Sb=Surfaces[nsb];
+  int NR=Sa->NumBFs, NC=Sb->NumBFs;
+  if (MaxRank<=0)
+   { MaxRank = NR*NC / (2*(NR+NC));
+     if (MaxRank<1) MaxRank=1;
+   };
+
+  /***************************************************************/
+  /* blocks between surfaces with no common region vanish        */
+  /***************************************************************/
+  UpdateCachedEpsMuValues(Omega);
+  ACABlockData MyData, *Data=&MyData;
+  if ( InitACABlockData(this, nsa, nsb, Omega, Data)==0 )
+   return new LRMatrix(NR, NC, 0);
+
+  Data->LastRowEdge = Data->LastColumnEdge = -1;
+  Data->RowBuffer    = (cdouble *)mallocEC(Data->BFPEA*NC*sizeof(cdouble));
+  Data->ColumnBuffer = (cdouble *)mallocEC(NR*Data->BFPEB*sizeof(cdouble));
+  Data->NumThreads   = GetNumThreads();
+
+  LRMatrix *L=ACA(NR, NC, GetACARow, GetACAColumn, (void *)Data, Tol, MaxRank);
+
+  free(Data->RowBuffer);
+  free(Data->ColumnBuffer);
+  return L;
+}
+
+/***************************************************************/
+/* assemble the BEM matrix of a compact geometry as a block    */
+/* matrix with one block per surface. diagonal blocks are      */
+/* dense; off-diagonal blocks between well-separated surfaces  */
+/* are computed by ACA to relative accuracy ACATol and stored  */
+/* in low-rank form, with all others (or any for which ACA     */
+/* fails to converge) stored densely.                          */
+/***************************************************************/
+LRBlockMatrix *RWGGeometry::AssembleCompressedBEMMatrix(cdouble Omega, double ACATol)
+{
+  if (LBasis!=0)
+   ErrExit("%s:%i: compressed BEM matrices not available for periodic geometries",__FILE__,__LINE__);
+
+  Log("Assembling compressed BEM matrix at Omega=%s",z2s(Omega));
+
+  int *BlockSizes = (int *)mallocEC(NumSurfaces*sizeof(int));
+  for(int ns=0; ns<NumSurfaces; ns++)
+   BlockSizes[ns]=Surfaces[ns]->NumBFs;
+  LRBlockMatrix *M = new LRBlockMatrix(NumSurfaces, BlockSizes);
+  free(BlockSizes);
+
+  /***************************************************************/
+  /* diagonal blocks: AssembleBEMMatrixBlock fills in the lower  */
+  /* triangle itself (see GetSurfaceSurfaceInteractions)         */
+  /***************************************************************/
+  for(int ns=0; ns<NumSurfaces; ns++)
+   { int nsm=Mate[ns];
+     HMatrix *D;
+     if ( nsm!=-1 )
+      { Log("Block(%i,%i) is identical to block (%i,%i) (reusing)",ns,ns,nsm,nsm);
+        D=new HMatrix(M->DBlocks[nsm*NumSurfaces + nsm]);
+      }
+     else
+      { int N=Surfaces[ns]->NumBFs;
+        D=new HMatrix(N, N, LHM_COMPLEX);
+        AssembleBEMMatrixBlock(ns, ns, Omega, 0, D);
+      };
+     M->SetBlock(ns, ns, D);
+   };
+
+  /***************************************************************/
+  /* off-diagonal blocks: compute the upper triangle and get the */
+  /* lower triangle by (non-conjugate) transposition             */
+  /***************************************************************/
+  for(int nsa=0; nsa<NumSurfaces; nsa++)
+   for(int nsb=nsa+1; nsb<NumSurfaces; nsb++)
+    {
+      LRMatrix *L=0;
+      if ( IsACAAdmissible(Surfaces[nsa], Surfaces[nsb]) )
+       L=AssembleBEMMatrixBlockACA(nsa, nsb, Omega, ACATol);
+
+      if (L)
+       { if (LogLevel>=SCUFF_VERBOSELOGGING)
+          Log("Block (%i,%i): ACA rank %i",nsa,nsb,L->Rank);
+         LRMatrix *LT=new LRMatrix(L);
+         LT->Transpose();
+         M->SetBlock(nsa, nsb, L);
+         M->SetBlock(nsb, nsa, LT);
+       }
+      else
+       { HMatrix *B=new HMatrix(Surfaces[nsa]->NumBFs, Surfaces[nsb]->NumBFs, LHM_COMPLEX);
+         AssembleBEMMatrixBlock(nsa, nsb, Omega, 0, B);
+         HMatrix *BT=new HMatrix(B);
+         BT->Transpose();
+         M->SetBlock(nsa, nsb, B);
+         M->SetBlock(nsb, nsa, BT);
+       };
+    };
+
+  Log(" compressed BEM matrix: %lu of %lu entries stored",
+        (unsigned long)M->GetStorage(),
+        ((unsigned long)TotalBFs)*((unsigned long)TotalBFs));
+
+  return M;
+}
+
+/***************************************************************/
+/* hierarchical-matrix (H-matrix) representation of the full   */
+/* BEM matrix of a compact geometry. The cluster tree is built */
+/* over RWG edge centroids, with each edge owning its one (PEC)*/
+/* or two (non-PEC) basis functions, so the H-matrix DOF       */
+/* indices are the usual BEM-matrix row/column indices.        */
+/***************************************************************/
+HierMatrix *RWGGeometry::AllocateHierBEMMatrix(int LeafSize, double Eta)
+{
+  if (LBasis!=0)
+   ErrExit("%s:%i: H-matrices not available for periodic geometries",__FILE__,__LINE__);
+
+  int NumEdges=0;
+  for(int ns=0; ns<NumSurfaces; ns++)
+   NumEdges+=Surfaces[ns]->NumEdges;
+
+  double *Points   = (double *)mallocEC(3*NumEdges*sizeof(double));
+  double *Radii    = (double *)mallocEC(NumEdges*sizeof(double));
+  int *DOFOffsets  = (int *)mallocEC((NumEdges+1)*sizeof(int));
+  int ne=0;
+  for(int ns=0; ns<NumSurfaces; ns++)
+   { RWGSurface *S=Surfaces[ns];
+     int BFPE = (S->IsPEC ? 1 : 2);
+     for(int nes=0; nes<S->NumEdges; nes++, ne++)
+      { memcpy(Points + 3*ne, S->Edges[nes]->Centroid, 3*sizeof(double));
+        Radii[ne]=S->Edges[nes]->Radius;
+        DOFOffsets[ne]=BFIndexOffset[ns] + BFPE*nes;
+      };
+   };
+  DOFOffsets[NumEdges]=TotalBFs;
+
+  HierMatrix *H=new HierMatrix(NumEdges, Points, Radii, DOFOffsets, LeafSize, Eta);
+
+  free(DOFOffsets);
+  free(Radii);
+  free(Points);
+  return H;
+}
+
+/***************************************************************/
+/* data passed to the H-matrix block-fetch routine: per-DOF    */
+/* (surface, edge, component) indices and per-surface-pair     */
+/* prefactors                                                  */
+/***************************************************************/
+typedef struct HierBEMData
+ {
+   int NumSurfaces;
+   int *DOFSurface, *DOFEdge, *DOFComponent;
+   ACABlockData *PairData;       // PairData[nsa*NumSurfaces + nsb]
+   int *NumCommonRegions;        // same indexing
+ } HierBEMData;
+
+/***************************************************************/
+/* fill in the per-DOF indices and per-surface-pair prefactors */
+/* of a HierBEMData, assuming the cached epsilon and mu values */
+/* are up to date                                              */
+/***************************************************************/
+static void InitHierBEMData(RWGGeometry *G, cdouble Omega, HierBEMData *Data)
+{
+  int NS=G->NumSurfaces, NBF=G->TotalBFs;
+  Data->NumSurfaces=NS;
+  Data->DOFSurface   = (int *)mallocEC(3*NBF*sizeof(int));
+  Data->DOFEdge      = Data->DOFSurface + NBF;
+  Data->DOFComponent = Data->DOFEdge + NBF;
+  for(int ns=0; ns<NS; ns++)
+   { int BFPE = (G->Surfaces[ns]->IsPEC ? 1 : 2);
+     for(int nbf=0; nbf<G->Surfaces[ns]->NumBFs; nbf++)
+      { int n=G->BFIndexOffset[ns] + nbf;
+        Data->DOFSurface[n]   = ns;
+        Data->DOFEdge[n]      = nbf / BFPE;
+        Data->DOFComponent[n] = nbf % BFPE;
+      };
+   };
+
+  Data->PairData = (ACABlockData *)mallocEC(NS*NS*sizeof(ACABlockData));
+  Data->NumCommonRegions = (int *)mallocEC(NS*NS*sizeof(int));
+  for(int nsa=0; nsa<NS; nsa++)
+   for(int nsb=0; nsb<NS; nsb++)
+    Data->NumCommonRegions[nsa*NS + nsb]
+     = InitACABlockData(G, nsa, nsb, Omega, Data->PairData + nsa*NS + nsb);
+}
+
+static void FreeHierBEMData(HierBEMData *Data)
+{
+  free(Data->NumCommonRegions);
+  free(Data->PairData);
+  free(Data->DOFSurface);
+}
+
+/***************************************************************/
+/* split a list of DOF indices into runs of consecutive        */
+/* entries belonging to the same edge; Runs[2*n], Runs[2*n+1]  */
+/* are the start and length of run #n                          */
+/***************************************************************/
+static int GetEdgeRuns(HierBEMData *Data, int N, int *Indices, int *Runs)
+{
+  int NumRuns=0;
+  for(int n=0; n<N; )
+   { int ns=Data->DOFSurface[Indices[n]], ne=Data->DOFEdge[Indices[n]];
+     int Length=1;
+     while( n+Length<N
+            && Data->DOFSurface[Indices[n+Length]]==ns
+            && Data->DOFEdge[Indices[n+Length]]==ne
+          ) Length++;
+     Runs[2*NumRuns+0]=n;
+     Runs[2*NumRuns+1]=Length;
+     NumRuns++;
+     n+=Length;
+   };
+  return NumRuns;
+}
+
+static void GetHierBEMBlock(void *UserData, int NR, int *Rows, int NC, int *Cols,
+                            cdouble *Block)
+{
+  HierBEMData *Data=(HierBEMData *)UserData;
+  int NS=Data->NumSurfaces;
+
+  int *RowRuns=new int[2*NR], *ColRuns=new int[2*NC];
+  int NumRowRuns=GetEdgeRuns(Data, NR, Rows, RowRuns);
+  int NumColRuns=GetEdgeRuns(Data, NC, Cols, ColRuns);
+
+  for(int n=0; n<NR*NC; n++)
+   Block[n]=0.0;
+  for(int ncr=0; ncr<NumColRuns; ncr++)
+   for(int nrr=0; nrr<NumRowRuns; nrr++)
+    { int r0=RowRuns[2*nrr], c0=ColRuns[2*ncr];
+      int nsa=Data->DOFSurface[Rows[r0]], nea=Data->DOFEdge[Rows[r0]];
+      int nsb=Data->DOFSurface[Cols[c0]], neb=Data->DOFEdge[Cols[c0]];
+      if (Data->NumCommonRegions[nsa*NS + nsb]==0)
+       continue;
+
+      cdouble Entries[4];
+      GetEdgePairEntries(Data->PairData + nsa*NS + nsb, nea, neb, Entries);
+      for(int r=r0; r<r0+RowRuns[2*nrr+1]; r++)
+       for(int c=c0; c<c0+ColRuns[2*ncr+1]; c++)
+        { int x=Data->DOFComponent[Rows[r]], y=Data->DOFComponent[Cols[c]];
+          Block[r + c*NR] = Entries[x + 2*y];
+        };
+    };
+
+  delete[] RowRuns;
+  delete[] ColRuns;
+}
+
+/***************************************************************/
+/* (re)assemble the BEM matrix into an H-matrix created by     */
+/* AllocateHierBEMMatrix; low-rank blocks are computed by ACA  */
+/* to relative tolerance Tol, which is also the truncation     */
+/* tolerance used by the subsequent H->LUFactorize().          */
+/***************************************************************/
+HierMatrix *RWGGeometry::AssembleBEMMatrix(cdouble Omega, HierMatrix *H, double Tol)
+{
+  if (LBasis!=0)
+   ErrExit("%s:%i: H-matrices not available for periodic geometries",__FILE__,__LINE__);
+  if (Substrate)
+   ErrExit("%s:%i: H-matrices not yet available for geometries with substrates",__FILE__,__LINE__);
+  for(int ns=0; ns<NumSurfaces; ns++)
+   if (Surfaces[ns]->SurfaceZeta)
+    ErrExit("%s:%i: H-matrices not yet available for surfaces with surface impedance",__FILE__,__LINE__);
+
+  if (H==0)
+   H=AllocateHierBEMMatrix();
+  else if (H->N!=TotalBFs)
+   { Warn("wrong-size H-matrix passed to AssembleBEMMatrix; reallocating...");
+     H=AllocateHierBEMMatrix();
+   };
+
+  Log("Assembling H-matrix BEM matrix at Omega=%s",z2s(Omega));
+  UpdateCachedEpsMuValues(Omega);
+
+  HierBEMData MyData, *Data=&MyData;
+  InitHierBEMData(this, Omega, Data);
+
+  H->Assemble(GetHierBEMBlock, (void *)Data, Tol);
+
+  Log(" H-matrix: %i leaves, max rank %i, %lu of %lu entries stored",
+        H->NumLeaves, H->GetMaxRank(), (unsigned long)H->GetStorage(),
+        ((unsigned long)TotalBFs)*((unsigned long)TotalBFs));
+
+  FreeHierBEMData(Data);
+  return H;
+}
+
+/***************************************************************/
+/* assemble selected rows of the BEM matrix of a compact       */
+/* geometry: row #nr of the NumRows x TotalBFs matrix B is row */
+/* #Rows[nr] of the full BEM matrix. this is cheaper than      */
+/* assembling the full matrix when only a fraction of its rows */
+/* are needed, as in the symmetry-reduced solver.              */
+/***************************************************************/
+HMatrix *RWGGeometry::AssembleBEMMatrixRows(cdouble Omega, int NumRows, int *Rows,
+                                            HMatrix *B)
+{
+  if (LBasis!=0)
+   ErrExit("%s:%i: row assembly not available for periodic geometries",__FILE__,__LINE__);
+  if (Substrate)
+   ErrExit("%s:%i: row assembly not yet available for geometries with substrates",__FILE__,__LINE__);
+  for(int ns=0; ns<NumSurfaces; ns++)
+   if (Surfaces[ns]->SurfaceZeta)
+    ErrExit("%s:%i: row assembly not yet available for surfaces with surface impedance",__FILE__,__LINE__);
+
+  if ( B && (B->NR!=NumRows || B->NC!=TotalBFs) )
+   { Warn("wrong-size matrix passed to AssembleBEMMatrixRows; reallocating...");
+     delete B;
+     B=0;
+   };
+  if (B==0)
+   B=new HMatrix(NumRows, TotalBFs, LHM_COMPLEX);
+
+  UpdateCachedEpsMuValues(Omega);
+  HierBEMData MyData, *Data=&MyData;
+  InitHierBEMData(this, Omega, Data);
+
+  // we fetch all BFPE rows belonging to a single edge at once,
+  // since GetEdgePairEntries computes them all together
+  int *Cols=(int *)mallocEC(TotalBFs*sizeof(int));
+  for(int nc=0; nc<TotalBFs; nc++)
+   Cols[nc]=nc;
+  int *Runs=(int *)mallocEC(2*NumRows*sizeof(int));
+  int NumRuns=GetEdgeRuns(Data, NumRows, Rows, Runs);
+
+  int NumThreads=GetNumThreads();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int nRun=0; nRun<NumRuns; nRun++)
+   { int r0=Runs[2*nRun], Length=Runs[2*nRun+1];
+     cdouble *Block=new cdouble[Length*TotalBFs];
+     GetHierBEMBlock((void *)Data, Length, Rows+r0, TotalBFs, Cols, Block);
+     for(int nr=0; nr<Length; nr++)
+      for(int nc=0; nc<TotalBFs; nc++)
+       B->SetEntry(r0+nr, nc, Block[nr + nc*Length]);
+     delete[] Block;
+   };
+
+  free(Runs);
+  free(Cols);
+  FreeHierBEMData(Data);
+  return B;
+}
+
+/***************************************************************/
+/* out-of-core BEM matrix of a compact geometry, for problems  */
+/* whose BEM matrix does not fit in memory. the scratch file   */
+/* lives in ScratchDir, and at most MemoryGB gigabytes of the  */
+/* matrix are held in memory at once (0 = OOCMatrix defaults). */
+/***************************************************************/
+OOCMatrix *RWGGeometry::AllocateOOCBEMMatrix(const char *ScratchDir, double MemoryGB)
+{
+  if (LBasis!=0)
+   ErrExit("%s:%i: out-of-core BEM matrices not available for periodic geometries",__FILE__,__LINE__);
+
+  size_t MemoryBudget = (size_t)(MemoryGB*1073741824.0);
+  return new OOCMatrix(TotalBFs, ScratchDir, MemoryBudget);
+}
+
+/***************************************************************/
+/* (re)assemble the BEM matrix into an OOCMatrix tile by tile, */
+/* fetching the entries of each tile as for H-matrix leaves    */
+/***************************************************************/
+OOCMatrix *RWGGeometry::AssembleBEMMatrix(cdouble Omega, OOCMatrix *M)
+{
+  if (LBasis!=0)
+   ErrExit("%s:%i: out-of-core BEM matrices not available for periodic geometries",__FILE__,__LINE__);
+  if (Substrate)
+   ErrExit("%s:%i: out-of-core BEM matrices not yet available for geometries with substrates",__FILE__,__LINE__);
+  for(int ns=0; ns<NumSurfaces; ns++)
+   if (Surfaces[ns]->SurfaceZeta)
+    ErrExit("%s:%i: out-of-core BEM matrices not yet available for surfaces with surface impedance",__FILE__,__LINE__);
+
+  if (M==0)
+   M=AllocateOOCBEMMatrix();
+  else if (M->N!=TotalBFs)
+   ErrExit("%s:%i: wrong-size matrix passed to AssembleBEMMatrix",__FILE__,__LINE__);
+
+  Log("Assembling out-of-core BEM matrix at Omega=%s",z2s(Omega));
+  UpdateCachedEpsMuValues(Omega);
+
+  HierBEMData MyData, *Data=&MyData;
+  InitHierBEMData(this, Omega, Data);
+  M->Assemble(GetHierBEMBlock, (void *)Data);
+  FreeHierBEMData(Data);
+
+  return M;
+}
+
+} // namespace scuff
@@ -0,0 +1,261 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * CubatureCache.cc -- implementation of the CubatureCache class, which
+ *                  -- stores the frequency-independent parts of the
+ *                  -- fixed-order panel-panel cubature so that
+ *                  -- BEM-matrix assembly at the second and subsequent
+ *                  -- frequencies of a frequency sweep only needs to
+ *                  -- evaluate the Helmholtz kernel.
+ *
+ * (the records themselves are computed and used in
+ *  PanelPanelInteractions.cc; this file only handles storage.)
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#ifdef HAVE_CXX11
+#include <unordered_map>
+#elif defined(HAVE_TR1)
+#include <tr1/unordered_map>
+#endif
+
+#include <libhrutil.h>
+#include <libTriInt.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+namespace scuff {
+
+// order of the panel cubature rule; must agree with the
+// low-order rule used by GetPPIs_Cubature()
+#define CC_TCRORDER 4
+
+// approximate bookkeeping overhead of one table entry
+#define CC_ENTRYOVERHEAD 64
+
+#ifdef HAVE_CXX11
+typedef std::unordered_map<uint64_t, CCRecord *> CCRecordMap;
+#elif defined(HAVE_TR1)
+typedef std::tr1::unordered_map<uint64_t, CCRecord *> CCRecordMap;
+#endif
+
+/***************************************************************/
+/* the records for one pair of surfaces. Fingerprint holds the */
+/* vertices of the first panel on each surface at the time the */
+/* records were computed; if either has changed, the surfaces  */
+/* have moved relative to each other and the records are stale.*/
+/***************************************************************/
+typedef struct CCBlock
+ {
+   double Fingerprint[18];
+   CCRecordMap *Records;
+   size_t Bytes;
+   rwlock Lock;
+
+ } CCBlock;
+
+static void GetFingerprint(RWGSurface *Sa, RWGSurface *Sb, double Fingerprint[18])
+{
+  RWGPanel *Pa=Sa->Panels[0], *Pb=Sb->Panels[0];
+  for(int nv=0; nv<3; nv++)
+   { memcpy(Fingerprint + 3*nv,     Sa->Vertices + 3*Pa->VI[nv], 3*sizeof(double));
+     memcpy(Fingerprint + 3*nv + 9, Sb->Vertices + 3*Pb->VI[nv], 3*sizeof(double));
+   };
+}
+
+static size_t GetRecordSize(int Type, int NumPts)
+{
+  size_t Size = sizeof(CCRecord) + CC_ENTRYOVERHEAD;
+  if (Type!=CCREC_NONE)
+   Size += 3*NumPts*NumPts*sizeof(double);
+  return Size;
+}
+
+static void ClearBlock(CCBlock *Block)
+{
+  CCRecordMap::iterator it;
+  for(it=Block->Records->begin(); it!=Block->Records->end(); it++)
+   free(it->second);
+  Block->Records->clear();
+  Block->Bytes=0;
+}
+
+/***************************************************************/
+/* class constructor and destructor                            */
+/***************************************************************/
+CubatureCache::CubatureCache(RWGGeometry *pG, double MaxMB)
+{
+  G=pG;
+  int NS=G->NumSurfaces;
+  Blocks=(void **)mallocEC(NS*NS*sizeof(void *));
+  for(int n=0; n<NS*NS; n++)
+   Blocks[n]=0;
+  MaxBytes=(size_t)(MaxMB*1048576.0);
+  BytesUsed=0;
+  TCR=GetTCR(CC_TCRORDER, &NumPts);
+  WW=(double *)mallocEC(NumPts*NumPts*sizeof(double));
+  for(int np=0; np<NumPts; np++)
+   for(int npp=0; npp<NumPts; npp++)
+    WW[NumPts*np + npp] = TCR[3*np+2]*TCR[3*npp+2];
+}
+
+CubatureCache::~CubatureCache()
+{
+  int NS=G->NumSurfaces;
+  for(int n=0; n<NS*NS; n++)
+   { CCBlock *Block=(CCBlock *)Blocks[n];
+     if (Block==0) continue;
+     ClearBlock(Block);
+     delete Block->Records;
+     delete Block;
+   };
+  free(Blocks);
+  free(WW);
+}
+
+/***************************************************************/
+/* records for pairs of panels on the same surface are stored  */
+/* in the block of the surface's mate, if it has one           */
+/***************************************************************/
+void *CubatureCache::GetBlock(RWGSurface *Sa, RWGSurface *Sb)
+{
+  int nsa=Sa->Index, nsb=Sb->Index;
+  if (nsa==nsb && G->Mate[nsa]!=-1)
+   nsa=nsb=G->Mate[nsa];
+  return Blocks[nsa*G->NumSurfaces + nsb];
+}
+
+/***************************************************************/
+/* create the block for (Sa,Sb) if it doesn't exist yet, and   */
+/* discard its records if the surfaces have moved relative to  */
+/* each other since they were computed                         */
+/***************************************************************/
+void CubatureCache::PrepareBlock(RWGSurface *Sa, RWGSurface *Sb)
+{
+  int nsa=Sa->Index, nsb=Sb->Index;
+  if (nsa==nsb && G->Mate[nsa]!=-1)
+   nsa=nsb=G->Mate[nsa];
+  CCBlock **pBlock=(CCBlock **)(Blocks + nsa*G->NumSurfaces + nsb);
+
+  double Fingerprint[18];
+  GetFingerprint(Sa, Sb, Fingerprint);
+
+  CCLock.write_lock();
+  if (*pBlock==0)
+   { *pBlock = new CCBlock;
+     (*pBlock)->Records = new CCRecordMap;
+     (*pBlock)->Bytes=0;
+     memcpy((*pBlock)->Fingerprint, Fingerprint, 18*sizeof(double));
+   }
+  else if ( nsa!=nsb && memcmp((*pBlock)->Fingerprint, Fingerprint, 18*sizeof(double)) )
+   { BytesUsed -= (*pBlock)->Bytes;
+     ClearBlock(*pBlock);
+     memcpy((*pBlock)->Fingerprint, Fingerprint, 18*sizeof(double));
+   };
+  CCLock.write_unlock();
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+static inline uint64_t GetKey(int npa, int iQa, RWGSurface *Sb, int npb, int iQb)
+{ return ( ((uint64_t)npa)*Sb->NumPanels + npb )*9 + 3*iQa + iQb; }
+
+CCRecord *CubatureCache::GetRecord(RWGSurface *Sa, int npa, int iQa,
+                                   RWGSurface *Sb, int npb, int iQb)
+{
+  CCBlock *Block=(CCBlock *)GetBlock(Sa, Sb);
+  if (Block==0)
+   return 0;
+
+  uint64_t Key=GetKey(npa, iQa, Sb, npb, iQb);
+  CCRecord *Record=0;
+  Block->Lock.read_lock();
+  CCRecordMap::iterator it=Block->Records->find(Key);
+  if ( it!=Block->Records->end() )
+   Record=it->second;
+  Block->Lock.read_unlock();
+  return Record;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+CCRecord *CubatureCache::NewRecord(int Type)
+{
+  size_t Size=GetRecordSize(Type, NumPts);
+
+  CCLock.read_lock();
+  bool Full = (BytesUsed + Size > MaxBytes);
+  CCLock.read_unlock();
+  if (Full)
+   return 0;
+
+  CCRecord *Record=(CCRecord *)mallocEC(Size - CC_ENTRYOVERHEAD);
+  Record->Type=Type;
+  Record->R=Record->hDot=Record->hTimes=0;
+  if (Type!=CCREC_NONE)
+   { int NP2=NumPts*NumPts;
+     Record->R      = (double *)(Record + 1);
+     Record->hDot   = Record->R + NP2;
+     Record->hTimes = Record->R + 2*NP2;
+   };
+  return Record;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+CCRecord *CubatureCache::AddRecord(RWGSurface *Sa, int npa, int iQa,
+                                   RWGSurface *Sb, int npb, int iQb,
+                                   CCRecord *Record)
+{
+  CCBlock *Block=(CCBlock *)GetBlock(Sa, Sb);
+  if (Block==0)
+   ErrExit("%s:%i: internal error (PrepareBlock not called)",__FILE__,__LINE__);
+
+  uint64_t Key=GetKey(npa, iQa, Sb, npb, iQb);
+  size_t Size=GetRecordSize(Record->Type, NumPts);
+
+  Block->Lock.write_lock();
+  std::pair<CCRecordMap::iterator, bool> Result
+   = Block->Records->insert( std::pair<uint64_t, CCRecord *>(Key, Record) );
+  if (Result.second)
+   Block->Bytes += Size;
+  Block->Lock.write_unlock();
+
+  if (!Result.second)
+   { free(Record);
+     return Result.first->second;
+   };
+
+  CCLock.write_lock();
+  BytesUsed += Size;
+  CCLock.write_unlock();
+  return Record;
+}
+
+} // namespace scuff
@@ -144,6 +144,8 @@ void GetEdgeEdgeInteractions(GetEEIArgStruct *Args)
   GetPPIArgs->NumTorqueAxes          = NumTorqueAxes;
   GetPPIArgs->GammaMatrix            = Args->GammaMatrix;
   GetPPIArgs->opFC                   = Args->opFC;
+  GetPPIArgs->opCC                   = Args->opCC;
+  GetPPIArgs->opPM                   = Args->opPM;
   GetPPIArgs->Displacement           = Args->Displacement;
   GetPPIArgs->GBA                    = Args->GBA;    
   GetPPIArgs->ForceFullEwald         = Args->ForceFullEwald;
@@ -302,6 +304,8 @@ void InitGetEEIArgs(GetEEIArgStruct *Args)
   Args->GammaMatrix=0;
   Args->Displacement=0;
   Args->opFC=0;
+  Args->opCC=0;
+  Args->opPM=0;
   Args->Force=EEI_NOFORCE;
   Args->GBA=0;
   Args->ForceFullEwald=false;
@@ -45,6 +45,9 @@
 #include <omp.h> // needed for rwlock
 #endif
 
+#include <vector>
+#include <algorithm>
+
 #include <libhrutil.h>
 #include "libscuff.h"
 
@@ -63,6 +66,7 @@ void ComputeFIBBIData(RWGSurface *Sa, int nea,
 #define MAXSTR 256
 
 #define SUFFIX "scuffcache"
+#define BULKSUFFIX "fibbitable"
 
 /*--------------------------------------------------------------*/
 /*- note: i found this on wikipedia ... ------------------------*/
@@ -125,6 +129,12 @@ typedef std::tr1::unordered_map< KeyStruct,
                                  KeyCmp> KDMap;
 #endif
 
+static void DestroyBulkTable(void *opBulk);
+static bool GetBulkFIBBIData(void *opBulk,
+                             RWGSurface *SA, int neA,
+                             RWGSurface *SB, int neB,
+                             double *FIBBIs);
+
 /*--------------------------------------------------------------*/
 /*--------------------------------------------------------------*/
 /*--------------------------------------------------------------*/
@@ -142,9 +152,13 @@ public:
    int PreLoad(const char *FileName);
    int Size(int *pHits, int *pMisses);
 
+   // bulk mode (see below)
+   void Precompute(RWGSurface *S);
+
    // data
    int Hits, Misses;
    void *opTable;
+   void *opBulk;
 
    pthread_rwlock_t lock;
 
@@ -160,6 +174,7 @@ FIBBICache::FIBBICache(char *MeshFileName)
 {
   KDMap *KDM=new KDMap;
   opTable = (void *)KDM;
+  opBulk = 0;
 
   pthread_rwlock_init(&lock,0);
 
@@ -204,6 +219,7 @@ FIBBICache::~FIBBICache()
   KDMap *KDM = (KDMap *)opTable;
   delete KDM;
 
+  DestroyBulkTable(opBulk);
 } 
 
 /***************************************************************/
@@ -277,6 +293,12 @@ void FIBBICache::GetFIBBIData(RWGSurface *SA, int neA,
                               RWGSurface *SB, int neB,
                               double *FIBBIs)
 {
+  /***************************************************************/
+  /* pairs covered by the bulk table are fetched without locking */
+  /***************************************************************/
+  if ( opBulk && GetBulkFIBBIData(opBulk, SA, neA, SB, neB, FIBBIs) )
+   return;
+
   /***************************************************************/
   /* look for this key in the cache ******************************/
   /***************************************************************/
@@ -531,6 +553,364 @@ int FIBBICache::Size(int *pHits, int *pMisses)
 
 }
 
+/***************************************************************/
+/* Bulk mode: instead of filling the hash table one record at  */
+/* a time as GetFIBBIData() encounters new pairs, Precompute() */
+/* enumerates up front every pair of edges on a surface that   */
+/* share at least one vertex (these are the only pairs for     */
+/* which FIBBI data are ever requested), computes all of their */
+/* records in parallel, and stores them in a flat array        */
+/* indexed by edge pair. Lookups in this table are read-only   */
+/* and need no locking.                                        */
+/*                                                             */
+/* The table is stored on disk next to the ordinary cache file */
+/* as MeshFile.fibbitable (MeshFile_Tag.fibbitable for meshes  */
+/* with multiple entities) and reloaded on subsequent runs.    */
+/*                                                             */
+/* Records depend on the orientation of the surface, so the   */
+/* table remembers the shape of edge 0 at the time it was      */
+/* built; if the surface has since been rotated, lookups fall  */
+/* through to the hash table.                                  */
+/***************************************************************/
+typedef struct FIBBIBulkTable
+ {
+   int NumEdges;
+   uint64_t NumPairs;
+   uint64_t *Offsets;  // neighbors of edge ne are Neighbors[Offsets[ne]..Offsets[ne+1]-1]
+   int *Neighbors;     // (sorted within each row)
+   double *Data;       // DATALEN doubles per pair, same ordering as Neighbors
+   double Frame[9];    // QM-QP, V1-QP, V2-QP for edge 0
+   double FrameTol;
+
+ } FIBBIBulkTable;
+
+static void DestroyBulkTable(void *opBulk)
+{
+  FIBBIBulkTable *T=(FIBBIBulkTable *)opBulk;
+  if (!T) return;
+  free(T->Offsets);
+  free(T->Neighbors);
+  free(T->Data);
+  free(T);
+}
+
+static void GetEdgeFrame(RWGSurface *S, int ne, double Frame[9])
+{
+  RWGEdge *E = S->Edges[ne];
+  double *QP = S->Vertices + 3*(E->iQP);
+  double *QM = (E->iQM==-1) ? QP : S->Vertices + 3*(E->iQM);
+  double *V1 = S->Vertices + 3*(E->iV1);
+  double *V2 = S->Vertices + 3*(E->iV2);
+  for(int Mu=0; Mu<3; Mu++)
+   { Frame[0+Mu] = QM[Mu] - QP[Mu];
+     Frame[3+Mu] = V1[Mu] - QP[Mu];
+     Frame[6+Mu] = V2[Mu] - QP[Mu];
+   };
+}
+
+static bool BulkTableMatches(FIBBIBulkTable *T, RWGSurface *S)
+{
+  if ( T->NumEdges != S->NumEdges || T->NumEdges==0 )
+   return false;
+  double Frame[9];
+  GetEdgeFrame(S, 0, Frame);
+  for(int n=0; n<9; n++)
+   if ( fabs(Frame[n] - T->Frame[n]) > T->FrameTol )
+    return false;
+  return true;
+}
+
+static bool GetBulkFIBBIData(void *opBulk,
+                             RWGSurface *SA, int neA,
+                             RWGSurface *SB, int neB,
+                             double *FIBBIs)
+{
+  FIBBIBulkTable *T=(FIBBIBulkTable *)opBulk;
+  if ( SA!=SB || neA<0 || neA>=T->NumEdges || !BulkTableMatches(T, SA) )
+   return false;
+
+  int *RowStart = T->Neighbors + T->Offsets[neA];
+  int *RowEnd   = T->Neighbors + T->Offsets[neA+1];
+  int *p = std::lower_bound(RowStart, RowEnd, neB);
+  if ( p==RowEnd || *p!=neB )
+   return false;
+
+  memcpy(FIBBIs, T->Data + (p - T->Neighbors)*DATALEN, DATASIZE);
+  return true;
+}
+
+/***************************************************************/
+/* list, for each edge of S, all edges sharing at least one of */
+/* its four vertices (including the edge itself). this is the  */
+/* set of pairs for which AssessBFPair() returns nonzero.      */
+/*                                                             */
+/* half-RWG edges (iQM==-1, present when SCUFF_HALF_RWG=1) are */
+/* left out of the table altogether; they get empty rows and   */
+/* never appear as neighbors, so lookups involving them fall   */
+/* through to the per-pair cache.                              */
+/***************************************************************/
+static void GetNeighborLists(RWGSurface *S, FIBBIBulkTable *T)
+{
+  int NE=S->NumEdges, NV=S->NumVertices;
+
+  std::vector< std::vector<int> > VertexEdges(NV);
+  for(int ne=0; ne<NE; ne++)
+   { RWGEdge *E=S->Edges[ne];
+     if (E->iQM==-1) continue;
+     VertexEdges[E->iQP].push_back(ne);
+     VertexEdges[E->iV1].push_back(ne);
+     VertexEdges[E->iV2].push_back(ne);
+     VertexEdges[E->iQM].push_back(ne);
+   };
+
+  std::vector< std::vector<int> > Rows(NE);
+  uint64_t NumPairs=0;
+  for(int ne=0; ne<NE; ne++)
+   { RWGEdge *E=S->Edges[ne];
+     if (E->iQM==-1) continue;
+     int iV[4]={E->iQP, E->iV1, E->iV2, E->iQM};
+     std::vector<int> &Row=Rows[ne];
+     for(int n=0; n<4; n++)
+      Row.insert(Row.end(), VertexEdges[iV[n]].begin(), VertexEdges[iV[n]].end());
+     std::sort(Row.begin(), Row.end());
+     Row.erase( std::unique(Row.begin(), Row.end()), Row.end() );
+     NumPairs+=Row.size();
+   };
+
+  T->NumEdges  = NE;
+  T->NumPairs  = NumPairs;
+  T->Offsets   = (uint64_t *)mallocEC( (NE+1)*sizeof(uint64_t) );
+  T->Neighbors = (int *)mallocEC( NumPairs*sizeof(int) );
+  T->Offsets[0]=0;
+  for(int ne=0; ne<NE; ne++)
+   { memcpy(T->Neighbors + T->Offsets[ne], Rows[ne].data(), Rows[ne].size()*sizeof(int));
+     T->Offsets[ne+1] = T->Offsets[ne] + Rows[ne].size();
+   };
+}
+
+/***************************************************************/
+/* table file format (native endianness; files written on a    */
+/* machine of different byte order are rejected):              */
+/*  header (FIBBITableHeader)                                  */
+/*  (NumEdges+1) uint64_t offsets                              */
+/*  NumPairs     int      neighbor indices                     */
+/*  NumPairs*DATALEN double FIBBI records                      */
+/*                                                             */
+/* MeshFingerprint hashes the edge connectivity together with  */
+/* the (float-rounded) shape of every edge, so a table is only */
+/* accepted for the mesh, and orientation, that produced it.   */
+/***************************************************************/
+const char FIBBITF_Signature[]  = "SCUFFFIBBITABLE";
+#define FIBBITF_VERSION   1
+#define FIBBITF_ENDIANTAG 0x01020304U
+
+typedef struct FIBBITableHeader
+ {
+   char Signature[16];
+   uint32_t Version;
+   uint32_t EndianTag;
+   uint32_t DataLen;
+   uint32_t NumEdges;
+   uint64_t NumPairs;
+   uint64_t MeshFingerprint;
+   uint64_t DataChecksum;
+   uint64_t HeaderChecksum;
+
+ } FIBBITableHeader;
+
+static uint64_t FNV1a(const void *Data, size_t Len, uint64_t Hash=14695981039346656037ULL)
+{
+  const unsigned char *p=(const unsigned char *)Data;
+  for(size_t n=0; n<Len; n++)
+   { Hash ^= p[n];
+     Hash *= 1099511628211ULL;
+   };
+  return Hash;
+}
+
+static uint64_t GetMeshFingerprint(RWGSurface *S)
+{
+  uint64_t Hash=FNV1a(&(S->NumEdges), sizeof(int));
+  for(int ne=0; ne<S->NumEdges; ne++)
+   { RWGEdge *E=S->Edges[ne];
+     int iV[4]={E->iQP, E->iV1, E->iV2, E->iQM};
+     Hash=FNV1a(iV, sizeof(iV), Hash);
+     if (E->iQM==-1) continue;
+     float K[KEYLEN];
+     GetFIBBICacheKey(S, ne, S, ne, K);
+     Hash=FNV1a(K, 3*3*sizeof(float), Hash);
+   };
+  return Hash;
+}
+
+static uint64_t GetDataChecksum(FIBBIBulkTable *T)
+{
+  uint64_t Hash=FNV1a(T->Offsets, (T->NumEdges+1)*sizeof(uint64_t));
+  Hash=FNV1a(T->Neighbors, T->NumPairs*sizeof(int), Hash);
+  return FNV1a(T->Data, T->NumPairs*DATASIZE, Hash);
+}
+
+// returns a newly allocated string, to be freed by the caller
+static char *GetBulkFileName(RWGSurface *S)
+{
+  char *MFNCopy=strdupEC(S->MeshFileName);
+  char *Base;
+  if (S->MeshTag==-1)
+   Base=strdupEC(GetFileBase(MFNCopy));
+  else
+   Base=vstrdup("%s_%i", GetFileBase(MFNCopy), S->MeshTag);
+  free(MFNCopy);
+
+  char *FileName, *CacheDir=getenv("SCUFF_CACHE_PATH");
+  if (CacheDir)
+   FileName=vstrdup("%s/%s.%s", CacheDir, Base, BULKSUFFIX);
+  else
+   FileName=vstrdup("%s.%s", Base, BULKSUFFIX);
+  free(Base);
+  return FileName;
+}
+
+static FIBBIBulkTable *LoadBulkTable(const char *FileName, RWGSurface *S)
+{
+  FILE *f=fopen(FileName,"r");
+  if (!f)
+   return 0;
+
+  const char *ErrMsg=0;
+  FIBBIBulkTable *T=(FIBBIBulkTable *)mallocEC(sizeof(FIBBIBulkTable));
+  memset(T, 0, sizeof(FIBBIBulkTable));
+
+  FIBBITableHeader Header;
+  uint64_t Checksum;
+  if ( 1!=fread(&Header, sizeof(Header), 1, f) )
+   { ErrMsg="truncated file"; goto fail; };
+  Checksum=Header.HeaderChecksum;
+  Header.HeaderChecksum=0;
+  if (    strncmp(Header.Signature, FIBBITF_Signature, sizeof(Header.Signature))
+       || Header.Version!=FIBBITF_VERSION
+       || Header.EndianTag!=FIBBITF_ENDIANTAG
+       || Header.DataLen!=DATALEN
+       || Checksum!=FNV1a(&Header, sizeof(Header))
+     )
+   { ErrMsg="invalid or incompatible file header"; goto fail; };
+  if (    (int)Header.NumEdges!=S->NumEdges
+       || Header.MeshFingerprint!=GetMeshFingerprint(S)
+     )
+   { ErrMsg="table was computed for a different mesh"; goto fail; };
+
+  T->NumEdges  = Header.NumEdges;
+  T->NumPairs  = Header.NumPairs;
+  T->Offsets   = (uint64_t *)mallocEC( (T->NumEdges+1)*sizeof(uint64_t) );
+  T->Neighbors = (int *)mallocEC( T->NumPairs*sizeof(int) );
+  T->Data      = (double *)mallocEC( T->NumPairs*DATASIZE );
+  if (    fread(T->Offsets,   sizeof(uint64_t), T->NumEdges+1, f) != (size_t)(T->NumEdges+1)
+       || fread(T->Neighbors, sizeof(int),      T->NumPairs,   f) != T->NumPairs
+       || fread(T->Data,      DATASIZE,         T->NumPairs,   f) != T->NumPairs
+     )
+   { ErrMsg="truncated file"; goto fail; };
+  if ( GetDataChecksum(T) != Header.DataChecksum )
+   { ErrMsg="checksum mismatch"; goto fail; };
+  if ( T->Offsets[0]!=0 || T->Offsets[T->NumEdges]!=T->NumPairs )
+   { ErrMsg="inconsistent offsets"; goto fail; };
+  for(int ne=0; ne<T->NumEdges; ne++)
+   if ( T->Offsets[ne+1] < T->Offsets[ne] )
+    { ErrMsg="inconsistent offsets"; goto fail; };
+
+  fclose(f);
+  return T;
+
+ fail:
+  Log("FC::B warning: file %s: %s (recomputing)",FileName,ErrMsg);
+  fclose(f);
+  DestroyBulkTable(T);
+  return 0;
+}
+
+static void StoreBulkTable(const char *FileName, FIBBIBulkTable *T, RWGSurface *S)
+{
+  FIBBITableHeader Header;
+  memset(&Header, 0, sizeof(Header));
+  strncpy(Header.Signature, FIBBITF_Signature, sizeof(Header.Signature));
+  Header.Version         = FIBBITF_VERSION;
+  Header.EndianTag       = FIBBITF_ENDIANTAG;
+  Header.DataLen         = DATALEN;
+  Header.NumEdges        = T->NumEdges;
+  Header.NumPairs        = T->NumPairs;
+  Header.MeshFingerprint = GetMeshFingerprint(S);
+  Header.DataChecksum    = GetDataChecksum(T);
+  Header.HeaderChecksum  = FNV1a(&Header, sizeof(Header));
+
+  // write to a temporary file and rename, so that concurrent
+  // runs never see a partially-written table
+  char *TmpFileName=vstrdup("%s.%i.tmp", FileName, (int)getpid());
+  FILE *f=fopen(TmpFileName,"w");
+  if (!f)
+   { Log("FC::B warning: could not open file %s (not storing FIBBI table)",TmpFileName);
+     free(TmpFileName);
+     return;
+   };
+
+  bool OK = (    1==fwrite(&Header, sizeof(Header), 1, f)
+              && fwrite(T->Offsets,   sizeof(uint64_t), T->NumEdges+1, f) == (size_t)(T->NumEdges+1)
+              && fwrite(T->Neighbors, sizeof(int),      T->NumPairs,   f) == T->NumPairs
+              && fwrite(T->Data,      DATASIZE,         T->NumPairs,   f) == T->NumPairs
+            );
+  if ( fclose(f)!=0 ) OK=false;
+
+  if ( !OK || rename(TmpFileName, FileName)!=0 )
+   { Log("FC::B warning: could not write file %s (not storing FIBBI table)",FileName);
+     unlink(TmpFileName);
+     free(TmpFileName);
+     return;
+   };
+  free(TmpFileName);
+  Log("FC::B Wrote FIBBI table to file %s.",FileName);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void FIBBICache::Precompute(RWGSurface *S)
+{
+  if ( opBulk || S->NumEdges==0 )
+   return;
+
+  char *FileName = S->MeshFileName ? GetBulkFileName(S) : 0;
+
+  FIBBIBulkTable *T = FileName ? LoadBulkTable(FileName, S) : 0;
+  if (T)
+   Log("FC::B Loaded %lu FIBBI records for %i edges from file %s.",
+        (unsigned long)T->NumPairs, T->NumEdges, FileName);
+  else
+   { 
+     T=(FIBBIBulkTable *)mallocEC(sizeof(FIBBIBulkTable));
+     memset(T, 0, sizeof(FIBBIBulkTable));
+     GetNeighborLists(S, T);
+     T->Data = (double *)mallocEC(T->NumPairs*DATASIZE);
+
+     Log("FC::B Computing %lu FIBBI records for %i edges...",
+          (unsigned long)T->NumPairs, T->NumEdges);
+     int NE=T->NumEdges;
+#ifdef USE_OPENMP
+     int NT=GetNumThreads();
+#pragma omp parallel for schedule(dynamic,16), num_threads(NT)
+#endif
+     for(int nea=0; nea<NE; nea++)
+      for(uint64_t np=T->Offsets[nea]; np<T->Offsets[nea+1]; np++)
+       ComputeFIBBIData(S, nea, S, T->Neighbors[np], T->Data + np*DATALEN);
+     Log("FC::B ...done.");
+
+     if (FileName)
+      StoreBulkTable(FileName, T, S);
+   };
+  if (FileName)
+   free(FileName);
+
+  GetEdgeFrame(S, 0, T->Frame);
+  T->FrameTol = 1.0e-6 * S->Edges[0]->Length;
+  opBulk = (void *)T;
+}
+
 /***************************************************************/
 /* opaque-pointer interface to FIBBI cache routines so that    */
 /* other code files don't need to know how the cache is        */
@@ -556,6 +936,11 @@ void StoreFIBBICache(void *pCache, const char *MeshFileName)
   Cache->Store(MeshFileName);
 }
 
+void PrecomputeFIBBIData(void *pCache, RWGSurface *S)
+{ FIBBICache *Cache = (FIBBICache *)pCache;
+  Cache->Precompute(S);
+}
+
 void GetFIBBIData(void *pCache,
                   RWGSurface *SA, int neA,
                   RWGSurface *SB, int neB,
@@ -31,7 +31,10 @@
 #include <math.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sched.h>
 #ifdef HAVE_CXX11
 #include <unordered_map>
 #elif defined(HAVE_TR1)
@@ -108,13 +111,69 @@ typedef std::tr1::unordered_map< KeyStruct,
                                  KeyCmp> KeyValueMap;
 #endif
 
+// cache files mapped into memory by PreLoad(); see below
+static QIFIPPIData *FindInFiles(void *opFiles, const KeyStruct &K);
+static void UnmapFiles(void *opFiles);
+
+/*--------------------------------------------------------------*/
+/*- the table is split into FC_NUMSHARDS independently-locked   -*/
+/*- shards, selected by the key hash, so that threads working   -*/
+/*- on different panel pairs rarely contend for the same lock.  -*/
+/*-                                                             -*/
+/*- a record that is still being computed is present in its     -*/
+/*- shard with a NULL data pointer; the computing thread        -*/
+/*- publishes the data pointer when it is done, and other       -*/
+/*- threads that look up the same key wait for that instead of  -*/
+/*- computing the record a second time.                         -*/
+/*--------------------------------------------------------------*/
+#define FC_NUMSHARDS 64
+
+typedef struct FCShard
+ { KeyValueMap Table;
+   rwlock Lock;
+ } FCShard;
+
+static inline FCShard *GetShard(void *opTable, const KeyStruct &K)
+{ unsigned long Hash=(unsigned long)HashFunction(K.Key);
+  return ((FCShard *)opTable) + ( (Hash>>16) % FC_NUMSHARDS );
+}
+
+/*--------------------------------------------------------------*/
+/*- lookup statistics are accumulated in per-thread slots (one  -*/
+/*- cache line each) and only summed when somebody asks.        -*/
+/*- threads are assigned slots in the order in which they first -*/
+/*- touch the cache; if there are more threads than slots, some -*/
+/*- slots are shared, which is harmless since the counters are  -*/
+/*- updated atomically.                                         -*/
+/*--------------------------------------------------------------*/
+#define FC_NUMSTATSLOTS 128
+
+typedef struct FCStats
+ { int Hits, Misses, Waits;
+   char Pad[64 - 3*sizeof(int)];
+ } FCStats;
+
+static __thread int MyStatSlot=-1;
+static int NextStatSlot=0;
+
+static inline FCStats *GetStats(void *opStats)
+{ if (MyStatSlot==-1)
+   MyStatSlot = __sync_fetch_and_add(&NextStatSlot, 1) % FC_NUMSTATSLOTS;
+  return ((FCStats *)opStats) + MyStatSlot;
+}
+
+static inline void Increment(int *Counter)
+{ __atomic_fetch_add(Counter, 1, __ATOMIC_RELAXED); }
+
 /*--------------------------------------------------------------*/
 /*- class constructor ------------------------------------------*/
 /*--------------------------------------------------------------*/
 FIPPICache::FIPPICache()
 {
-  KeyValueMap *KVM=new KeyValueMap;
-  opTable = (void *)KVM;
+  opTable = (void *)(new FCShard[FC_NUMSHARDS]);
+  opStats = mallocEC(FC_NUMSTATSLOTS*sizeof(FCStats));
+  opFiles = 0;
+  ResetStatistics();
   PreloadFileName=0;
   RecordsPreloaded=0;
 }
@@ -127,10 +186,43 @@ FIPPICache::~FIPPICache()
   if (PreloadFileName) 
    free(PreloadFileName);
 
-  KeyValueMap *KVM=(KeyValueMap *)opTable;
-  delete KVM;
+  delete[] (FCShard *)opTable;
+  free(opStats);
+  UnmapFiles(opFiles);
 } 
 
+/*--------------------------------------------------------------*/
+/*- statistics -------------------------------------------------*/
+/*--------------------------------------------------------------*/
+void FIPPICache::GetStatistics(int *Hits, int *Misses, int *Waits)
+{
+  FCStats *Stats=(FCStats *)opStats;
+  int H=0, M=0, W=0;
+  for(int ns=0; ns<FC_NUMSTATSLOTS; ns++)
+   { H+=__atomic_load_n(&(Stats[ns].Hits),   __ATOMIC_RELAXED);
+     M+=__atomic_load_n(&(Stats[ns].Misses), __ATOMIC_RELAXED);
+     W+=__atomic_load_n(&(Stats[ns].Waits),  __ATOMIC_RELAXED);
+   };
+  if (Hits)   *Hits=H;
+  if (Misses) *Misses=M;
+  if (Waits)  *Waits=W;
+}
+
+void FIPPICache::ResetStatistics()
+{ memset(opStats, 0, FC_NUMSTATSLOTS*sizeof(FCStats)); }
+
+unsigned int FIPPICache::NumRecords()
+{
+  FCShard *Shards=(FCShard *)opTable;
+  unsigned int N=0;
+  for(int ns=0; ns<FC_NUMSHARDS; ns++)
+   { Shards[ns].Lock.read_lock();
+     N+=Shards[ns].Table.size();
+     Shards[ns].Lock.read_unlock();
+   };
+  return N;
+}
+
 static void inline VecSubFloat(double *V1, double *V2, float *V1mV2)
 { V1mV2[0] = ((float)V1[0]) - ((float)V2[0]);
   V1mV2[1] = ((float)V1[1]) - ((float)V2[1]);
@@ -170,33 +262,65 @@ QIFIPPIData *FIPPICache::GetQIFIPPIData(double **OVa, double **OVb, int ncv)
   VecSubFloat(OVb[2], OVa[0], K.Key+12 );
 
   /***************************************************************/
-  /* look for this key in the cache ******************************/
+  /* look for this key in the cache, first in any cache files    */
+  /* that were mapped into memory by PreLoad() and then in the   */
+  /* in-memory table                                             */
   /***************************************************************/
-  KeyValueMap *KVM=(KeyValueMap *)opTable;
+  FCStats *Stats=GetStats(opStats);
+  QIFIPPIData *MappedQIFD=FindInFiles(opFiles, K);
+  if (MappedQIFD)
+   { Increment(&(Stats->Hits));
+     return MappedQIFD;
+   };
 
-  FCLock.read_lock();
-  KeyValueMap::iterator p=KVM->find(K);
-  FCLock.read_unlock();
+  FCShard *Shard=GetShard(opTable, K);
+  QIFIPPIData **Slot=0;
 
-  if ( p != (KVM->end()) )
-   { Hits++;
-     return (QIFIPPIData *)(p->second);
+  Shard->Lock.read_lock();
+  KeyValueMap::iterator p=Shard->Table.find(K);
+  if ( p != Shard->Table.end() )
+   Slot=&(p->second);
+  Shard->Lock.read_unlock();
+
+  /***************************************************************/
+  /* if it was not found, claim the key by inserting an in-flight*/
+  /* (NULL) record, unless another thread has claimed it in the  */
+  /* meantime                                                    */
+  /***************************************************************/
+  bool Claimed=false;
+  if (Slot==0)
+   { Shard->Lock.write_lock();
+     std::pair<KeyValueMap::iterator, bool> Result
+      = Shard->Table.insert( KeyValuePair(K, (QIFIPPIData *)0) );
+     Slot=&(Result.first->second);
+     Claimed=Result.second;
+     Shard->Lock.write_unlock();
    };
-  
+
   /***************************************************************/
-  /* if it was not found, allocate and compute a new QIFIPPIData */
-  /* structure, then add this structure to the cache             */
+  /* if we claimed the key, compute the record and publish it    */
   /***************************************************************/
-  Misses++;
-  KeyStruct *K2 = (KeyStruct *)mallocEC(sizeof(*K2));
-  memcpy(K2->Key, K.Key, KEYSIZE);
-  QIFIPPIData *QIFD=(QIFIPPIData *)mallocEC(sizeof *QIFD);
-  ComputeQIFIPPIData(OVa, OVb, ncv, QIFD);
-   
-  FCLock.write_lock();
-  KVM->insert( KeyValuePair(*K2, QIFD) );
-  FCLock.write_unlock();
+  if (Claimed)
+   { Increment(&(Stats->Misses));
+     QIFIPPIData *QIFD=(QIFIPPIData *)mallocEC(sizeof *QIFD);
+     ComputeQIFIPPIData(OVa, OVb, ncv, QIFD);
+     __atomic_store_n(Slot, QIFD, __ATOMIC_RELEASE);
+     return QIFD;
+   };
+
+  /***************************************************************/
+  /* otherwise the record either exists or is being computed by  */
+  /* another thread; in the latter case, wait for it             */
+  /***************************************************************/
+  QIFIPPIData *QIFD=__atomic_load_n(Slot, __ATOMIC_ACQUIRE);
+  if (QIFD)
+   { Increment(&(Stats->Hits));
+     return QIFD;
+   };
 
+  Increment(&(Stats->Waits));
+  while( (QIFD=__atomic_load_n(Slot, __ATOMIC_ACQUIRE))==0 )
+   sched_yield();
   return QIFD;
 }
 
@@ -206,22 +330,61 @@ QIFIPPIData *FIPPICache::GetQIFIPPIData(double **OVa, double **OVb, int ncv)
 /* and subsequently pre-loading a FIPPI cache with the content */
 /* of a file created by this storage operation.                */
 /*                                                             */
-/* the file format is pretty simple (and non-portable w.r.t.   */
-/* endianness):                                                */
-/*  bytes 0--10:   'FIPPICACHE' + 0 (a file signature used as  */
-/*                                   a simple sanity check)    */
-/*  next xx bytes:  first record                               */
-/*  next xx bytes:  second record                              */
-/*  ...             ...                                        */
+/* the file format (version 2) is:                             */
+/*  (a) a FIPPICF_Header (see below)                           */
+/*  (b) a hash index of NumBuckets 64-bit slots (NumBuckets is */
+/*      a power of 2); each slot is either 0 (empty) or 1 plus */
+/*      the index of a record. a key with hash h is found by   */
+/*      linear probing starting at slot h&(NumBuckets-1).      */
+/*  (c) NumRecords records, each consisting of a search key    */
+/*      (15 float values) followed by the content of the       */
+/*      QIFIPPIData structure for that search key.             */
 /*                                                             */
-/* where xx is the size of the record; each record consists of */
-/* a search key (15 double values) followed by the content     */
-/* of the QIFIPPIDataRecord for that search key.               */
+/* PreLoad() does not read the records; it maps the file into  */
+/* memory and GetQIFIPPIData() looks keys up in place, so only */
+/* the pages that are actually needed are ever read from disk. */
+/*                                                             */
+/* files are not portable between machines with different     */
+/* byte order or structure layout; the header records enough   */
+/* to detect this. the header checksum is always verified, and */
+/* the index is always scanned to check that it holds exactly  */
+/* NumRecords entries, all in range (this reads only the       */
+/* 8*NumBuckets bytes of the index);                           */
+/* the checksum of the index and records is only verified if   */
+/* the environment variable SCUFF_VERIFY_FIPPI_CACHE is set to */
+/* 1, since that requires reading the whole file.              */
+/*                                                             */
+/* the mesh fingerprint identifies the geometry for which the  */
+/* file was written (0 if unknown). records are keyed on panel */
+/* geometry and so remain valid for any geometry; a mismatch   */
+/* is only noted in the log.                                   */
+/*                                                             */
+/* files in the original format (a 'FIPPICACHE' signature      */
+/* followed by raw records) are still accepted, and are read   */
+/* into memory in their entirety as before.                    */
 /*                                                             */
 /* note: FIPPICF = 'FIPPI cache file'                          */
 /***************************************************************/
-const char FIPPICF_Signature[]="FIPPICACHE";
-#define FIPPICF_SIGSIZE sizeof(FIPPICF_Signature)
+const char FIPPICF_Signature[]="SCUFFFIPPICACHE";
+const char FIPPICF_OldSignature[]="FIPPICACHE";
+#define FIPPICF_OLDSIGSIZE sizeof(FIPPICF_OldSignature)
+#define FIPPICF_VERSION   2
+#define FIPPICF_ENDIANTAG 0x01020304U
+
+typedef struct FIPPICF_Header
+ { char Signature[16];
+   uint32_t Version;
+   uint32_t EndianTag;
+   uint32_t KeySize;
+   uint32_t RecordSize;
+   uint64_t NumRecords;
+   uint64_t NumBuckets;
+   uint64_t IndexOffset;     // byte offsets from the start of the file
+   uint64_t RecordOffset;
+   uint64_t MeshFingerprint;
+   uint64_t DataChecksum;    // of the index and records
+   uint64_t HeaderChecksum;  // of this header with HeaderChecksum=0
+ } FIPPICF_Header;
 
 // note that this structure differs from the KeyValuePair structure 
 // defined above in that it contains the actual contents of 
@@ -233,88 +396,293 @@ typedef struct FIPPICF_Record
  } FIPPICF_Record;
 #define FIPPICF_RECSIZE sizeof(FIPPICF_Record)
 
-void FIPPICache::Store(const char *FileName)
+/***************************************************************/
+/* a cache file that has been mapped into memory by PreLoad()  */
+/***************************************************************/
+typedef struct FCFile
+ { char *FileName;
+   void *Base;
+   size_t Size;
+   uint64_t NumBuckets;
+   uint64_t NumRecords;
+   uint64_t *Index;
+   FIPPICF_Record *Records;
+   struct FCFile *Next;
+ } FCFile;
+
+/***************************************************************/
+/* 64-bit FNV-1a hash, used for the on-disk index (which must  */
+/* not depend on the signedness of char, unlike JenkinsHash)   */
+/* and for checksums                                           */
+/***************************************************************/
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME  1099511628211ULL
+static uint64_t FNV1a(const void *Data, size_t Size, uint64_t Hash=FNV_OFFSET)
+{
+  const unsigned char *p=(const unsigned char *)Data;
+  for(size_t n=0; n<Size; n++)
+   { Hash ^= p[n];
+     Hash *= FNV_PRIME;
+   };
+  return Hash;
+}
+
+static uint64_t GetHeaderChecksum(FIPPICF_Header *Header)
+{
+  FIPPICF_Header Copy=*Header;
+  Copy.HeaderChecksum=0;
+  return FNV1a(&Copy, sizeof(Copy));
+}
+
+/***************************************************************/
+/* fingerprint of the meshes in a geometry. this is built from */
+/* the panel areas, so it is unchanged by rigid motions of the */
+/* surfaces.                                                   */
+/***************************************************************/
+static uint64_t GetMeshFingerprint(RWGGeometry *G)
+{
+  if (G==0) return 0;
+  uint64_t Hash=FNV_OFFSET;
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   { RWGSurface *S=G->Surfaces[ns];
+     Hash=FNV1a(&(S->NumPanels), sizeof(int), Hash);
+     for(int np=0; np<S->NumPanels; np++)
+      { float Area=(float)(S->Panels[np]->Area);
+        Hash=FNV1a(&Area, sizeof(float), Hash);
+      };
+   };
+  return Hash ? Hash : 1;
+}
+
+/***************************************************************/
+/* look up a key in the mapped cache files. PreLoad() has      */
+/* checked the index, but we still never probe more than       */
+/* NumBuckets slots or follow an out-of-range entry.           */
+/***************************************************************/
+static QIFIPPIData *FindInFiles(void *opFiles, const KeyStruct &K)
+{
+  if (opFiles==0) return 0;
+  uint64_t Hash=FNV1a(K.Key, KEYSIZE);
+  for(FCFile *F=(FCFile *)opFiles; F; F=F->Next)
+   { uint64_t Mask=F->NumBuckets-1;
+     uint64_t nb=Hash&Mask;
+     for(uint64_t np=0; np<F->NumBuckets && F->Index[nb]!=0; np++, nb=(nb+1)&Mask)
+      { if (F->Index[nb] > F->NumRecords) 
+         continue;
+        FIPPICF_Record *R=F->Records + (F->Index[nb]-1);
+        if ( !memcmp(R->K.Key, K.Key, KEYSIZE) )
+         return &(R->QIFDBuffer);
+      };
+   };
+  return 0;
+}
+
+static void UnmapFiles(void *opFiles)
+{
+  FCFile *F=(FCFile *)opFiles;
+  while(F)
+   { FCFile *Next=F->Next;
+     munmap(F->Base, F->Size);
+     free(F->FileName);
+     free(F);
+     F=Next;
+   };
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void FIPPICache::Store(const char *FileName, RWGGeometry *G)
 {
-  KeyValueMap *KVM=(KeyValueMap *)opTable;
+  FCShard *Shards=(FCShard *)opTable;
 
   if (FileName==0) return;
 
   /*--------------------------------------------------------------*/
   /*- pause to check if the following conditions are satisfied:  -*/
-  /*-  (1) the FIPPI cache was preloaded from an input file whose-*/
-  /*-      name matches the name of the output file to which we  -*/
-  /*-      are being asked to dump the cache                     -*/
-  /*-  (2) the number of cache records hasn't changed since we   -*/
-  /*-      preloaded from the input file.                        -*/
+  /*-  (1) the FIPPI cache was preloaded from a single input file-*/
+  /*-      whose name matches the name of the output file to     -*/
+  /*-      which we are being asked to dump the cache            -*/
+  /*-  (2) the number of in-memory cache records hasn't changed  -*/
+  /*-      since we preloaded from the input file.               -*/
   /*- if both conditions are satisfied, we don't bother to dump  -*/
   /*- the cache since the operation would result in a cache dump -*/
   /*- file identical to the one that already exists.             -*/
   /*--------------------------------------------------------------*/
+  FCFile *Files=(FCFile *)opFiles;
   if (     PreloadFileName 
        && !strcmp(PreloadFileName, FileName) 
-       && RecordsPreloaded==(KVM->size())
+       && (Files==0 || Files->Next==0)
+       && RecordsPreloaded==NumRecords()
      )  
    { Log("FIPPI cache unchanged since reading from %s (skipping cache dump)",FileName);
      return;
    };
 
   /*--------------------------------------------------------------*/
+  /*- gather pointers to all records, from the mapped files and  -*/
+  /*- from the in-memory table, and build the hash index. keys   -*/
+  /*- that appear in more than one mapped file are only written  -*/
+  /*- once.                                                      -*/
   /*--------------------------------------------------------------*/
-  /*--------------------------------------------------------------*/
-  FCLock.read_lock();
+  uint64_t MaxRecords=NumRecords();
+  for(FCFile *F=Files; F; F=F->Next)
+   MaxRecords += ((FIPPICF_Header *)F->Base)->NumRecords;
+
+  uint64_t NumBuckets=16;
+  while( NumBuckets < 2*MaxRecords )
+   NumBuckets*=2;
+  uint64_t Mask=NumBuckets-1;
+
+  uint64_t *Index=(uint64_t *)mallocEC(NumBuckets*sizeof(uint64_t));
+  memset(Index, 0, NumBuckets*sizeof(uint64_t));
+  const KeyStruct **Keys=(const KeyStruct **)mallocEC((MaxRecords+1)*sizeof(KeyStruct *));
+  const QIFIPPIData **Data=(const QIFIPPIData **)mallocEC((MaxRecords+1)*sizeof(QIFIPPIData *));
+  uint64_t NumRecordsWritten=0;
+
+#define ADD_RECORD(KP, DP)                                           \
+  { uint64_t nb=FNV1a((KP)->Key, KEYSIZE) & Mask;                    \
+    bool Duplicate=false;                                            \
+    for(; Index[nb]!=0 && !Duplicate; nb=(nb+1)&Mask)                \
+     Duplicate = !memcmp(Keys[Index[nb]-1]->Key, (KP)->Key, KEYSIZE);\
+    if (!Duplicate)                                                  \
+     { Keys[NumRecordsWritten]=(KP);                                 \
+       Data[NumRecordsWritten]=(DP);                                 \
+       Index[nb] = ++NumRecordsWritten;                              \
+     };                                                              \
+  }
+
+  for(FCFile *F=Files; F; F=F->Next)
+   { uint64_t N=((FIPPICF_Header *)F->Base)->NumRecords;
+     for(uint64_t nr=0; nr<N; nr++)
+      ADD_RECORD( &(F->Records[nr].K), &(F->Records[nr].QIFDBuffer) );
+   };
 
-  KeyValueMap::iterator it;
-  int NumRecords=0;
+  for(int ns=0; ns<FC_NUMSHARDS; ns++)
+   { Shards[ns].Lock.read_lock();
+     KeyValueMap::iterator it;
+     for(it=Shards[ns].Table.begin(); it!=Shards[ns].Table.end(); it++)
+      { QIFIPPIData *QIFD=__atomic_load_n(&(it->second), __ATOMIC_ACQUIRE);
+        if (QIFD==0) continue; // still being computed
+        ADD_RECORD( &(it->first), QIFD );
+      };
+     Shards[ns].Lock.read_unlock();
+   };
+#undef ADD_RECORD
 
   /*--------------------------------------------------------------*/
-  /*- try to open the file ---------------------------------------*/
+  /*- write to a temporary file and rename it at the end, so that-*/
+  /*- a mapped file of the same name stays valid while we work   -*/
   /*--------------------------------------------------------------*/
-  FILE *f=fopen(FileName,"w");
+  char *TmpFileName=vstrdup("%s.%i.tmp", FileName, (int)getpid());
+  FILE *f=fopen(TmpFileName,"w");
   if (!f)
-   { fprintf(stderr,"warning: could not open file %s (aborting cache dump)...",FileName);
-     goto done;
+   { fprintf(stderr,"warning: could not open file %s (aborting cache dump)...",TmpFileName);
+     free(TmpFileName); free(Index); free(Keys); free(Data);
+     return;
    };
   Log("Writing FIPPI cache to file %s...",FileName);
 
-  /*---------------------------------------------------------------------*/
-  /*- write file signature ----------------------------------------------*/
-  /*---------------------------------------------------------------------*/
-  fwrite(FIPPICF_Signature,FIPPICF_SIGSIZE,1,f);
+  FIPPICF_Header Header;
+  memset(&Header, 0, sizeof(Header));
+  strncpy(Header.Signature, FIPPICF_Signature, sizeof(Header.Signature));
+  Header.Version         = FIPPICF_VERSION;
+  Header.EndianTag       = FIPPICF_ENDIANTAG;
+  Header.KeySize         = KEYSIZE;
+  Header.RecordSize      = FIPPICF_RECSIZE;
+  Header.NumRecords      = NumRecordsWritten;
+  Header.NumBuckets      = NumBuckets;
+  Header.IndexOffset     = sizeof(FIPPICF_Header);
+  Header.RecordOffset    = Header.IndexOffset + NumBuckets*sizeof(uint64_t);
+  Header.MeshFingerprint = GetMeshFingerprint(G);
+
+  // the header is rewritten with its checksums at the end
+  bool WriteError = ( 1!=fwrite(&Header, sizeof(Header), 1, f) );
+  if (!WriteError)
+   WriteError = ( 1!=fwrite(Index, NumBuckets*sizeof(uint64_t), 1, f) );
+  uint64_t Checksum=FNV1a(Index, NumBuckets*sizeof(uint64_t));
 
-  /*---------------------------------------------------------------------*/
-  /*- iterate through the table and write entries to the file one-by-one */
-  /*---------------------------------------------------------------------*/
-  KeyStruct K;
-  QIFIPPIData *QIFD;
   FIPPICF_Record MyRecord;
-  for ( it = KVM->begin(); it != KVM->end(); it++ ) 
-   { 
-     K=it->first;
-     QIFD=it->second;
-     memcpy(&(MyRecord.K.Key),       K.Key, sizeof(MyRecord.K.Key ));
-     memcpy(&(MyRecord.QIFDBuffer),  QIFD,  sizeof(MyRecord.QIFDBuffer));
-     if ( 1 != fwrite(&(MyRecord),sizeof(MyRecord),1,f ) )
-      break;
-     NumRecords++;
+  memset(&MyRecord, 0, sizeof(MyRecord)); // zero any padding bytes
+  for(uint64_t nr=0; nr<NumRecordsWritten && !WriteError; nr++)
+   { memcpy(&(MyRecord.K.Key),      Keys[nr]->Key, sizeof(MyRecord.K.Key));
+     memcpy(&(MyRecord.QIFDBuffer), Data[nr],      sizeof(MyRecord.QIFDBuffer));
+     Checksum=FNV1a(&MyRecord, sizeof(MyRecord), Checksum);
+     WriteError = ( 1!=fwrite(&MyRecord, sizeof(MyRecord), 1, f) );
    };
 
-  /*---------------------------------------------------------------------*/
-  /*- and that's it -----------------------------------------------------*/
-  /*---------------------------------------------------------------------*/
-  fclose(f);
-  Log(" ...wrote %i FIPPI records.",NumRecords);
+  Header.DataChecksum   = Checksum;
+  Header.HeaderChecksum = GetHeaderChecksum(&Header);
+  if (!WriteError)
+   WriteError = ( fseek(f, 0, SEEK_SET) || 1!=fwrite(&Header, sizeof(Header), 1, f) );
+  if ( fclose(f) ) 
+   WriteError=true;
+
+  free(Index);
+  free(Keys);
+  free(Data);
+
+  if ( WriteError || rename(TmpFileName, FileName) )
+   { fprintf(stderr,"warning: could not write file %s (aborting cache dump)\n",FileName);
+     Log("Could not write FIPPI cache file %s.",FileName);
+     unlink(TmpFileName);
+     free(TmpFileName);
+     return;
+   };
+  free(TmpFileName);
 
- done:
-  FCLock.read_unlock();
+  Log(" ...wrote %lu FIPPI records.",(unsigned long)NumRecordsWritten);
 }
 
-void FIPPICache::PreLoad(const char *FileName)
+/***************************************************************/
+/* read a file in the original format into the in-memory table.*/
+/* f is positioned just past the signature on entry, and is    */
+/* closed on return.                                           */
+/***************************************************************/
+static unsigned int PreLoadOldFormat(FILE *f, const char *FileName,
+                                     off_t FileSize, void *opTable)
 {
+  // the file size, minus the portion taken up by the signature, 
+  // should be an integer multiple of the size of a FIPPICF_Record
+  FileSize-=FIPPICF_OLDSIGSIZE;
+  if ( (FileSize % FIPPICF_RECSIZE)!=0 )
+   { fprintf(stderr,"warning: file %s: cache file has incorrect size (skipping cache preload)\n",FileName);
+     Log("FIPPI cache file %s: cache file has incorrect size (skipping cache preload)",FileName);
+     fclose(f);
+     return 0;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- allocate memory to store cache entries read from the file  -*/
+  /*- and read them in one at a time                             -*/
+  /*--------------------------------------------------------------*/
+  unsigned int NumRecords = FileSize / FIPPICF_RECSIZE;
+  FIPPICF_Record *Records=(FIPPICF_Record *)mallocEC(NumRecords*FIPPICF_RECSIZE);
+  Log("Preloading FIPPI records from file %s...",FileName);
+  for(unsigned int nr=0; nr<NumRecords; nr++)
+   { 
+     if ( fread(Records+nr, FIPPICF_RECSIZE,1,f) != 1 )
+      { fprintf(stderr,"warning: file %s: read only %i of %i records",FileName,nr+1,NumRecords);
+        fclose(f);
+        return nr;
+      };
 
-  FCLock.write_lock();
+     FCShard *Shard=GetShard(opTable, Records[nr].K);
+     Shard->Lock.write_lock();
+     Shard->Table.insert( KeyValuePair(Records[nr].K, &(Records[nr].QIFDBuffer)) );
+     Shard->Lock.write_unlock();
+   };
 
-  KeyValueMap *KVM=(KeyValueMap *)opTable;
+  Log(" ...successfully preloaded %i FIPPI records.",NumRecords);
+  fclose(f);
+  return NumRecords;
+}
 
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void FIPPICache::PreLoad(const char *FileName, RWGGeometry *G)
+{
   /*--------------------------------------------------------------*/
   /*- try to open the file ---------------------------------------*/
   /*--------------------------------------------------------------*/
@@ -322,95 +690,135 @@ void FIPPICache::PreLoad(const char *FileName)
   if (!f)
    { fprintf(stderr,"warning: could not open file %s (skipping cache preload)\n",FileName);
      Log("Could not open FIPPI cache file %s...",FileName); 
-     goto done;
+     return;
+   };
+
+  struct stat fileStats;
+  off_t FileSize = fstat(fileno(f), &fileStats) ? 0 : fileStats.st_size;
+
+  /*--------------------------------------------------------------*/
+  /*- files in the original format are read into memory          -*/
+  /*--------------------------------------------------------------*/
+  char OldSignature[FIPPICF_OLDSIGSIZE];
+  if (    FileSize >= (off_t)FIPPICF_OLDSIGSIZE
+       && 1==fread(OldSignature, FIPPICF_OLDSIGSIZE, 1, f)
+       && !strcmp(OldSignature, FIPPICF_OldSignature)
+     )
+   { RecordsPreloaded=PreLoadOldFormat(f, FileName, FileSize, opTable);
+     if (PreloadFileName)
+      free(PreloadFileName);
+     PreloadFileName=strdupEC(FileName);
+     return;
    };
 
   /*--------------------------------------------------------------*/
-  /*- run through some sanity checks to make sure we have a valid */
-  /*- cache file                                                  */
+  /*- otherwise check the header ---------------------------------*/
   /*--------------------------------------------------------------*/
-  const char *ErrMsg;
-  ErrMsg = 0;
-  
-  struct stat fileStats;
-  if ( fstat(fileno(f), &fileStats) )
-   ErrMsg="invalid cache file";
-  
-  // check that the file signature is present and correct 
-  off_t FileSize;
-  FileSize=fileStats.st_size;
-  char FileSignature[FIPPICF_SIGSIZE]; 
-  if ( ErrMsg==0 && (FileSize < (signed int )FIPPICF_SIGSIZE) )
-   ErrMsg="invalid cache file";
-  if ( ErrMsg==0 && 1!=fread(FileSignature, FIPPICF_SIGSIZE, 1, f) )
+  const char *ErrMsg=0;
+  FIPPICF_Header Header;
+  if ( FileSize < (off_t)sizeof(Header) || fseek(f, 0, SEEK_SET) || 1!=fread(&Header, sizeof(Header), 1, f) )
    ErrMsg="invalid cache file";
-  if ( ErrMsg==0 && strcmp(FileSignature, FIPPICF_Signature) ) 
+  else if ( strncmp(Header.Signature, FIPPICF_Signature, sizeof(Header.Signature)) )
    ErrMsg="invalid cache file";
-
-  // the file size, minus the portion taken up by the signature, 
-  // should be an integer multiple of the size of a FIPPICF_Record
-  FileSize-=FIPPICF_SIGSIZE;
-  if ( ErrMsg==0 && (FileSize % FIPPICF_RECSIZE)!=0 )
+  else if ( Header.EndianTag!=FIPPICF_ENDIANTAG )
+   ErrMsg="cache file was written on a machine with different byte order";
+  else if ( Header.HeaderChecksum != GetHeaderChecksum(&Header) )
+   ErrMsg="cache file header is corrupted";
+  else if ( Header.Version!=FIPPICF_VERSION )
+   ErrMsg="unsupported cache file version";
+  else if ( Header.KeySize!=KEYSIZE || Header.RecordSize!=FIPPICF_RECSIZE )
+   ErrMsg="cache file was written by an incompatible version of scuff-em";
+  else if (    Header.NumBuckets==0 || (Header.NumBuckets & (Header.NumBuckets-1))
+            || Header.NumRecords >= Header.NumBuckets
+            || Header.IndexOffset  != sizeof(Header)
+            || Header.RecordOffset != Header.IndexOffset + Header.NumBuckets*sizeof(uint64_t)
+            || (uint64_t)FileSize  != Header.RecordOffset + Header.NumRecords*FIPPICF_RECSIZE 
+          )
    ErrMsg="cache file has incorrect size";
+  fclose(f);
 
   /*--------------------------------------------------------------*/
-  /*- allocate memory to store cache entries read from the file. -*/
-  /*- for now, we abort if there is not enough memory to store   -*/
-  /*- the full cache; TODO explore schemes for partial preload.  -*/
+  /*- map the file into memory -----------------------------------*/
   /*--------------------------------------------------------------*/
-  unsigned int NumRecords;
-  FIPPICF_Record *Records;
-  NumRecords = FileSize / FIPPICF_RECSIZE;
-  if ( ErrMsg==0 )
-   { Records=(FIPPICF_Record *)mallocEC(NumRecords*FIPPICF_RECSIZE);
-     if ( !Records)
-      ErrMsg="insufficient memory to preload cache";
+  void *Base=MAP_FAILED;
+  if (ErrMsg==0)
+   { int fd=open(FileName, O_RDONLY);
+     if (fd>=0)
+      { Base=mmap(0, FileSize, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+      };
+     if (Base==MAP_FAILED)
+      ErrMsg="could not map cache file into memory";
    };
 
   /*--------------------------------------------------------------*/
-  /*- pause here to clean up if anything went wrong --------------*/
+  /*- check that the index holds NumRecords in-range entries; a  -*/
+  /*- corrupted index could otherwise send lookups outside the   -*/
+  /*- mapped region or leave no empty slot to end a probe        -*/
   /*--------------------------------------------------------------*/
-  if (ErrMsg)
-   { fprintf(stderr,"warning: file %s: %s (skipping cache preload)\n",FileName,ErrMsg);
-     Log("FIPPI cache file %s: %s (skipping cache preload)",FileName,ErrMsg);
-     fclose(f);
-     goto done;
+  if (ErrMsg==0)
+   { uint64_t *Index=(uint64_t *)( ((char *)Base) + Header.IndexOffset);
+     uint64_t NumEntries=0;
+     for(uint64_t nb=0; nb<Header.NumBuckets && ErrMsg==0; nb++)
+      if (Index[nb]!=0)
+       { if (Index[nb] > Header.NumRecords)
+          ErrMsg="cache file index is corrupted";
+         NumEntries++;
+       };
+     if (ErrMsg==0 && NumEntries!=Header.NumRecords)
+      ErrMsg="cache file index is corrupted";
    };
 
   /*--------------------------------------------------------------*/
-  /*- now just read records from the file one at a time and add   */
-  /*- them to the table.                                          */
+  /*- optionally verify the checksum of the index and records    -*/
   /*--------------------------------------------------------------*/
-  unsigned int nr;
-  Log("Preloading FIPPI records from file %s...",FileName);
-  for(nr=0; nr<NumRecords; nr++)
-   { 
-     if ( fread(Records+nr, FIPPICF_RECSIZE,1,f) != 1 )
-      { fprintf(stderr,"warning: file %s: read only %i of %i records",FileName,nr+1,NumRecords);
-        fclose(f);
-	goto done;
-      };
+  char *s;
+  if ( ErrMsg==0 && (s=getenv("SCUFF_VERIFY_FIPPI_CACHE")) && s[0]=='1' )
+   { Log("Verifying checksum of FIPPI cache file %s...",FileName);
+     uint64_t Checksum=FNV1a( ((char *)Base) + Header.IndexOffset, FileSize - Header.IndexOffset);
+     if (Checksum!=Header.DataChecksum)
+      ErrMsg="cache file is corrupted";
+   };
 
-     KVM->insert( KeyValuePair(Records[nr].K, &(Records[nr].QIFDBuffer)) );
+  if (ErrMsg)
+   { fprintf(stderr,"warning: file %s: %s (skipping cache preload)\n",FileName,ErrMsg);
+     Log("FIPPI cache file %s: %s (skipping cache preload)",FileName,ErrMsg);
+     if (Base!=MAP_FAILED) 
+      munmap(Base, FileSize);
+     return;
    };
 
+  uint64_t Fingerprint=GetMeshFingerprint(G);
+  if ( Fingerprint && Header.MeshFingerprint && Fingerprint!=Header.MeshFingerprint )
+   Log("FIPPI cache file %s was written for a different geometry.",FileName);
+
+  // records are looked up at random, so readahead would only waste I/O
+  madvise(Base, FileSize, MADV_RANDOM);
+
   /*--------------------------------------------------------------*/
-  /*- the full file was successfully preloaded -------------------*/
+  /*- add the file to the list of mapped files -------------------*/
   /*--------------------------------------------------------------*/
-  Log(" ...successfully preloaded %i FIPPI records.",NumRecords);
-  fclose(f);
-
-  // the most recent file from which we preloaded, and the number of 
-  // records preloaded, are stored within the class body to allow us 
-  // to skip dumping the cache back to disk in cases where that would
-  // amount to just rewriting the same cache file
+  FCFile *F=(FCFile *)mallocEC(sizeof(FCFile));
+  F->FileName   = strdupEC(FileName);
+  F->Base       = Base;
+  F->Size       = FileSize;
+  F->NumBuckets = Header.NumBuckets;
+  F->NumRecords = Header.NumRecords;
+  F->Index      = (uint64_t *)( ((char *)Base) + Header.IndexOffset);
+  F->Records    = (FIPPICF_Record *)( ((char *)Base) + Header.RecordOffset);
+  F->Next       = (FCFile *)opFiles;
+  opFiles=(void *)F;
+
+  Log("Mapped %lu FIPPI records from file %s.",(unsigned long)Header.NumRecords,FileName);
+
+  // the most recent file from which we preloaded is stored within
+  // the class body to allow us to skip dumping the cache back to
+  // disk in cases where that would amount to just rewriting the
+  // same cache file
   if (PreloadFileName)
    free(PreloadFileName);
   PreloadFileName=strdupEC(FileName);
-  RecordsPreloaded=NumRecords;
-
- done:
-  FCLock.write_unlock();
+  RecordsPreloaded=0;
 }
 
 /***************************************************************/
@@ -418,14 +826,14 @@ void FIPPICache::PreLoad(const char *FileName)
 /***************************************************************/
 FIPPICache GlobalFIPPICache;
 
-void PreloadCache(const char *FileName)
+void PreloadCache(const char *FileName, RWGGeometry *G)
 { 
-  GlobalFIPPICache.PreLoad(FileName);
+  GlobalFIPPICache.PreLoad(FileName, G);
 }
 
-void StoreCache(const char *FileName)
+void StoreCache(const char *FileName, RWGGeometry *G)
 { 
-  GlobalFIPPICache.Store(FileName);
+  GlobalFIPPICache.Store(FileName, G);
 }
 
 
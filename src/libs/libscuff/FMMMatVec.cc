@@ -0,0 +1,751 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * FMMMatVec.cc -- libscuff routines for computing BEM matrix-vector
+ *              -- products without forming the BEM matrix, using the
+ *              -- fast multipole method for far interactions
+ *
+ * Overview:
+ *
+ *  For edge pairs whose panels are all more than DESINGULARIZATION_RADIUS
+ *  panel radii apart, GetPanelPanelInteractions() computes the G and C
+ *  integrals by a fixed (order-4) cubature over each panel. In that
+ *  case the <f_a|G|f_b> and <f_a|C|f_b> integrals are sums over pairs
+ *  of cubature points,
+ *
+ *   G_ab = \sum_{ij} [ c_i.c_j - d_i d_j / k^2 ] Phi(x_i-x_j)
+ *   C_ab = -(1/ik) \sum_i c_i . \sum_j ( \nabla Phi(x_i-x_j) x c_j )
+ *
+ *  where the vector / scalar weights c, d are the values of the RWG
+ *  function and its divergence times the cubature weights. In each
+ *  region, these sums over all edge pairs at once are eight-channel
+ *  (3 current components + 1 charge, for electric and magnetic
+ *  currents) Helmholtz sums, which we evaluate by the fast multipole
+ *  method. The remaining (near) edge pairs are handled by adding a
+ *  sparse correction: the exact matrix entries computed by
+ *  GetEdgeEdgeInteractions(), minus the cubature-point sums that the
+ *  FMM included for those pairs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <libhmat.h>
+#include <libhrutil.h>
+#include <libTriInt.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+#include "HelmholtzFMM.h"
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
+#define II cdouble(0,1)
+
+// panel pairs closer than this (in units of the larger panel
+// radius) are not handled by plain cubature in
+// GetPanelPanelInteractions(); this is DESINGULARIZATION_RADIUS
+// in PanelPanelInteractions.cc
+#define FMM_NEARTHRESHOLD 4.0
+
+// order of the panel cubature used for distant panel pairs
+#define FMM_TCRORDER 4
+#define FMM_MAXCP    16
+
+// FMM channels: electric current (3), magnetic current (3),
+// electric charge, magnetic charge; gradients are computed
+// for the first 6
+#define FMM_NUMCHANNELS 8
+#define FMM_NUMGRADCHANNELS 6
+
+namespace scuff {
+
+/***************************************************************/
+/* per-region data: the FMM over the cubature points of all    */
+/* panels on surfaces bounding the region                      */
+/***************************************************************/
+typedef struct FMMRegionData
+ {
+   int NumPoints;
+   double *Sign;              // Sign[ns] = +1 (-1) if region is exterior (interior) to surface ns, 0 if not bounded by ns
+   int *PointOffset;          // first cubature point on surface ns
+   HelmholtzFMM *FMM;
+
+   // the following are set for each frequency
+   bool Active;
+   cdouble k, PreFac1, PreFac2, PreFac3;
+
+   // workspace
+   cdouble *Q, *Phi, *GradPhi;
+ } FMMRegionData;
+
+struct FMMBEMData
+ {
+   RWGGeometry *G;
+   int NumCP;
+   double *TCR;
+
+   FMMRegionData *Regions;
+
+   // global edge indices: edge ne of surface ns is EdgeOffset[ns] + ne
+   int TotalEdges;
+   int *EdgeOffset, *EdgeSurface, *EdgeIndex;
+
+   // near edge pairs in CSR form, with NearBlock[4*n + x + 2*y]
+   // the correction to the (x,y) matrix entry for near pair #n
+   int *NearStart, *NearEdge;
+   cdouble *NearBlock;
+
+   // inverses of the 1x1 or 2x2 diagonal blocks of the BEM
+   // matrix, DiagInv[4*nge + x + 2*y], for preconditioning
+   cdouble *DiagInv;
+ };
+
+/***************************************************************/
+/* cubature points and RWG weights for the panels of an edge;  */
+/* returns the number of points                                */
+/***************************************************************/
+static int GetEdgeCubature(FMMBEMData *Data, RWGSurface *S, int ne,
+                           double *XC, double *C, double *D)
+{
+  RWGEdge *E=S->Edges[ne];
+  int NCP=Data->NumCP, N=0;
+  for(int PM=0; PM<2; PM++)
+   { int np    = (PM==0) ? E->iPPanel : E->iMPanel;
+     double *Q = S->Vertices + 3*( (PM==0) ? E->iQP : E->iQM );
+     double Sign = (PM==0) ? 1.0 : -1.0;
+     RWGPanel *P=S->Panels[np];
+     double *V0=S->Vertices + 3*P->VI[0];
+     double *V1=S->Vertices + 3*P->VI[1];
+     double *V2=S->Vertices + 3*P->VI[2];
+     for(int ncp=0; ncp<NCP; ncp++, N++)
+      { double u=Data->TCR[3*ncp+0], v=Data->TCR[3*ncp+1], w=Data->TCR[3*ncp+2];
+        for(int Mu=0; Mu<3; Mu++)
+         { XC[3*N+Mu] = V0[Mu] + u*(V1[Mu]-V0[Mu]) + v*(V2[Mu]-V0[Mu]);
+           C[3*N+Mu]  = Sign*E->Length*w*(XC[3*N+Mu] - Q[Mu]);
+         };
+        D[N] = Sign*2.0*E->Length*w;
+      };
+   };
+  return N;
+}
+
+/***************************************************************/
+/* the G and C integrals for an edge pair, computed as sums    */
+/* over pairs of cubature points exactly as the FMM does       */
+/***************************************************************/
+static void GetCubatureGC(FMMBEMData *Data, RWGSurface *Sa, int nea,
+                          RWGSurface *Sb, int neb, cdouble k, cdouble GC[2])
+{
+  double XA[3*FMM_MAXCP], CA[3*FMM_MAXCP], DA[FMM_MAXCP];
+  double XB[3*FMM_MAXCP], CB[3*FMM_MAXCP], DB[FMM_MAXCP];
+  int NA=GetEdgeCubature(Data, Sa, nea, XA, CA, DA);
+  int NB=GetEdgeCubature(Data, Sb, neb, XB, CB, DB);
+
+  cdouble ik=II*k, G=0.0, C=0.0;
+  for(int na=0; na<NA; na++)
+   for(int nb=0; nb<NB; nb++)
+    { double R[3], CxC[3];
+      VecSub(XA+3*na, XB+3*nb, R);
+      double r=VecNorm(R);
+      if (r==0.0) continue;
+      cdouble Phi = exp(ik*r) / (4.0*M_PI*r);
+      cdouble dPhiOverR = Phi*(ik - 1.0/r)/r;
+      G += (VecDot(CA+3*na, CB+3*nb) + DA[na]*DB[nb]/(ik*ik))*Phi;
+      VecCross(CB+3*nb, CA+3*na, CxC);
+      C += dPhiOverR*VecDot(R, CxC);
+    };
+  GC[0]=G;
+  GC[1]=-C/ik;
+}
+
+/***************************************************************/
+/* get the list of edges (as global indices) that form near    */
+/* pairs with global edge nge, sorted and without duplicates.  */
+/* a near pair is one in which some panel of one edge is       */
+/* within FMM_NEARTHRESHOLD panel radii of some panel of the   */
+/* other, and the two surfaces share a region.                 */
+/***************************************************************/
+typedef struct PanelKey
+ { uint64_t Key;
+   int ns, np;
+ } PanelKey;
+
+static int ComparePanelKeys(const void *a, const void *b)
+{ uint64_t Ka=((const PanelKey *)a)->Key, Kb=((const PanelKey *)b)->Key;
+  return Ka<Kb ? -1 : Ka>Kb ? 1 : 0;
+}
+
+typedef struct PanelGrid
+ { double Origin[3], CellSize;
+   int NumPanels;
+   PanelKey *Entries;       // sorted by cell key
+ } PanelGrid;
+
+static uint64_t GetCellKey(PanelGrid *PG, double *X, int Delta[3])
+{
+  uint64_t Key=0;
+  for(int Mu=2; Mu>=0; Mu--)
+   { int64_t i = (int64_t)floor( (X[Mu]-PG->Origin[Mu])/PG->CellSize ) + 1 + Delta[Mu];
+     if (i<0) i=0;
+     Key = (Key<<21) | (((uint64_t)i) & 0x1fffff);
+   };
+  return Key;
+}
+
+static int LowerBound(PanelGrid *PG, uint64_t Key)
+{
+  int Lo=0, Hi=PG->NumPanels;
+  while(Lo<Hi)
+   { int Mid=(Lo+Hi)/2;
+     if (PG->Entries[Mid].Key<Key) Lo=Mid+1; else Hi=Mid;
+   };
+  return Lo;
+}
+
+static int CompareInts(const void *a, const void *b)
+{ return *((const int *)a) - *((const int *)b); }
+
+static int GetNearEdges(FMMBEMData *Data, PanelGrid *PG, int nge,
+                        int **List, int *Allocated)
+{
+  RWGGeometry *G=Data->G;
+  int nsa=Data->EdgeSurface[nge];
+  RWGSurface *Sa=G->Surfaces[nsa];
+  RWGEdge *Ea=Sa->Edges[Data->EdgeIndex[nge]];
+
+  int N=0;
+  for(int PM=0; PM<2; PM++)
+   { RWGPanel *Pa=Sa->Panels[ PM==0 ? Ea->iPPanel : Ea->iMPanel ];
+     int Delta[3];
+     for(Delta[0]=-1; Delta[0]<=1; Delta[0]++)
+      for(Delta[1]=-1; Delta[1]<=1; Delta[1]++)
+       for(Delta[2]=-1; Delta[2]<=1; Delta[2]++)
+        { uint64_t Key=GetCellKey(PG, Pa->Centroid, Delta);
+          for(int n=LowerBound(PG, Key);
+              n<PG->NumPanels && PG->Entries[n].Key==Key; n++)
+           { int nsb=PG->Entries[n].ns;
+             RWGSurface *Sb=G->Surfaces[nsb];
+             RWGPanel *Pb=Sb->Panels[PG->Entries[n].np];
+             double rMax=fmax(Pa->Radius, Pb->Radius);
+             if ( VecDistance(Pa->Centroid, Pb->Centroid) > FMM_NEARTHRESHOLD*rMax )
+              continue;
+             int CommonRegions[2];
+             double Signs[2];
+             if ( CountCommonRegions(Sa, Sb, CommonRegions, Signs)==0 )
+              continue;
+             for(int i=0; i<3; i++)
+              { if (Pb->EI[i]<0) continue;
+                if (N+1>*Allocated)
+                 { *Allocated=2*(*Allocated) + 64;
+                   *List=(int *)reallocEC(*List, (*Allocated)*sizeof(int));
+                 };
+                (*List)[N++] = Data->EdgeOffset[nsb] + Pb->EI[i];
+              };
+           };
+        };
+   };
+
+  qsort(*List, N, sizeof(int), CompareInts);
+  int NumUnique=0;
+  for(int n=0; n<N; n++)
+   if (n==0 || (*List)[n]!=(*List)[n-1])
+    (*List)[NumUnique++]=(*List)[n];
+  return NumUnique;
+}
+
+/***************************************************************/
+/* allocate data structures for FMM matrix-vector products:    */
+/* the octree for each region and the list of near edge pairs. */
+/* These depend only on the geometry; AssembleFMMBEMData()     */
+/* must be called at each frequency before ApplyBEMMatrixFMM.  */
+/***************************************************************/
+FMMBEMData *RWGGeometry::AllocateFMMBEMData(int LeafSize, int Order)
+{
+  if (LBasis!=0)
+   ErrExit("%s:%i: FMM not available for periodic geometries",__FILE__,__LINE__);
+  if (Substrate)
+   ErrExit("%s:%i: FMM not available for geometries with substrates",__FILE__,__LINE__);
+  for(int ns=0; ns<NumSurfaces; ns++)
+   { if (Surfaces[ns]->SurfaceZeta)
+      ErrExit("%s:%i: FMM not available for surfaces with surface impedance",__FILE__,__LINE__);
+     for(int ne=0; ne<Surfaces[ns]->NumEdges; ne++)
+      if (Surfaces[ns]->Edges[ne]->iMPanel<0)
+       ErrExit("%s:%i: FMM not available for half-RWG basis functions",__FILE__,__LINE__);
+   };
+
+  Log("Initializing FMM data structures...");
+  FMMBEMData *Data=(FMMBEMData *)mallocEC(sizeof(FMMBEMData));
+  Data->G=this;
+  Data->TCR=GetTCR(FMM_TCRORDER, &(Data->NumCP));
+  if (2*Data->NumCP > FMM_MAXCP)
+   ErrExit("%s:%i: internal error",__FILE__,__LINE__);
+
+  /*--------------------------------------------------------------*/
+  /*- global edge indexing                                       -*/
+  /*--------------------------------------------------------------*/
+  Data->EdgeOffset=(int *)mallocEC((NumSurfaces+1)*sizeof(int));
+  Data->EdgeOffset[0]=0;
+  for(int ns=0; ns<NumSurfaces; ns++)
+   Data->EdgeOffset[ns+1] = Data->EdgeOffset[ns] + Surfaces[ns]->NumEdges;
+  int TotalEdges=Data->TotalEdges=Data->EdgeOffset[NumSurfaces];
+  Data->EdgeSurface=(int *)mallocEC(2*TotalEdges*sizeof(int));
+  Data->EdgeIndex=Data->EdgeSurface + TotalEdges;
+  for(int ns=0; ns<NumSurfaces; ns++)
+   for(int ne=0; ne<Surfaces[ns]->NumEdges; ne++)
+    { Data->EdgeSurface[Data->EdgeOffset[ns] + ne]=ns;
+      Data->EdgeIndex[Data->EdgeOffset[ns] + ne]=ne;
+    };
+
+  /*--------------------------------------------------------------*/
+  /*- one FMM per region, over the cubature points of all panels -*/
+  /*- on the surfaces bounding that region                       -*/
+  /*--------------------------------------------------------------*/
+  int NCP=Data->NumCP;
+  Data->Regions=(FMMRegionData *)mallocEC(NumRegions*sizeof(FMMRegionData));
+  for(int nr=0; nr<NumRegions; nr++)
+   { FMMRegionData *R=Data->Regions + nr;
+     R->Sign=(double *)mallocEC(NumSurfaces*sizeof(double));
+     R->PointOffset=(int *)mallocEC(NumSurfaces*sizeof(int));
+     R->NumPoints=0;
+     for(int ns=0; ns<NumSurfaces; ns++)
+      { RWGSurface *S=Surfaces[ns];
+        R->Sign[ns] = 0.0;
+        if (S->RegionIndices[0]==nr)
+         R->Sign[ns] = +1.0;
+        else if (!S->IsPEC && S->RegionIndices[1]==nr)
+         R->Sign[ns] = -1.0;
+        R->PointOffset[ns]=R->NumPoints;
+        if (R->Sign[ns]!=0.0)
+         R->NumPoints += NCP*S->NumPanels;
+      };
+
+     R->FMM=0;
+     R->Q=R->Phi=R->GradPhi=0;
+     R->Active=false;
+     if (R->NumPoints==0)
+      continue;
+
+     double *X=(double *)mallocEC(3*R->NumPoints*sizeof(double));
+     for(int ns=0; ns<NumSurfaces; ns++)
+      { if (R->Sign[ns]==0.0) continue;
+        RWGSurface *S=Surfaces[ns];
+        for(int np=0; np<S->NumPanels; np++)
+         { RWGPanel *P=S->Panels[np];
+           double *V0=S->Vertices + 3*P->VI[0];
+           double *V1=S->Vertices + 3*P->VI[1];
+           double *V2=S->Vertices + 3*P->VI[2];
+           for(int ncp=0; ncp<NCP; ncp++)
+            { double u=Data->TCR[3*ncp+0], v=Data->TCR[3*ncp+1];
+              double *XX=X + 3*(R->PointOffset[ns] + np*NCP + ncp);
+              for(int Mu=0; Mu<3; Mu++)
+               XX[Mu] = V0[Mu] + u*(V1[Mu]-V0[Mu]) + v*(V2[Mu]-V0[Mu]);
+            };
+         };
+      };
+     Log(" region %s: ",RegionLabels[nr]);
+     R->FMM=new HelmholtzFMM(R->NumPoints, X, LeafSize, Order);
+     free(X);
+
+     R->Q       = (cdouble *)mallocEC(R->NumPoints*FMM_NUMCHANNELS*sizeof(cdouble));
+     R->Phi     = (cdouble *)mallocEC(R->NumPoints*FMM_NUMCHANNELS*sizeof(cdouble));
+     R->GradPhi = (cdouble *)mallocEC(3*R->NumPoints*FMM_NUMGRADCHANNELS*sizeof(cdouble));
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- sort panels into a grid of cells, each large enough that   -*/
+  /*- all near neighbors of a panel lie in adjacent cells        -*/
+  /*--------------------------------------------------------------*/
+  PanelGrid MyPG, *PG=&MyPG;
+  int TotalPanels=0;
+  double RMax=0.0;
+  for(int ns=0; ns<NumSurfaces; ns++)
+   { TotalPanels+=Surfaces[ns]->NumPanels;
+     for(int np=0; np<Surfaces[ns]->NumPanels; np++)
+      RMax=fmax(RMax, Surfaces[ns]->Panels[np]->Radius);
+   };
+  PG->NumPanels=TotalPanels;
+  PG->CellSize=fmax(FMM_NEARTHRESHOLD*RMax, 1.0e-12);
+  for(int Mu=0; Mu<3; Mu++)
+   PG->Origin[Mu]=HUGE_VAL;
+  for(int ns=0; ns<NumSurfaces; ns++)
+   for(int np=0; np<Surfaces[ns]->NumPanels; np++)
+    for(int Mu=0; Mu<3; Mu++)
+     PG->Origin[Mu]=fmin(PG->Origin[Mu], Surfaces[ns]->Panels[np]->Centroid[Mu]);
+
+  PG->Entries=(PanelKey *)mallocEC(TotalPanels*sizeof(PanelKey));
+  int Zero[3]={0,0,0};
+  for(int ns=0, n=0; ns<NumSurfaces; ns++)
+   for(int np=0; np<Surfaces[ns]->NumPanels; np++, n++)
+    { PG->Entries[n].Key=GetCellKey(PG, Surfaces[ns]->Panels[np]->Centroid, Zero);
+      PG->Entries[n].ns=ns;
+      PG->Entries[n].np=np;
+    };
+  qsort(PG->Entries, TotalPanels, sizeof(PanelKey), ComparePanelKeys);
+
+  /*--------------------------------------------------------------*/
+  /*- near edge pairs: count, then fill in                       -*/
+  /*--------------------------------------------------------------*/
+  int NumThreads=GetNumThreads();
+  Data->NearStart=(int *)mallocEC((TotalEdges+1)*sizeof(int));
+#ifdef USE_OPENMP
+#pragma omp parallel num_threads(NumThreads)
+#endif
+  { int *List=0, Allocated=0;
+#ifdef USE_OPENMP
+#pragma omp for schedule(dynamic,64)
+#endif
+    for(int nge=0; nge<TotalEdges; nge++)
+     Data->NearStart[nge+1]=GetNearEdges(Data, PG, nge, &List, &Allocated);
+    if (List) free(List);
+  }
+  Data->NearStart[0]=0;
+  for(int nge=0; nge<TotalEdges; nge++)
+   Data->NearStart[nge+1]+=Data->NearStart[nge];
+  size_t NumNear=Data->NearStart[TotalEdges];
+  Data->NearEdge=(int *)mallocEC(NumNear*sizeof(int));
+  Data->NearBlock=(cdouble *)mallocEC(4*NumNear*sizeof(cdouble));
+  Data->DiagInv=(cdouble *)mallocEC(4*TotalEdges*sizeof(cdouble));
+#ifdef USE_OPENMP
+#pragma omp parallel num_threads(NumThreads)
+#endif
+  { int *List=0, Allocated=0;
+#ifdef USE_OPENMP
+#pragma omp for schedule(dynamic,64)
+#endif
+    for(int nge=0; nge<TotalEdges; nge++)
+     { int N=GetNearEdges(Data, PG, nge, &List, &Allocated);
+       memcpy(Data->NearEdge + Data->NearStart[nge], List, N*sizeof(int));
+     };
+    if (List) free(List);
+  }
+  free(PG->Entries);
+
+  Log(" FMM: %i near edge pairs (%.1f per edge)",(int)NumNear,
+        ((double)NumNear)/((double)(TotalEdges>0 ? TotalEdges : 1)));
+
+  return Data;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void DestroyFMMBEMData(FMMBEMData *Data)
+{
+  RWGGeometry *G=Data->G;
+  for(int nr=0; nr<G->NumRegions; nr++)
+   { FMMRegionData *R=Data->Regions + nr;
+     if (R->FMM)
+      { delete R->FMM;
+        free(R->Q);
+        free(R->Phi);
+        free(R->GradPhi);
+      };
+     free(R->PointOffset);
+     free(R->Sign);
+   };
+  free(Data->Regions);
+  free(Data->DiagInv);
+  free(Data->NearBlock);
+  free(Data->NearEdge);
+  free(Data->NearStart);
+  free(Data->EdgeSurface);
+  free(Data->EdgeOffset);
+  free(Data);
+}
+
+/***************************************************************/
+/* set up the per-region prefactors for frequency Omega and    */
+/* compute the near-field corrections and the diagonal blocks  */
+/***************************************************************/
+void RWGGeometry::AssembleFMMBEMData(cdouble Omega, FMMBEMData *Data)
+{
+  Log("Assembling FMM near-field corrections at Omega=%s",z2s(Omega));
+  UpdateCachedEpsMuValues(Omega);
+
+  for(int nr=0; nr<NumRegions; nr++)
+   { FMMRegionData *R=Data->Regions + nr;
+     cdouble Eps=EpsTF[nr], Mu=MuTF[nr];
+     R->Active  = (R->FMM!=0 && Eps!=0.0 && Mu!=0.0);
+     R->k       = csqrt2(Eps*Mu)*Omega;
+     R->PreFac1 =  II*Mu*Omega;
+     R->PreFac2 = -II*R->k;
+     R->PreFac3 = -II*Eps*Omega;
+   };
+
+  int TotalEdges=Data->TotalEdges;
+  int NumThreads=GetNumThreads();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,16), num_threads(NumThreads)
+#endif
+  for(int nga=0; nga<TotalEdges; nga++)
+   {
+     int nsa=Data->EdgeSurface[nga], nea=Data->EdgeIndex[nga];
+     RWGSurface *Sa=Surfaces[nsa];
+     bool SaIsPEC=(Sa->IsPEC==1);
+
+     GetEEIArgStruct MyGetEEIArgs, *GetEEIArgs=&MyGetEEIArgs;
+     InitGetEEIArgs(GetEEIArgs);
+     GetEEIArgs->Sa  = Sa;
+     GetEEIArgs->nea = nea;
+
+     for(int nn=Data->NearStart[nga]; nn<Data->NearStart[nga+1]; nn++)
+      {
+        int ngb=Data->NearEdge[nn];
+        if (ngb<nga) continue; // filled in by symmetry below
+        int nsb=Data->EdgeSurface[ngb], neb=Data->EdgeIndex[ngb];
+        RWGSurface *Sb=Surfaces[nsb];
+        bool SbIsPEC=(Sb->IsPEC==1);
+        GetEEIArgs->Sb  = Sb;
+        GetEEIArgs->neb = neb;
+
+        cdouble *Block=Data->NearBlock + 4*nn, Exact[4];
+        for(int n=0; n<4; n++)
+         Block[n]=Exact[n]=0.0;
+
+        for(int nr=0; nr<NumRegions; nr++)
+         { FMMRegionData *R=Data->Regions + nr;
+           double Sign = R->Sign[nsa]*R->Sign[nsb];
+           if (!R->Active || Sign==0.0) continue;
+
+           GetEEIArgs->k = R->k;
+           GetEdgeEdgeInteractions(GetEEIArgs);
+           cdouble GCCubature[2], dGC[2];
+           GetCubatureGC(Data, Sa, nea, Sb, neb, R->k, GCCubature);
+           dGC[0] = GetEEIArgs->GC[0] - GCCubature[0];
+           dGC[1] = GetEEIArgs->GC[1] - GCCubature[1];
+
+           Block[0] += Sign*R->PreFac1*dGC[0];
+           Block[1] += Sign*R->PreFac2*dGC[1];
+           Block[2] += Sign*R->PreFac2*dGC[1];
+           Block[3] += Sign*R->PreFac3*dGC[0];
+           if (nga==ngb)
+            { Exact[0] += Sign*R->PreFac1*GetEEIArgs->GC[0];
+              Exact[1] += Sign*R->PreFac2*GetEEIArgs->GC[1];
+              Exact[2] += Sign*R->PreFac2*GetEEIArgs->GC[1];
+              Exact[3] += Sign*R->PreFac3*GetEEIArgs->GC[0];
+            };
+         };
+
+        // entries with a PEC row or column have only the
+        // electric-current component
+        if (SaIsPEC) Block[1]=Block[3]=Exact[1]=Exact[3]=0.0;
+        if (SbIsPEC) Block[2]=Block[3]=Exact[2]=Exact[3]=0.0;
+
+        if (nga==ngb)
+         { cdouble *DI=Data->DiagInv + 4*nga;
+           cdouble Det = SaIsPEC ? Exact[0] : Exact[0]*Exact[3] - Exact[1]*Exact[2];
+           if (Det==0.0)
+            { DI[0]=DI[3]=1.0; DI[1]=DI[2]=0.0; }
+           else if (SaIsPEC)
+            { DI[0]=1.0/Det; DI[1]=DI[2]=DI[3]=0.0; }
+           else
+            { DI[0] =  Exact[3]/Det;
+              DI[1] = -Exact[1]/Det;
+              DI[2] = -Exact[2]/Det;
+              DI[3] =  Exact[0]/Det;
+            };
+         };
+      };
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- the BEM matrix is symmetric, so the block for (nga,ngb)   -*/
+  /*- with ngb<nga is the transpose of the block for (ngb,nga)  -*/
+  /*--------------------------------------------------------------*/
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,64), num_threads(NumThreads)
+#endif
+  for(int nga=0; nga<TotalEdges; nga++)
+   for(int nn=Data->NearStart[nga]; nn<Data->NearStart[nga+1]; nn++)
+    { int ngb=Data->NearEdge[nn];
+      if (ngb>=nga) break;
+      int *Row=Data->NearEdge + Data->NearStart[ngb];
+      int NumInRow=Data->NearStart[ngb+1] - Data->NearStart[ngb];
+      int *Match=(int *)bsearch(&nga, Row, NumInRow, sizeof(int), CompareInts);
+      if (Match==0) ErrExit("%s:%i: internal error",__FILE__,__LINE__);
+      cdouble *BT=Data->NearBlock + 4*(Data->NearStart[ngb] + (Match-Row));
+      cdouble *Block=Data->NearBlock + 4*nn;
+      Block[0]=BT[0];
+      Block[1]=BT[2];
+      Block[2]=BT[1];
+      Block[3]=BT[3];
+    };
+}
+
+/***************************************************************/
+/* Y = M*X, with M the BEM matrix at the frequency passed to   */
+/* the most recent call to AssembleFMMBEMData()                */
+/***************************************************************/
+void RWGGeometry::ApplyBEMMatrixFMM(FMMBEMData *Data, HVector *X, HVector *Y)
+{
+  int NCP=Data->NumCP;
+  int NC=FMM_NUMCHANNELS, NG=FMM_NUMGRADCHANNELS;
+  int NumThreads=GetNumThreads();
+
+  Y->Zero();
+
+  for(int nr=0; nr<NumRegions; nr++)
+   {
+     FMMRegionData *R=Data->Regions + nr;
+     if (!R->Active) continue;
+     cdouble ik=II*R->k;
+
+     /*--------------------------------------------------------------*/
+     /*- source densities at the cubature points of each panel      -*/
+     /*--------------------------------------------------------------*/
+     for(int ns=0; ns<NumSurfaces; ns++)
+      {
+        if (R->Sign[ns]==0.0) continue;
+        RWGSurface *S=Surfaces[ns];
+        int Offset=BFIndexOffset[ns], BFPE = S->IsPEC ? 1 : 2;
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(static), num_threads(NumThreads)
+#endif
+        for(int np=0; np<S->NumPanels; np++)
+         { RWGPanel *P=S->Panels[np];
+           double *V0=S->Vertices + 3*P->VI[0];
+           double *V1=S->Vertices + 3*P->VI[1];
+           double *V2=S->Vertices + 3*P->VI[2];
+           cdouble *Q=R->Q + NC*(R->PointOffset[ns] + np*NCP);
+           for(int n=0; n<NC*NCP; n++)
+            Q[n]=0.0;
+           for(int i=0; i<3; i++)
+            { int ne=P->EI[i];
+              if (ne<0) continue;
+              RWGEdge *E=S->Edges[ne];
+              bool IsP = (E->iPPanel==np);
+              double *QV=S->Vertices + 3*(IsP ? E->iQP : E->iQM);
+              double Sign = R->Sign[ns]*(IsP ? 1.0 : -1.0)*E->Length;
+              cdouble KE = Sign*X->ZV[Offset + BFPE*ne];
+              cdouble KM = (BFPE==2) ? Sign*X->ZV[Offset + BFPE*ne + 1] : 0.0;
+              for(int ncp=0; ncp<NCP; ncp++)
+               { double u=Data->TCR[3*ncp+0], v=Data->TCR[3*ncp+1], w=Data->TCR[3*ncp+2];
+                 cdouble *QQ=Q + NC*ncp;
+                 for(int Mu=0; Mu<3; Mu++)
+                  { double C=w*(V0[Mu] + u*(V1[Mu]-V0[Mu]) + v*(V2[Mu]-V0[Mu]) - QV[Mu]);
+                    QQ[Mu]   += KE*C;
+                    QQ[3+Mu] += KM*C;
+                  };
+                 QQ[6] += 2.0*w*KE;
+                 QQ[7] += 2.0*w*KM;
+               };
+            };
+         };
+      };
+
+     R->FMM->Apply(R->k, NC, R->Q, R->Phi, NG, R->GradPhi);
+
+     /*--------------------------------------------------------------*/
+     /*- project the potentials onto the testing functions          -*/
+     /*--------------------------------------------------------------*/
+     for(int ns=0; ns<NumSurfaces; ns++)
+      {
+        if (R->Sign[ns]==0.0) continue;
+        RWGSurface *S=Surfaces[ns];
+        int Offset=BFIndexOffset[ns], BFPE = S->IsPEC ? 1 : 2;
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(static), num_threads(NumThreads)
+#endif
+        for(int ne=0; ne<S->NumEdges; ne++)
+         { double XC[3*FMM_MAXCP], C[3*FMM_MAXCP], D[FMM_MAXCP];
+           GetEdgeCubature(Data, S, ne, XC, C, D);
+           RWGEdge *E=S->Edges[ne];
+           cdouble GE=0.0, GM=0.0, CE=0.0, CM=0.0;
+           for(int PM=0, n=0; PM<2; PM++)
+            { int np = (PM==0) ? E->iPPanel : E->iMPanel;
+              for(int ncp=0; ncp<NCP; ncp++, n++)
+               { int nPt = R->PointOffset[ns] + np*NCP + ncp;
+                 cdouble *Phi=R->Phi + NC*nPt;
+                 cdouble *dPhi=R->GradPhi + 3*NG*nPt; // dPhi[3*Channel + Mu]
+                 double *CC=C+3*n;
+                 GE += CC[0]*Phi[0] + CC[1]*Phi[1] + CC[2]*Phi[2] + D[n]*Phi[6]/(ik*ik);
+                 GM += CC[0]*Phi[3] + CC[1]*Phi[4] + CC[2]*Phi[5] + D[n]*Phi[7]/(ik*ik);
+                 // C . curl A, with A_Nu = channel Nu (electric) or 3+Nu (magnetic)
+                 for(int EM=0; EM<2; EM++)
+                  { cdouble *dA=dPhi + 9*EM;
+                    cdouble CCurlA = CC[0]*(dA[3*2+1] - dA[3*1+2])
+                                    +CC[1]*(dA[3*0+2] - dA[3*2+0])
+                                    +CC[2]*(dA[3*1+0] - dA[3*0+1]);
+                    if (EM==0) CE+=CCurlA; else CM+=CCurlA;
+                  };
+               };
+            };
+           CE*=-1.0/ik;
+           CM*=-1.0/ik;
+
+           double Sign=R->Sign[ns];
+           Y->ZV[Offset + BFPE*ne] += Sign*(R->PreFac1*GE + R->PreFac2*CM);
+           if (BFPE==2)
+            Y->ZV[Offset + BFPE*ne + 1] += Sign*(R->PreFac2*CE + R->PreFac3*GM);
+         };
+      };
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- near-field corrections                                     -*/
+  /*--------------------------------------------------------------*/
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,64), num_threads(NumThreads)
+#endif
+  for(int nga=0; nga<Data->TotalEdges; nga++)
+   { int nsa=Data->EdgeSurface[nga], nea=Data->EdgeIndex[nga];
+     int BFPEA = Surfaces[nsa]->IsPEC ? 1 : 2;
+     cdouble *YA=Y->ZV + BFIndexOffset[nsa] + BFPEA*nea;
+     for(int nn=Data->NearStart[nga]; nn<Data->NearStart[nga+1]; nn++)
+      { int ngb=Data->NearEdge[nn];
+        int nsb=Data->EdgeSurface[ngb], neb=Data->EdgeIndex[ngb];
+        int BFPEB = Surfaces[nsb]->IsPEC ? 1 : 2;
+        cdouble *XB=X->ZV + BFIndexOffset[nsb] + BFPEB*neb;
+        cdouble *Block=Data->NearBlock + 4*nn;
+        for(int x=0; x<BFPEA; x++)
+         for(int y=0; y<BFPEB; y++)
+          YA[x] += Block[x + 2*y]*XB[y];
+      };
+   };
+}
+
+/***************************************************************/
+/* Y = P^{-1}*X, where P is the block-diagonal part of the BEM */
+/* matrix with one 1x1 (PEC) or 2x2 block per edge             */
+/***************************************************************/
+void RWGGeometry::ApplyFMMPreconditioner(FMMBEMData *Data, HVector *X, HVector *Y)
+{
+  for(int nge=0; nge<Data->TotalEdges; nge++)
+   { int ns=Data->EdgeSurface[nge], ne=Data->EdgeIndex[nge];
+     cdouble *DI=Data->DiagInv + 4*nge;
+     int Index=BFIndexOffset[ns] + (Surfaces[ns]->IsPEC ? ne : 2*ne);
+     if (Surfaces[ns]->IsPEC)
+      Y->ZV[Index] = DI[0]*X->ZV[Index];
+     else
+      { cdouble XE=X->ZV[Index], XM=X->ZV[Index+1];
+        Y->ZV[Index]   = DI[0]*XE + DI[2]*XM;
+        Y->ZV[Index+1] = DI[1]*XE + DI[3]*XM;
+      };
+   };
+}
+
+} // namespace scuff
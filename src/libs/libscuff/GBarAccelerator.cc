@@ -22,8 +22,12 @@
  */
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <math.h>
 
+#include <vector>
+
 #include <libhrutil.h>
 #include <libMDInterp.h>
 #include <libhmat.h>
@@ -271,6 +275,399 @@ void GetOptimalGridSpacing2D(GBarAccelerator *GBA,
 
 }
 
+/***************************************************************/
+/* compute the table of GBar values and derivatives needed to  */
+/* initialize the interpolator in one batched Ewald call.      */
+/*                                                             */
+/* LDim=1: grid points (x,Rho,0) for x in XPoints, Rho in      */
+/*         ZPoints (YPoints unused), 8 doubles per point, in   */
+/*         the order of GBarVDPhi2D                            */
+/* LDim=2: grid points (x,y,z), 16 doubles per point, in the   */
+/*         order of GBarVDPhi3D                                */
+/*                                                             */
+/* the return value is a table laid out as expected by the     */
+/* Interp2D / Interp3D table constructors; caller must free it.*/
+/***************************************************************/
+static double *GetGBarVDTable(GBarAccelerator *GBA,
+                              double *XPoints, int NX,
+                              double *YPoints, int NY,
+                              double *ZPoints, int NZ)
+{
+  int NR = NX*NY*NZ;
+  double *R = new double[3*NR];
+  for(int nx=0, nr=0; nx<NX; nx++)
+   for(int ny=0; ny<NY; ny++)
+    for(int nz=0; nz<NZ; nz++, nr++)
+     { R[3*nr+0] = XPoints[nx];
+       if (GBA->LDim==1)
+        { R[3*nr+1] = ZPoints[nz];
+          R[3*nr+2] = 0.0;
+        }
+       else
+        { R[3*nr+1] = YPoints[ny];
+          R[3*nr+2] = ZPoints[nz];
+        };
+     };
+
+  cdouble *GBarVD = new cdouble[8*NR];
+  GBarVDEwaldBatch(NR, R, GBA->k, GBA->kBloch, GBA->LBV, GBA->LDim, -1.0,
+                   GBA->ExcludeInnerCells, GBarVD);
+
+  int NDouble = (GBA->LDim==1) ? 8 : 16;
+  double *PhiVDTable = (double *)mallocEC(NR*NDouble*sizeof(double));
+  for(int nr=0; nr<NR; nr++)
+   { cdouble *G = GBarVD + 8*nr;
+     double *PhiVD = PhiVDTable + NDouble*nr;
+     if (GBA->LDim==1)
+      { PhiVD[0] = real(G[0]); PhiVD[4] = imag(G[0]);
+        PhiVD[1] = real(G[1]); PhiVD[5] = imag(G[1]);
+        PhiVD[2] = real(G[2]); PhiVD[6] = imag(G[2]);
+        PhiVD[3] = real(G[4]); PhiVD[7] = imag(G[4]);
+      }
+     else
+      for(int n=0; n<8; n++)
+       { PhiVD[n]   = real(G[n]);
+         PhiVD[8+n] = imag(G[n]);
+       };
+   };
+
+  delete[] R;
+  delete[] GBarVD;
+  return PhiVDTable;
+}
+
+/***************************************************************/
+/* adaptive construction of the interpolation grid.            */
+/*                                                             */
+/* The table coordinates are (x,Rho) for 1D lattices and       */
+/* (x,y,z) for 2D lattices; in both cases GBarVDEwald returns  */
+/* the derivative along table axis Mu in slot 1+Mu.            */
+/*                                                             */
+/* Each axis is refined independently by recursive bisection.  */
+/* On a line parallel to axis Mu through grid nodes in the     */
+/* other axes, the interpolant reduces to a 1D cubic Hermite   */
+/* interpolant between adjacent nodes, so its error on an      */
+/* interval can be estimated by comparing it and its derivative*/
+/* with the exact values at the interval midpoint. Intervals   */
+/* are bisected until the relative error of both is below      */
+/* tolerance on a few sample lines; the                        */
+/* exact midpoint values become node data for the refined      */
+/* intervals.                                                  */
+/***************************************************************/
+#define ADAPTIVE_INITIALINTERVALS 4
+#define ADAPTIVE_MAXPOINTS        1000    // per axis
+#define ADAPTIVE_MAXTABLE         1000000 // total
+#define ADAPTIVE_MAXSAMPLES       4
+#define ADAPTIVE_MAXLINES         (ADAPTIVE_MAXSAMPLES*ADAPTIVE_MAXSAMPLES)
+
+// evaluate GBarVD at coordinate Mu = X[nx] on each of the sample lines
+static void GetLineData(GBarAccelerator *GBA, int Mu, int NumLines,
+                        double Lines[ADAPTIVE_MAXLINES][3],
+                        int NX, double *X, cdouble *Data)
+{
+  int NR = NX*NumLines;
+  double *R = new double[3*NR];
+  for(int nx=0, nr=0; nx<NX; nx++)
+   for(int nl=0; nl<NumLines; nl++, nr++)
+    { double C[3];
+      memcpy(C, Lines[nl], 3*sizeof(double));
+      C[Mu] = X[nx];
+      R[3*nr+0] = C[0];
+      R[3*nr+1] = C[1];
+      R[3*nr+2] = (GBA->LDim==1) ? 0.0 : C[2];
+    };
+  GBarVDEwaldBatch(NR, R, GBA->k, GBA->kBloch, GBA->LBV, GBA->LDim, -1.0,
+                   GBA->ExcludeInnerCells, Data);
+  delete[] R;
+}
+
+// relative error of the cubic Hermite interpolant and of its
+// derivative on [a,b] given exact data Ga, Gb, Gm at the endpoints
+// and midpoint. the leading error term C*(x-a)^2*(x-b)^2 has zero
+// slope at the midpoint, where it equals C*h^4/16, and maximum slope
+// 16/(3*sqrt(3)) times that value over h, so the derivative (slot
+// 1+Mu) error is estimated from both the value and the derivative
+// mismatch at the midpoint. it is taken relative to |dG/dMu|, or to
+// |G|/Length (Length = extent of the table axis) if that is larger,
+// since dG/dMu passes through zero on symmetry lines.
+static double GetMidpointError(int Mu, double h, double Length,
+                               cdouble *Ga, cdouble *Gb, cdouble *Gm)
+{
+  if (abs(Gm[0])==0.0) 
+   return 0.0;
+  cdouble GInterp = 0.5*(Ga[0]+Gb[0]) + 0.125*h*(Ga[1+Mu]-Gb[1+Mu]);
+  double GError = abs(GInterp-Gm[0]);
+
+  cdouble dGInterp = 1.5*(Gb[0]-Ga[0])/h - 0.25*(Ga[1+Mu]+Gb[1+Mu]);
+  double dGError = fmax( abs(dGInterp-Gm[1+Mu]), 3.0792*GError/h );
+  double dGScale = fmax( abs(Gm[1+Mu]), abs(Gm[0])/Length );
+
+  return fmax( GError/abs(Gm[0]), dGError/dGScale );
+}
+
+/***************************************************************/
+/* refine table axis Mu over [Min, Max]; Samples[Nu] are the   */
+/* (NumSamples[Nu]) values of coordinate Nu at which sample    */
+/* lines are placed for Nu!=Mu. Returns the grid points.       */
+/***************************************************************/
+static std::vector<double> RefineAxis(GBarAccelerator *GBA, int Mu,
+                                      double Min, double Max,
+                                      double Samples[3][ADAPTIVE_MAXSAMPLES],
+                                      int NumSamples[3],
+                                      double RelTol)
+{
+  int NumAxes = GBA->LDim + 1;
+
+  // sample lines = all combinations of sample values in the other axes
+  double Lines[ADAPTIVE_MAXLINES][3];
+  int NumLines=1;
+  memset(Lines, 0, sizeof(Lines));
+  for(int Nu=0; Nu<NumAxes; Nu++)
+   { if (Nu==Mu) continue;
+     for(int nl=0; nl<NumLines; nl++)
+      for(int ns=NumSamples[Nu]-1; ns>=0; ns--)
+       { memcpy(Lines[ns*NumLines + nl], Lines[nl], 3*sizeof(double));
+         Lines[ns*NumLines + nl][Nu] = Samples[Nu][ns];
+       };
+     NumLines*=NumSamples[Nu];
+   };
+
+  int LineSize = 8*NumLines;
+  double MinH = (Max-Min) / ADAPTIVE_MAXPOINTS;
+
+  std::vector<double> X(ADAPTIVE_INITIALINTERVALS+1);
+  for(int n=0; n<=ADAPTIVE_INITIALINTERVALS; n++)
+   X[n] = Min + n*(Max-Min)/ADAPTIVE_INITIALINTERVALS;
+  X[ADAPTIVE_INITIALINTERVALS]=Max;
+  std::vector<cdouble> Data(X.size()*LineSize);
+  GetLineData(GBA, Mu, NumLines, Lines, X.size(), &(X[0]), &(Data[0]));
+  std::vector<bool> Done(X.size()-1, false);
+
+  while(true)
+   { 
+     std::vector<double> XMid;
+     for(size_t n=0; n<Done.size(); n++)
+      if (!Done[n])
+       XMid.push_back( 0.5*(X[n]+X[n+1]) );
+     if ( XMid.size()==0 || X.size()+XMid.size() > ADAPTIVE_MAXPOINTS )
+      break;
+
+     std::vector<cdouble> MidData(XMid.size()*LineSize);
+     GetLineData(GBA, Mu, NumLines, Lines, XMid.size(), &(XMid[0]), &(MidData[0]));
+
+     std::vector<double>  NewX;
+     std::vector<cdouble> NewData;
+     std::vector<bool>    NewDone;
+     for(size_t n=0, nm=0; n<X.size(); n++)
+      { 
+        NewX.push_back(X[n]);
+        NewData.insert(NewData.end(), Data.begin() + n*LineSize, Data.begin() + (n+1)*LineSize);
+        if ( n+1==X.size() ) break;
+        if (Done[n])
+         { NewDone.push_back(true);
+           continue;
+         };
+
+        double h = X[n+1] - X[n];
+        double RelError=0.0;
+        for(int nl=0; nl<NumLines; nl++)
+         RelError=fmax(RelError,
+                       GetMidpointError(Mu, h, Max-Min,
+                                        &(Data[n*LineSize + 8*nl]),
+                                        &(Data[(n+1)*LineSize + 8*nl]),
+                                        &(MidData[nm*LineSize + 8*nl])));
+
+        if ( RelError>RelTol && h>MinH )
+         { NewX.push_back(XMid[nm]);
+           NewData.insert(NewData.end(), MidData.begin() + nm*LineSize, MidData.begin() + (nm+1)*LineSize);
+           NewDone.push_back(false);
+           NewDone.push_back(false);
+         }
+        else
+         NewDone.push_back(true);
+        nm++;
+      };
+     X.swap(NewX);
+     Data.swap(NewData);
+     Done.swap(NewDone);
+   };
+
+  return X;
+}
+
+/***************************************************************/
+/* initialize GBA->I2D or GBA->I3D on an adaptively refined    */
+/* nonuniform grid (see above)                                 */
+/***************************************************************/
+static void InitAdaptiveGrid(GBarAccelerator *GBA, double RelTol, int LMDILogLevel)
+{
+  int LDim = GBA->LDim;
+  double LMax = GBA->LMax;
+  double RhoMin = GBA->RhoMin, RhoMax = GBA->RhoMax;
+
+  double L[2];
+  for(int nd=0; nd<LDim; nd++)
+   { L[nd] = GBA->LBV[nd][nd];
+     if ( LMax<L[nd] )
+      { L[nd]=LMax;
+        Log("  Cutting off interpolation table at L%c=LMax=%e.",'x'+nd,LMax);
+      };
+   };
+
+  // sample lines in the lattice directions run through the center,
+  // the edge, and the quarter points of the unit cell, and in the
+  // transverse direction through the ends and middle of the Rho range
+  double Samples[3][ADAPTIVE_MAXSAMPLES];
+  int NumSamples[3];
+  for(int nd=0; nd<LDim; nd++)
+   { Samples[nd][0] = 0.0;
+     Samples[nd][1] = -0.5*L[nd];
+     Samples[nd][2] = -0.25*L[nd];
+     Samples[nd][3] =  0.25*L[nd];
+     NumSamples[nd] = 4;
+   };
+  Samples[LDim][0] = RhoMin;
+  Samples[LDim][1] = RhoMax;
+  Samples[LDim][2] = 0.5*(RhoMin+RhoMax);
+  NumSamples[LDim] = (RhoMax>RhoMin) ? 3 : 1;
+
+  // interpolation errors in the individual axes add up
+  RelTol /= ((double)(LDim+1));
+
+  std::vector<double> Points[3];
+  double MinDelta=1.0e100;
+  for(int nd=0; nd<LDim; nd++)
+   { Points[nd] = RefineAxis(GBA, nd, -0.5*L[nd], 0.5*L[nd], Samples, NumSamples, RelTol);
+     for(size_t n=0; n+1<Points[nd].size(); n++)
+      MinDelta = fmin(MinDelta, Points[nd][n+1] - Points[nd][n]);
+   };
+  if (RhoMax>RhoMin)
+   Points[LDim] = RefineAxis(GBA, LDim, RhoMin, RhoMax, Samples, NumSamples, RelTol);
+  else
+   { Points[LDim].push_back(RhoMin);
+     Points[LDim].push_back(RhoMin + MinDelta);
+   };
+
+  size_t TableSize=1;
+  for(int nd=0; nd<=LDim; nd++)
+   TableSize*=Points[nd].size();
+  if (TableSize > ADAPTIVE_MAXTABLE)
+   { Warn("adaptive interpolation table would have %lu points (using full Ewald summation)",
+           (unsigned long)TableSize);
+     GBA->ForceFullEwald=true;
+     return;
+   };
+
+  if (LDim==1)
+   { int nx=Points[0].size(), nRho=Points[1].size();
+     Log("  Initializing adaptive %ix%i interpolation table",nx,nRho);
+     double *PhiVDTable
+      = GetGBarVDTable(GBA, &(Points[0][0]), nx, 0, 1, &(Points[1][0]), nRho);
+     GBA->I2D=new Interp2D(PhiVDTable, &(Points[0][0]), nx,
+                           &(Points[1][0]), nRho, 2, LMDILogLevel);
+     free(PhiVDTable);
+   }
+  else
+   { int nx=Points[0].size(), ny=Points[1].size(), nRho=Points[2].size();
+     Log("  Initializing adaptive %ix%ix%i interpolation table",nx,ny,nRho);
+     double *PhiVDTable
+      = GetGBarVDTable(GBA, &(Points[0][0]), nx, &(Points[1][0]), ny,
+                       &(Points[2][0]), nRho);
+     GBA->I3D=new Interp3D(PhiVDTable, &(Points[0][0]), nx, &(Points[1][0]), ny,
+                           &(Points[2][0]), nRho, 2, LMDILogLevel);
+     free(PhiVDTable);
+   };
+}
+
+/***************************************************************/
+/* persistent on-disk store of interpolation tables: if        */
+/* SCUFF_GBA_CACHE_PATH names a directory, tables are looked   */
+/* up there before being computed and are written there after.*/
+/* the key comprises everything that determines the table, and */
+/* stored tables are memory-mapped rather than read in.        */
+/* setting SCUFF_VERIFY_GBA_CACHE=1 verifies the checksum of   */
+/* the full table on loading.                                  */
+/***************************************************************/
+#define GBASTORE_VERSION 1
+
+typedef struct GBAStoreKey
+ { char Tag[8];
+   int32_t Version;
+   int32_t LDim;
+   int32_t ExcludeInnerCells;
+   int32_t Uniform;
+   double LBV[2][3];
+   double k[2];
+   double kBloch[2];
+   double RhoMin, RhoMax, RelTol;
+ } GBAStoreKey;
+
+static char *GetGBAStoreFileName(GBarAccelerator *GBA, double RelTol,
+                                 bool Uniform, GBAStoreKey *Key)
+{
+  char *Dir=getenv("SCUFF_GBA_CACHE_PATH");
+  if ( !Dir || Dir[0]==0 )
+   return 0;
+
+  // the key is hashed and compared bytewise, so zero the padding too
+  memset(Key, 0, sizeof(GBAStoreKey));
+  strncpy(Key->Tag, "GBAR", sizeof(Key->Tag));
+  Key->Version           = GBASTORE_VERSION;
+  Key->LDim              = GBA->LDim;
+  Key->ExcludeInnerCells = GBA->ExcludeInnerCells ? 1 : 0;
+  Key->Uniform           = Uniform ? 1 : 0;
+  for(int nd=0; nd<GBA->LDim; nd++)
+   { memcpy(Key->LBV[nd], GBA->LBV[nd], 3*sizeof(double));
+     Key->kBloch[nd] = GBA->kBloch[nd];
+   };
+  Key->k[0]   = real(GBA->k);
+  Key->k[1]   = imag(GBA->k);
+  Key->RhoMin = GBA->RhoMin;
+  Key->RhoMax = GBA->RhoMax;
+  Key->RelTol = RelTol;
+
+  return GetTableFileName(Dir, "GBA_", Key, sizeof(GBAStoreKey));
+}
+
+static bool ReadGBAFromStore(GBarAccelerator *GBA, const char *FileName,
+                             GBAStoreKey *Key, int LMDILogLevel)
+{
+  char *s=getenv("SCUFF_VERIFY_GBA_CACHE");
+  bool Verify = (s && s[0]=='1');
+
+  const char *ErrMsg=0;
+  if (GBA->LDim==1)
+   { GBA->I2D=new Interp2D(FileName, Key, sizeof(GBAStoreKey), Verify, LMDILogLevel);
+     if ( (ErrMsg=GBA->I2D->ErrMsg) )
+      { Log("  %s (computing table)",ErrMsg);
+        delete GBA->I2D;
+        GBA->I2D=0;
+      };
+   }
+  else
+   { GBA->I3D=new Interp3D(FileName, Key, sizeof(GBAStoreKey), Verify, LMDILogLevel);
+     if ( (ErrMsg=GBA->I3D->ErrMsg) )
+      { Log("  %s (computing table)",ErrMsg);
+        delete GBA->I3D;
+        GBA->I3D=0;
+      };
+   };
+
+  return (GBA->I2D || GBA->I3D);
+}
+
+static void WriteGBAToStore(GBarAccelerator *GBA, const char *FileName,
+                            GBAStoreKey *Key)
+{
+  bool Success=true;
+  if (GBA->I2D)
+   Success=GBA->I2D->WriteToFile(FileName, Key, sizeof(GBAStoreKey));
+  else if (GBA->I3D)
+   Success=GBA->I3D->WriteToFile(FileName, Key, sizeof(GBAStoreKey));
+  if (!Success)
+   Warn("could not write interpolation table to file %s",FileName);
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -331,9 +728,29 @@ GBarAccelerator *CreateGBarAccelerator(HMatrix *LBasis,
    return GBA;
 
   /***************************************************************/
+  /* by default the grid is refined adaptively; the older        */
+  /* uniform grid sized by GetOptimalGridSpacing is available    */
+  /* by setting SCUFF_GBA_UNIFORM=1                              */
+  /***************************************************************/
+  char *str=getenv("SCUFF_GBA_UNIFORM");
+  bool Uniform = (str && str[0]=='1');
+
   /***************************************************************/
+  /* look for a previously computed table in the on-disk store   */
   /***************************************************************/
-  if (LDim==1)
+  GBAStoreKey Key;
+  char *StoreFileName=GetGBAStoreFileName(GBA, RelTol, Uniform, &Key);
+  if ( StoreFileName && ReadGBAFromStore(GBA, StoreFileName, &Key, LMDILogLevel) )
+   { free(StoreFileName);
+     return GBA;
+   };
+
+  /***************************************************************/
+  /***************************************************************/
+  /***************************************************************/
+  if (!Uniform)
+   InitAdaptiveGrid(GBA, RelTol, LMDILogLevel);
+  else if (LDim==1)
    {
       // sample the optimal grid spacing at a few points
       // in the domain of interest and take the smallest
@@ -382,9 +799,11 @@ GBarAccelerator *CreateGBarAccelerator(HMatrix *LBasis,
        LogC("%.2e, ",RhoPoints[n]);
       LogC("%.2e)",RhoPoints[nRho-1]);
 
+      double *PhiVDTable = GetGBarVDTable(GBA, XPoints, nx, 0, 1, RhoPoints, nRho);
       GBA->I3D=0;
-      GBA->I2D=new Interp2D(XPoints, nx, RhoPoints, nRho,
-                            2, GBarVDPhi2D, (void *)GBA, LMDILogLevel);
+      GBA->I2D=new Interp2D(PhiVDTable, XPoints, nx, RhoPoints, nRho,
+                            2, LMDILogLevel);
+      free(PhiVDTable);
 
       delete[] XPoints;
 
@@ -431,10 +850,30 @@ GBarAccelerator *CreateGBarAccelerator(HMatrix *LBasis,
          if (nRho<2) nRho=2;
        };
 
+      double *XPoints   = new double[nx];
+      double *YPoints   = new double[ny];
+      double *RhoPoints = new double[nRho];
+      double DX = Lx / ((double)(nx-1));
+      double DY = Ly / ((double)(ny-1));
+      double DRho = (RhoMax-RhoMin) / ((double)(nRho-1));
+      for(int n=0; n<nx; n++)   XPoints[n]   = -0.5*Lx + ((double)n)*DX;
+      for(int n=0; n<ny; n++)   YPoints[n]   = -0.5*Ly + ((double)n)*DY;
+      for(int n=0; n<nRho; n++) RhoPoints[n] = RhoMin  + ((double)n)*DRho;
+      double *PhiVDTable
+       = GetGBarVDTable(GBA, XPoints, nx, YPoints, ny, RhoPoints, nRho);
+
       GBA->I2D=0;
-      GBA->I3D=new Interp3D(-0.5*Lx, 0.5*Lx, nx, -0.5*Ly, 0.5*Ly, ny,
-                            RhoMin, RhoMax, nRho,
-                            2, GBarVDPhi3D, (void *)GBA, LMDILogLevel);
+      GBA->I3D=new Interp3D(PhiVDTable, -0.5*Lx, 0.5*Lx, nx, -0.5*Ly, 0.5*Ly, ny,
+                            RhoMin, RhoMax, nRho, 2, LMDILogLevel);
+      free(PhiVDTable);
+      delete[] XPoints;
+      delete[] YPoints;
+      delete[] RhoPoints;
+   };
+
+  if (StoreFileName)
+   { WriteGBAToStore(GBA, StoreFileName, &Key);
+     free(StoreFileName);
    };
 
   return GBA;
@@ -507,48 +946,55 @@ void AddGFullTerm(double R[3], cdouble k, double kBloch[2],
 cdouble GetGBarFullEwald(double R[3], GBarAccelerator *GBA,
                          cdouble *dGBar, cdouble *ddGBar)
 {
-  cdouble G[8];
-
   cdouble k              = GBA->k;
   double *kBloch         = GBA->kBloch;
   int LDim               = GBA->LDim;
   bool ExcludeInnerCells = GBA->ExcludeInnerCells;
 
-  GBarVDEwald(R, k, kBloch, GBA->LBV, LDim, -1.0, ExcludeInnerCells, G);
+  /*--------------------------------------------------------------*/
+  /* RR[0] = R; if we need unmixed second partials, RR[1+2*Mu]    */
+  /* and RR[2+2*Mu] are R displaced by +- Delta in direction Mu,  */
+  /* for finite-differencing; all points go into a single batched */
+  /* Ewald evaluation.                                            */
+  /*--------------------------------------------------------------*/
+  double RR[7][3], Delta[3];
+  int NR=1;
+  RR[0][0]=R[0]; RR[0][1]=R[1]; RR[0][2]=R[2];
+  if (ddGBar)
+   for(int Mu=0; Mu<3; Mu++)
+    { Delta[Mu] = (R[Mu]==0.0) ? 1.0e-4 : 1.0e-4*fabs(R[Mu]);
+      for(int np=0; np<2; np++, NR++)
+       { RR[NR][0]=R[0]; RR[NR][1]=R[1]; RR[NR][2]=R[2];
+         RR[NR][Mu] += Delta[Mu];
+         if (np==1) RR[NR][Mu] -= 2.0*Delta[Mu];
+       };
+    };
+
+  cdouble G[7][8];
+  GBarVDEwaldBatch(NR, RR[0], k, kBloch, GBA->LBV, LDim, -1.0,
+                   ExcludeInnerCells, G[0]);
 
   if (dGBar) 
-   { dGBar[0]=G[1];
-     dGBar[1]=G[2];
-     dGBar[2]=G[3];
+   { dGBar[0]=G[0][1];
+     dGBar[1]=G[0][2];
+     dGBar[2]=G[0][3];
    };
 
   if (ddGBar)
    { 
-     ddGBar[3*0 + 1] = ddGBar[3*1 + 0] = G[4];
-     ddGBar[3*0 + 2] = ddGBar[3*2 + 0] = G[5];
-     ddGBar[3*1 + 2] = ddGBar[3*2 + 1] = G[6];
+     ddGBar[3*0 + 1] = ddGBar[3*1 + 0] = G[0][4];
+     ddGBar[3*0 + 2] = ddGBar[3*2 + 0] = G[0][5];
+     ddGBar[3*1 + 2] = ddGBar[3*2 + 1] = G[0][6];
     
      // finite-differencing to get unmixed second partials
      for(int Mu=0; Mu<3; Mu++)
-      { 
-         double Delta = (R[Mu]==0.0) ? 1.0e-4 : 1.0e-4*fabs(R[Mu]);
-         double RR[3];
-         RR[0]=R[0]; RR[1]=R[1]; RR[2]=R[2]; 
-
-         RR[Mu] += Delta;
-         cdouble Gp[8];
-         GBarVDEwald(RR, k, kBloch, GBA->LBV, LDim, -1.0, ExcludeInnerCells, Gp);
-
-         RR[Mu] -= 2.0*Delta;
-         cdouble Gm[8];
-         GBarVDEwald(RR, k, kBloch, GBA->LBV, LDim, -1.0, ExcludeInnerCells, Gm);
-
-         ddGBar[3*Mu + Mu] = (Gp[0] + Gm[0] - 2.0*G[0]) / (Delta*Delta);
+      { cdouble *Gp = G[1+2*Mu], *Gm = G[2+2*Mu];
+        ddGBar[3*Mu + Mu] = (Gp[0] + Gm[0] - 2.0*G[0][0]) / (Delta[Mu]*Delta[Mu]);
       };
 
    };
 
-  return G[0];
+  return G[0][0];
 }
 
 /***************************************************************/
@@ -869,7 +1315,7 @@ cdouble GetGBar(double R[3], GBarAccelerator *GBA,
 /***************************************************************/
 GBarAccelerator *RWGGeometry::CreateRegionGBA(int nr, cdouble Omega, double *kBloch,
                                               double RMin[3], double RMax[3],
-                                              bool ExcludeInnerCells)
+                                              bool ExcludeInnerCells, bool Pooled)
 {
   double Buffer[3];
   HMatrix LBasis1D(3,1,LHM_REAL,LHM_NORMAL,Buffer);
@@ -975,6 +1421,11 @@ GBarAccelerator *RWGGeometry::CreateRegionGBA(int nr, cdouble Omega, double *kBl
   int LMDILogLevel = LMDI_LOGLEVEL_TERSE;
   if (LogLevel>=SCUFF_VERBOSE2)
    LMDILogLevel = LMDI_LOGLEVEL_VERBOSE;
+
+  if (Pooled)
+   return GetPooledGBA(nr, Omega, k, kBloch, GBA_LBasis, RhoMin, RhoMax,
+                       RelTol, ExcludeInnerCells, LMDILogLevel);
+
   return CreateGBarAccelerator(GBA_LBasis, RhoMin, RhoMax,
                                k, kBloch, RelTol, ExcludeInnerCells,
                                LMDILogLevel);
@@ -985,12 +1436,13 @@ GBarAccelerator *RWGGeometry::CreateRegionGBA(int nr, cdouble Omega, double *kBl
 /* the periodic contribution to the scattered fields at a list */
 /* of evaluation points.                                       */
 /***************************************************************/
-GBarAccelerator *RWGGeometry::CreateRegionGBA(int nr, cdouble Omega, double *kBloch, HMatrix *XMatrix)
+GBarAccelerator *RWGGeometry::CreateRegionGBA(int nr, cdouble Omega, double *kBloch,
+                                              HMatrix *XMatrix, bool Pooled)
 {
   if (XMatrix->NR < 8)
    { double RMin[3]={1.0, 1.0, 1.0};
      double RMax[3]={0.0, 0.0, 0.0};
-     return CreateRegionGBA(nr, Omega, kBloch, RMin, RMax, false);
+     return CreateRegionGBA(nr, Omega, kBloch, RMin, RMax, false, Pooled);
    };
 
   if (LogLevel>=SCUFF_VERBOSE2)
@@ -1051,7 +1503,7 @@ GBarAccelerator *RWGGeometry::CreateRegionGBA(int nr, cdouble Omega, double *kBl
    ErrExit("%s:%i: internal error (%e,%e,%e) (%e,%e,%e)",
            __FILE__,__LINE__,RMin[0],RMin[1],RMin[2],RMax[0],RMax[1],RMax[2]);
 
-  return CreateRegionGBA(nr, Omega, kBloch, RMin, RMax, false);
+  return CreateRegionGBA(nr, Omega, kBloch, RMin, RMax, false, Pooled);
 
 }
 
@@ -1060,7 +1512,8 @@ GBarAccelerator *RWGGeometry::CreateRegionGBA(int nr, cdouble Omega, double *kBl
 /* the periodic contribution to the BEM matrix block for two   */
 /* RWG surfaces.                                               */
 /***************************************************************/
-GBarAccelerator *RWGGeometry::CreateRegionGBA(int nr, cdouble Omega, double *kBloch, int ns1, int ns2)
+GBarAccelerator *RWGGeometry::CreateRegionGBA(int nr, cdouble Omega, double *kBloch,
+                                              int ns1, int ns2, bool Pooled)
 {
   if (LogLevel>=SCUFF_VERBOSE2)
    Log("Creating GBar accelerator for region %s, surfaces %s,%s",
@@ -1074,8 +1527,162 @@ GBarAccelerator *RWGGeometry::CreateRegionGBA(int nr, cdouble Omega, double *kBl
   VecSub(Surfaces[ns1]->RMax, Surfaces[ns2]->RMin, RMax);
   VecSub(Surfaces[ns1]->RMin, Surfaces[ns2]->RMax, RMin);
 
-  return CreateRegionGBA(nr, Omega, kBloch, RMin, RMax, true);
+  return CreateRegionGBA(nr, Omega, kBloch, RMin, RMax, true, Pooled);
+
+}
+
+/***************************************************************/
+/* Pool of GBarAccelerators shared by all BEM matrix blocks,   */
+/* GetFields() calls, etc. at a given frequency. Entries are   */
+/* keyed by (region, k, kBloch, ExcludeInnerCells); a request  */
+/* whose Rho range is covered by an existing table reuses it,  */
+/* while a request that is not covered replaces the table with */
+/* one spanning the union of the old and new ranges, so that   */
+/* subsequent requests over either range are satisfied.        */
+/*                                                             */
+/* The pool is flushed whenever the frequency changes and      */
+/* holds at most GBAPOOL_MAXENTRIESPERREGION*NumRegions tables */
+/* (least recently used are discarded first), which bounds its */
+/* memory footprint in Brillouin-zone sweeps.                  */
+/*                                                             */
+/* Note: pooled accelerators remain valid until the next       */
+/* request to the pool, so requests must not be issued from    */
+/* within multithreaded code sections.                         */
+/***************************************************************/
+#define GBAPOOL_MAXENTRIESPERREGION 4
+
+typedef struct GBAPoolEntry
+ {
+   int nr;
+   bool ExcludeInnerCells;
+   cdouble k;
+   double kBloch[3];      // GBA->kBloch points here
+   double RhoMin, RhoMax; // range covered (empty if RhoMin>RhoMax)
+   GBarAccelerator *GBA;
+   unsigned long LastUsed;
+
+ } GBAPoolEntry;
+
+struct GBarAcceleratorPool
+ {
+   cdouble Omega;
+   int NumEntries, MaxEntries;
+   GBAPoolEntry **Entries;
+   unsigned long Clock;
+ };
+
+static void DestroyGBAPoolEntry(GBAPoolEntry *E)
+{
+  if (E->GBA) DestroyGBarAccelerator(E->GBA);
+  free(E);
+}
+
+void RWGGeometry::ClearGBAPool()
+{
+  if (!GBAPool)
+   return;
+  for(int ne=0; ne<GBAPool->NumEntries; ne++)
+   DestroyGBAPoolEntry(GBAPool->Entries[ne]);
+  free(GBAPool->Entries);
+  free(GBAPool);
+  GBAPool=0;
+}
+
+/***************************************************************/
+/* Callers must not hold on to a pooled GBA across another     */
+/* CreateRegionGBA(..., Pooled=true) call for the same region: */
+/* if that call extends the Rho range of the entry, the table  */
+/* returned earlier is destroyed and rebuilt. (A request for a */
+/* different region cannot evict a table that was just        */
+/* returned, since eviction takes the least recently used      */
+/* entry; this is what allows AssembleBEMMatrixBlock to hold   */
+/* the tables for its two regions at once.)                    */
+/***************************************************************/
+GBarAccelerator *RWGGeometry::GetPooledGBA(int nr, cdouble Omega, cdouble k,
+                                           double *kBloch, HMatrix *GBA_LBasis,
+                                           double RhoMin, double RhoMax,
+                                           double RelTol, bool ExcludeInnerCells,
+                                           int LMDILogLevel)
+{
+  if (GBAPool && GBAPool->Omega!=Omega)
+   ClearGBAPool();
+
+  if (!GBAPool)
+   { GBAPool=(GBarAcceleratorPool *)mallocEC(sizeof(GBarAcceleratorPool));
+     GBAPool->Omega      = Omega;
+     GBAPool->NumEntries = 0;
+     GBAPool->MaxEntries = GBAPOOL_MAXENTRIESPERREGION*NumRegions;
+     GBAPool->Entries    = (GBAPoolEntry **)mallocEC(GBAPool->MaxEntries*sizeof(GBAPoolEntry *));
+     GBAPool->Clock      = 0;
+   };
+
+  /***************************************************************/
+  /* look for an existing entry with the same key                */
+  /***************************************************************/
+  GBAPoolEntry *E=0;
+  for(int ne=0; E==0 && ne<GBAPool->NumEntries; ne++)
+   { GBAPoolEntry *EP=GBAPool->Entries[ne];
+     if ( EP->nr!=nr || EP->ExcludeInnerCells!=ExcludeInnerCells || EP->k!=k )
+      continue;
+     bool SamekBloch=true;
+     for(int d=0; d<LDim; d++)
+      if ( EP->kBloch[d] != kBloch[d] )
+       SamekBloch=false;
+     if (SamekBloch)
+      E=EP;
+   };
+
+  bool Empty = (RhoMin > RhoMax);
+  if (E)
+   { 
+     E->LastUsed = ++(GBAPool->Clock);
+     bool Covered
+      =  Empty
+      || ( E->RhoMin<=E->RhoMax && E->RhoMin<=RhoMin && RhoMax<=E->RhoMax );
+     if (Covered)
+      { if (LogLevel>=SCUFF_VERBOSE2)
+         Log("Reusing pooled GBar accelerator for region %s.",RegionLabels[nr]);
+        return E->GBA;
+      };
+
+     // extend the existing table to span both ranges
+     if (E->RhoMin<=E->RhoMax)
+      { RhoMin = fmin(RhoMin, E->RhoMin);
+        RhoMax = fmax(RhoMax, E->RhoMax);
+      };
+     if (LogLevel>=SCUFF_VERBOSE2)
+      Log("Extending pooled GBar accelerator for region %s to Rho=[%e,%e].",
+           RegionLabels[nr],RhoMin,RhoMax);
+     DestroyGBarAccelerator(E->GBA);
+   }
+  else
+   { 
+     // evict the least recently used entry if the pool is full
+     if (GBAPool->NumEntries==GBAPool->MaxEntries)
+      { int nOldest=0;
+        for(int ne=1; ne<GBAPool->NumEntries; ne++)
+         if ( GBAPool->Entries[ne]->LastUsed < GBAPool->Entries[nOldest]->LastUsed )
+          nOldest=ne;
+        DestroyGBAPoolEntry(GBAPool->Entries[nOldest]);
+        GBAPool->Entries[nOldest]=GBAPool->Entries[--(GBAPool->NumEntries)];
+      };
+
+     E=(GBAPoolEntry *)mallocEC(sizeof(GBAPoolEntry));
+     E->nr                = nr;
+     E->ExcludeInnerCells = ExcludeInnerCells;
+     E->k                 = k;
+     for(int d=0; d<LDim; d++)
+      E->kBloch[d] = kBloch[d];
+     E->LastUsed = ++(GBAPool->Clock);
+     GBAPool->Entries[GBAPool->NumEntries++]=E;
+   };
 
+  E->RhoMin = RhoMin;
+  E->RhoMax = RhoMax;
+  E->GBA = CreateGBarAccelerator(GBA_LBasis, RhoMin, RhoMax,
+                                 k, E->kBloch, RelTol, ExcludeInnerCells,
+                                 LMDILogLevel);
+  return E->GBA;
 }
 
 } // namespace scuff
@@ -39,6 +39,11 @@ void GBarVDEwald(double *R, cdouble k, double *kBloch,
                  double (*LBV)[3], int LDim,
                  double E, bool ExcludeInnerCells, cdouble *GBarVD);
 
+// batched version: R[3*nr+0..2] -> GBarVD[8*nr+0..7], 0<=nr<NR
+void GBarVDEwaldBatch(int NR, double *R, cdouble k, double *kBloch,
+                      double (*LBV)[3], int LDim,
+                      double E, bool ExcludeInnerCells, cdouble *GBarVD);
+
 /***************************************************************/
 /* interpolation-based acceleration of periodic GF evaluation  */
 /***************************************************************/
@@ -74,6 +79,13 @@ cdouble GetGBar(double R[3], GBarAccelerator *GBA,
                 cdouble *dGBar=0, cdouble *ddGBar=0,
                 bool ForceFullEwald=false);
 
+/***************************************************************/
+/* opaque pool of GBarAccelerators shared by the matrix blocks */
+/* and field evaluations of an RWGGeometry (see the end of     */
+/* GBarAccelerator.cc)                                         */
+/***************************************************************/
+typedef struct GBarAcceleratorPool GBarAcceleratorPool;
+
 } // namespace scuff 
 
 #endif // #ifndef GBARACCELERATOR_H
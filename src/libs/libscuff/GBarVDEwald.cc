@@ -16,10 +16,15 @@
  * along with this program; if not, write to the Free Software
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
+#include "config.h"
+
 #include <stdlib.h>
 #include <stdlib.h>
 #include <math.h>
 
+#include <vector>
+#include <algorithm>
+
 #include <libhrutil.h>
 #include <libMDInterp.h>
 #include <libSpherical.h>
@@ -995,4 +1000,304 @@ void GBarVDEwald(double *R, cdouble k, double *kBloch0,
 
 } 
 
+/***************************************************************/
+/* Batched version of GBarVDEwald: computes GBar and its       */
+/* derivatives at NR points, R[3*nr + 0..2] -> GBarVD[8*nr+...]*/
+/*                                                             */
+/* The reciprocal-lattice ('distant') sum depends on the       */
+/* evaluation point only through a plane-wave phase factor and */
+/* through z (2D lattices) or Rho (1D lattices). Points sharing*/
+/* the same value of z or Rho -- e.g. entire planes or rows of */
+/* an interpolation grid -- are grouped, and the expensive     */
+/* exp*erfc factors (2D) or Fourier-space Green's functions    */
+/* (1D) are computed once per group for each reciprocal-lattice*/
+/* vector and then applied to all points in the group. Each    */
+/* point retains its own convergence test, so the results are  */
+/* identical to those of GBarVDEwald. Real-space sums are      */
+/* per-point. Both stages are parallelized over points.        */
+/***************************************************************/
+#define BATCH_GROUPSIZE   256 // max points per group
+#define BATCH_MINPARALLEL 64  // don't multithread smaller batches
+
+// list the reciprocal-lattice vectors in shell #NN (NN=NFIRSTROUND
+// for the first round) in the order used by GetGBarDistant
+static void GetShell(int LDim, int NN, std::vector<int> &m1, std::vector<int> &m2)
+{
+  m1.clear();
+  m2.clear();
+  if (LDim==1)
+   { if (NN==NFIRSTROUND)
+      for (int m=-NFIRSTROUND; m<=NFIRSTROUND; m++)
+       { m1.push_back(m); m2.push_back(0); }
+     else
+      { m1.push_back( NN); m2.push_back(0);
+        m1.push_back(-NN); m2.push_back(0);
+      };
+   }
+  else if (NN==NFIRSTROUND)
+   { for (int m=-NFIRSTROUND; m<=NFIRSTROUND; m++)
+      for (int n=-NFIRSTROUND; n<=NFIRSTROUND; n++)
+       { m1.push_back(m); m2.push_back(n); }
+   }
+  else
+   { for(int m=-NN; m<NN; m++)
+      { m1.push_back( m);  m2.push_back( NN);
+        m1.push_back( NN); m2.push_back(-m);
+        m1.push_back(-m);  m2.push_back(-NN);
+        m1.push_back(-NN); m2.push_back( m);
+      };
+   };
+}
+
+// distant sum for a group of points sharing the same E and the same
+// z (LDim==2) or Rho (LDim==1). if the spectral sum hits a singular
+// term, the summation stops and Singular[] is set for all points
+// that had not yet converged; the sums for the others are complete
+static void GetGBarDistantGroup(int NP, int *Index, double *R, double *Rho,
+                                cdouble k, double *kBloch, double Gamma[3][3],
+                                int LDim, double E, cdouble *Sum,
+                                bool *Singular)
+{
+  for(int np=0; np<NP; np++)
+   for(int ns=0; ns<NSUM; ns++)
+    Sum[NSUM*Index[np] + ns]=0.0;
+  if (E==0.0) return;
+
+  std::vector<cdouble> LastSum(NSUM*NP);
+  std::vector<int> ConvergedIters(NP,0);
+  std::vector<int> m1, m2;
+  double z      = R[3*Index[0] + 2];
+  double GroupRho = Rho[Index[0]];
+  int NumActive = NP;
+
+  bool SingularShell=false;
+  for(int NN=NFIRSTROUND; NumActive>0 && NN<=NMAX; NN++)
+   { 
+     GetShell(LDim, NN, m1, m2);
+     for(size_t ng=0; ng<m1.size(); ng++)
+      { 
+        double PmG[2];
+        PmG[0] = kBloch[0] - m1[ng]*Gamma[0][0] - m2[ng]*Gamma[1][0];
+        PmG[1] = kBloch[1] - m1[ng]*Gamma[0][1] - m2[ng]*Gamma[1][1];
+
+        if (LDim==2)
+         { 
+           cdouble Q = sqrt ( PmG[0]*PmG[0] + PmG[1]*PmG[1] - k*k );
+           if ( abs(Q) < 1.0e-4*abs(k) )
+            { SingularShell=true;
+              break;
+            };
+
+           cdouble EEF, EEFPrime;
+           GetEEF(z, E, Q, &EEF, &EEFPrime);
+
+           for(int np=0; np<NP; np++)
+            { if (ConvergedIters[np]>=3) continue;
+              double *RP = R + 3*Index[np];
+              cdouble *S = Sum + NSUM*Index[np];
+              cdouble PreFactor = exp( II * (PmG[0]*RP[0] + PmG[1]*RP[1]) ) / Q;
+              S[0] += PreFactor * EEF;
+              S[1] += II*PmG[0]*PreFactor*EEF;
+              S[2] += II*PmG[1]*PreFactor*EEF;
+              S[3] += PreFactor*EEFPrime;
+              S[4] += -PmG[0]*PmG[1]*PreFactor*EEF;
+              S[5] += II*PmG[0]*PreFactor*EEFPrime;
+              S[6] += II*PmG[1]*PreFactor*EEFPrime;
+              S[7] += -PmG[0]*PmG[1]*PreFactor*EEFPrime;
+            };
+         }
+        else // LDim==1
+         { 
+           if (PmG[1]!=0.0)
+            ErrExit("1D lattice vectors must point in the x direction");
+
+           bool GroupSingular=false;
+           cdouble dGdRho[2];
+           cdouble GT=GetGLongTwiddle1D(PmG[0], GroupRho, k, E, dGdRho, GroupSingular);
+           if (GroupSingular)
+            { SingularShell=true;
+              break;
+            };
+           cdouble dGTdRho = dGdRho[0];
+           cdouble dGT2dRho2 = GroupRho==0.0 ? 0.0 : (dGdRho[1] - dGdRho[0]/GroupRho);
+
+           for(int np=0; np<NP; np++)
+            { if (ConvergedIters[np]>=3) continue;
+              double *RP = R + 3*Index[np];
+              cdouble *S = Sum + NSUM*Index[np];
+              cdouble ExpFac = exp( II * ( PmG[0]*RP[0] + PmG[1]*RP[1]) );
+              double YOverRho = (GroupRho==0.0) ? 0.0 : RP[1]/GroupRho;
+              double ZOverRho = (GroupRho==0.0) ? 0.0 : RP[2]/GroupRho;
+              S[0] += ExpFac * GT;
+              S[1] += II*PmG[0] * ExpFac * GT;
+              S[2] += YOverRho * ExpFac * dGTdRho;
+              S[3] += ZOverRho * ExpFac * dGTdRho;
+              S[4] += II*PmG[0] * YOverRho * ExpFac * dGTdRho;
+              S[5] += II*PmG[0] * ZOverRho * ExpFac * dGTdRho;
+              S[6] += YOverRho * ZOverRho * ExpFac * dGT2dRho2;
+              S[7] += II*PmG[0] * YOverRho * ZOverRho * ExpFac * dGT2dRho2;
+            };
+         };
+      };
+
+     if (SingularShell)
+      { for(int np=0; np<NP; np++)
+         if (ConvergedIters[np]<3) Singular[Index[np]]=true;
+        break;
+      };
+
+     /*--------------------------------------------------------------*/
+     /* per-point convergence analysis, as in GetGBarDistant         */
+     /*--------------------------------------------------------------*/
+     for(int np=0; np<NP; np++)
+      { if (ConvergedIters[np]>=3) continue;
+        cdouble *S = Sum + NSUM*Index[np], *LS=&(LastSum[NSUM*np]);
+        if (NN>NFIRSTROUND)
+         { double MaxAbsDelta=0.0, MaxRelDelta=0.0;
+           for(int ns=0; ns<NSUM; ns++)
+            { double Delta=abs(S[ns]-LS[ns]);
+              if ( Delta>MaxAbsDelta )
+               MaxAbsDelta=Delta;
+              double AbsSum=abs(S[ns]);
+              if ( AbsSum>0.0 && (Delta > MaxRelDelta*AbsSum) )
+               MaxRelDelta=Delta/AbsSum;
+            };
+           if ( MaxAbsDelta<ABSTOL || MaxRelDelta<RELTOL )
+            ConvergedIters[np]++;
+           else
+            ConvergedIters[np]=0;
+           if (ConvergedIters[np]==3)
+            NumActive--;
+         };
+        memcpy(LS, S, NSUM*sizeof(cdouble));
+      };
+   };
+
+  double PreFactor;
+  if (LDim==1)
+   PreFactor = sqrt(Gamma[0][0]*Gamma[0][0] + Gamma[0][1]*Gamma[0][1]);
+  else
+   PreFactor = (Gamma[0][0]*Gamma[1][1] - Gamma[0][1]*Gamma[1][0])/(16.0*M_PI*M_PI);
+
+  for(int np=0; np<NP; np++)
+   for(int ns=0; ns<NSUM; ns++)
+    Sum[NSUM*Index[np] + ns] *= PreFactor;
+}
+
+void GBarVDEwaldBatch(int NR, double *R, cdouble k, double *kBloch0,
+                      double (*LBV)[3], int LDim,
+                      double E, bool ExcludeInnerCells,
+                      cdouble *GBarVD)
+{
+  if (NR<=0) return;
+  if (k==0.0)
+   { for(int n=0; n<NR*NSUM; n++)
+      GBarVD[n]=0.0;
+     return;
+   };
+
+  double kBloch[3]={0.0, 0.0, 0.0};
+  memcpy(kBloch, kBloch0, LDim*sizeof(double));
+
+  std::vector<double> Es(NR), Rhos(NR, 0.0);
+  std::vector<cdouble> Distant(NSUM*NR), Inner;
+  if (ExcludeInnerCells)
+   Inner.resize(NSUM*NR);
+  bool *Singular = new bool[NR];
+  double Gamma[3][3];
+
+  int NT=1;
+#ifdef USE_OPENMP
+  if (NR>=BATCH_MINPARALLEL)
+   NT=GetNumThreads();
+#endif
+
+  /***************************************************************/
+  /* stage 1: per-point Ewald parameters, real-space sums, and   */
+  /*          inner-cell contributions to the distant sum        */
+  /***************************************************************/
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,16), num_threads(NT)
+#endif
+  for(int nr=0; nr<NR; nr++)
+   { 
+     double *RP = R + 3*nr;
+     double GammaP[3][3], EOpt;
+     GetRLBasis(LDim, LBV, GammaP, k, &EOpt, RP, &(Rhos[nr]));
+     Es[nr] = (E==-1.0) ? EOpt : E;
+     Singular[nr] = false;
+
+     cdouble *G = GBarVD + NSUM*nr;
+     GetGBarNearby(RP, k, kBloch, LBV, LDim, Es[nr], ExcludeInnerCells, 0, G);
+
+     if (ExcludeInnerCells)
+      { cdouble *GLongInner = &(Inner[NSUM*nr]);
+        int n2Mult = (LDim==2) ? 1 : 0;
+        for(int n1=-1; n1<=1; n1++)
+         for(int n2=-1*n2Mult; n2<=1*n2Mult; n2++)
+          AddGLongRealSpace(RP, k, kBloch, n1, n2, LBV, LDim, Es[nr], GLongInner);
+      };
+   };
+  double EOpt;
+  GetRLBasis(LDim, LBV, Gamma, k, &EOpt, R, 0);
+
+  /***************************************************************/
+  /* stage 2: group points by (E, z) or (E, Rho) and evaluate the*/
+  /*          reciprocal-lattice sums group by group             */
+  /***************************************************************/
+  int KeyIndex = (LDim==2) ? 2 : -1;
+  std::vector<int> Order(NR);
+  for(int nr=0; nr<NR; nr++) Order[nr]=nr;
+  struct KeyCmp
+   { const double *R, *Rho, *Es; int KeyIndex;
+     double Key(int n) const { return KeyIndex==2 ? R[3*n+2] : Rho[n]; }
+     bool operator()(int a, int b) const
+      { if (Es[a]!=Es[b]) return Es[a]<Es[b];
+        if (Key(a)!=Key(b)) return Key(a)<Key(b);
+        return a<b;
+      }
+   } Cmp = { R, &(Rhos[0]), &(Es[0]), KeyIndex };
+  std::sort(Order.begin(), Order.end(), Cmp);
+
+  std::vector<int> GroupStart;
+  for(int n=0; n<NR; n++)
+   if (    n==0
+        || Es[Order[n]]!=Es[Order[n-1]]
+        || Cmp.Key(Order[n])!=Cmp.Key(Order[n-1])
+        || (n-GroupStart.back())==BATCH_GROUPSIZE
+      )
+    GroupStart.push_back(n);
+  int NumGroups=GroupStart.size();
+  GroupStart.push_back(NR);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NT)
+#endif
+  for(int ng=0; ng<NumGroups; ng++)
+   { int *Index = &(Order[GroupStart[ng]]);
+     GetGBarDistantGroup(GroupStart[ng+1]-GroupStart[ng], Index, R, &(Rhos[0]),
+                         k, kBloch, Gamma, LDim, Es[Index[0]], &(Distant[0]),
+                         Singular);
+   };
+
+  /***************************************************************/
+  /* stage 3: combine, and redo any points at which the spectral */
+  /*          sum was singular with the single-point routine,    */
+  /*          which handles that case by displacing kBloch       */
+  /***************************************************************/
+  for(int nr=0; nr<NR; nr++)
+   { if (Singular[nr])
+      { GBarVDEwald(R + 3*nr, k, kBloch0, LBV, LDim, E, ExcludeInnerCells, GBarVD + NSUM*nr);
+        continue;
+      };
+     for(int ns=0; ns<NSUM; ns++)
+      GBarVD[NSUM*nr + ns] += Distant[NSUM*nr + ns];
+     if (ExcludeInnerCells)
+      for(int ns=0; ns<NSUM; ns++)
+       GBarVD[NSUM*nr + ns] -= Inner[NSUM*nr + ns];
+   };
+
+  delete[] Singular;
+}
+
 } // namespace scuff
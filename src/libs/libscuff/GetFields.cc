@@ -219,7 +219,7 @@ HMatrix *RWGGeometry::GetRFMatrix(cdouble Omega, double *kBloch0,
       (GBarAccelerator **)mallocEC(NumRegions*sizeof(RegionGBAs[0]));
      for(int nr=0; nr<NumRegions; nr++)
       if ( ! ( RegionMPs[nr]->IsPEC() ) )
-       RegionGBAs[nr]=CreateRegionGBA(nr, Omega, kBloch, XMatrix);
+       RegionGBAs[nr]=CreateRegionGBA(nr, Omega, kBloch, XMatrix, true);
    };
 
   /***************************************************************/
@@ -356,11 +356,7 @@ HMatrix *RWGGeometry::GetRFMatrix(cdouble Omega, double *kBloch0,
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   if (RegionGBAs)
-   { for(int nr=0; nr<NumRegions; nr++)
-      if (RegionGBAs[nr])
-       DestroyGBarAccelerator(RegionGBAs[nr]);
-     free(RegionGBAs);
-   };
+   free(RegionGBAs);
 
   delete[] ZRels;
   delete[] ks;
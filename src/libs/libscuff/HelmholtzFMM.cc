@@ -0,0 +1,893 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * HelmholtzFMM.cc -- implementation of the HelmholtzFMM class
+ *
+ * Overview:
+ *
+ *  (1) The points are sorted along a Morton curve and an octree of
+ *      uniform depth is built over them; the depth is the smallest
+ *      for which the average nonempty leaf holds at most LeafSize
+ *      points. Only nonempty boxes are stored.
+ *
+ *  (2) The field radiated by the points in a box b of half-width h
+ *      is represented outside b by an 'upward equivalent' density
+ *      on the surface of the cube of half-width RUE*h centered on b.
+ *      The equivalent density is chosen to reproduce the true field
+ *      on the 'upward check' cube of half-width RUC*h.
+ *      Similarly, the field in b due to distant sources is
+ *      represented by a 'downward equivalent' density on the cube
+ *      of half-width RDE*h, matched on the cube of half-width RDC*h.
+ *
+ *  (3) Since the translation operators (M2M, M2L, L2L) are just
+ *      samples of the kernel between equivalent and check surfaces,
+ *      followed by a pseudoinverse, they depend only on the level,
+ *      on the relative position of the boxes, and on k; they are
+ *      computed once per wavenumber and reused for all boxes.
+ *
+ * Reference: Ying, Biros, Zorin, J. Comp. Phys. 196 591 (2004).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include <libhmat.h>
+
+#include "HelmholtzFMM.h"
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
+#define II cdouble(0.0,1.0)
+
+// finest possible octree level (coordinates are quantized to
+// MAXLEVEL bits per dimension in the Morton keys)
+#define MAXLEVEL 20
+
+// radii of the equivalent / check surfaces in units of the box half-width
+#define RUE 1.05
+#define RUC 2.95
+#define RDE 2.95
+#define RDC 1.05
+
+// relative singular-value cutoff for the check-to-equivalent pseudoinverses
+#define PINV_TOL 1.0e-12
+
+// number of equivalent points per cube edge beyond which we warn
+// that the operators are getting expensive
+#define MAXORDER 20
+
+// M2L matrices are stored for all offsets in use on a level if they
+// fit within this many bytes, and otherwise computed on the fly
+#define M2L_MAXBYTES (1UL<<30)
+
+namespace scuff {
+
+/***************************************************************/
+/* Morton-key helpers: 3D keys interleave MAXLEVEL bits each   */
+/* of the x, y, z integer coordinates, x in the lowest bit     */
+/***************************************************************/
+static uint64_t SpreadBits(uint64_t x)
+{
+  x &= 0x1fffff;
+  x = (x | x << 32) & 0x1f00000000ffffULL;
+  x = (x | x << 16) & 0x1f0000ff0000ffULL;
+  x = (x | x <<  8) & 0x100f00f00f00f00fULL;
+  x = (x | x <<  4) & 0x10c30c30c30c30c3ULL;
+  x = (x | x <<  2) & 0x1249249249249249ULL;
+  return x;
+}
+
+static uint64_t CompactBits(uint64_t x)
+{
+  x &= 0x1249249249249249ULL;
+  x = (x ^ (x >>  2)) & 0x10c30c30c30c30c3ULL;
+  x = (x ^ (x >>  4)) & 0x100f00f00f00f00fULL;
+  x = (x ^ (x >>  8)) & 0x1f0000ff0000ffULL;
+  x = (x ^ (x >> 16)) & 0x1f00000000ffffULL;
+  x = (x ^ (x >> 32)) & 0x1fffff;
+  return x;
+}
+
+static uint64_t EncodeKey(int i[3])
+{ return    SpreadBits(i[0])
+         | (SpreadBits(i[1])<<1)
+         | (SpreadBits(i[2])<<2);
+}
+
+static void DecodeKey(uint64_t Key, int i[3])
+{ i[0]=(int)CompactBits(Key);
+  i[1]=(int)CompactBits(Key>>1);
+  i[2]=(int)CompactBits(Key>>2);
+}
+
+typedef struct KeyIndex
+ { uint64_t Key;
+   int Index;
+ } KeyIndex;
+
+static int CompareKeyIndex(const void *a, const void *b)
+{ uint64_t Ka=((const KeyIndex *)a)->Key, Kb=((const KeyIndex *)b)->Key;
+  return Ka<Kb ? -1 : Ka>Kb ? 1 : 0;
+}
+
+/***************************************************************/
+/* append an entry to a growing integer array                  */
+/***************************************************************/
+static void Append(int **List, int *Length, int *Allocated, int Entry)
+{
+  if (*Length==*Allocated)
+   { *Allocated = (*Allocated==0) ? 1024 : 2*(*Allocated);
+     *List = (int *)reallocEC(*List, (*Allocated)*sizeof(int));
+   };
+  (*List)[(*Length)++]=Entry;
+}
+
+/***************************************************************/
+/* K[nt + ns*NT] = G(XT_nt - XS_ns), and, if KGrad is non-NULL,*/
+/* KGrad[nt + ns*NT + Mu*NT*NS] = d/dXT_Mu of the same         */
+/***************************************************************/
+static void GetKernelMatrix(cdouble k, int NT, double *XT, int NS, double *XS,
+                            cdouble *K, cdouble *KGrad=0)
+{
+  for(int ns=0; ns<NS; ns++)
+   for(int nt=0; nt<NT; nt++)
+    { double R[3];
+      R[0] = XT[3*nt+0] - XS[3*ns+0];
+      R[1] = XT[3*nt+1] - XS[3*ns+1];
+      R[2] = XT[3*nt+2] - XS[3*ns+2];
+      double r2 = R[0]*R[0] + R[1]*R[1] + R[2]*R[2];
+      int Index = nt + ns*NT;
+      if (r2==0.0)
+       { K[Index]=0.0;
+         if (KGrad)
+          KGrad[Index] = KGrad[Index + NT*NS] = KGrad[Index + 2*NT*NS] = 0.0;
+         continue;
+       };
+      double r=sqrt(r2);
+      cdouble G = exp(II*k*r) / (4.0*M_PI*r);
+      K[Index]=G;
+      if (KGrad)
+       { cdouble dGOverR = G*(II*k - 1.0/r)/r;
+         KGrad[Index]           = dGOverR*R[0];
+         KGrad[Index + NT*NS]   = dGOverR*R[1];
+         KGrad[Index + 2*NT*NS] = dGOverR*R[2];
+       };
+    };
+}
+
+/***************************************************************/
+/* C = A*B, where A is MxK and B is KxNC; if Work is non-NULL  */
+/* (of length M*NC) then instead C += A*B                      */
+/***************************************************************/
+static void MatMul(int M, int K, int NC, cdouble *A, cdouble *B,
+                   cdouble *C, cdouble *Work=0)
+{
+  HMatrix AM(M, K,  LHM_COMPLEX, LHM_NORMAL, (void *)A);
+  HMatrix BM(K, NC, LHM_COMPLEX, LHM_NORMAL, (void *)B);
+  HMatrix CM(M, NC, LHM_COMPLEX, LHM_NORMAL, (void *)(Work ? Work : C));
+  AM.Multiply(&BM, &CM);
+  if (Work)
+   for(int n=0; n<M*NC; n++)
+    C[n]+=Work[n];
+}
+
+/***************************************************************/
+/* return a newly allocated NxN array containing the           */
+/* regularized pseudoinverse of the NxN matrix K               */
+/***************************************************************/
+static cdouble *PseudoInverse(int N, cdouble *K)
+{
+  HMatrix KM(N, N, LHM_COMPLEX);
+  memcpy(KM.ZM, K, N*N*sizeof(cdouble));
+  HVector Sigma(N, LHM_REAL);
+  HMatrix U(N, N, LHM_COMPLEX), VT(N, N, LHM_COMPLEX);
+  KM.SVD(&Sigma, &U, &VT);
+
+  // K = U*Sigma*VT ==> K^+ = VT^H * Sigma^+ * U^H
+  for(int nc=0; nc<N; nc++)
+   { double S = Sigma.DV[nc];
+     double SInv = (S > PINV_TOL*Sigma.DV[0]) ? 1.0/S : 0.0;
+     for(int nr=0; nr<N; nr++)
+      U.ZM[nr + nc*N] *= SInv;
+   };
+
+  cdouble *KInv=(cdouble *)mallocEC(N*N*sizeof(cdouble));
+  HMatrix KInvM(N, N, LHM_COMPLEX, LHM_NORMAL, (void *)KInv);
+  VT.Multiply(&U, &KInvM, "--transA C --transB C");
+  return KInv;
+}
+
+/***************************************************************/
+/* points on the surface of the cube [-1,1]^3 lying on a grid  */
+/* with P points per edge; returns the number of points        */
+/***************************************************************/
+static int GetUnitSurface(int P, double *S)
+{
+  int N=0;
+  for(int i=0; i<P; i++)
+   for(int j=0; j<P; j++)
+    for(int k=0; k<P; k++)
+     { if ( i!=0 && i!=P-1 && j!=0 && j!=P-1 && k!=0 && k!=P-1 )
+        continue;
+       if (S)
+        { S[3*N+0] = -1.0 + 2.0*i/(P-1);
+          S[3*N+1] = -1.0 + 2.0*j/(P-1);
+          S[3*N+2] = -1.0 + 2.0*k/(P-1);
+        };
+       N++;
+     };
+  return N;
+}
+
+static void ScaleSurface(int N, double *S, double *Center, double Radius,
+                         double *XS)
+{
+  for(int n=0; n<N; n++)
+   for(int Mu=0; Mu<3; Mu++)
+    XS[3*n+Mu] = (Center ? Center[Mu] : 0.0) + Radius*S[3*n+Mu];
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+HelmholtzFMM::HelmholtzFMM(int pNumPoints, double *Points, int LeafSize, int pOrder)
+{
+  NumPoints=pNumPoints;
+  Order=pOrder<2 ? 2 : pOrder;
+  if (LeafSize<1) LeafSize=1;
+
+  HaveOperators=false;
+  CurrentK=0.0;
+  P=N=0;
+  S=0;
+  UC2UE=DC2DE=0;
+  M2M=L2L=M2L=0;
+
+  BuildTree(Points, LeafSize);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+HelmholtzFMM::~HelmholtzFMM()
+{
+  FreeOperators();
+
+  for(int l=0; l<=Depth; l++)
+   { free(Keys[l]);
+     free(Start[l]);
+     free(Count[l]);
+     if (Parent[l]) free(Parent[l]);
+     if (ChildStart[l]) free(ChildStart[l]);
+     if (FarStart[l]) free(FarStart[l]);
+     if (FarList[l]) free(FarList[l]);
+     if (FarOffset[l]) free(FarOffset[l]);
+   };
+  free(Keys);
+  free(Start);
+  free(Count);
+  free(Parent);
+  free(ChildStart);
+  free(FarStart);
+  free(FarList);
+  free(FarOffset);
+  free(NearStart);
+  if (NearList) free(NearList);
+  free(NumBoxes);
+  free(Perm);
+  free(X);
+}
+
+/***************************************************************/
+/* index of the box with the given key on the given level,     */
+/* or -1 if there is no such (nonempty) box                    */
+/***************************************************************/
+int HelmholtzFMM::FindBox(int Level, uint64_t Key)
+{
+  uint64_t *K=Keys[Level];
+  int Lo=0, Hi=NumBoxes[Level]-1;
+  while(Lo<=Hi)
+   { int Mid=(Lo+Hi)/2;
+     if (K[Mid]==Key)
+      return Mid;
+     else if (K[Mid]<Key)
+      Lo=Mid+1;
+     else
+      Hi=Mid-1;
+   };
+  return -1;
+}
+
+void HelmholtzFMM::GetBoxCenter(int Level, int nb, double Center[3])
+{
+  int i[3];
+  DecodeKey(Keys[Level][nb], i);
+  double BoxWidth = Width / ((double)(1<<Level));
+  for(int Mu=0; Mu<3; Mu++)
+   Center[Mu] = Origin[Mu] + (i[Mu]+0.5)*BoxWidth;
+}
+
+/***************************************************************/
+/* sort the points in Morton order and build the octree and    */
+/* its interaction lists                                       */
+/***************************************************************/
+void HelmholtzFMM::BuildTree(double *Points, int LeafSize)
+{
+  /*--------------------------------------------------------------*/
+  /*- root box                                                   -*/
+  /*--------------------------------------------------------------*/
+  double Min[3], Max[3];
+  for(int Mu=0; Mu<3; Mu++)
+   Min[Mu]=Max[Mu]=(NumPoints>0 ? Points[Mu] : 0.0);
+  for(int n=1; n<NumPoints; n++)
+   for(int Mu=0; Mu<3; Mu++)
+    { Min[Mu]=fmin(Min[Mu], Points[3*n+Mu]);
+      Max[Mu]=fmax(Max[Mu], Points[3*n+Mu]);
+    };
+  Width=fmax( Max[0]-Min[0], fmax(Max[1]-Min[1], Max[2]-Min[2]) );
+  Width = (Width==0.0) ? 1.0 : 1.001*Width;
+  for(int Mu=0; Mu<3; Mu++)
+   Origin[Mu] = 0.5*(Min[Mu]+Max[Mu]) - 0.5*Width;
+
+  /*--------------------------------------------------------------*/
+  /*- sort points by their finest-level Morton keys              -*/
+  /*--------------------------------------------------------------*/
+  KeyIndex *KI=(KeyIndex *)mallocEC(NumPoints*sizeof(KeyIndex));
+  double Scale = ((double)(1<<MAXLEVEL)) / Width;
+  for(int n=0; n<NumPoints; n++)
+   { int i[3];
+     for(int Mu=0; Mu<3; Mu++)
+      { i[Mu] = (int)floor( (Points[3*n+Mu]-Origin[Mu])*Scale );
+        if (i[Mu]<0) i[Mu]=0;
+        if (i[Mu]>=(1<<MAXLEVEL)) i[Mu]=(1<<MAXLEVEL)-1;
+      };
+     KI[n].Key=EncodeKey(i);
+     KI[n].Index=n;
+   };
+  qsort(KI, NumPoints, sizeof(KeyIndex), CompareKeyIndex);
+
+  X=(double *)mallocEC(3*NumPoints*sizeof(double));
+  Perm=(int *)mallocEC(NumPoints*sizeof(int));
+  for(int n=0; n<NumPoints; n++)
+   { Perm[n]=KI[n].Index;
+     memcpy(X+3*n, Points+3*Perm[n], 3*sizeof(double));
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- choose the depth                                           -*/
+  /*--------------------------------------------------------------*/
+  for(Depth=0; Depth<MAXLEVEL; Depth++)
+   { int Shift=3*(MAXLEVEL-Depth), NumLeaves=(NumPoints>0 ? 1 : 0);
+     for(int n=1; n<NumPoints; n++)
+      if ( (KI[n].Key>>Shift) != (KI[n-1].Key>>Shift) )
+       NumLeaves++;
+     if ( NumPoints <= LeafSize*NumLeaves )
+      break;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- boxes on each level                                        -*/
+  /*--------------------------------------------------------------*/
+  NumBoxes   = (int *)mallocEC((Depth+1)*sizeof(int));
+  Keys       = (uint64_t **)mallocEC((Depth+1)*sizeof(uint64_t *));
+  Start      = (int **)mallocEC((Depth+1)*sizeof(int *));
+  Count      = (int **)mallocEC((Depth+1)*sizeof(int *));
+  Parent     = (int **)mallocEC((Depth+1)*sizeof(int *));
+  ChildStart = (int **)mallocEC((Depth+1)*sizeof(int *));
+  FarStart   = (int **)mallocEC((Depth+1)*sizeof(int *));
+  FarList    = (int **)mallocEC((Depth+1)*sizeof(int *));
+  FarOffset  = (int **)mallocEC((Depth+1)*sizeof(int *));
+  for(int l=0; l<=Depth; l++)
+   { int Shift=3*(MAXLEVEL-l), NB=0;
+     for(int n=0; n<NumPoints; n++)
+      if ( n==0 || (KI[n].Key>>Shift) != (KI[n-1].Key>>Shift) )
+       NB++;
+     NumBoxes[l]=NB;
+     Keys[l]=(uint64_t *)mallocEC((NB+1)*sizeof(uint64_t));
+     Start[l]=(int *)mallocEC((NB+1)*sizeof(int));
+     Count[l]=(int *)mallocEC((NB+1)*sizeof(int));
+     NB=0;
+     for(int n=0; n<NumPoints; n++)
+      if ( n==0 || (KI[n].Key>>Shift) != (KI[n-1].Key>>Shift) )
+       { Keys[l][NB]  = KI[n].Key>>Shift;
+         Start[l][NB] = n;
+         Count[l][NB] = 0;
+         NB++;
+       }
+      else
+       Count[l][NB-1]++;
+     for(int nb=0; nb<NB; nb++)
+      Count[l][nb]++;
+   };
+  free(KI);
+
+  /*--------------------------------------------------------------*/
+  /*- parent / child relations                                   -*/
+  /*--------------------------------------------------------------*/
+  Parent[0]=0;
+  for(int l=1; l<=Depth; l++)
+   { Parent[l]=(int *)mallocEC(NumBoxes[l]*sizeof(int));
+     for(int nb=0; nb<NumBoxes[l]; nb++)
+      Parent[l][nb]=FindBox(l-1, Keys[l][nb]>>3);
+   };
+  ChildStart[Depth]=0;
+  for(int l=0; l<Depth; l++)
+   { ChildStart[l]=(int *)mallocEC((NumBoxes[l]+1)*sizeof(int));
+     for(int nb=0, nc=0; nb<=NumBoxes[l]; nb++)
+      { while( nc<NumBoxes[l+1] && Parent[l+1][nc]<nb )
+         nc++;
+        ChildStart[l][nb]=nc;
+      };
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- near lists of leaf boxes: all adjacent leaves, including   -*/
+  /*- the box itself                                             -*/
+  /*--------------------------------------------------------------*/
+  int Length=0, Allocated=0, MaxCoord=(1<<Depth);
+  NearList=0;
+  NearStart=(int *)mallocEC((NumBoxes[Depth]+1)*sizeof(int));
+  for(int nb=0; nb<NumBoxes[Depth]; nb++)
+   { NearStart[nb]=Length;
+     int i[3], j[3];
+     DecodeKey(Keys[Depth][nb], i);
+     for(int dx=-1; dx<=1; dx++)
+      for(int dy=-1; dy<=1; dy++)
+       for(int dz=-1; dz<=1; dz++)
+        { j[0]=i[0]+dx; j[1]=i[1]+dy; j[2]=i[2]+dz;
+          if (    j[0]<0 || j[0]>=MaxCoord
+               || j[1]<0 || j[1]>=MaxCoord
+               || j[2]<0 || j[2]>=MaxCoord ) continue;
+          int nbp=FindBox(Depth, EncodeKey(j));
+          if (nbp!=-1)
+           Append(&NearList, &Length, &Allocated, nbp);
+        };
+   };
+  NearStart[NumBoxes[Depth]]=Length;
+
+  /*--------------------------------------------------------------*/
+  /*- far (interaction) lists on levels 2..Depth: children of    -*/
+  /*- the parent's neighbors that are not themselves adjacent    -*/
+  /*- to the box; FarOffset encodes the relative position        -*/
+  /*--------------------------------------------------------------*/
+  for(int l=0; l<=Depth; l++)
+   FarStart[l]=FarList[l]=FarOffset[l]=0;
+  for(int l=2; l<=Depth; l++)
+   { int LengthO=0, AllocatedO=0;
+     Length=Allocated=0;
+     MaxCoord=(1<<(l-1));
+     FarStart[l]=(int *)mallocEC((NumBoxes[l]+1)*sizeof(int));
+     for(int nb=0; nb<NumBoxes[l]; nb++)
+      { FarStart[l][nb]=Length;
+        int i[3], ip[3], j[3], jc[3];
+        DecodeKey(Keys[l][nb], i);
+        DecodeKey(Keys[l-1][Parent[l][nb]], ip);
+        for(int dx=-1; dx<=1; dx++)
+         for(int dy=-1; dy<=1; dy++)
+          for(int dz=-1; dz<=1; dz++)
+           { j[0]=ip[0]+dx; j[1]=ip[1]+dy; j[2]=ip[2]+dz;
+             if (    j[0]<0 || j[0]>=MaxCoord
+                  || j[1]<0 || j[1]>=MaxCoord
+                  || j[2]<0 || j[2]>=MaxCoord ) continue;
+             int npp=FindBox(l-1, EncodeKey(j));
+             if (npp==-1) continue;
+             for(int nc=ChildStart[l-1][npp]; nc<ChildStart[l-1][npp+1]; nc++)
+              { DecodeKey(Keys[l][nc], jc);
+                int D0=jc[0]-i[0], D1=jc[1]-i[1], D2=jc[2]-i[2];
+                if ( abs(D0)<=1 && abs(D1)<=1 && abs(D2)<=1 )
+                 continue;
+                Append(&(FarList[l]), &Length, &Allocated, nc);
+                Append(&(FarOffset[l]), &LengthO, &AllocatedO,
+                       (D0+3) + 7*(D1+3) + 49*(D2+3));
+              };
+           };
+      };
+     FarStart[l][NumBoxes[l]]=Length;
+   };
+
+  Log("FMM octree: %i points, %i levels, %i leaves",NumPoints,Depth,NumBoxes[Depth]);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void HelmholtzFMM::FreeOperators()
+{
+  if (!HaveOperators) return;
+  for(int l=2; l<=Depth; l++)
+   { free(S[l]);
+     free(UC2UE[l]);
+     free(DC2DE[l]);
+     if (l>=3)
+      for(int no=0; no<8; no++)
+       { free(M2M[l][no]);
+         free(L2L[l][no]);
+       };
+     free(M2M[l]);
+     free(L2L[l]);
+     if (M2L[l])
+      { for(int no=0; no<343; no++)
+         if (M2L[l][no]) free(M2L[l][no]);
+        free(M2L[l]);
+      };
+   };
+  free(P);
+  free(N);
+  free(S);
+  free(UC2UE);
+  free(DC2DE);
+  free(M2M);
+  free(L2L);
+  free(M2L);
+  HaveOperators=false;
+}
+
+/***************************************************************/
+/* M2L operator for level l and the given offset, taken from   */
+/* the cache if present and otherwise computed into Buffer     */
+/***************************************************************/
+cdouble *HelmholtzFMM::GetM2LMatrix(int l, int Offset, cdouble *Buffer)
+{
+  if (M2L[l] && M2L[l][Offset])
+   return M2L[l][Offset];
+
+  double h = 0.5*Width / ((double)(1<<l));
+  double Center[3];
+  Center[0] = 2.0*h*( (Offset%7) - 3);
+  Center[1] = 2.0*h*( ((Offset/7)%7) - 3);
+  Center[2] = 2.0*h*( (Offset/49) - 3);
+  int NL=N[l];
+  double *XT=(double *)mallocEC(6*NL*sizeof(double)), *XS=XT+3*NL;
+  ScaleSurface(NL, S[l], 0,      RDC*h, XT);
+  ScaleSurface(NL, S[l], Center, RUE*h, XS);
+  GetKernelMatrix(CurrentK, NL, XT, NL, XS, Buffer);
+  free(XT);
+  return Buffer;
+}
+
+/***************************************************************/
+/* compute the translation operators for wavenumber k          */
+/***************************************************************/
+void HelmholtzFMM::InitOperators(cdouble k)
+{
+  FreeOperators();
+  CurrentK=k;
+  HaveOperators=true;
+  if (Depth<2) return;
+
+  P     = (int *)mallocEC((Depth+1)*sizeof(int));
+  N     = (int *)mallocEC((Depth+1)*sizeof(int));
+  S     = (double **)mallocEC((Depth+1)*sizeof(double *));
+  UC2UE = (cdouble **)mallocEC((Depth+1)*sizeof(cdouble *));
+  DC2DE = (cdouble **)mallocEC((Depth+1)*sizeof(cdouble *));
+  M2M   = (cdouble ***)mallocEC((Depth+1)*sizeof(cdouble **));
+  L2L   = (cdouble ***)mallocEC((Depth+1)*sizeof(cdouble **));
+  M2L   = (cdouble ***)mallocEC((Depth+1)*sizeof(cdouble **));
+
+  /*--------------------------------------------------------------*/
+  /*- number of equivalent points on each level: enough to       -*/
+  /*- resolve the oscillations of the field on the equivalent    -*/
+  /*- surface, in addition to the low-frequency Order            -*/
+  /*--------------------------------------------------------------*/
+  int MaxN=0;
+  for(int l=2; l<=Depth; l++)
+   { double h = 0.5*Width / ((double)(1<<l));
+     P[l] = Order + (int)ceil( fabs(real(k))*RUE*h/M_SQRT2 );
+     N[l] = GetUnitSurface(P[l], 0);
+     S[l] = (double *)mallocEC(3*N[l]*sizeof(double));
+     GetUnitSurface(P[l], S[l]);
+     if (N[l]>MaxN) MaxN=N[l];
+   };
+  if (P[2]>MAXORDER)
+   Warn("FMM boxes are electrically large at k=%s (%i equivalent points per box); operators will be expensive",z2s(k),N[2]);
+  Log(" FMM operators at k=%s: %i..%i equivalent points per box",
+        z2s(k),N[Depth],N[2]);
+
+  int NumThreads=GetNumThreads();
+  for(int l=2; l<=Depth; l++)
+   {
+     double h = 0.5*Width / ((double)(1<<l));
+     int NL=N[l];
+     double *XT=(double *)mallocEC(2*3*MaxN*sizeof(double));
+     double *XS=XT + 3*MaxN;
+     cdouble *K=(cdouble *)mallocEC(NL*NL*sizeof(cdouble));
+
+     /*--------------------------------------------------------------*/
+     /*- check-to-equivalent operators                              -*/
+     /*--------------------------------------------------------------*/
+     ScaleSurface(NL, S[l], 0, RUC*h, XT);
+     ScaleSurface(NL, S[l], 0, RUE*h, XS);
+     GetKernelMatrix(k, NL, XT, NL, XS, K);
+     UC2UE[l]=PseudoInverse(NL, K);
+
+     ScaleSurface(NL, S[l], 0, RDC*h, XT);
+     ScaleSurface(NL, S[l], 0, RDE*h, XS);
+     GetKernelMatrix(k, NL, XT, NL, XS, K);
+     DC2DE[l]=PseudoInverse(NL, K);
+     free(K);
+
+     /*--------------------------------------------------------------*/
+     /*- child-to-parent and parent-to-child operators              -*/
+     /*--------------------------------------------------------------*/
+     M2M[l]=(cdouble **)mallocEC(8*sizeof(cdouble *));
+     L2L[l]=(cdouble **)mallocEC(8*sizeof(cdouble *));
+     if (l>=3)
+      { int NP=N[l-1];
+        for(int no=0; no<8; no++)
+         { double Center[3];
+           Center[0] = (no&1) ? h : -h;
+           Center[1] = (no&2) ? h : -h;
+           Center[2] = (no&4) ? h : -h;
+
+           M2M[l][no]=(cdouble *)mallocEC(NP*NL*sizeof(cdouble));
+           ScaleSurface(NP, S[l-1], 0,      RUC*2.0*h, XT);
+           ScaleSurface(NL, S[l],   Center, RUE*h,     XS);
+           GetKernelMatrix(k, NP, XT, NL, XS, M2M[l][no]);
+
+           L2L[l][no]=(cdouble *)mallocEC(NL*NP*sizeof(cdouble));
+           ScaleSurface(NL, S[l],   Center, RDC*h,     XT);
+           ScaleSurface(NP, S[l-1], 0,      RDE*2.0*h, XS);
+           GetKernelMatrix(k, NL, XT, NP, XS, L2L[l][no]);
+         };
+      };
+     free(XT);
+
+     /*--------------------------------------------------------------*/
+     /*- M2L operators for all offsets in use on this level, if     -*/
+     /*- they fit in memory                                         -*/
+     /*--------------------------------------------------------------*/
+     bool InUse[343];
+     int NumInUse=0;
+     memset(InUse, 0, 343*sizeof(bool));
+     for(int n=0; n<FarStart[l][NumBoxes[l]]; n++)
+      if (!InUse[FarOffset[l][n]])
+       { InUse[FarOffset[l][n]]=true;
+         NumInUse++;
+       };
+     M2L[l]=0;
+     if ( ((size_t)NumInUse)*NL*NL*sizeof(cdouble) <= M2L_MAXBYTES )
+      { M2L[l]=(cdouble **)mallocEC(343*sizeof(cdouble *));
+        for(int no=0; no<343; no++)
+         M2L[l][no]=0;
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+        for(int no=0; no<343; no++)
+         if (InUse[no])
+          { cdouble *Buffer=(cdouble *)mallocEC(NL*NL*sizeof(cdouble));
+            GetM2LMatrix(l, no, Buffer);
+            M2L[l][no]=Buffer;
+          };
+      };
+   };
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void HelmholtzFMM::Apply(cdouble k, int NC, cdouble *Q, cdouble *Phi,
+                         int NG, cdouble *GradPhi)
+{
+  if (GradPhi==0) NG=0;
+  if (NG>NC)
+   ErrExit("%s:%i: internal error (NG>NC)",__FILE__,__LINE__);
+
+  if (!HaveOperators || k!=CurrentK)
+   InitOperators(k);
+
+  int NumThreads=GetNumThreads();
+
+  /*--------------------------------------------------------------*/
+  /*- densities in sorted order                                  -*/
+  /*--------------------------------------------------------------*/
+  cdouble *QS   = (cdouble *)mallocEC(NumPoints*NC*sizeof(cdouble));
+  cdouble *PhiS = (cdouble *)mallocEC(NumPoints*NC*sizeof(cdouble));
+  cdouble *GradS = NG ? (cdouble *)mallocEC(3*NumPoints*NG*sizeof(cdouble)) : 0;
+  for(int n=0; n<NumPoints; n++)
+   for(int c=0; c<NC; c++)
+    { QS[n*NC+c]   = Q[Perm[n]*NC+c];
+      PhiS[n*NC+c] = 0.0;
+    };
+  for(int n=0; n<3*NumPoints*NG; n++)
+   GradS[n]=0.0;
+
+  /*--------------------------------------------------------------*/
+  /*- UE[l][nb*N[l]*NC + c*N[l] + n] is the upward equivalent    -*/
+  /*- density of channel c at point n of box nb; similarly DE.   -*/
+  /*--------------------------------------------------------------*/
+  cdouble **UE=0, **DE=0;
+  if (Depth>=2)
+   {
+     UE=(cdouble **)mallocEC((Depth+1)*sizeof(cdouble *));
+     DE=(cdouble **)mallocEC((Depth+1)*sizeof(cdouble *));
+     for(int l=2; l<=Depth; l++)
+      { UE[l]=(cdouble *)mallocEC(NumBoxes[l]*N[l]*NC*sizeof(cdouble));
+        DE[l]=(cdouble *)mallocEC(NumBoxes[l]*N[l]*NC*sizeof(cdouble));
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- upward pass: P2M on leaves, then M2M up to level 2         -*/
+     /*--------------------------------------------------------------*/
+     for(int l=Depth; l>=2; l--)
+      {
+        int NL=N[l];
+        double h = 0.5*Width / ((double)(1<<l));
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+        for(int nb=0; nb<NumBoxes[l]; nb++)
+         {
+           cdouble *Check=(cdouble *)mallocEC(2*NL*NC*sizeof(cdouble));
+           cdouble *Work=Check + NL*NC;
+           if (l==Depth)
+            { int Offset=Start[l][nb], NP=Count[l][nb];
+              double Center[3];
+              GetBoxCenter(l, nb, Center);
+              double *XC=(double *)mallocEC(3*NL*sizeof(double));
+              ScaleSurface(NL, S[l], Center, RUC*h, XC);
+              cdouble *K=(cdouble *)mallocEC( (NL*NP + NP*NC)*sizeof(cdouble));
+              cdouble *QB=K + NL*NP;
+              GetKernelMatrix(k, NL, XC, NP, X+3*Offset, K);
+              for(int np=0; np<NP; np++)
+               for(int c=0; c<NC; c++)
+                QB[np + c*NP] = QS[(Offset+np)*NC + c];
+              MatMul(NL, NP, NC, K, QB, Check);
+              free(K);
+              free(XC);
+            }
+           else
+            { for(int n=0; n<NL*NC; n++)
+               Check[n]=0.0;
+              int NLC=N[l+1];
+              for(int nc=ChildStart[l][nb]; nc<ChildStart[l][nb+1]; nc++)
+               MatMul(NL, NLC, NC, M2M[l+1][Keys[l+1][nc]&7],
+                      UE[l+1] + nc*NLC*NC, Check, Work);
+            };
+           MatMul(NL, NL, NC, UC2UE[l], Check, UE[l] + nb*NL*NC);
+           free(Check);
+         };
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- downward pass: M2L plus L2L from level 2 down to leaves    -*/
+     /*--------------------------------------------------------------*/
+     for(int l=2; l<=Depth; l++)
+      {
+        int NL=N[l];
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+        for(int nb=0; nb<NumBoxes[l]; nb++)
+         {
+           cdouble *Check=(cdouble *)mallocEC(2*NL*NC*sizeof(cdouble));
+           cdouble *Work=Check + NL*NC;
+           cdouble *Buffer = M2L[l] ? 0 : (cdouble *)mallocEC(NL*NL*sizeof(cdouble));
+           for(int n=0; n<NL*NC; n++)
+            Check[n]=0.0;
+           for(int nf=FarStart[l][nb]; nf<FarStart[l][nb+1]; nf++)
+            MatMul(NL, NL, NC, GetM2LMatrix(l, FarOffset[l][nf], Buffer),
+                   UE[l] + FarList[l][nf]*NL*NC, Check, Work);
+           if (l>=3)
+            MatMul(NL, N[l-1], NC, L2L[l][Keys[l][nb]&7],
+                   DE[l-1] + Parent[l][nb]*N[l-1]*NC, Check, Work);
+           MatMul(NL, NL, NC, DC2DE[l], Check, DE[l] + nb*NL*NC);
+           if (Buffer) free(Buffer);
+           free(Check);
+         };
+      };
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- leaf boxes: evaluate local expansions (L2P) and direct      */
+  /*- interactions with neighbors (P2P)                          -*/
+  /*--------------------------------------------------------------*/
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int nb=0; nb<NumBoxes[Depth]; nb++)
+   {
+     int Offset=Start[Depth][nb], NP=Count[Depth][nb];
+
+     if (Depth>=2)
+      { int NL=N[Depth];
+        double h = 0.5*Width / ((double)(1<<Depth));
+        double Center[3];
+        GetBoxCenter(Depth, nb, Center);
+        double *XE=(double *)mallocEC(3*NL*sizeof(double));
+        ScaleSurface(NL, S[Depth], Center, RDE*h, XE);
+        cdouble *K=(cdouble *)mallocEC( (4*NP*NL + NP*NC)*sizeof(cdouble));
+        cdouble *KGrad=K + NP*NL, *Out=KGrad + 3*NP*NL;
+        cdouble *DEB=DE[Depth] + nb*NL*NC;
+        GetKernelMatrix(k, NP, X+3*Offset, NL, XE, K, NG ? KGrad : 0);
+        MatMul(NP, NL, NC, K, DEB, Out);
+        for(int np=0; np<NP; np++)
+         for(int c=0; c<NC; c++)
+          PhiS[(Offset+np)*NC + c] += Out[np + c*NP];
+        for(int Mu=0; Mu<3 && NG>0; Mu++)
+         { MatMul(NP, NL, NG, KGrad + Mu*NP*NL, DEB, Out);
+           for(int np=0; np<NP; np++)
+            for(int c=0; c<NG; c++)
+             GradS[((Offset+np)*NG + c)*3 + Mu] += Out[np + c*NP];
+         };
+        free(K);
+        free(XE);
+      };
+
+     for(int nn=NearStart[nb]; nn<NearStart[nb+1]; nn++)
+      { int nbs=NearList[nn];
+        int OffsetS=Start[Depth][nbs], NPS=Count[Depth][nbs];
+        for(int np=Offset; np<Offset+NP; np++)
+         for(int nps=OffsetS; nps<OffsetS+NPS; nps++)
+          { double R[3];
+            R[0] = X[3*np+0] - X[3*nps+0];
+            R[1] = X[3*np+1] - X[3*nps+1];
+            R[2] = X[3*np+2] - X[3*nps+2];
+            double r2 = R[0]*R[0] + R[1]*R[1] + R[2]*R[2];
+            if (r2==0.0) continue;
+            double r=sqrt(r2);
+            cdouble G = exp(II*k*r) / (4.0*M_PI*r);
+            cdouble *PhiT=PhiS + np*NC, *QSrc=QS + nps*NC;
+            for(int c=0; c<NC; c++)
+             PhiT[c] += G*QSrc[c];
+            if (NG)
+             { cdouble dGOverR = G*(II*k - 1.0/r)/r;
+               cdouble *GradT=GradS + 3*np*NG;
+               for(int c=0; c<NG; c++)
+                { cdouble dGQ = dGOverR*QSrc[c];
+                  GradT[3*c+0] += dGQ*R[0];
+                  GradT[3*c+1] += dGQ*R[1];
+                  GradT[3*c+2] += dGQ*R[2];
+                };
+             };
+          };
+      };
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- unsort                                                     -*/
+  /*--------------------------------------------------------------*/
+  for(int n=0; n<NumPoints; n++)
+   { memcpy(Phi + Perm[n]*NC, PhiS + n*NC, NC*sizeof(cdouble));
+     if (NG)
+      memcpy(GradPhi + 3*Perm[n]*NG, GradS + 3*n*NG, 3*NG*sizeof(cdouble));
+   };
+
+  if (UE)
+   { for(int l=2; l<=Depth; l++)
+      { free(UE[l]);
+        free(DE[l]);
+      };
+     free(UE);
+     free(DE);
+   };
+  if (GradS) free(GradS);
+  free(PhiS);
+  free(QS);
+}
+
+} // namespace scuff
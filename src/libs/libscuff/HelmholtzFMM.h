@@ -0,0 +1,113 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * HelmholtzFMM.h -- multilevel fast multipole method for sums of
+ *                -- the form
+ *
+ *                --  Phi_c(x_i) = \sum_{j!=i} G(x_i-x_j) Q_c(x_j)
+ *
+ *                -- over a fixed set of points x_i, where
+ *                -- G(r)=e^{ikr}/(4 pi r) and k may be real,
+ *                -- imaginary or complex.
+ */
+
+#ifndef HELMHOLTZFMM_H
+#define HELMHOLTZFMM_H
+
+#include <stdint.h>
+#include "libscuff.h"
+
+namespace scuff {
+
+/***************************************************************/
+/* HelmholtzFMM is a kernel-independent FMM on a uniform-depth */
+/* octree. Multipole and local expansions are represented by   */
+/* equivalent densities on cube surfaces surrounding each box, */
+/* so the translation operators are just samples of G itself   */
+/* and the method works equally well at real and imaginary     */
+/* frequencies. The number of equivalent points per box grows  */
+/* with the size of the box in wavelengths.                    */
+/*                                                             */
+/* Points are given once, to the constructor; Apply() may then */
+/* be called any number of times with different wavenumbers    */
+/* and densities. The translation operators are recomputed     */
+/* only when k changes.                                        */
+/***************************************************************/
+class HelmholtzFMM
+ {
+ public:
+
+   HelmholtzFMM(int NumPoints, double *Points, int LeafSize=64, int Order=5);
+   ~HelmholtzFMM();
+
+   // Q[n*NumChannels + c] is the density of channel c at point n;
+   // on return Phi[n*NumChannels + c] is the potential of that
+   // density at point n. If GradPhi is non-NULL, the first
+   // NumGradChannels channels also have their gradients computed,
+   // GradPhi[(n*NumGradChannels + c)*3 + Mu] = d/dx_Mu Phi_c(x_n).
+   // The self term (r=0) is omitted from all sums.
+   void Apply(cdouble k, int NumChannels, cdouble *Q, cdouble *Phi,
+              int NumGradChannels=0, cdouble *GradPhi=0);
+
+   int NumPoints;
+   int Depth;                // leaves live at level Depth
+   int Order;                // equivalent points per edge at low frequency
+
+ private:
+
+   void BuildTree(double *Points, int LeafSize);
+   void InitOperators(cdouble k);
+   void FreeOperators();
+   int FindBox(int Level, uint64_t Key);
+   void GetBoxCenter(int Level, int nb, double Center[3]);
+   cdouble *GetM2LMatrix(int Level, int Offset, cdouble *Buffer);
+
+   /*--------------------------------------------------------------*/
+   /*- octree; points are stored sorted in Morton order, and       */
+   /*- the boxes on each level cover contiguous ranges of points   */
+   /*--------------------------------------------------------------*/
+   double *X;                // sorted points
+   int *Perm;                // X[n] = Points[Perm[n]]
+   double Origin[3], Width;  // root box = Origin + [0,Width]^3
+
+   int *NumBoxes;            // NumBoxes[l] for l=0..Depth
+   uint64_t **Keys;          // Keys[l][nb], sorted
+   int **Start, **Count;     // range of points in box
+   int **Parent;             // index of parent box on level l-1
+   int **ChildStart;         // children of box nb are ChildStart[l][nb..nb+1) on level l+1
+   int *NearStart, *NearList;              // leaf-level neighbors (CSR)
+   int **FarStart, **FarList, **FarOffset; // interaction lists (CSR)
+
+   /*--------------------------------------------------------------*/
+   /*- translation operators, valid for wavenumber CurrentK        */
+   /*--------------------------------------------------------------*/
+   bool HaveOperators;
+   cdouble CurrentK;
+   int *P, *N;               // points per edge / total points on equivalent surfaces
+   double **S;               // unit equivalent surface on level l
+   cdouble **UC2UE, **DC2DE; // N[l] x N[l] pseudoinverses
+   cdouble ***M2M, ***L2L;   // M2M[l][Octant], L2L[l][Octant] for l>=3
+   cdouble ***M2L;           // M2L[l][Offset], or NULL if computed on the fly
+
+ };
+
+} // namespace scuff
+
+#endif // HELMHOLTZFMM_H
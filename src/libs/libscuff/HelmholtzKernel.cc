@@ -0,0 +1,375 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * HelmholtzKernel.cc -- batched evaluation of the Helmholtz kernel
+ *                    -- and its radial derivatives at many points,
+ *                    -- for use in fixed-order panel-panel cubature
+ *
+ * all arrays are stored in structure-of-arrays form, and complex
+ * quantities are split into real and imaginary parts stored in
+ * consecutive blocks of N doubles: K[n] = Re K_n, K[N+n] = Im K_n.
+ *
+ * the loops are written so that the compiler can vectorize them;
+ * in particular, the sine, cosine, and exponential are computed by
+ * inline polynomial approximations (after Cephes) instead of calls
+ * to libm. on x86-64 systems with GCC, each routine is compiled
+ * for AVX-512, AVX2+FMA, and baseline SSE2, and the best version for
+ * the host CPU is selected at load time.
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__>=6) \
+ && defined(__x86_64__) && defined(__linux__)
+#  define HK_TARGETS __attribute__((target_clones("arch=skylake-avx512","arch=haswell","default")))
+#else
+#  define HK_TARGETS
+#endif
+
+#ifdef __GNUC__
+#  define HK_INLINE inline __attribute__((always_inline))
+#else
+#  define HK_INLINE inline
+#endif
+
+namespace scuff {
+
+#define II cdouble(0.0,1.0)
+
+cdouble ExpRel(cdouble x, int n);
+
+/***************************************************************/
+/* sin(x) and cos(x), accurate to a few ulp for |x| < 1e9.     */
+/* the argument is reduced modulo pi/4 using a three-part      */
+/* representation of pi/4, and the selection of the octant is  */
+/* done with integer arithmetic rather than branches (and      */
+/* without floor(), which most compilers won't vectorize).     */
+/***************************************************************/
+#define HK_FOPI 1.27323954473516268615   // 4/pi
+#define HK_DP1  7.85398125648498535156E-1
+#define HK_DP2  3.77489470793079817668E-8
+#define HK_DP3  2.69515142907905952645E-15
+
+static HK_INLINE void hkSinCos(double x, double *pSin, double *pCos)
+{
+  double ax = fabs(x);
+  int j     = (int)(ax*HK_FOPI);
+  j         = (j+1) & ~1;               // round up to an even octant
+  double y  = (double)j;
+  int q     = (j>>1) & 3;               // quadrant 0, 1, 2, or 3
+
+  double z  = ((ax - y*HK_DP1) - y*HK_DP2) - y*HK_DP3;
+  double zz = z*z;
+
+  double sp = 1.58962301576546568060E-10;
+  sp = sp*zz - 2.50507477628578072866E-8;
+  sp = sp*zz + 2.75573136213857245213E-6;
+  sp = sp*zz - 1.98412698295895385996E-4;
+  sp = sp*zz + 8.33333333332211858878E-3;
+  sp = sp*zz - 1.66666666666666307295E-1;
+  sp = z + z*zz*sp;
+
+  double cp = -1.13585365213876817300E-11;
+  cp = cp*zz + 2.08757008419747316778E-9;
+  cp = cp*zz - 2.75573141792967388112E-7;
+  cp = cp*zz + 2.48015872888517045348E-5;
+  cp = cp*zz - 1.38888888888730564116E-3;
+  cp = cp*zz + 4.16666666666665929218E-2;
+  cp = 1.0 - 0.5*zz + zz*zz*cp;
+
+  // sin and cos are swapped for odd q, sin changes
+  // sign for q>=2, and cos changes sign for q=1,2
+  double Swap    = (double)(q&1);
+  double SinSign = ((q&2) ? -1.0 : 1.0) * copysign(1.0, x);
+  double CosSign = ((q==1) | (q==2)) ? -1.0 : 1.0;
+
+  *pSin = SinSign * (sp + Swap*(cp-sp));
+  *pCos = CosSign * (cp + Swap*(sp-cp));
+}
+
+/***************************************************************/
+/* exp(x) for x <= 709 (in practice we only need x <= 0).      */
+/* arguments below -708 are clamped to -708, which is as good  */
+/* as zero for our purposes. the result is assembled from a    */
+/* rational approximation on [-ln2/2, ln2/2] and an exact      */
+/* power of 2.                                                 */
+/***************************************************************/
+#define HK_LOG2E  1.4426950408889634073599
+#define HK_C1     6.93145751953125E-1
+#define HK_C2     1.42860682030941723212E-6
+#define HK_MINLOG (-708.0)
+
+static HK_INLINE double hkExp(double x)
+{
+  // x = max(x, HK_MINLOG), written so that the compiler can't
+  // turn it into a branch (which would defeat vectorization)
+  double Lo = (x < HK_MINLOG) ? 1.0 : 0.0;
+  x += Lo*(HK_MINLOG - x);
+
+  // n = floor(x/ln2 + 1/2); the offset makes the argument of the
+  // truncating conversion positive
+  int ni   = (int)(HK_LOG2E*x + 0.5 + 1100.0) - 1100;
+  double n = (double)ni;
+  x -= n*HK_C1;
+  x -= n*HK_C2;
+
+  double xx = x*x;
+  double P = 1.26177193074810590878E-4;
+  P = P*xx + 3.02994407707441961300E-2;
+  P = P*xx + 9.99999999999999999910E-1;
+  P *= x;
+  double Q = 3.00198505138664455042E-6;
+  Q = Q*xx + 2.52448340349684104192E-3;
+  Q = Q*xx + 2.27265548208155028766E-1;
+  Q = Q*xx + 2.00000000000000000009E0;
+  double e = 1.0 + 2.0*P/(Q-P);
+
+  // 2^n, built directly from its IEEE bit pattern
+  uint64_t Bits = ((uint64_t)(ni + 1023)) << 52;
+  double TwoN;
+  memcpy(&TwoN, &Bits, sizeof(TwoN));
+
+  return e*TwoN;
+}
+
+/***************************************************************/
+/* Phi_n = e^{ik r_n}/(4 pi r_n), split into real and         */
+/* imaginary parts, with special cases for real and imaginary  */
+/* k. entries with r_n=0 are set to zero.                      */
+/***************************************************************/
+#define HK_OO4PI 0.07957747154594766788  // 1/(4 pi)
+
+// 1/(4 pi r), or 0 if r==0, written so that the compiler does not
+// need a branch to guard the division
+static HK_INLINE double hkOO4PIR(double r)
+{ double Pos = (r>0.0) ? 1.0 : 0.0;
+  return Pos*HK_OO4PI / (r + (1.0-Pos));
+}
+
+HK_TARGETS
+static void GetPhi_RealK(int N, double k, const double *r,
+                         double *PhiRe, double *PhiIm)
+{
+#ifdef USE_OPENMP
+#pragma omp simd
+#endif
+  for(int n=0; n<N; n++)
+   { double S, C, rn=r[n];
+     hkSinCos(k*rn, &S, &C);
+     double Mag = hkOO4PIR(rn);
+     PhiRe[n] = Mag*C;
+     PhiIm[n] = Mag*S;
+   };
+}
+
+HK_TARGETS
+static void GetPhi_ImagK(int N, double kappa, const double *r,
+                         double *PhiRe, double *PhiIm)
+{
+#ifdef USE_OPENMP
+#pragma omp simd
+#endif
+  for(int n=0; n<N; n++)
+   { double rn=r[n];
+     double Mag = hkOO4PIR(rn);
+     PhiRe[n] = Mag*hkExp(-kappa*rn);
+     PhiIm[n] = 0.0;
+   };
+}
+
+HK_TARGETS
+static void GetPhi_ComplexK(int N, double kr, double ki, const double *r,
+                            double *PhiRe, double *PhiIm)
+{
+#ifdef USE_OPENMP
+#pragma omp simd
+#endif
+  for(int n=0; n<N; n++)
+   { double S, C, rn=r[n];
+     hkSinCos(kr*rn, &S, &C);
+     double Mag = hkOO4PIR(rn);
+     Mag *= hkExp(-ki*rn);
+     PhiRe[n] = Mag*C;
+     PhiIm[n] = Mag*S;
+   };
+}
+
+HK_TARGETS
+static void ApplyWeights(int N, const double *W, double *PhiRe, double *PhiIm)
+{
+#ifdef USE_OPENMP
+#pragma omp simd
+#endif
+  for(int n=0; n<N; n++)
+   { PhiRe[n]*=W[n];
+     PhiIm[n]*=W[n];
+   };
+}
+
+/***************************************************************/
+/* given Phi, compute                                          */
+/*  Psi  = Phi * (ik - 1/r) / r                                */
+/*  Zeta = Phi * ( (ik)^2 - 3ik/r + 3/r^2 ) / r^2              */
+/***************************************************************/
+HK_TARGETS
+static void GetPsiZeta(int N, double kr, double ki, const double *r,
+                       const double *PhiRe, const double *PhiIm,
+                       double *PsiRe, double *PsiIm,
+                       double *ZetaRe, double *ZetaIm)
+{
+  // ik = -ki + i*kr, (ik)^2 = -(kr^2 - ki^2) - 2i*kr*ki
+  double ikRe = -ki, ikIm = kr;
+  double ik2Re = ki*ki - kr*kr, ik2Im = -2.0*kr*ki;
+
+  if (ZetaRe==0)
+   {
+#ifdef USE_OPENMP
+#pragma omp simd
+#endif
+     for(int n=0; n<N; n++)
+      { double rn=r[n], OOR = 4.0*M_PI*hkOO4PIR(rn);
+        double FRe = (ikRe - OOR)*OOR, FIm = ikIm*OOR;
+        PsiRe[n] = PhiRe[n]*FRe - PhiIm[n]*FIm;
+        PsiIm[n] = PhiRe[n]*FIm + PhiIm[n]*FRe;
+      };
+     return;
+   };
+
+#ifdef USE_OPENMP
+#pragma omp simd
+#endif
+  for(int n=0; n<N; n++)
+   { double rn=r[n], OOR = 4.0*M_PI*hkOO4PIR(rn), OOR2=OOR*OOR;
+     double FRe = (ikRe - OOR)*OOR, FIm = ikIm*OOR;
+     PsiRe[n] = PhiRe[n]*FRe - PhiIm[n]*FIm;
+     PsiIm[n] = PhiRe[n]*FIm + PhiIm[n]*FRe;
+     double GRe = (ik2Re - 3.0*ikRe*OOR + 3.0*OOR2)*OOR2;
+     double GIm = (ik2Im - 3.0*ikIm*OOR)*OOR2;
+     ZetaRe[n] = PhiRe[n]*GRe - PhiIm[n]*GIm;
+     ZetaIm[n] = PhiRe[n]*GIm + PhiIm[n]*GRe;
+   };
+}
+
+/***************************************************************/
+/* evaluate the Helmholtz kernel and its radial derivatives at */
+/* N points:                                                   */
+/*                                                             */
+/*  Phi_n  = W_n * e^{ikr_n} / (4 pi r_n)                      */
+/*  Psi_n  = Phi_n * (ik - 1/r_n) / r_n                        */
+/*  Zeta_n = Phi_n * ( (ik)^2 - 3ik/r_n + 3/r_n^2 ) / r_n^2    */
+/*                                                             */
+/* if DeSingularize is true, e^{ikr} is replaced by its        */
+/* Taylor series with the first four terms removed, as in      */
+/* AssembleInnerPPIIntegrand(). W and Zeta may be NULL. each   */
+/* output array holds 2N doubles (real parts, then imaginary   */
+/* parts).                                                     */
+/***************************************************************/
+void GetHelmholtzKernels(int N, cdouble k, const double *r, const double *W,
+                         bool DeSingularize,
+                         double *Phi, double *Psi, double *Zeta)
+{
+  double kr=real(k), ki=imag(k);
+
+  if (DeSingularize)
+   { // the desingularized kernel is only used for nearby panel
+     // pairs, which are comparatively rare, so we don't bother
+     // vectorizing it
+     cdouble ik=II*k;
+     for(int n=0; n<N; n++)
+      { double rn=r[n];
+        cdouble P = ExpRel(ik*rn,4) / (4.0*M_PI*rn);
+        if ( !IsFinite(real(P)) ) P=0.0;
+        if (W) P*=W[n];
+        Phi[n]=real(P);
+        Phi[N+n]=imag(P);
+      };
+   }
+  else 
+   { if (ki==0.0)
+      GetPhi_RealK(N, kr, r, Phi, Phi+N);
+     else if (kr==0.0)
+      GetPhi_ImagK(N, ki, r, Phi, Phi+N);
+     else
+      GetPhi_ComplexK(N, kr, ki, r, Phi, Phi+N);
+     if (W)
+      ApplyWeights(N, W, Phi, Phi+N);
+   };
+
+  GetPsiZeta(N, kr, ki, r, Phi, Phi+N, Psi, Psi+N,
+             Zeta ? Zeta : 0, Zeta ? Zeta+N : 0);
+}
+
+/***************************************************************/
+/* return sum_n A_n * B_n * K_n, where K is a complex array    */
+/* stored as above and A, B are real arrays; either or both of */
+/* A and B may be NULL, in which case they are taken to be 1.  */
+/***************************************************************/
+HK_TARGETS
+cdouble KernelDot(int N, const double *K, const double *A, const double *B)
+{
+  const double *KRe=K, *KIm=K+N;
+  double SRe=0.0, SIm=0.0;
+
+  if (A && B)
+   {
+#ifdef USE_OPENMP
+#pragma omp simd reduction(+:SRe,SIm)
+#endif
+     for(int n=0; n<N; n++)
+      { double AB=A[n]*B[n];
+        SRe += AB*KRe[n];
+        SIm += AB*KIm[n];
+      };
+   }
+  else if (A || B)
+   { const double *C = A ? A : B;
+#ifdef USE_OPENMP
+#pragma omp simd reduction(+:SRe,SIm)
+#endif
+     for(int n=0; n<N; n++)
+      { SRe += C[n]*KRe[n];
+        SIm += C[n]*KIm[n];
+      };
+   }
+  else
+   {
+#ifdef USE_OPENMP
+#pragma omp simd reduction(+:SRe,SIm)
+#endif
+     for(int n=0; n<N; n++)
+      { SRe += KRe[n];
+        SIm += KIm[n];
+      };
+   };
+
+  return cdouble(SRe, SIm);
+}
+
+} // namespace scuff
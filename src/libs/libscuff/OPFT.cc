@@ -283,18 +283,10 @@ void GetOPFT(RWGGeometry *G, int SurfaceIndex, cdouble Omega,
   // 20151003 surface-conductivity contribution to absorbed power
   cdouble ZS = 0.0;
   if (S->SurfaceZeta)
-   {  char *ParmNames[4]={ const_cast<char *>("w"), 
-                           const_cast<char *>("x"), 
-                           const_cast<char *>("y"), 
-                           const_cast<char *>("z") 
-                         };
-      cdouble ParmValues[4];
-      ParmValues[0] = Omega*MatProp::FreqUnit;
+   { 
 // FIXME this doesn't account for spatially-varying surface impedance
-      ParmValues[1] = 0.0;
-      ParmValues[2] = 0.0;
-      ParmValues[3] = 0.0;
-      ZS=ZVAC*cevaluator_evaluate(S->SurfaceZeta, 4, ParmNames, ParmValues);
+     double X0[3]={0.0, 0.0, 0.0};
+     ZS=ZVAC*S->GetSurfaceZeta(Omega, X0);
    };
 
   /*--------------------------------------------------------------*/
@@ -531,18 +523,10 @@ void GetOPFTMatrices(RWGGeometry *G,
   // 20151003 surface-impedance contribution to absorbed power
   cdouble ZS = 0.0;
   if (S->SurfaceZeta)
-   {  char *ParmNames[4]={ const_cast<char *>("w"), 
-                           const_cast<char *>("x"), 
-                           const_cast<char *>("y"), 
-                           const_cast<char *>("z") 
-                         };
-      cdouble ParmValues[4];
-      ParmValues[0] = Omega*MatProp::FreqUnit;
+   { 
 // FIXME this doesn't account for spatially-varying surface impedance
-      ParmValues[1] = 0.0;
-      ParmValues[2] = 0.0;
-      ParmValues[3] = 0.0;
-      ZS=ZVAC*cevaluator_evaluate(S->SurfaceZeta, 4, ParmNames, ParmValues);
+     double X0[3]={0.0, 0.0, 0.0};
+     ZS=ZVAC*S->GetSurfaceZeta(Omega, X0);
    };
 
   /***************************************************************/
@@ -0,0 +1,194 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * PPIMemo.cc  -- implementation of the PPIMemo class, which stores
+ *             -- complete panel-panel integrals at a single frequency,
+ *             -- keyed by the relative geometry of the panel pair
+ *
+ * (the memo is consulted in PanelPanelInteractions.cc; this file
+ *  only handles keys and storage.)
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef HAVE_CXX11
+#include <unordered_map>
+#elif defined(HAVE_TR1)
+#include <tr1/unordered_map>
+#endif
+
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+namespace scuff {
+
+long JenkinsHash(const char *key, size_t len); // in FIPPICache.cc
+
+// vertex differences are rounded to multiples of this fraction
+// of RWGGeometry::tolVecClose (itself 1e-3 * the shortest edge)
+#define PM_QUANTUM 1.0e-6
+
+// approximate bookkeeping overhead of one table entry
+#define PM_ENTRYOVERHEAD 64
+
+typedef struct PMRecord
+ {
+   cdouble H[2];
+   cdouble GradH[6];
+
+ } PMRecord;
+
+struct PMKeyHash
+ {
+   long operator() (const PMKey &K) const
+    { return JenkinsHash( (const char *)&K, sizeof(PMKey) ); }
+ };
+
+struct PMKeyCmp
+ {
+   bool operator()(const PMKey &K1, const PMKey &K2) const
+    { return 0==memcmp( (const void *)&K1, (const void *)&K2, sizeof(PMKey) ); }
+ };
+
+#ifdef HAVE_CXX11
+typedef std::unordered_map<PMKey, PMRecord, PMKeyHash, PMKeyCmp> PMRecordMap;
+#elif defined(HAVE_TR1)
+typedef std::tr1::unordered_map<PMKey, PMRecord, PMKeyHash, PMKeyCmp> PMRecordMap;
+#endif
+
+/***************************************************************/
+/* class constructor and destructor                            */
+/***************************************************************/
+PPIMemo::PPIMemo(RWGGeometry *G, double MaxMB)
+{
+  opTable=(void *)(new PMRecordMap);
+  LengthQuantum=PM_QUANTUM*G->tolVecClose;
+  Omega=0.0;
+  size_t EntrySize = sizeof(PMKey) + sizeof(PMRecord) + PM_ENTRYOVERHEAD;
+  MaxRecords=(size_t)(MaxMB*1048576.0 / ((double)EntrySize));
+}
+
+PPIMemo::~PPIMemo()
+{
+  delete (PMRecordMap *)opTable;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void PPIMemo::PrepareFrequency(cdouble NewOmega)
+{
+  if (NewOmega==Omega)
+   return;
+
+  PMLock.write_lock();
+  ((PMRecordMap *)opTable)->clear();
+  Omega=NewOmega;
+  PMLock.write_unlock();
+}
+
+size_t PPIMemo::NumRecords()
+{
+  PMLock.read_lock();
+  size_t N=((PMRecordMap *)opTable)->size();
+  PMLock.read_unlock();
+  return N;
+}
+
+/***************************************************************/
+/* the key must be zeroed in its entirety (including padding)  */
+/* because it is hashed and compared bytewise                  */
+/***************************************************************/
+void PPIMemo::GetKey(GetPPIArgStruct *Args, PMKey *Key)
+{
+  memset(Key, 0, sizeof(PMKey));
+
+  RWGSurface *Sa=Args->Sa, *Sb=Args->Sb;
+  RWGPanel *Pa=Sa->Panels[Args->npa], *Pb=Sb->Panels[Args->npb];
+  double *Va0 = Sa->Vertices + 3*Pa->VI[0];
+  double *V[5];
+  V[0] = Sa->Vertices + 3*Pa->VI[1];
+  V[1] = Sa->Vertices + 3*Pa->VI[2];
+  V[2] = Sb->Vertices + 3*Pb->VI[0];
+  V[3] = Sb->Vertices + 3*Pb->VI[1];
+  V[4] = Sb->Vertices + 3*Pb->VI[2];
+
+  double *D=Args->Displacement;
+  for(int nv=0; nv<5; nv++)
+   for(int Mu=0; Mu<3; Mu++)
+    { double dV = V[nv][Mu] - Va0[Mu];
+      if (D && nv>=2) dV+=D[Mu];
+      Key->dV[3*nv+Mu] = (long long)floor(dV/LengthQuantum + 0.5);
+    };
+
+  Key->kRe                   = real(Args->k);
+  Key->kIm                   = imag(Args->k);
+  Key->iQa                   = (char)Args->iQa;
+  Key->iQb                   = (char)Args->iQb;
+  Key->NumGradientComponents = (char)Args->NumGradientComponents;
+  Key->ForceTaylorDuffy      = (char)(Args->ForceTaylorDuffy ? 1 : 0);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+bool PPIMemo::GetRecord(PMKey *Key, GetPPIArgStruct *Args)
+{
+  PMRecordMap *Table=(PMRecordMap *)opTable;
+  bool Found=false;
+
+  PMLock.read_lock();
+  PMRecordMap::iterator it=Table->find(*Key);
+  if ( it!=Table->end() )
+   { PMRecord *Record=&(it->second);
+     memcpy(Args->H, Record->H, 2*sizeof(cdouble));
+     if (Args->NumGradientComponents>0)
+      memcpy(Args->GradH, Record->GradH, 2*Args->NumGradientComponents*sizeof(cdouble));
+     Found=true;
+   };
+  PMLock.read_unlock();
+
+  return Found;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void PPIMemo::AddRecord(PMKey *Key, GetPPIArgStruct *Args)
+{
+  PMRecordMap *Table=(PMRecordMap *)opTable;
+
+  PMRecord Record={};
+  memcpy(Record.H, Args->H, 2*sizeof(cdouble));
+  if (Args->NumGradientComponents>0)
+   memcpy(Record.GradH, Args->GradH, 2*Args->NumGradientComponents*sizeof(cdouble));
+
+  PMLock.write_lock();
+  if ( Table->size() < MaxRecords )
+   Table->insert( std::pair<PMKey, PMRecord>(*Key, Record) );
+  PMLock.write_unlock();
+}
+
+} // namespace scuff
@@ -200,6 +200,125 @@ if ( MyRD > 1.0e-2 )
    };
 }
 
+/***************************************************************/
+/* batched version of the cubature loop in GetPPIs_Cubature(), */
+/* used whenever there is no GBarAccelerator.                  */
+/*                                                             */
+/* the (X, XP) point pairs are processed PPI_BATCHSIZE at a    */
+/* time. for each batch we first tabulate the geometric        */
+/* factors in the integrand (structure-of-arrays layout), then */
+/* evaluate the Helmholtz kernel at all points of the batch    */
+/* with a single call to GetHelmholtzKernels(), and finally    */
+/* contract the kernel values against the geometric factors.   */
+/* the integrand is the same as in AssembleInnerPPIIntegrand().*/
+/***************************************************************/
+#define PPI_BATCHSIZE 128
+
+typedef struct PPIBatch
+ { 
+   double W[PPI_BATCHSIZE];        // w*wp
+   double r[PPI_BATCHSIZE];        // |X-XP|
+   double FdotFP[PPI_BATCHSIZE];   // F \cdot FP
+   double hTimes[PPI_BATCHSIZE];   // (F \times FP) \cdot R
+   double R[3][PPI_BATCHSIZE];     // X-XP
+   double FxFP[3][PPI_BATCHSIZE];  // F \times FP
+   double Puv[3][PPI_BATCHSIZE];   // R \cdot dX
+   double dFdotFP[3][PPI_BATCHSIZE];
+   double dhTimes[3][PPI_BATCHSIZE];
+   double Phi[2*PPI_BATCHSIZE], Psi[2*PPI_BATCHSIZE], Zeta[2*PPI_BATCHSIZE];
+ } PPIBatch;
+
+static void GetPPIs_CubatureBatched(cdouble k, int DeSingularize,
+                                    int NumPts, double *TCR,
+                                    double *V0, double *A, double *B, double *Q,
+                                    double *V0P, double *AP, double *BP, double *QP,
+                                    int NumTorqueAxes, double *GammaMatrix,
+                                    cdouble *H, cdouble *GradH, cdouble *dHdT)
+{
+  PPIBatch Batch, *PB=&Batch;
+  cdouble ik=II*k, FourOverIK2=4.0/(ik*ik);
+
+  int NumPairs=NumPts*NumPts;
+  for(int nPairStart=0; nPairStart<NumPairs; nPairStart+=PPI_BATCHSIZE)
+   { 
+     int N = NumPairs - nPairStart;
+     if (N>PPI_BATCHSIZE) N=PPI_BATCHSIZE;
+
+     /***************************************************************/
+     /* tabulate geometric factors for this batch of point pairs    */
+     /***************************************************************/
+     for(int n=0; n<N; n++)
+      { 
+        int np  = (nPairStart + n) / NumPts;
+        int npp = (nPairStart + n) % NumPts;
+        double u=TCR[3*np+0],   v=TCR[3*np+1],   w=TCR[3*np+2];
+        double up=TCR[3*npp+0], vp=TCR[3*npp+1], wp=TCR[3*npp+2];
+
+        double X[3], F[3], XP[3], FP[3], R[3], FxFP[3];
+        for(int Mu=0; Mu<3; Mu++)
+         { X[Mu]  = V0[Mu] + u*A[Mu] + v*B[Mu];
+           F[Mu]  = X[Mu] - Q[Mu];
+           XP[Mu] = V0P[Mu] + up*AP[Mu] + vp*BP[Mu];
+           FP[Mu] = XP[Mu] - QP[Mu];
+           R[Mu]  = X[Mu] - XP[Mu];
+         };
+        VecCross(F, FP, FxFP);
+
+        PB->W[n]      = w*wp;
+        PB->r[n]      = VecNorm(R);
+        PB->FdotFP[n] = VecDot(F, FP);
+        PB->hTimes[n] = VecDot(FxFP, R);
+        for(int Mu=0; Mu<3; Mu++)
+         { PB->R[Mu][n]    = R[Mu];
+           PB->FxFP[Mu][n] = FxFP[Mu];
+         };
+
+        if ( NumTorqueAxes>0 && GammaMatrix!=0 )
+         for(int nta=0; nta<NumTorqueAxes; nta++)
+          { double dX[3]={0.0, 0.0, 0.0}, dF[3]={0.0, 0.0, 0.0}, dFxFP[3];
+            for(int Mu=0; Mu<3; Mu++)
+             for(int Nu=0; Nu<3; Nu++)
+              { dX[Mu]+=GammaMatrix[9*nta + Mu + 3*Nu]*X[Nu];
+                dF[Mu]+=GammaMatrix[9*nta + Mu + 3*Nu]*F[Nu];
+              };
+            PB->Puv[nta][n]     = VecDot(R, dX);
+            PB->dFdotFP[nta][n] = VecDot(dF, FP);
+            PB->dhTimes[nta][n] = VecDot(VecCross(dF,FP,dFxFP),R) + VecDot(FxFP,dX);
+          };
+      };
+
+     /***************************************************************/
+     /* evaluate the kernel at all points in the batch              */
+     /***************************************************************/
+     bool NeedZeta = (GradH!=0 || dHdT!=0);
+     GetHelmholtzKernels(N, k, PB->r, PB->W, DeSingularize,
+                         PB->Phi, PB->Psi, NeedZeta ? PB->Zeta : 0);
+
+     /***************************************************************/
+     /* contract kernel values against geometric factors            */
+     /***************************************************************/
+     H[0] += KernelDot(N, PB->Phi, PB->FdotFP) + FourOverIK2*KernelDot(N, PB->Phi);
+     H[1] += KernelDot(N, PB->Psi, PB->hTimes);
+
+     if (GradH)
+      for(int Mu=0; Mu<3; Mu++)
+       { GradH[2*Mu+0] +=  KernelDot(N, PB->Psi, PB->R[Mu], PB->FdotFP)
+                          +FourOverIK2*KernelDot(N, PB->Psi, PB->R[Mu]);
+         GradH[2*Mu+1] +=  KernelDot(N, PB->Zeta, PB->R[Mu], PB->hTimes)
+                          +KernelDot(N, PB->Psi, PB->FxFP[Mu]);
+       };
+
+     if (dHdT)
+      for(int nta=0; nta<NumTorqueAxes; nta++)
+       { dHdT[2*nta+0] +=  KernelDot(N, PB->Psi, PB->Puv[nta], PB->FdotFP)
+                          +FourOverIK2*KernelDot(N, PB->Psi, PB->Puv[nta])
+                          +KernelDot(N, PB->Phi, PB->dFdotFP[nta]);
+         dHdT[2*nta+1] +=  KernelDot(N, PB->Zeta, PB->Puv[nta], PB->hTimes)
+                          +KernelDot(N, PB->Psi, PB->dhTimes[nta]);
+       };
+   };
+}
+
 /*--------------------------------------------------------------*/
 /*--------------------------------------------------------------*/
 /*--------------------------------------------------------------*/
@@ -276,13 +395,23 @@ void GetPPIs_Cubature(GetPPIArgStruct *Args,
   else
    TCR=GetTCR(4, &NumPts);
 
-  /***************************************************************/
-  /* outer loop **************************************************/
-  /***************************************************************/
   cdouble k = Args->k;
   memset(H,0,2*sizeof(cdouble));
   if (GradH) memset(GradH,0,6*sizeof(cdouble));
   if (dHdT) memset(dHdT,0,2*NumTorqueAxes*sizeof(cdouble));
+
+  /***************************************************************/
+  /* in the usual case of no GBarAccelerator we use the batched  */
+  /* (vectorized) version of the loop below                      */
+  /***************************************************************/
+  if (Args->GBA==0)
+   GetPPIs_CubatureBatched(k, DeSingularize, NumPts, TCR,
+                           V0, A, B, Q, V0P, AP, BP, QP,
+                           NumTorqueAxes, GammaMatrix, H, GradH, dHdT);
+  else
+  /***************************************************************/
+  /* outer loop **************************************************/
+  /***************************************************************/
   for(int np=0, ncp=0; np<NumPts; np++)
    { 
      double u=TCR[ncp++];
@@ -349,12 +478,187 @@ void GetPPIs_Cubature(GetPPIArgStruct *Args,
 
 }
 
+/***************************************************************/
+/* add the contributions of the singular terms, as computed    */
+/* from the FIPPI data, to the desingularized panel-panel      */
+/* integrals                                                   */
+/***************************************************************/
+static void AddFIPPIContributions(cdouble k, QDFIPPIData *QDFD, cdouble *H)
+{
+  // note: PF[n] = (ik)^n / (4\pi)
+  cdouble ik=II*k; 
+  cdouble OOIK2=1.0/(ik*ik);
+  cdouble PF[5];
+  PF[0]=1.0/(4.0*M_PI);
+  PF[1]=ik*PF[0];
+  PF[2]=ik*PF[1];
+  PF[3]=ik*PF[2];
+  PF[4]=ik*PF[3];
+
+  // add contributions to panel-panel integrals
+  H[0] +=  PF[0]*AA0*( QDFD->hDotRM1 + OOIK2*QDFD->hNablaRM1)
+          +PF[1]*AA1*( QDFD->hDotR0  + OOIK2*QDFD->hNablaR0 )
+          +PF[2]*AA2*( QDFD->hDotR1  + OOIK2*QDFD->hNablaR1 )
+          +PF[3]*AA3*( QDFD->hDotR2  + OOIK2*QDFD->hNablaR2 );
+  
+  H[1] +=  PF[0]*BB0*QDFD->hTimesRM3
+          +PF[2]*BB2*QDFD->hTimesRM1
+          +PF[3]*BB3*QDFD->hTimesR0 
+          +PF[4]*BB4*QDFD->hTimesR1;
+}
+
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+/*- PART 2: Routines to compute panel-panel integrals from     -*/
+/*-         frequency-independent data stored in a             -*/
+/*-         CubatureCache.                                     -*/
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+
+/***************************************************************/
+/* compute a new CCRecord for the panel pair described by Args.*/
+/* the cubature points are the same ones used by               */
+/* GetPPIs_Cubature(), so cached and uncached results agree.   */
+/***************************************************************/
+static CCRecord *ComputeCCRecord(CubatureCache *CC, GetPPIArgStruct *Args)
+{
+  RWGSurface *Sa = Args->Sa;
+  RWGSurface *Sb = Args->Sb;
+  RWGPanel *Pa   = Sa->Panels[Args->npa];
+  RWGPanel *Pb   = Sb->Panels[Args->npb];
+  double *Qa     = Sa->Vertices + 3*Pa->VI[Args->iQa];
+  double *Qb     = Sb->Vertices + 3*Pb->VI[Args->iQb];
+  double *Va[3], *Vb[3], rRel;
+  int ncv=AssessPanelPair(Sa, Args->npa, Sb, Args->npb, &rRel, Va, Vb);
+
+  int Type;
+  if (ncv==3)
+   Type=CCREC_NONE;
+  else if (rRel > DESINGULARIZATION_RADIUS)
+   Type=CCREC_FAR;
+  else
+   Type=CCREC_DESING;
+
+  CCRecord *Record=CC->NewRecord(Type);
+  if (Record==0)
+   return 0;
+  Record->ncv  = ncv;
+  Record->RMax = fmax(Pa->Radius, Pb->Radius);
+  if (Type==CCREC_NONE)
+   return Record;
+
+  if (Type==CCREC_DESING)
+   { void *opFC = Args->opFC ? Args->opFC : (void *)&GlobalFIPPICache;
+     GetQDFIPPIData(Va, Qa, Vb, Qb, ncv, opFC, &(Record->QDFD));
+   };
+
+  double A[3], B[3], AP[3], BP[3];
+  VecSub(Va[1], Va[0], A);
+  VecSub(Va[2], Va[0], B);
+  VecSub(Vb[1], Vb[0], AP);
+  VecSub(Vb[2], Vb[0], BP);
+
+  int NumPts=CC->NumPts;
+  double *TCR=CC->TCR;
+  for(int np=0, n=0; np<NumPts; np++)
+   { 
+     double u=TCR[3*np+0], v=TCR[3*np+1], w=TCR[3*np+2];
+     double X[3], F[3];
+     for(int Mu=0; Mu<3; Mu++)
+      { X[Mu] = Va[0][Mu] + u*A[Mu] + v*B[Mu];
+        F[Mu] = X[Mu] - Qa[Mu];
+      };
+
+     for(int npp=0; npp<NumPts; npp++, n++)
+      { 
+        double up=TCR[3*npp+0], vp=TCR[3*npp+1], wp=TCR[3*npp+2];
+        double XP[3], FP[3], R[3], FxFP[3];
+        for(int Mu=0; Mu<3; Mu++)
+         { XP[Mu] = Vb[0][Mu] + up*AP[Mu] + vp*BP[Mu];
+           FP[Mu] = XP[Mu] - Qb[Mu];
+           R[Mu]  = X[Mu] - XP[Mu];
+         };
+        VecCross(F, FP, FxFP);
+
+        Record->R[n]      = VecNorm(R);
+        Record->hDot[n]   = w*wp*VecDot(F, FP);
+        Record->hTimes[n] = w*wp*VecDot(FxFP, R);
+      };
+   };
+
+  return Record;
+}
+
+/***************************************************************/
+/* compute panel-panel integrals from cached data. returns     */
+/* false if the cache cannot be used for this panel pair at    */
+/* this wavenumber, in which case the caller must compute the  */
+/* integrals from scratch.                                     */
+/***************************************************************/
+static bool GetPPIs_Cached(GetPPIArgStruct *Args)
+{
+  CubatureCache *CC=(CubatureCache *)Args->opCC;
+
+  CCRecord *Record=CC->GetRecord(Args->Sa, Args->npa, Args->iQa,
+                                 Args->Sb, Args->npb, Args->iQb);
+  if (Record==0)
+   { Record=ComputeCCRecord(CC, Args);
+     if (Record==0)
+      return false;
+     Record=CC->AddRecord(Args->Sa, Args->npa, Args->iQa,
+                          Args->Sb, Args->npb, Args->iQb, Record);
+   };
+
+  /***************************************************************/
+  /* make the same choice of algorithm that                      */
+  /* GetPanelPanelInteractions() would make                      */
+  /***************************************************************/
+  cdouble k=Args->k;
+  bool DeSingularize = (Record->Type==CCREC_DESING);
+  if (Record->Type==CCREC_NONE)
+   return false;
+  if ( DeSingularize && abs(k*Record->RMax) > SWTHRESHOLD )
+   return false;
+  if ( DeSingularize && Record->ncv>0 && Args->ForceTaylorDuffy )
+   return false;
+
+  /***************************************************************/
+  /* the only thing left to do is evaluate the kernel at the     */
+  /* cached point-point distances                                */
+  /***************************************************************/
+  cdouble ik=II*k, FourOverIK2=4.0/(ik*ik);
+  int NumPairs=CC->NumPts*CC->NumPts;
+  double Phi[2*PPI_BATCHSIZE], Psi[2*PPI_BATCHSIZE];
+  cdouble H[2]={0.0, 0.0};
+  for(int nPairStart=0; nPairStart<NumPairs; nPairStart+=PPI_BATCHSIZE)
+   { int N = NumPairs - nPairStart;
+     if (N>PPI_BATCHSIZE) N=PPI_BATCHSIZE;
+     GetHelmholtzKernels(N, k, Record->R + nPairStart, 0, DeSingularize, Phi, Psi);
+     H[0] +=  KernelDot(N, Phi, Record->hDot + nPairStart)
+             +FourOverIK2*KernelDot(N, Phi, CC->WW + nPairStart);
+     H[1] +=  KernelDot(N, Psi, Record->hTimes + nPairStart);
+   };
+
+  if (DeSingularize)
+   { AddFIPPIContributions(k, &(Record->QDFD), H);
+     Args->WhichAlgorithm=PPIALG_DESING;
+   }
+  else
+   Args->WhichAlgorithm=PPIALG_LOCUBATURE;
+
+  Args->H[0]=H[0];
+  Args->H[1]=H[1];
+  return true;
+}
+
 /***************************************************************/
 /* calculate integrals over a single pair of triangles using   */
 /* one of several different methods based on how near the two  */
 /* triangles are to each other.                                */
 /***************************************************************/
-void GetPanelPanelInteractions(GetPPIArgStruct *Args)
+static void ComputePanelPanelInteractions(GetPPIArgStruct *Args)
 { 
   /***************************************************************/
   /* local copies of fields in argument structure ****************/
@@ -373,6 +677,15 @@ void GetPanelPanelInteractions(GetPPIArgStruct *Args)
   cdouble *GradH            = Args->GradH;
   cdouble *dHdT             = Args->dHdT;
 
+  /***************************************************************/
+  /* if we have a cache of frequency-independent cubature data   */
+  /* and don't need derivatives, try that first                  */
+  /***************************************************************/
+  if (    Args->opCC && Args->GBA==0 && Displacement==0
+       && NumGradientComponents==0 && NumTorqueAxes==0
+       && GetPPIs_Cached(Args)
+     ) return;
+
   /***************************************************************/
   /* extract panel vertices, detect common vertices, measure     */
   /* relative distance                                           */
@@ -531,26 +844,7 @@ void GetPanelPanelInteractions(GetPPIArgStruct *Args)
    GetQDFIPPIData(Va, Qa, Vb, Qb, ncv, &GlobalFIPPICache, QDFD);
 
   // step 3
-  // note: PF[n] = (ik)^n / (4\pi)
-  cdouble ik=II*k; 
-  cdouble OOIK2=1.0/(ik*ik);
-  cdouble PF[5];
-  PF[0]=1.0/(4.0*M_PI);
-  PF[1]=ik*PF[0];
-  PF[2]=ik*PF[1];
-  PF[3]=ik*PF[2];
-  PF[4]=ik*PF[3];
-
-  // add contributions to panel-panel integrals
-  H[0] +=  PF[0]*AA0*( QDFD->hDotRM1 + OOIK2*QDFD->hNablaRM1)
-          +PF[1]*AA1*( QDFD->hDotR0  + OOIK2*QDFD->hNablaR0 )
-          +PF[2]*AA2*( QDFD->hDotR1  + OOIK2*QDFD->hNablaR1 )
-          +PF[3]*AA3*( QDFD->hDotR2  + OOIK2*QDFD->hNablaR2 );
-  
-  H[1] +=  PF[0]*BB0*QDFD->hTimesRM3
-          +PF[2]*BB2*QDFD->hTimesRM1
-          +PF[3]*BB3*QDFD->hTimesR0 
-          +PF[4]*BB4*QDFD->hTimesR1;
+  AddFIPPIContributions(k, QDFD, H);
 
   // restore derivative integrals as necessary 
   if (NumGradientComponents>0)
@@ -560,6 +854,54 @@ void GetPanelPanelInteractions(GetPPIArgStruct *Args)
 
 } 
 
+/***************************************************************/
+/* returns true if the panel pair described by Args is one    */
+/* whose integrals may be stored in a PPIMemo: the pair must   */
+/* be near enough to need singularity handling (far pairs are  */
+/* cheap, and rarely repeat exactly), and the integrals must    */
+/* depend only on the relative geometry of the panels, which   */
+/* rules out the periodic kernel and torque derivatives.       */
+/***************************************************************/
+static bool UsePPIMemo(GetPPIArgStruct *Args)
+{
+  if ( Args->opPM==0 || Args->GBA || Args->NumTorqueAxes>0 )
+   return false;
+
+  RWGPanel *Pa = Args->Sa->Panels[Args->npa];
+  RWGPanel *Pb = Args->Sb->Panels[Args->npb];
+  double DC[3]; // 'delta centroid'
+  VecSub(Pa->Centroid, Pb->Centroid, DC);
+  if (Args->Displacement)
+   VecPlusEquals(DC, -1.0, Args->Displacement);
+
+  double rMax = fmax(Pa->Radius, Pb->Radius);
+  return VecNorm(DC) <= DESINGULARIZATION_RADIUS*rMax;
+}
+
+/***************************************************************/
+/* main entry point: look the panel pair up in the PPI memo if */
+/* there is one, and otherwise compute the integrals (and      */
+/* store them in the memo)                                     */
+/***************************************************************/
+void GetPanelPanelInteractions(GetPPIArgStruct *Args)
+{ 
+  if ( !UsePPIMemo(Args) )
+   { ComputePanelPanelInteractions(Args);
+     return;
+   };
+
+  PPIMemo *Memo=(PPIMemo *)Args->opPM;
+  PMKey Key;
+  Memo->GetKey(Args, &Key);
+  if ( Memo->GetRecord(&Key, Args) )
+   { Args->WhichAlgorithm=PPIALG_MEMO;
+     return;
+   };
+
+  ComputePanelPanelInteractions(Args);
+  Memo->AddRecord(&Key, Args);
+}
+
 /***************************************************************/
 /* this is an alternate entry point to GetPanelPanelInteractions*/
 /* that copies the results out of the structure body into      */
@@ -589,6 +931,8 @@ void InitGetPPIArgs(GetPPIArgStruct *Args)
   Args->ForceTaylorDuffy = RWGGeometry::DisableCache;
   Args->GammaMatrix=0;
   Args->opFC=0;
+  Args->opCC=0;
+  Args->opPM=0;
   Args->Displacement=0;
   Args->GBA=0;
   Args->ForceFullEwald=false;
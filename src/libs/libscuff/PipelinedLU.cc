@@ -0,0 +1,396 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * PipelinedLU.cc -- libscuff routine for assembling and LU-factorizing
+ *                -- the BEM matrix in a single pass, overlapping the
+ *                -- factorization of the leading columns of the matrix
+ *                -- with the assembly of the remaining columns
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <libhmat.h>
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
+// approximate number of basis functions per tile
+#define PIPELINE_TILESIZE 256
+
+namespace scuff {
+
+/***************************************************************/
+/* The matrix is divided into NT x NT tiles; tile boundaries   */
+/* fall between edges but not necessarily between surfaces, so */
+/* the rows of a tile are a list of segments, each consisting  */
+/* of a range of edges on a single surface.                    */
+/*                                                             */
+/* The work is a graph of tasks executed by a single team of   */
+/* threads:                                                    */
+/*                                                             */
+/*  (a) one assembly task for each tile pair (I,J) with I<=J,  */
+/*      which computes tile (I,J) and (the BEM matrix being    */
+/*      symmetric) copies its transpose into tile (J,I), or    */
+/*      for I==J computes the upper triangle of the tile and   */
+/*      copies it into the lower triangle. the tasks are       */
+/*      created row by row, so that column panel #K (all tiles */
+/*      in column K) is complete once rows 0..K have been      */
+/*      assembled.                                             */
+/*                                                             */
+/*  (b) column tasks, which carry a completely assembled       */
+/*      column panel through a left-looking LU factorization:  */
+/*      updates from panels 0,1,...,K-1 are applied in order   */
+/*      as soon as each of those panels has been factorized,   */
+/*      and then the panel itself is factorized.               */
+/*                                                             */
+/* A column task runs until it needs a panel that has not yet  */
+/* been factorized, at which point it goes idle; whoever       */
+/* factorizes that panel resumes the waiting columns. Thus the */
+/* factorization of the leading panels proceeds while the      */
+/* trailing panels are still being assembled, and idle threads */
+/* are always available to assembly tasks.                     */
+/***************************************************************/
+typedef struct PLSegment
+ { int ns, neStart, neEnd;
+ } PLSegment;
+
+typedef struct PipelineData
+ {
+   RWGGeometry *G;
+   cdouble Omega;
+   HMatrix *M;
+
+   int NT;            // number of tiles per dimension
+   int *TileStart;    // first row/column of each tile; TileStart[NT]=N
+   PLSegment *Segments;
+   int *SegStart;     // segments of tile #I are SegStart[I]..SegStart[I+1]-1
+
+   // per-column-panel state, protected by Lock
+   int *Pending;      // number of unfinished assembly tasks writing to panel
+   int *NextPanel;    // index of next panel update to be applied
+   bool *Busy;        // true while a column task is working on the panel
+   int NumFactored;   // panels 0..NumFactored-1 are factorized
+   int Info;          // first nonzero LAPACK info code
+   rwlock Lock;
+
+ } PipelineData;
+
+/***************************************************************/
+/* divide the BFs into tiles of roughly PIPELINE_TILESIZE      */
+/***************************************************************/
+static void CreateTiles(PipelineData *PD)
+{
+  RWGGeometry *G = PD->G;
+
+  int MaxTiles = G->TotalBFs/PIPELINE_TILESIZE + 1;
+  PD->TileStart = (int *)mallocEC( (MaxTiles+1)*sizeof(int) );
+  PD->SegStart  = (int *)mallocEC( (MaxTiles+1)*sizeof(int) );
+  PD->Segments  = (PLSegment *)mallocEC( (MaxTiles+G->NumSurfaces)*sizeof(PLSegment) );
+
+  int NT=0, NumSegments=0, TileBFs=0;
+  PD->TileStart[0]=PD->SegStart[0]=0;
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   { RWGSurface *S=G->Surfaces[ns];
+     int BFPE = S->IsPEC ? 1 : 2;
+     for(int ne=0; ne<S->NumEdges; )
+      { int NumEdges = (PIPELINE_TILESIZE - TileBFs + BFPE - 1) / BFPE;
+        if (NumEdges > S->NumEdges - ne)
+         NumEdges = S->NumEdges - ne;
+        PLSegment *Seg = PD->Segments + NumSegments++;
+        Seg->ns      = ns;
+        Seg->neStart = ne;
+        Seg->neEnd   = ne + NumEdges;
+        ne      += NumEdges;
+        TileBFs += BFPE*NumEdges;
+        if (TileBFs >= PIPELINE_TILESIZE)
+         { NT++;
+           PD->TileStart[NT] = PD->TileStart[NT-1] + TileBFs;
+           PD->SegStart[NT]  = NumSegments;
+           TileBFs=0;
+         };
+      };
+   };
+  if (TileBFs>0)
+   { NT++;
+     PD->TileStart[NT] = PD->TileStart[NT-1] + TileBFs;
+     PD->SegStart[NT]  = NumSegments;
+   };
+  PD->NT=NT;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+static void AdvanceColumn(PipelineData *PD, int C);
+
+/***************************************************************/
+/* task (a): assemble tile (I,J) and its transpose (J,I)       */
+/***************************************************************/
+static void AssembleTilePair(PipelineData *PD, int I, int J)
+{
+  RWGGeometry *G = PD->G;
+  HMatrix *M     = PD->M;
+  int N          = M->NR;
+
+  int RowStart=PD->TileStart[I], NumRows=PD->TileStart[I+1]-RowStart;
+  int ColStart=PD->TileStart[J], NumCols=PD->TileStart[J+1]-ColStart;
+  M->ZeroBlock(RowStart, NumRows, ColStart, NumCols);
+
+  // on diagonal tiles we only compute the upper triangle, as
+  // AssembleBEMMatrix() does for diagonal blocks, and fill in
+  // the lower triangle below
+  for(int nsga=PD->SegStart[I]; nsga<PD->SegStart[I+1]; nsga++)
+   for(int nsgb=(I==J ? nsga : PD->SegStart[J]); nsgb<PD->SegStart[J+1]; nsgb++)
+    { PLSegment *SegA=PD->Segments + nsga, *SegB=PD->Segments + nsgb;
+      GetSSIArgStruct GetSSIArgs, *Args=&GetSSIArgs;
+      InitGetSSIArgs(Args);
+      Args->G         = G;
+      Args->Sa        = G->Surfaces[SegA->ns];
+      Args->Sb        = G->Surfaces[SegB->ns];
+      Args->Omega     = PD->Omega;
+      Args->B         = M;
+      Args->RowOffset = G->BFIndexOffset[SegA->ns];
+      Args->ColOffset = G->BFIndexOffset[SegB->ns];
+      Args->Symmetric = (nsga==nsgb);
+      GetSurfaceSurfaceInteractionsTile(Args, SegA->neStart, SegA->neEnd,
+                                              SegB->neStart, SegB->neEnd);
+    };
+
+  for(int nc=ColStart; nc<ColStart+NumCols; nc++)
+   for(int nr=RowStart; nr<(I==J ? nc : RowStart+NumRows); nr++)
+    M->ZM[ nc + ((size_t)nr)*N ] = M->ZM[ nr + ((size_t)nc)*N ];
+
+  // column panels I and J are now one assembly task closer to
+  // being ready for factorization
+  bool ReadyI=false, ReadyJ=false;
+  PD->Lock.write_lock();
+  ReadyJ = ( --(PD->Pending[J]) == 0 );
+  if (I!=J)
+   ReadyI = ( --(PD->Pending[I]) == 0 );
+  PD->Lock.write_unlock();
+
+  if (ReadyI) AdvanceColumn(PD, I);
+  if (ReadyJ) AdvanceColumn(PD, J);
+}
+
+/***************************************************************/
+/* task (b): carry column panel C as far through the           */
+/* factorization as the currently factorized panels allow. if  */
+/* C itself gets factorized, resume all columns that were      */
+/* waiting on it, continuing directly with column C+1 (which   */
+/* is on the critical path) and spawning new tasks for others. */
+/***************************************************************/
+static void AdvanceColumn(PipelineData *PD, int C)
+{
+  HMatrix *M     = PD->M;
+  int *TileStart = PD->TileStart;
+  int NT         = PD->NT;
+  int *Resume    = new int[NT];
+
+  while( C!=-1 )
+   {
+     PD->Lock.write_lock();
+     if ( PD->Busy[C] || PD->Pending[C]>0 )
+      { PD->Lock.write_unlock();
+        break;
+      };
+     PD->Busy[C]=true;
+
+     int ColStart=TileStart[C], NumCols=TileStart[C+1]-ColStart;
+     int K;
+     while( (K=PD->NextPanel[C]) < C && K < PD->NumFactored )
+      { PD->Lock.write_unlock();
+        M->PanelLUUpdate(TileStart[K], TileStart[K+1]-TileStart[K], ColStart, NumCols);
+        PD->Lock.write_lock();
+        PD->NextPanel[C]++;
+      };
+
+     if (K<C) // waiting for panel K to be factorized
+      { PD->Busy[C]=false;
+        PD->Lock.write_unlock();
+        break;
+      };
+
+     PD->Lock.write_unlock();
+     int Info=M->PanelLUFactorize(ColStart, NumCols);
+     PD->Lock.write_lock();
+     if (Info!=0 && PD->Info==0)
+      PD->Info=Info;
+     PD->NextPanel[C]++;
+     PD->NumFactored=C+1;
+     PD->Busy[C]=false;
+
+     int NumResume=0;
+     for(int CP=C+1; CP<NT; CP++)
+      if ( !PD->Busy[CP] && PD->Pending[CP]==0 && PD->NextPanel[CP]==C )
+       Resume[NumResume++]=CP;
+     PD->Lock.write_unlock();
+
+     // tasks are only spawned with the lock released, since
+     // the runtime may choose to execute them immediately
+     int nrStart = (NumResume>0 && Resume[0]==C+1) ? 1 : 0;
+     for(int nr=nrStart; nr<NumResume; nr++)
+      { int CP=Resume[nr];
+#ifdef USE_OPENMP
+#pragma omp task firstprivate(CP)
+#endif
+        AdvanceColumn(PD, CP);
+      };
+     C = nrStart ? C+1 : -1;
+   };
+
+  delete[] Resume;
+}
+
+/***************************************************************/
+/* assemble the BEM matrix and replace it with its LU          */
+/* factorization, as would be obtained by AssembleBEMMatrix()  */
+/* followed by M->LUFactorize().                               */
+/*                                                             */
+/* the pipelined algorithm is used for compact geometries      */
+/* with full-storage matrices; geometries with periodic        */
+/* boundary conditions, substrates, surface impedances, or     */
+/* multi-material junctions, and builds without OpenMP, fall   */
+/* back to assembly followed by factorization. the pipelined   */
+/* algorithm does not reuse the diagonal blocks of mate        */
+/* surfaces or the on-disk T-block store.                      */
+/***************************************************************/
+HMatrix *RWGGeometry::AssembleAndFactorizeBEMMatrix(cdouble Omega, double *kBloch, HMatrix *M)
+{
+  if (M==NULL)
+   M=AllocateBEMMatrix();
+  else if ( M->NR != TotalBFs || M->NC != TotalBFs )
+   { Warn("wrong-size matrix passed to AssembleAndFactorizeBEMMatrix; reallocating...");
+     M=AllocateBEMMatrix();
+   };
+
+  bool Pipelined = (    LBasis==0
+                     && Substrate==0
+                     && !(UseHRWGFunctions && NumMMJs>0)
+                     && M->RealComplex==LHM_COMPLEX
+                     && M->StorageType==LHM_NORMAL
+                   );
+  for(int ns=0; ns<NumSurfaces; ns++)
+   if (Surfaces[ns]->SurfaceZeta)
+    Pipelined=false;
+#ifndef USE_OPENMP
+  Pipelined=false;
+#endif
+
+  if (!Pipelined)
+   { AssembleBEMMatrix(Omega, kBloch, M);
+     Log("  LU-factorizing BEM matrix...");
+     M->LUFactorize();
+     return M;
+   };
+
+  if ( kBloch!=0 && (kBloch[0]!=0.0 || kBloch[1]!=0.0) )
+   ErrExit("%s:%i: Bloch wavevector is undefined for compact geometries",__FILE__,__LINE__);
+
+  /***************************************************************/
+  /* set up tiles and task-graph state ***************************/
+  /***************************************************************/
+  PipelineData MyPD, *PD=&MyPD;
+  PD->G=this;
+  PD->Omega=Omega;
+  PD->M=M;
+  CreateTiles(PD);
+  int NT=PD->NT;
+
+  PD->Pending   = new int[NT];
+  PD->NextPanel = new int[NT];
+  PD->Busy      = new bool[NT];
+  for(int nt=0; nt<NT; nt++)
+   { PD->Pending[nt]   = NT; // tile pairs (I,nt) and (nt,J)
+     PD->NextPanel[nt] = 0;
+     PD->Busy[nt]      = false;
+   };
+  PD->NumFactored=0;
+  PD->Info=0;
+
+  Log("Assembling and LU-factorizing BEM matrix at Omega=%s (%i tiles)",z2s(Omega),NT);
+
+  /***************************************************************/
+  /* the tile assembly tasks do not touch any shared state, so   */
+  /* the frequency-dependent material properties and the caches */
+  /* used by GetSurfaceSurfaceInteractions() are set up here     */
+  /***************************************************************/
+  UpdateCachedEpsMuValues(Omega);
+  if (CCache)
+   for(int nsa=0; nsa<NumSurfaces; nsa++)
+    for(int nsb=0; nsb<NumSurfaces; nsb++)
+     CCache->PrepareBlock(Surfaces[nsa], Surfaces[nsb]);
+  if (PMemo)
+   PMemo->PrepareFrequency(Omega);
+
+  M->InitPanelLU();
+
+  /***************************************************************/
+  /* run the task graph ******************************************/
+  /***************************************************************/
+#ifdef USE_OPENMP
+#pragma omp parallel num_threads(GetNumThreads())
+ {
+#pragma omp single
+  for(int I=0; I<NT; I++)
+   for(int J=I; J<NT; J++)
+    {
+#pragma omp task firstprivate(I,J)
+      AssembleTilePair(PD, I, J);
+    };
+ }
+#endif
+
+  if (PD->NumFactored!=NT)
+   ErrExit("%s:%i: internal error (%i/%i panels factorized)",__FILE__,__LINE__,PD->NumFactored,NT);
+
+  M->FinishPanelLU(NT, PD->TileStart);
+  if (PD->Info>0)
+   Warn("BEM matrix is singular (zero pivot in row %i)",PD->Info);
+
+  free(PD->TileStart);
+  free(PD->SegStart);
+  free(PD->Segments);
+  delete[] PD->Pending;
+  delete[] PD->NextPanel;
+  delete[] PD->Busy;
+
+  return M;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+HMatrix *RWGGeometry::AssembleAndFactorizeBEMMatrix(cdouble Omega, HMatrix *M)
+{
+  return AssembleAndFactorizeBEMMatrix(Omega, 0, M);
+}
+
+} // namespace scuff
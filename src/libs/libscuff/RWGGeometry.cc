@@ -35,6 +35,7 @@
 #include <BZIntegration.h> // needed for GetRLBasis
 
 #include "libscuff.h"
+#include "libscuffInternals.h"
 
 namespace scuff {
 
@@ -49,6 +50,9 @@ bool RWGGeometry::UseHRWGFunctions=false;
 bool RWGGeometry::UseHighKTaylorDuffy=true;
 bool RWGGeometry::UseTaylorDuffyV2P0=true;
 bool RWGGeometry::DisableCache=false;
+bool RWGGeometry::BulkFIBBIs=false;
+double RWGGeometry::CubatureCacheMB=512.0;
+double RWGGeometry::PPIMemoMB=256.0;
 int RWGGeometry::NumMeshDirs=0;
 char **RWGGeometry::MeshDirs=0;
 
@@ -435,6 +439,23 @@ RWGGeometry::RWGGeometry(const char *pGeoFileName, int pLogLevel)
      RWGGeometry::DisableCache=true;
    };
 
+  if ( (s=getenv("SCUFF_CUBATURE_CACHE_MB")) )
+   { if ( 1!=sscanf(s,"%le",&CubatureCacheMB) || CubatureCacheMB<0.0 )
+      ErrExit("invalid value %s for SCUFF_CUBATURE_CACHE_MB",s);
+     Log("Capping cubature cache at %g MB.",CubatureCacheMB);
+   };
+
+  if ( (s=getenv("SCUFF_PPI_MEMO_MB")) )
+   { if ( 1!=sscanf(s,"%le",&PPIMemoMB) || PPIMemoMB<0.0 )
+      ErrExit("invalid value %s for SCUFF_PPI_MEMO_MB",s);
+     Log("Capping panel-panel integral memo at %g MB.",PPIMemoMB);
+   };
+
+  if ( (s=getenv("SCUFF_BULK_FIBBI")) && (s[0]=='1') )
+   { Log("Precomputing FIBBI records for all neighboring edge pairs.");
+     RWGGeometry::BulkFIBBIs=true;
+   };
+
   if ( (s= getenv("SCUFF_HALF_RWG")) && (s[0]=='1') )
    { Log("Assigning half-RWG basis functions to exterior edges.");
      RWGGeometry::UseHRWGFunctions=true;
@@ -848,6 +869,28 @@ RWGGeometry::RWGGeometry(const char *pGeoFileName, int pLogLevel)
     FIBBICaches[ns] = FIBBICaches[ Mate[ns] ];
    else
     FIBBICaches[ns] = CreateFIBBICache(Surfaces[ns]->MeshFileName);
+  if (BulkFIBBIs)
+   for(int ns=0; ns<NumSurfaces; ns++)
+    if (Mate[ns]==-1)
+     PrecomputeFIBBIData(FIBBICaches[ns], Surfaces[ns]);
+
+  /***************************************************************/
+  /* cache of frequency-independent cubature data, filled in the */
+  /* first time the BEM matrix is assembled                      */
+  /***************************************************************/
+  CCache=0;
+  if (CubatureCacheMB>0.0)
+   CCache=new CubatureCache(this, CubatureCacheMB);
+
+  /***************************************************************/
+  /* memo of complete panel-panel integrals for congruent panel  */
+  /* pairs, refilled at each new frequency                       */
+  /***************************************************************/
+  PMemo=0;
+  if (PPIMemoMB>0.0)
+   PMemo=new PPIMemo(this, PPIMemoMB);
+
+  GBAPool=0;
 
 }
 
@@ -873,13 +916,23 @@ RWGGeometry::~RWGGeometry()
   free(PanelIndexOffset);
   free(EpsTF);
   free(MuTF);
-  free(Mate);
   free(SurfaceMoved);
   free(GeoFileName);
 
+  // mated surfaces share the FIBBI cache of their mate
   for(int ns=0; ns<NumSurfaces; ns++)
-   DestroyFIBBICache(FIBBICaches[ns]);
+   if (Mate[ns]==-1)
+    DestroyFIBBICache(FIBBICaches[ns]);
   free(FIBBICaches);
+  free(Mate);
+
+  if (CCache)
+   delete CCache;
+
+  if (PMemo)
+   delete PMemo;
+
+  ClearGBAPool();
 
 }
 
@@ -79,7 +79,7 @@ void RWGSurface::UpdateBoundingBox()
 RWGSurface::RWGSurface(FILE *f, const char *pLabel, int *LineNum, char *Keyword)
 { 
   ErrMsg=0;
-  SurfaceZeta=0;
+  SurfaceZeta=SurfaceZetaProgram=0;
   MeshTag=-1;
   MeshFileName=0;
   IsPEC=1;
@@ -233,6 +233,13 @@ RWGSurface::RWGSurface(FILE *f, const char *pLabel, int *LineNum, char *Keyword)
         cevaluator_set_var_index(SurfaceZeta, "y", 2);
         cevaluator_set_var_index(SurfaceZeta, "z", 3);
 
+        char *ZetaVars[4]={ const_cast<char *>("w"),
+                            const_cast<char *>("x"),
+                            const_cast<char *>("y"),
+                            const_cast<char *>("z")
+                          };
+        SurfaceZetaProgram=cevaluator_compile(SurfaceZeta, 4, ZetaVars);
+
       }
      else if (   !StrCaseCmp(Tokens[0],"ENDOBJECT") || !StrCaseCmp(Tokens[0],"ENDSURFACE") )
       { 
@@ -275,7 +282,7 @@ RWGSurface::RWGSurface(const char *MeshFile, int pMeshTag)
   MeshFileName=strdup(MeshFile);
   MeshTag=pMeshTag;
   Label=strdup(MeshFile);
-  SurfaceZeta=0;
+  SurfaceZeta=SurfaceZetaProgram=0;
   MaterialName=0;
   RegionLabels[0]=RegionLabels[1]=0;
   IsPEC=1;
@@ -462,6 +469,7 @@ RWGSurface::RWGSurface(double *pVertices, int pNumVertices,
 
   MeshFileName=strdupEC("ByHand.msh");
   Label=strdupEC("ByHand");
+  SurfaceZeta=SurfaceZetaProgram=0;
 
   NumEdges=0;
   NumVertices=pNumVertices;
@@ -558,8 +566,11 @@ RWGSurface::~RWGSurface()
    free(Panels[np]);
   free(Panels);
 
+  // half-RWG edges (iQM==-1) live in both Edges and ExteriorEdges;
+  // free them only once, below
   for(int ne=0; ne<NumEdges; ne++)
-   free(Edges[ne]);
+   if (Edges[ne]->iQM!=-1)
+    free(Edges[ne]);
   free(Edges);
 
   for(int ne=0; ne<NumExteriorEdges; ne++)
@@ -579,12 +590,52 @@ RWGSurface::~RWGSurface()
   if (OTGT) delete OTGT;
 
   if (MaterialName) free(MaterialName);
+  if (SurfaceZetaProgram) cevaluator_program_destroy(SurfaceZetaProgram);
   if (RegionLabels[0]) free(RegionLabels[0]);
   if (RegionLabels[1]) free(RegionLabels[1]);
 
   kdtri_destroy(kdPanels);
 }
 
+/***************************************************************/
+/* dimensionless surface impedance at frequency Omega, at one  */
+/* point or at many points at once. if the impedance does not  */
+/* depend on position, it is evaluated only once.              */
+/***************************************************************/
+cdouble RWGSurface::GetSurfaceZeta(cdouble Omega, double *X)
+{
+  cdouble Zeta;
+  GetSurfaceZeta(Omega, 1, &X, &Zeta);
+  return Zeta;
+}
+
+void RWGSurface::GetSurfaceZeta(cdouble Omega, int NX, double **X, cdouble *Zeta)
+{
+  if (NX<=0) return;
+
+  cdouble w = Omega*MatProp::FreqUnit;
+  if (    !cevaluator_program_uses(SurfaceZetaProgram, 1)
+       && !cevaluator_program_uses(SurfaceZetaProgram, 2)
+       && !cevaluator_program_uses(SurfaceZetaProgram, 3)
+     )
+   { cdouble ParmValues[4]={w, 0.0, 0.0, 0.0};
+     cdouble Zeta0=cevaluator_program_evaluate(SurfaceZetaProgram, ParmValues);
+     for(int nx=0; nx<NX; nx++)
+      Zeta[nx]=Zeta0;
+     return;
+   };
+
+  cdouble *ParmValues = new cdouble[4*NX];
+  for(int nx=0; nx<NX; nx++)
+   { ParmValues[4*nx + 0] = w;
+     ParmValues[4*nx + 1] = X[nx][0];
+     ParmValues[4*nx + 2] = X[nx][1];
+     ParmValues[4*nx + 3] = X[nx][2];
+   };
+  cevaluator_program_evaluate_many(SurfaceZetaProgram, NX, ParmValues, 4, Zeta);
+  delete[] ParmValues;
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -54,6 +54,19 @@ namespace scuff {
 
 void AddSubstrateSSI(GetSSIArgStruct *Args);
 
+/***************************************************************/
+/* add an entry to the BEM matrix, skipping entries below the  */
+/* diagonal if B uses packed storage: callers add both (a,b)   */
+/* and (b,a), but packed storage would fold (b,a) onto (a,b)   */
+/* and count the entry twice.                                  */
+/***************************************************************/
+static inline void AddBEMEntry(HMatrix *B, int nr, int nc, cdouble Entry)
+{
+  if (B->StorageType!=LHM_NORMAL && nr>nc)
+   return;
+  B->AddEntry(nr, nc, Entry);
+}
+
 /***************************************************************/
 /* Given two surfaces, identify whether they bound zero, one,  */
 /* or two common regions. If there are any common regions,     */
@@ -91,14 +104,339 @@ int CountCommonRegions(RWGSurface *Sa, RWGSurface *Sb,
 
 }
 
+/***************************************************************/
+/* Work scheduling for GetSurfaceSurfaceInteractions.          */
+/*                                                             */
+/* The (nea,neb) edge-pair space is partitioned into tiles of  */
+/* SSI_TILESIZE x SSI_TILESIZE edge pairs. Before tiling, the  */
+/* edges of each surface are sorted along a Morton (Z-order)   */
+/* curve through their centroids, so each tile contains edges  */
+/* that are close to one another and the panel data they touch */
+/* stay in cache.                                              */
+/*                                                             */
+/* Each tile is assigned a cost predicted from the PPI         */
+/* algorithms its edge pairs will need (cheap low-order        */
+/* cubature for distant pairs, more expensive methods for      */
+/* nearby or touching pairs). The tile list is cut into one    */
+/* contiguous chunk of roughly equal cost per thread; each     */
+/* thread works through its own chunk from the front, and a    */
+/* thread that runs out of work steals tiles from the back of  */
+/* the busiest remaining chunk.                                */
+/***************************************************************/
+#define SSI_TILESIZE 32
+
+// relative costs of the various PPI algorithms, used only
+// to weight tiles for load balancing
+#define SSICOST_FAR    1.0   // low-order cubature
+#define SSICOST_NEAR   6.0   // high-order cubature or desingularization
+#define SSICOST_TD    40.0   // taylor-duffy
+
+// edge pairs whose relative distance exceeds this value are
+// assumed to be handled by low-order cubature; this is the
+// panel-panel DESINGULARIZATION_RADIUS in PanelPanelInteractions.cc
+// plus a margin for the edge radius exceeding the panel radii
+#define SSI_FARTHRESHOLD 6.0
+
+typedef struct SSITile
+ { int iaStart, iaEnd;   // range of positions in edge ordering for Sa
+   int ibStart, ibEnd;   // range of positions in edge ordering for Sb
+   double Cost;
+ } SSITile;
+
+typedef struct SSITileQueue
+ { int Head, Tail;       // next tile for the owner / one past last tile
+   rwlock Lock;
+ } SSITileQueue;
+
+typedef struct SSISchedule
+ { int *OrderA, *OrderB; // edge orderings for Sa, Sb
+   SSITile *Tiles;
+   int NumTiles;
+   SSITileQueue *Queues;
+   int NumQueues;
+ } SSISchedule;
+
+/***************************************************************/
+/* sort the edges of a surface along a Morton curve through    */
+/* their centroids                                             */
+/***************************************************************/
+typedef struct MortonKey
+ { unsigned long Key;
+   int ne;
+ } MortonKey;
+
+static int CompareMortonKeys(const void *p1, const void *p2)
+{
+  const MortonKey *K1=(const MortonKey *)p1;
+  const MortonKey *K2=(const MortonKey *)p2;
+  if (K1->Key < K2->Key) return -1;
+  if (K1->Key > K2->Key) return +1;
+  return K1->ne - K2->ne;
+}
+
+static unsigned long SpreadBits(unsigned long x)
+{
+  unsigned long Result=0;
+  for(int nb=0; nb<21; nb++)
+   Result |= ((x>>nb)&1UL) << (3*nb);
+  return Result;
+}
+
+static void GetMortonOrdering(RWGSurface *S, int neStart, int neEnd, int *Order)
+{
+  int NE=neEnd-neStart;
+
+  double XMin[3], XMax[3];
+  for(int i=0; i<3; i++)
+   { XMin[i]=HUGE_VAL; XMax[i]=-HUGE_VAL; }
+  for(int ne=neStart; ne<neEnd; ne++)
+   for(int i=0; i<3; i++)
+    { XMin[i] = fmin(XMin[i], S->Edges[ne]->Centroid[i]);
+      XMax[i] = fmax(XMax[i], S->Edges[ne]->Centroid[i]);
+    };
+
+  MortonKey *Keys=(MortonKey *)mallocEC(NE*sizeof(MortonKey));
+  for(int n=0; n<NE; n++)
+   { double *X=S->Edges[neStart+n]->Centroid;
+     unsigned long Key=0;
+     for(int i=0; i<3; i++)
+      { double Width = XMax[i] - XMin[i];
+        unsigned long q = (Width==0.0) ? 0 :
+                          (unsigned long)( 2097151.0*(X[i]-XMin[i])/Width );
+        Key |= SpreadBits(q) << i;
+      };
+     Keys[n].Key=Key;
+     Keys[n].ne=neStart+n;
+   };
+  qsort(Keys, NE, sizeof(MortonKey), CompareMortonKeys);
+
+  for(int n=0; n<NE; n++)
+   Order[n]=Keys[n].ne;
+  free(Keys);
+}
+
+/***************************************************************/
+/* bounding sphere of a range of edges in an edge ordering;    */
+/* MaxEdgeRadius is the largest radius of any edge in range.   */
+/***************************************************************/
+static void GetTileBounds(RWGSurface *S, int *Order, int iStart, int iEnd,
+                          double *Displacement, double Center[3],
+                          double *Radius, double *MaxEdgeRadius)
+{
+  Center[0]=Center[1]=Center[2]=0.0;
+  for(int i=iStart; i<iEnd; i++)
+   VecPlusEquals(Center, 1.0/((double)(iEnd-iStart)),
+                 S->Edges[Order[i]]->Centroid);
+  if (Displacement)
+   VecPlusEquals(Center, 1.0, Displacement);
+
+  *Radius=*MaxEdgeRadius=0.0;
+  for(int i=iStart; i<iEnd; i++)
+   { RWGEdge *E=S->Edges[Order[i]];
+     double X[3];
+     VecCopy(E->Centroid, X);
+     if (Displacement)
+      VecPlusEquals(X, 1.0, Displacement);
+     *Radius        = fmax(*Radius, VecDistance(X, Center) + E->Radius);
+     *MaxEdgeRadius = fmax(*MaxEdgeRadius, E->Radius);
+   };
+}
+
+/***************************************************************/
+/* predicted cost of computing all edge-pair interactions in   */
+/* a tile                                                      */
+/***************************************************************/
+static double GetTileCost(GetSSIArgStruct *Args, SSISchedule *Schedule,
+                          SSITile *T)
+{
+  RWGSurface *Sa = Args->Sa;
+  RWGSurface *Sb = Args->Sb;
+  int *OrderA    = Schedule->OrderA;
+  int *OrderB    = Schedule->OrderB;
+  bool Symmetric = Args->Symmetric;
+  bool DiagonalTile = Symmetric && (T->iaStart==T->ibStart);
+
+  int NumPairs = (T->iaEnd - T->iaStart) * (T->ibEnd - T->ibStart);
+  if (DiagonalTile)
+   NumPairs = (NumPairs + (T->iaEnd-T->iaStart)) / 2;
+
+  // with the periodic (interpolated) kernel every panel pair
+  // is handled by low-order cubature
+  if (Args->GBA1 || Args->GBA2)
+   return NumPairs*SSICOST_FAR;
+
+  double CA[3], RA, ERA, CB[3], RB, ERB;
+  GetTileBounds(Sa, OrderA, T->iaStart, T->iaEnd, 0, CA, &RA, &ERA);
+  GetTileBounds(Sb, OrderB, T->ibStart, T->ibEnd, Args->Displacement,
+                CB, &RB, &ERB);
+  double Gap = VecDistance(CA, CB) - RA - RB;
+  if ( Gap > SSI_FARTHRESHOLD*fmax(ERA, ERB) )
+   return NumPairs*SSICOST_FAR;
+
+  // nearby tiles: classify each edge pair individually
+  double Cost=0.0;
+  for(int ia=T->iaStart; ia<T->iaEnd; ia++)
+   for(int ib=T->ibStart; ib<T->ibEnd; ib++)
+    {
+      int nea=OrderA[ia], neb=OrderB[ib];
+      if (DiagonalTile && neb<nea) continue;
+
+      RWGEdge *Ea=Sa->Edges[nea], *Eb=Sb->Edges[neb];
+      double X[3];
+      VecCopy(Eb->Centroid, X);
+      if (Args->Displacement)
+       VecPlusEquals(X, 1.0, Args->Displacement);
+      double rRel = VecDistance(Ea->Centroid, X) / fmax(Ea->Radius, Eb->Radius);
+
+      if ( Sa==Sb && Args->Displacement==0 && AssessBFPair(Sa, nea, Sb, neb)>0 )
+       Cost+=SSICOST_TD;
+      else if ( rRel < SSI_FARTHRESHOLD )
+       Cost+=SSICOST_NEAR;
+      else
+       Cost+=SSICOST_FAR;
+    };
+
+  return Cost;
+}
+
+/***************************************************************/
+/* build the tile list and per-thread queues for the edge      */
+/* pairs (nea,neb) with neaStart<=nea<neaEnd and               */
+/* nebStart<=neb<nebEnd                                        */
+/***************************************************************/
+static SSISchedule *CreateSSISchedule(GetSSIArgStruct *Args, int NumQueues,
+                                      int neaStart, int neaEnd,
+                                      int nebStart, int nebEnd)
+{
+  RWGSurface *Sa = Args->Sa;
+  RWGSurface *Sb = Args->Sb;
+  bool Symmetric = Args->Symmetric;
+  int NA = neaEnd - neaStart;
+  int NB = nebEnd - nebStart;
+
+  SSISchedule *Schedule = new SSISchedule;
+
+  /*--------------------------------------------------------------*/
+  /*- spatially sort the edges on both surfaces                  -*/
+  /*--------------------------------------------------------------*/
+  Schedule->OrderA = new int[NA];
+  GetMortonOrdering(Sa, neaStart, neaEnd, Schedule->OrderA);
+  if (Sb==Sa && nebStart==neaStart && nebEnd==neaEnd)
+   Schedule->OrderB = Schedule->OrderA;
+  else
+   { Schedule->OrderB = new int[NB];
+     GetMortonOrdering(Sb, nebStart, nebEnd, Schedule->OrderB);
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- create tiles; for symmetric blocks we only need the tiles   */
+  /*- on and above the diagonal                                   */
+  /*--------------------------------------------------------------*/
+  int NTA = (NA + SSI_TILESIZE - 1) / SSI_TILESIZE;
+  int NTB = (NB + SSI_TILESIZE - 1) / SSI_TILESIZE;
+  Schedule->Tiles = new SSITile[NTA*NTB];
+  int NumTiles=0;
+  double TotalCost=0.0;
+  for(int nta=0; nta<NTA; nta++)
+   for(int ntb=(Symmetric ? nta : 0); ntb<NTB; ntb++)
+    { SSITile *T = Schedule->Tiles + NumTiles++;
+      T->iaStart = nta*SSI_TILESIZE;
+      T->iaEnd   = T->iaStart + SSI_TILESIZE;
+      if (T->iaEnd > NA) T->iaEnd = NA;
+      T->ibStart = ntb*SSI_TILESIZE;
+      T->ibEnd   = T->ibStart + SSI_TILESIZE;
+      if (T->ibEnd > NB) T->ibEnd = NB;
+      T->Cost    = GetTileCost(Args, Schedule, T);
+      TotalCost += T->Cost;
+    };
+  Schedule->NumTiles=NumTiles;
+
+  /*--------------------------------------------------------------*/
+  /*- cut the tile list into contiguous chunks of roughly equal   */
+  /*- predicted cost, one per queue                               */
+  /*--------------------------------------------------------------*/
+  Schedule->NumQueues = NumQueues;
+  Schedule->Queues = new SSITileQueue[NumQueues];
+  double CostPerQueue = TotalCost / ((double)NumQueues);
+  double RunningCost = 0.0;
+  int nTile=0;
+  for(int nq=0; nq<NumQueues; nq++)
+   { Schedule->Queues[nq].Head = nTile;
+     if (nq==NumQueues-1)
+      nTile=NumTiles;
+     else
+      while( nTile<NumTiles && RunningCost < (nq+1)*CostPerQueue )
+       RunningCost += Schedule->Tiles[nTile++].Cost;
+     Schedule->Queues[nq].Tail = nTile;
+   };
+
+  return Schedule;
+}
+
+static void DestroySSISchedule(SSISchedule *Schedule)
+{
+  if (Schedule->OrderB != Schedule->OrderA)
+   delete[] Schedule->OrderB;
+  delete[] Schedule->OrderA;
+  delete[] Schedule->Tiles;
+  delete[] Schedule->Queues;
+  delete Schedule;
+}
+
+/***************************************************************/
+/* fetch the next tile for queue #nq, stealing from the back   */
+/* of the fullest other queue if queue #nq is empty. returns   */
+/* -1 when no work remains anywhere.                           */
+/***************************************************************/
+static int GetNextSSITile(SSISchedule *Schedule, int nq)
+{
+  SSITileQueue *Queues = Schedule->Queues;
+  int NumQueues        = Schedule->NumQueues;
+
+  SSITileQueue *Q = Queues + nq;
+  int nTile=-1;
+  Q->Lock.write_lock();
+  if (Q->Head < Q->Tail)
+   nTile = Q->Head++;
+  Q->Lock.write_unlock();
+  if (nTile!=-1)
+   return nTile;
+
+  for(;;)
+   {
+     // find the victim with the most remaining tiles; the counts
+     // are read without locking, so they are only a hint
+     int Victim=-1, MaxRemaining=0;
+     for(int n=0; n<NumQueues; n++)
+      { int Remaining = Queues[n].Tail - Queues[n].Head;
+        if (Remaining > MaxRemaining)
+         { MaxRemaining=Remaining; Victim=n; }
+      };
+     if (Victim==-1)
+      return -1;
+
+     Q = Queues + Victim;
+     Q->Lock.write_lock();
+     if (Q->Head < Q->Tail)
+      nTile = --Q->Tail;
+     Q->Lock.write_unlock();
+     if (nTile!=-1)
+      return nTile;
+   };
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
 typedef struct ThreadData
- { 
+ {
    GetSSIArgStruct *Args;
+   SSISchedule *Schedule;
+   CubatureCache *CCache;
+   PPIMemo *PMemo;
    unsigned PPIAlgorithmCount[NUMPPIALGORITHMS];
    int nt, NumTasks;
+   bool LogProgress;
 
  } ThreadData;
 
@@ -151,6 +489,8 @@ void *GSSIThread(void *data)
   GetEEIArgs->NumTorqueAxes=NumTorqueAxes;
   GetEEIArgs->GammaMatrix=GammaMatrix;
   GetEEIArgs->Displacement=Displacement;
+  GetEEIArgs->opCC=TD->CCache;
+  GetEEIArgs->opPM=TD->PMemo;
 
   /* pointers to arrays inside the structure */
   cdouble *GC=GetEEIArgs->GC;
@@ -178,22 +518,57 @@ void *GSSIThread(void *data)
    };
 
   /***************************************************************/
-  /* loop over all internal edges on both objects.               */
+  /* thread-local tile buffers. matrix entries for all edge      */
+  /* pairs in a tile are accumulated into dense local arrays     */
+  /* (one for B and one for each nonzero GradB, dBdTheta) and    */
+  /* then added to the output matrices in a single call to      */
+  /* HMatrix::AddBlock once the tile is finished.                */
   /***************************************************************/
-  int nea, NEa=Sa->NumEdges;
-  int neb, NEb=Sb->NumEdges;
-  int X, Y, Mu, nt=0;
   int NumGradientComponents = GradB ? 3 : 0;
-  int nebStart = Symmetric ? 1 : 0;
-  for(nea=0; nea<NEa; nea++)
-   for(neb=nebStart*nea; neb<NEb; neb++)
-    { 
-      nt++;
-      if (nt==TD->NumTasks) nt=0;
-      if (nt!=TD->nt) continue;
+  int BFPEA = SaIsPEC ? 1 : 2; // basis functions per edge on Sa
+  int BFPEB = SbIsPEC ? 1 : 2; // basis functions per edge on Sb
+  int LDT = BFPEA*SSI_TILESIZE;
+  size_t TileSize = ((size_t)LDT)*BFPEB*SSI_TILESIZE;
+  int NumTileBuffers = 1 + NumGradientComponents + NumTorqueAxes;
+  cdouble *TileBuffers = (cdouble *)mallocEC(NumTileBuffers*TileSize*sizeof(cdouble));
+  cdouble *BT = TileBuffers, *GradBT[3], *dBdThetaT[3];
+  for(int Mu=0; Mu<NumGradientComponents; Mu++)
+   GradBT[Mu] = TileBuffers + (1+Mu)*TileSize;
+  for(int Mu=0; Mu<NumTorqueAxes; Mu++)
+   dBdThetaT[Mu] = TileBuffers + (1+NumGradientComponents+Mu)*TileSize;
+  int *RowIndices = new int[BFPEA*SSI_TILESIZE];
+  int *ColIndices = new int[BFPEB*SSI_TILESIZE];
+#define TI(x,y) ( (x) + LDT*(y) )
 
-      if (G->LogLevel>=SCUFF_VERBOSE2 && (neb==nebStart*nea) )
-       LogPercent(nea, NEa);
+  /***************************************************************/
+  /* loop over tiles of edge pairs handed out by the scheduler.  */
+  /* for symmetric blocks, tiles on the diagonal contain both    */
+  /* orderings of each edge pair and we keep only the one with   */
+  /* nea<=neb, while each off-diagonal tile contains exactly one */
+  /* ordering of each pair; entries that land in the lower       */
+  /* triangle are folded into the upper triangle by AddBlock.    */
+  /***************************************************************/
+  SSISchedule *Schedule = TD->Schedule;
+  int *OrderA = Schedule->OrderA;
+  int *OrderB = Schedule->OrderB;
+  int X, Y, Mu, nTile, NumTilesDone=0;
+  while( (nTile=GetNextSSITile(Schedule, TD->nt)) != -1 )
+   {
+     SSITile *T = Schedule->Tiles + nTile;
+     bool DiagonalTile = Symmetric && (T->iaStart==T->ibStart);
+
+     if (TD->LogProgress && G->LogLevel>=SCUFF_VERBOSE2 && TD->nt==0)
+      LogPercent(TD->NumTasks*(NumTilesDone++), Schedule->NumTiles);
+
+     for(size_t n=0; n<NumTileBuffers*TileSize; n++)
+      TileBuffers[n]=0.0;
+
+     for(int ia=T->iaStart; ia<T->iaEnd; ia++)
+      for(int ib=T->ibStart; ib<T->ibEnd; ib++)
+    {
+      int nea=OrderA[ia], neb=OrderB[ib];
+      if (DiagonalTile && neb<nea)
+       continue;
 
       /*--------------------------------------------------------------*/
       /*- contributions of first medium (EpsA, MuA)  -----------------*/
@@ -206,84 +581,84 @@ void *GSSIThread(void *data)
 
       if ( SaIsPEC && SbIsPEC )
        { 
-         X=RowOffset + nea;
-         Y=ColOffset + neb;  
+         X=ia-T->iaStart;
+         Y=ib-T->ibStart;  
 
-         B->AddEntry( X, Y, PreFac1A*GC[0] );
+         BT[TI(X,Y)] += PreFac1A*GC[0];
 
          for(Mu=0; Mu<NumGradientComponents; Mu++)
-          if (GradB[Mu]) GradB[Mu]->AddEntry( X, Y, PreFac1A*GradGC[2*Mu+0]);
+          if (GradB[Mu]) GradBT[Mu][TI(X,Y)] += PreFac1A*GradGC[2*Mu+0];
 
          for(Mu=0; Mu<NumTorqueAxes; Mu++)
-          dBdTheta[Mu]->AddEntry( X, Y, PreFac1A*dGCdT[2*Mu+0]);
+          dBdThetaT[Mu][TI(X,Y)] += PreFac1A*dGCdT[2*Mu+0];
 
        }
       else if ( SaIsPEC && !SbIsPEC )
        { 
-         X=RowOffset + nea;
-         Y=ColOffset + 2*neb;  
+         X=ia-T->iaStart;
+         Y=2*(ib-T->ibStart);  
 
-         B->AddEntry( X, Y,   PreFac1A*GC[0] );
-         B->AddEntry( X, Y+1, PreFac2A*GC[1] );
+         BT[TI(X,Y)]   += PreFac1A*GC[0];
+         BT[TI(X,Y+1)] += PreFac2A*GC[1];
 
          for(Mu=0; Mu<NumGradientComponents; Mu++)
           { if (!GradB[Mu]) continue;
-            GradB[Mu]->AddEntry( X, Y,   PreFac1A*GradGC[2*Mu+0]);
-            GradB[Mu]->AddEntry( X, Y+1, PreFac2A*GradGC[2*Mu+1]);
+            GradBT[Mu][TI(X,Y)]   += PreFac1A*GradGC[2*Mu+0];
+            GradBT[Mu][TI(X,Y+1)] += PreFac2A*GradGC[2*Mu+1];
           };
 
          for(Mu=0; Mu<NumTorqueAxes; Mu++)
-          { dBdTheta[Mu]->AddEntry( X, Y, PreFac1A*dGCdT[2*Mu+0]);
-            dBdTheta[Mu]->AddEntry( X, Y+1, PreFac2A*dGCdT[2*Mu+1]);
+          { dBdThetaT[Mu][TI(X,Y)] += PreFac1A*dGCdT[2*Mu+0];
+            dBdThetaT[Mu][TI(X,Y+1)] += PreFac2A*dGCdT[2*Mu+1];
           };
        }
       else if ( !SaIsPEC && SbIsPEC )
        {
-         X=RowOffset + 2*nea;
-         Y=ColOffset + neb;  
+         X=2*(ia-T->iaStart);
+         Y=ib-T->ibStart;  
 
-         B->AddEntry( X,   Y, PreFac1A*GC[0] );
-         B->AddEntry( X+1, Y, PreFac2A*GC[1] );
+         BT[TI(X,Y)] += PreFac1A*GC[0];
+         BT[TI(X+1,Y)] += PreFac2A*GC[1];
 
          for(Mu=0; Mu<NumGradientComponents; Mu++)
           { if (!GradB[Mu]) continue;
-            GradB[Mu]->AddEntry( X, Y,   PreFac1A*GradGC[2*Mu+0]);
-            GradB[Mu]->AddEntry( X+1, Y, PreFac2A*GradGC[2*Mu+1]);
+            GradBT[Mu][TI(X,Y)]   += PreFac1A*GradGC[2*Mu+0];
+            GradBT[Mu][TI(X+1,Y)] += PreFac2A*GradGC[2*Mu+1];
           };
 
          for(Mu=0; Mu<NumTorqueAxes; Mu++)
-          { dBdTheta[Mu]->AddEntry( X, Y,   PreFac1A*dGCdT[2*Mu+0]);
-            dBdTheta[Mu]->AddEntry( X+1, Y, PreFac2A*dGCdT[2*Mu+1]);
+          { dBdThetaT[Mu][TI(X,Y)]   += PreFac1A*dGCdT[2*Mu+0];
+            dBdThetaT[Mu][TI(X+1,Y)] += PreFac2A*dGCdT[2*Mu+1];
           };
        }
       else if ( !SaIsPEC && !SbIsPEC )
        { 
-         X=RowOffset + 2*nea;
-         Y=ColOffset + 2*neb;
+         X=2*(ia-T->iaStart);
+         Y=2*(ib-T->ibStart);
 
-         B->AddEntry( X, Y,   PreFac1A*GC[0]);
-         B->AddEntry( X, Y+1, PreFac2A*GC[1]);
+         BT[TI(X,Y)]   += PreFac1A*GC[0];
+         BT[TI(X,Y+1)] += PreFac2A*GC[1];
          if ( !Symmetric || (nea!=neb) )
-          B->AddEntry( X+1, Y, PreFac2A*GC[1]);
-         B->AddEntry( X+1, Y+1, PreFac3A*GC[0]);
+          BT[TI(X+1,Y)] += PreFac2A*GC[1];
+         BT[TI(X+1,Y+1)] += PreFac3A*GC[0];
 
          for(Mu=0; Mu<NumGradientComponents; Mu++)
           { 
             if (!GradB[Mu]) continue;
-            GradB[Mu]->AddEntry( X, Y,   PreFac1A*GradGC[2*Mu+0]);
-            GradB[Mu]->AddEntry( X, Y+1, PreFac2A*GradGC[2*Mu+1]);
+            GradBT[Mu][TI(X,Y)]   += PreFac1A*GradGC[2*Mu+0];
+            GradBT[Mu][TI(X,Y+1)] += PreFac2A*GradGC[2*Mu+1];
             if ( !Symmetric || (nea!=neb) )
-             GradB[Mu]->AddEntry( X+1, Y, PreFac2A*GradGC[2*Mu+1]);
-            GradB[Mu]->AddEntry( X+1, Y+1, PreFac3A*GradGC[2*Mu+0]);
+             GradBT[Mu][TI(X+1,Y)] += PreFac2A*GradGC[2*Mu+1];
+            GradBT[Mu][TI(X+1,Y+1)] += PreFac3A*GradGC[2*Mu+0];
           };
 
          for(Mu=0; Mu<NumTorqueAxes; Mu++)
           { 
-            dBdTheta[Mu]->AddEntry( X, Y,   PreFac1A*dGCdT[2*Mu+0]);
-            dBdTheta[Mu]->AddEntry( X, Y+1, PreFac2A*dGCdT[2*Mu+1]);
+            dBdThetaT[Mu][TI(X,Y)]   += PreFac1A*dGCdT[2*Mu+0];
+            dBdThetaT[Mu][TI(X,Y+1)] += PreFac2A*dGCdT[2*Mu+1];
             if ( !Symmetric || (nea!=neb) )
-             dBdTheta[Mu]->AddEntry( X+1, Y, PreFac2A*dGCdT[2*Mu+1]);
-            dBdTheta[Mu]->AddEntry( X+1, Y+1, PreFac3A*dGCdT[2*Mu+0]);
+             dBdThetaT[Mu][TI(X+1,Y)] += PreFac2A*dGCdT[2*Mu+1];
+            dBdThetaT[Mu][TI(X+1,Y+1)] += PreFac3A*dGCdT[2*Mu+0];
           };
 
        }; // if ( OaIsPEC && ObIsPEC ) ... else ... 
@@ -299,42 +674,69 @@ void *GSSIThread(void *data)
          GetEEIArgs->GBA = Args->GBA2;
          GetEdgeEdgeInteractions(GetEEIArgs);
 
-         X=RowOffset + 2*nea;
-         Y=ColOffset + 2*neb;
+         X=2*(ia-T->iaStart);
+         Y=2*(ib-T->ibStart);
 
-         B->AddEntry( X, Y,   PreFac1B*GC[0]);
-         B->AddEntry( X, Y+1, PreFac2B*GC[1]);
+         BT[TI(X,Y)]   += PreFac1B*GC[0];
+         BT[TI(X,Y+1)] += PreFac2B*GC[1];
          if ( !Symmetric || (nea!=neb) )
-          B->AddEntry( X+1, Y, PreFac2B*GC[1]);
-         B->AddEntry( X+1, Y+1, PreFac3B*GC[0]);
+          BT[TI(X+1,Y)] += PreFac2B*GC[1];
+         BT[TI(X+1,Y+1)] += PreFac3B*GC[0];
 
          for(Mu=0; Mu<NumGradientComponents; Mu++)
           { 
             if (!GradB[Mu]) continue;
-            GradB[Mu]->AddEntry( X, Y,   PreFac1B*GradGC[2*Mu+0]);
-            GradB[Mu]->AddEntry( X, Y+1, PreFac2B*GradGC[2*Mu+1]);
+            GradBT[Mu][TI(X,Y)]   += PreFac1B*GradGC[2*Mu+0];
+            GradBT[Mu][TI(X,Y+1)] += PreFac2B*GradGC[2*Mu+1];
             if ( !Symmetric || (nea!=neb) )
-             GradB[Mu]->AddEntry( X+1, Y, PreFac2B*GradGC[2*Mu+1]);
-            GradB[Mu]->AddEntry( X+1, Y+1, PreFac3B*GradGC[2*Mu+0]);
+             GradBT[Mu][TI(X+1,Y)] += PreFac2B*GradGC[2*Mu+1];
+            GradBT[Mu][TI(X+1,Y+1)] += PreFac3B*GradGC[2*Mu+0];
           };
 
          for(Mu=0; Mu<NumTorqueAxes; Mu++)
           { 
-            dBdTheta[Mu]->AddEntry( X, Y,   PreFac1B*dGCdT[2*Mu+0]);
-            dBdTheta[Mu]->AddEntry( X, Y+1, PreFac2B*dGCdT[2*Mu+1]);
+            dBdThetaT[Mu][TI(X,Y)]   += PreFac1B*dGCdT[2*Mu+0];
+            dBdThetaT[Mu][TI(X,Y+1)] += PreFac2B*dGCdT[2*Mu+1];
             if ( !Symmetric || (nea!=neb) )
-             dBdTheta[Mu]->AddEntry( X+1, Y, PreFac2B*dGCdT[2*Mu+1]);
-            dBdTheta[Mu]->AddEntry( X+1, Y+1, PreFac3B*dGCdT[2*Mu+0]);
+             dBdThetaT[Mu][TI(X+1,Y)] += PreFac2B*dGCdT[2*Mu+1];
+            dBdThetaT[Mu][TI(X+1,Y+1)] += PreFac3B*dGCdT[2*Mu+0];
           };
        }; // if (EpsB!=0.0)
 
-    }; // for(nea=0; nea<NEa; nea++), for(neb=nebStart*nea; neb<NEb; neb++) ... 
+    }; // for(int ia=...; ...), for(int ib=...; ...)
+
+     /*--------------------------------------------------------------*/
+     /*- flush the tile buffers into the output matrices            -*/
+     /*--------------------------------------------------------------*/
+     int NRT=0, NCT=0;
+     for(int ia=T->iaStart; ia<T->iaEnd; ia++)
+      for(int n=0; n<BFPEA; n++)
+       RowIndices[NRT++] = RowOffset + BFPEA*OrderA[ia] + n;
+     for(int ib=T->ibStart; ib<T->ibEnd; ib++)
+      for(int n=0; n<BFPEB; n++)
+       ColIndices[NCT++] = ColOffset + BFPEB*OrderB[ib] + n;
+
+     B->AddBlock(BT, NRT, NCT, LDT, RowIndices, ColIndices, Symmetric);
+     for(Mu=0; Mu<NumGradientComponents; Mu++)
+      if (GradB[Mu])
+       GradB[Mu]->AddBlock(GradBT[Mu], NRT, NCT, LDT, RowIndices, ColIndices, Symmetric);
+     for(Mu=0; Mu<NumTorqueAxes; Mu++)
+      dBdTheta[Mu]->AddBlock(dBdThetaT[Mu], NRT, NCT, LDT, RowIndices, ColIndices, Symmetric);
+
+   }; // while( (nTile=GetNextSSITile(...)) != -1 )
+
+  free(TileBuffers);
+  delete[] RowIndices;
+  delete[] ColIndices;
+#undef TI
 
   memcpy(TD->PPIAlgorithmCount, GetEEIArgs->PPIAlgorithmCount, NUMPPIALGORITHMS*sizeof(unsigned));
   return 0;
 
 }
 
+int GetOverlappingEdgeIndices(RWGSurface *S, int nea, int nebArray[5]); // in OPFT.cc
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -360,66 +762,116 @@ void AddSurfaceZetaContributionToBEMMatrix(GetSSIArgStruct *Args)
    ErrExit("%s:%i: internal error",__FILE__,__LINE__);
 
   /*--------------------------------------------------------------*/
+  /*- tabulate the dimensionless surface impedance at all points  */
+  /*- at which it is sampled below (edge centroids for diagonal   */
+  /*- entries, panel centroids for off-diagonal entries) in a     */
+  /*- single vectorized evaluation                                */
   /*--------------------------------------------------------------*/
+  int NE=S->NumEdges, NP=S->NumPanels;
+  double **X = new double *[NE+NP];
+  for(int ne=0; ne<NE; ne++)
+   X[ne]=S->Edges[ne]->Centroid;
+  for(int np=0; np<NP; np++)
+   X[NE+np]=S->Panels[np]->Centroid;
+  cdouble *ZetaValues = new cdouble[NE+NP];
+  S->GetSurfaceZeta(Args->Omega, NE+NP, X, ZetaValues);
+  delete[] X;
+
   /*--------------------------------------------------------------*/
-  int neAlpha, neBeta;
-  double Overlap;
-  for(neAlpha=0; neAlpha<S->NumEdges; neAlpha++)
-   for(neBeta=neAlpha; neBeta<S->NumEdges; neBeta++)
-    { 
-      Overlap=S->GetOverlap(neAlpha, neBeta);
-      if (Overlap==0.0) continue;
-
-      // if there was a nonzero overlap, get the value
-      // of the dimensionless surface impedance at the centroid
-      // of the common panel (if there was only one common panel)
-      // or of the common edge if there were two common panels.
-      RWGEdge *EAlpha = S->Edges[neAlpha];
-      RWGEdge *EBeta  = S->Edges[neBeta];
-      double *X = EAlpha->Centroid;
-      if (neAlpha==neBeta)
-       {
-         X = EAlpha->Centroid;
-       }
-      else if (    EAlpha->iPPanel==EBeta->iPPanel 
-                || EAlpha->iPPanel==EBeta->iMPanel 
-              )
-       {
-        X = S->Panels[EAlpha->iPPanel]->Centroid;
-       }
-      else if ( (EAlpha->iMPanel!=-1) && 
-                (    (EAlpha->iMPanel==EBeta->iPPanel) 
-                  || (EAlpha->iMPanel==EBeta->iMPanel) 
+  /*- loop over the (at most 5) edges that overlap each edge       */
+  /*--------------------------------------------------------------*/
+  for(int neAlpha=0; neAlpha<NE; neAlpha++)
+   { 
+     int nebArray[5];
+     int nebCount=GetOverlappingEdgeIndices(S, neAlpha, nebArray);
+     for(int nneb=0; nneb<nebCount; nneb++)
+      { 
+        int neBeta=nebArray[nneb];
+        if (neBeta<neAlpha) continue;
+
+        double Overlap=S->GetOverlap(neAlpha, neBeta);
+        if (Overlap==0.0) continue;
+
+        // if there was a nonzero overlap, get the value
+        // of the dimensionless surface impedance at the centroid
+        // of the common panel (if there was only one common panel)
+        // or of the common edge if there were two common panels.
+        RWGEdge *EAlpha = S->Edges[neAlpha];
+        RWGEdge *EBeta  = S->Edges[neBeta];
+        int nx = neAlpha;
+        if (neAlpha==neBeta)
+         {
+           nx = neAlpha;
+         }
+        else if (    EAlpha->iPPanel==EBeta->iPPanel 
+                  || EAlpha->iPPanel==EBeta->iMPanel 
+                )
+         {
+           nx = NE + EAlpha->iPPanel;
+         }
+        else if ( (EAlpha->iMPanel!=-1) && 
+                  (    (EAlpha->iMPanel==EBeta->iPPanel) 
+                    || (EAlpha->iMPanel==EBeta->iMPanel) 
+                  ) 
                 ) 
-              ) 
-       {
-         X = S->Panels[EAlpha->iMPanel]->Centroid;
-       };
-
-
-      char *ParmNames[4]={ const_cast<char *>("w"), 
-                           const_cast<char *>("x"), 
-                           const_cast<char *>("y"), 
-                           const_cast<char *>("z") 
-                         };
-      cdouble ParmValues[4];
-      ParmValues[0] = Args->Omega*MatProp::FreqUnit;
-      ParmValues[1] = X[0];
-      ParmValues[2] = X[1];
-      ParmValues[3] = X[2];
-      cdouble Zeta=cevaluator_evaluate(S->SurfaceZeta, 4, ParmNames, ParmValues);
-
-      if (neAlpha==0 && neBeta==neAlpha)
-       Log("Zeta = %s ",CD2S(Zeta));
-
-      if ( S->IsPEC )
-       { B->AddEntry(Offset+neAlpha, Offset+neBeta, -1.0*Zeta*Overlap);
-         if (neAlpha!=neBeta)
-          B->AddEntry(Offset+neBeta, Offset+neAlpha, -1.0*Zeta*Overlap);
-       };
-      
-    };
+         {
+           nx = NE + EAlpha->iMPanel;
+         };
+        cdouble Zeta=ZetaValues[nx];
+
+        if ( S->IsPEC )
+         { AddBEMEntry(B, Offset+neAlpha, Offset+neBeta, -1.0*Zeta*Overlap);
+           if (neAlpha!=neBeta)
+            AddBEMEntry(B, Offset+neBeta, Offset+neAlpha, -1.0*Zeta*Overlap);
+         };
+      };
+   };
+
+  delete[] ZetaValues;
+}
+
+/***************************************************************/
+/* figure out if the two surfaces have 0, 1, or 2 regions in   */
+/* common and fill in the region-dependent fields of the Args  */
+/* struct; returns false if the surfaces do not interact.      */
+/* the cached epsilon and mu values of G must be up to date.   */
+/***************************************************************/
+static bool GetSSIRegionData(GetSSIArgStruct *Args)
+{
+  RWGGeometry *G = Args->G;
+  RWGSurface  *Sa = Args->Sa;
+  RWGSurface  *Sb = Args->Sb;
+
+  double Signs[2];
+  int CommonRegions[2]; 
+  int NumCommonRegions=CountCommonRegions(Sa, Sb, CommonRegions, Signs);
+  if (NumCommonRegions==0)
+   return false;
+
+  Args->EpsA  = G->EpsTF[ CommonRegions[0] ];
+  Args->MuA   = G->MuTF[  CommonRegions[0] ];
+  Args->SignA = Signs[0];
+  if ( NumCommonRegions==2 )
+   { Args->EpsB = G->EpsTF[ CommonRegions[1] ];
+     Args->MuB  = G->MuTF[  CommonRegions[1] ];
+     Args->SignB = Signs[1];
+   }
+  else
+   Args->EpsB = Args->MuB = Args->SignB = 0.0;
+
+  Args->SaIsPEC = (Sa->IsPEC==1);
+  Args->SbIsPEC = (Sb->IsPEC==1);
 
+  /***************************************************************/
+  /***************************************************************/
+  /***************************************************************/
+  if (Args->OmitRegion1)
+   Args->EpsA=Args->MuA=Args->SignA=0.0;
+
+  if (Args->OmitRegion2)
+   Args->EpsB=Args->MuB=Args->SignB=0.0;
+
+  return ( Args->EpsA!=0.0 || Args->EpsB!=0.0 );
 }
 
 /***************************************************************/  
@@ -457,106 +909,95 @@ void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
       Args->dBdTheta[2]->ZeroBlock(Args->RowOffset, Sa->NumBFs, Args->ColOffset, Sb->NumBFs);
    };
 
-  /***************************************************************/
-  /* figure out if the two surfaces have 0, 1, or 2 regions in   */
-  /* common and fill in some relevant fields in the Args struct  */
-  /***************************************************************/
-  double Signs[2];
-  int CommonRegions[2]; 
-  int NumCommonRegions=CountCommonRegions(Sa, Sb, CommonRegions, Signs);
-  if (NumCommonRegions==0)
+  if ( !GetSSIRegionData(Args) )
    return;
 
-  Args->EpsA  = G->EpsTF[ CommonRegions[0] ];
-  Args->MuA   = G->MuTF[  CommonRegions[0] ];
-  Args->SignA = Signs[0];
-  if ( NumCommonRegions==2 )
-   { Args->EpsB = G->EpsTF[ CommonRegions[1] ];
-     Args->MuB  = G->MuTF[  CommonRegions[1] ];
-     Args->SignB = Signs[1];
-   }
-  else
-   Args->EpsB = Args->MuB = Args->SignB = 0.0;
-
-  Args->SaIsPEC = (Sa->IsPEC==1);
-  Args->SbIsPEC = (Sb->IsPEC==1);
-
-  /***************************************************************/
   /***************************************************************/
+  /* fire off threads ********************************************/
   /***************************************************************/
-  if (Args->OmitRegion1)
-   Args->EpsA=Args->MuA=Args->SignA=0.0;
+  GlobalFIPPICache.ResetStatistics();
 
-  if (Args->OmitRegion2)
-   Args->EpsB=Args->MuB=Args->SignB=0.0;
+  int nt, NumThreads = GetNumThreads();
+#if !defined(USE_PTHREAD) && !defined(USE_OPENMP)
+  NumThreads=1;
+#endif
+  unsigned PPIAlgorithmCount[NUMPPIALGORITHMS];
+  memset(PPIAlgorithmCount, 0, NUMPPIALGORITHMS*sizeof(unsigned));
 
-  if ( Args->EpsA==0.0 && Args->EpsB==0.0 )
-   return;
+  /***************************************************************/
+  /* the cubature cache only covers the ordinary Helmholtz kernel */
+  /* without derivatives                                         */
+  /***************************************************************/
+  CubatureCache *CCache=0;
+  if (    G->CCache && Args->GBA1==0 && Args->GBA2==0
+       && Args->Displacement==0 && Args->GradB==0 && Args->NumTorqueAxes==0 )
+   { CCache=G->CCache;
+     CCache->PrepareBlock(Sa, Sb);
+   };
 
   /***************************************************************/
-  /* fire off threads ********************************************/
+  /* the PPI memo only holds integrals for the current frequency */
   /***************************************************************/
-  GlobalFIPPICache.Hits=GlobalFIPPICache.Misses=0;
+  PPIMemo *PMemo=G->PMemo;
+  if (PMemo)
+   PMemo->PrepareFrequency(Omega);
 
-  int nt, NumTasks, NumThreads = GetNumThreads();
-  unsigned PPIAlgorithmCount[NUMPPIALGORITHMS];  
-  memset(PPIAlgorithmCount, 0, NUMPPIALGORITHMS*sizeof(unsigned));
+  SSISchedule *Schedule = CreateSSISchedule(Args, NumThreads,
+                                            0, Sa->NumEdges, 0, Sb->NumEdges);
+  if (G->LogLevel>=SCUFF_VERBOSE2)
+   Log(" %i threads, %i tiles of %ix%i edge pairs...",
+         NumThreads,Schedule->NumTiles,SSI_TILESIZE,SSI_TILESIZE);
+
+  ThreadData *TDs = new ThreadData[NumThreads];
+  for(nt=0; nt<NumThreads; nt++)
+   { TDs[nt].nt=nt;
+     TDs[nt].NumTasks=NumThreads;
+     TDs[nt].Args=Args;
+     TDs[nt].Schedule=Schedule;
+     TDs[nt].CCache=CCache;
+     TDs[nt].PMemo=PMemo;
+     TDs[nt].LogProgress=true;
+   };
 
 #ifdef USE_PTHREAD
-  ThreadData *TDs = new ThreadData[NumThreads], *TD;
   pthread_t *Threads = new pthread_t[NumThreads];
   for(nt=0; nt<NumThreads; nt++)
-   { 
-     TD=&(TDs[nt]);
-     TD->nt=nt;
-     TD->NumTasks=NumThreads;
-     TD->Args=Args;
+   {
      if (nt+1 == NumThreads)
-       GSSIThread((void *)TD);
+       GSSIThread((void *)&(TDs[nt]));
      else
-       pthread_create( &(Threads[nt]), 0, GSSIThread, (void *)TD);
+       pthread_create( &(Threads[nt]), 0, GSSIThread, (void *)&(TDs[nt]));
    }
   for(nt=0; nt<NumThreads-1; nt++)
-   { pthread_join(Threads[nt],0);
-     for(int n=0; n<NUMPPIALGORITHMS; n++)
-      PPIAlgorithmCount[n] += TD->PPIAlgorithmCount[n];
-   };
+   pthread_join(Threads[nt],0);
   delete[] Threads;
-  delete[] TDs;
-
-#else 
-#ifndef USE_OPENMP
-  NumTasks=NumThreads=1;
-  if (G->LogLevel>=SCUFF_VERBOSE2)
-   Log(" no multithreading...");
 #else
-  NumTasks=NumThreads*100;
-  if (NumTasks>Sa->NumEdges) 
-   NumTasks=Sa->NumEdges;
-  if (G->LogLevel>=SCUFF_VERBOSE2)
-   Log(" OpenMP multithreading (%i threads,%i tasks)...",NumThreads,NumTasks);
-#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(static,1), num_threads(NumThreads)
 #endif
-  for(nt=0; nt<NumTasks; nt++)
-   { 
-     ThreadData TD1;
-     TD1.nt=nt;
-     TD1.NumTasks=NumTasks;
-     TD1.Args=Args;
-     GSSIThread((void *)&TD1);
-     for(int n=0; n<NUMPPIALGORITHMS; n++)
-      PPIAlgorithmCount[n] += TD1.PPIAlgorithmCount[n];
-   };
+  for(nt=0; nt<NumThreads; nt++)
+   GSSIThread((void *)&(TDs[nt]));
 #endif
 
+  for(nt=0; nt<NumThreads; nt++)
+   for(int n=0; n<NUMPPIALGORITHMS; n++)
+    PPIAlgorithmCount[n] += TDs[nt].PPIAlgorithmCount[n];
+  delete[] TDs;
+  DestroySSISchedule(Schedule);
+
   if (G->LogLevel>=SCUFF_VERBOSE2)
-   { Log("  %i/%i cache hits/misses",GlobalFIPPICache.Hits,GlobalFIPPICache.Misses);
-     Log("  PPIs: LOC(%u), HOC(%u), TD(%u), HK(%u), D(%u)",
+   { int Hits, Misses, Waits;
+     GlobalFIPPICache.GetStatistics(&Hits, &Misses, &Waits);
+     Log("  %i/%i/%i cache hits/misses/waits",Hits,Misses,Waits);
+     Log("  PPIs: LOC(%u), HOC(%u), TD(%u), HK(%u), D(%u), M(%u)",
             PPIAlgorithmCount[PPIALG_LOCUBATURE],
             PPIAlgorithmCount[PPIALG_HOCUBATURE],
             PPIAlgorithmCount[PPIALG_TD],
             PPIAlgorithmCount[PPIALG_HKTD],
-            PPIAlgorithmCount[PPIALG_DESING]);
+            PPIAlgorithmCount[PPIALG_DESING],
+            PPIAlgorithmCount[PPIALG_MEMO]);
+     if (PMemo)
+      Log("  %lu records in PPI memo",(unsigned long)PMemo->NumRecords());
    };
 
   /***************************************************************/
@@ -573,25 +1014,70 @@ void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
 
   /***************************************************************/
   /* if the caller specified the matrix as symmetric, then so far*/
-  /* we have only computed the upper triangle, so now we need to */
-  /* fill in the lower triangle. The exception is if the matrix  */
-  /* uses packed storage, in which case only the upper triangle  */
-  /* is stored anyway.                                           */
+  /* we have only computed the upper triangle of the diagonal    */
+  /* block, so now we need to fill in its lower triangle. (This  */
+  /* is a no-op if the matrix uses packed storage, in which case */
+  /* only the upper triangle is stored anyway.)                  */
   /***************************************************************/
   if ( Args->Symmetric && (Args->B->StorageType==LHM_NORMAL) )
    { 
      if (G->LogLevel>=SCUFF_VERBOSE2)
       Log("Handling symmetry...");
-     int N=Args->B->NR;
-     for(int nr=1; nr<N; nr++)
-      for(int nc=0; nc<nr; nc++)
-       Args->B->SetEntry(nr,nc,Args->B->GetEntry(nc,nr));
+     Args->B->CopyUpperToLower(Args->RowOffset, Args->Sa->NumBFs);
      if (G->LogLevel>=SCUFF_VERBOSE2)
       Log("...done with symmetry...");
    };
 
 }
 
+/***************************************************************/
+/* compute the interactions of edges neaStart..neaEnd-1 on Sa  */
+/* with edges nebStart..nebEnd-1 on Sb, serially in the calling*/
+/* thread, and add them to the corresponding entries of        */
+/* Args->B (the Accumulate field is ignored). if Args->Symmetric*/
+/* is true, the two ranges must be the same range of edges on  */
+/* the same surface, and only the upper triangle of the        */
+/* corresponding diagonal block of B is filled in.             */
+/*                                                             */
+/* this is used to assemble the BEM matrix in tiles that are   */
+/* computed concurrently (see PipelinedLU.cc), so unlike       */
+/* GetSurfaceSurfaceInteractions() it does not touch any state */
+/* shared between calls: the caller must first have called    */
+/* G->UpdateCachedEpsMuValues(Omega), and also                 */
+/* G->CCache->PrepareBlock(Sa,Sb) and                          */
+/* G->PMemo->PrepareFrequency(Omega) if G has those caches.    */
+/* derivatives, surface-impedance and substrate contributions  */
+/* are not supported.                                          */
+/***************************************************************/
+void GetSurfaceSurfaceInteractionsTile(GetSSIArgStruct *Args,
+                                       int neaStart, int neaEnd,
+                                       int nebStart, int nebEnd)
+{
+  if ( Args->GradB || Args->dBdTheta || Args->NumTorqueAxes )
+   ErrExit("%s:%i: internal error",__FILE__,__LINE__);
+  if ( Args->Symmetric && (Args->Sa!=Args->Sb || neaStart!=nebStart || neaEnd!=nebEnd) )
+   ErrExit("%s:%i: internal error",__FILE__,__LINE__);
+
+  if ( neaEnd<=neaStart || nebEnd<=nebStart || !GetSSIRegionData(Args) )
+   return;
+
+  RWGGeometry *G = Args->G;
+  CubatureCache *CCache=0;
+  if ( G->CCache && Args->GBA1==0 && Args->GBA2==0 && Args->Displacement==0 )
+   CCache=G->CCache;
+
+  ThreadData TD;
+  TD.nt=0;
+  TD.NumTasks=1;
+  TD.Args=Args;
+  TD.Schedule=CreateSSISchedule(Args, 1, neaStart, neaEnd, nebStart, nebEnd);
+  TD.CCache=CCache;
+  TD.PMemo=G->PMemo;
+  TD.LogProgress=false;
+  GSSIThread((void *)&TD);
+  DestroySSISchedule(TD.Schedule);
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -639,6 +1125,9 @@ void AddSubstrateSSI(GetSSIArgStruct *Args)
 
   /***************************************************************/
   /* loop over all RWG functions on both surfaces ****************/
+  /* (with packed storage, AddBEMEntry drops the lower-triangle  */
+  /* entries, so each stored entry is written by exactly one     */
+  /* loop iteration and the threads never collide)               */
   /***************************************************************/
 #ifdef USE_OPENMP
   int NT = GetNumThreads();
@@ -655,14 +1144,14 @@ void AddSubstrateSSI(GetSSIArgStruct *Args)
 
       if (Sa->IsPEC && Sb->IsPEC)
        { 
-         B->AddEntry(Row+nea, Col+neb, EEIs[0]);
+         AddBEMEntry(B, Row+nea, Col+neb, EEIs[0]);
        }
       else if (!Sa->IsPEC && !Sb->IsPEC)
        { 
-         B->AddEntry(Row+2*nea+0, Col+2*neb+0, EEIs[0]);
-         B->AddEntry(Row+2*nea+0, Col+2*neb+1, EEIs[1]);
-         B->AddEntry(Row+2*nea+1, Col+2*neb+0, EEIs[1]);
-         B->AddEntry(Row+2*nea+1, Col+2*neb+1, EEIs[2]);
+         AddBEMEntry(B, Row+2*nea+0, Col+2*neb+0, EEIs[0]);
+         AddBEMEntry(B, Row+2*nea+0, Col+2*neb+1, EEIs[1]);
+         AddBEMEntry(B, Row+2*nea+1, Col+2*neb+0, EEIs[1]);
+         AddBEMEntry(B, Row+2*nea+1, Col+2*neb+1, EEIs[2]);
        }
       else 
        ErrExit("%s:%i: internal error");
@@ -0,0 +1,546 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * SymmetryReduction.cc -- libscuff routines for block-diagonalizing the
+ *                      -- BEM system of a geometry that is invariant
+ *                      -- under reflection through one or more of the
+ *                      -- coordinate planes
+ *
+ * The group generated by P mirror planes is abelian of order 2^P, with
+ * 2^P one-dimensional irreducible representations (irreps). If RWG
+ * basis function b is carried by the group element g into the basis
+ * function s_g(b) b', then the symmetry-adapted basis vector for irrep
+ * I built on the orbit of b is
+ *
+ *  u = (1/sqrt(|orbit|)) \sum_{x in orbit} \chi_I(g_x) s_{g_x}(b) e_x
+ *
+ * (where g_x carries b to x), provided this does not vanish. The BEM
+ * matrix is block-diagonal in this basis, and the block for irrep I
+ * may be computed from the rows of the BEM matrix corresponding to
+ * just one representative from each orbit, so both the assembly and
+ * the storage are reduced by a factor of 2^P and the factorization by
+ * a factor of 4^P.
+ *
+ * Reflection through a coordinate plane carries electric currents
+ * into electric currents, but magnetic currents (which are
+ * pseudovectors) acquire an extra minus sign.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <libhmat.h>
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
+namespace scuff {
+
+#define MAXPLANES 3
+#define MAXSTR 1000
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+struct SymmetryData
+ {
+   int NumPlanes;
+   int Axes[MAXPLANES];   // the mirror #p flips coordinate Axes[p]
+   int NumOps;            // 2^NumPlanes
+
+   // BF-level group action: EdgeImage[p][ne], EdgeSign[p][ne] give
+   // the image of (global interior) edge #ne under mirror #p and
+   // the sign picked up by its electric-current basis function
+   int NumEdges;
+   int *EdgeImage[MAXPLANES];
+   int *EdgeSign[MAXPLANES];
+   int *EdgeBFOffset;     // index of first BF of each edge
+   int *BFEdge, *BFComponent;
+
+   // orbits: BF #nbf lies in the orbit of Reps[RepOf[nbf]], from
+   // which it is obtained by applying group element OpOf[nbf],
+   // with sign SignOf[nbf]
+   int NumBFs, NumReps;
+   int *Reps, *RepOf, *OpOf, *SignOf, *OrbitSize;
+   int *StabSign;         // StabSign[nr*NumOps+g] = s_g(Reps[nr]) if g fixes Reps[nr], else 0
+
+   // IrrepPosition[nIrrep][nr] = index of the basis vector built on
+   // orbit #nr within irrep block #nIrrep, or -1 if it vanishes
+   int NumIrreps;
+   int *IrrepDims;
+   int **IrrepPosition;
+   HMatrix **MI;
+ };
+
+/***************************************************************/
+/* character of group element g in irrep I: the bits of g, I   */
+/* indicate which mirrors are applied, and which are odd       */
+/***************************************************************/
+static inline int Chi(int I, int g)
+{
+  int Bits=I&g, Parity=0;
+  for(; Bits; Bits>>=1)
+   Parity^=(Bits&1);
+  return Parity ? -1 : 1;
+}
+
+/***************************************************************/
+/* image of basis function nbf under group element g           */
+/***************************************************************/
+static int ApplyOp(SymmetryData *SD, int g, int nbf, int *pSign)
+{
+  int ne=SD->BFEdge[nbf], x=SD->BFComponent[nbf], Sign=1;
+  for(int p=0; p<SD->NumPlanes; p++)
+   if ( g & (1<<p) )
+    { Sign *= SD->EdgeSign[p][ne];
+      if (x==1) Sign=-Sign; // magnetic currents are pseudovectors
+      ne = SD->EdgeImage[p][ne];
+    };
+  *pSign=Sign;
+  return SD->EdgeBFOffset[ne] + x;
+}
+
+/***************************************************************/
+/* attempt to match every edge in the geometry (including any  */
+/* half-RWG edges) with its mirror image through the plane     */
+/* normal to axis Axis.                                        */
+/* returns false (leaving Image, Sign in an undefined state) if*/
+/* the geometry is not symmetric under this reflection.        */
+/***************************************************************/
+typedef struct SortedCentroid
+ { double x;
+   int ns, ne;
+   bool operator<(const SortedCentroid &Other) const { return x < Other.x; };
+ } SortedCentroid;
+
+static bool GetMirrorImages(RWGGeometry *G, int Axis, SortedCentroid *SC,
+                            int *GEOffset, int *Image, int *Sign)
+{
+  int NumEdges=GEOffset[G->NumSurfaces];
+  double Tol = 10.0*G->tolVecClose;
+
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   { RWGSurface *S=G->Surfaces[ns];
+     for(int ne=0; ne<S->NumEdges; ne++)
+      {
+        RWGEdge *E=S->Edges[ne];
+        double XImage[3], QPImage[3];
+        memcpy(XImage, E->Centroid, 3*sizeof(double));
+        memcpy(QPImage, S->Vertices + 3*E->iQP, 3*sizeof(double));
+        XImage[Axis]  *= -1.0;
+        QPImage[Axis] *= -1.0;
+
+        SortedCentroid Key;
+        Key.x = XImage[0] - Tol;
+        int nMatch=-1, MatchSign=0;
+        for(SortedCentroid *p=std::lower_bound(SC, SC+NumEdges, Key);
+            p<SC+NumEdges && p->x <= XImage[0]+Tol && nMatch==-1; p++)
+         { RWGSurface *SImage=G->Surfaces[p->ns];
+           RWGEdge *EImage=SImage->Edges[p->ne];
+           if ( !VecClose(XImage, EImage->Centroid, Tol) )
+            continue;
+           // as in the Mate[] test, the image surface must bound
+           // regions with the same material properties
+           int nr1=S->RegionIndices[0], nr1i=SImage->RegionIndices[0];
+           int nr2=S->RegionIndices[1], nr2i=SImage->RegionIndices[1];
+           if (    SImage->IsPEC!=S->IsPEC
+                || strcmp(G->RegionMPs[nr1]->Name, G->RegionMPs[nr1i]->Name)
+                || (!S->IsPEC && strcmp(G->RegionMPs[nr2]->Name, G->RegionMPs[nr2i]->Name))
+              ) return false;
+
+           // a half-RWG edge (iQM==-1) can only be the image of
+           // another half-RWG edge, with the same orientation
+           if ( (E->iQM==-1) != (EImage->iQM==-1) )
+            return false;
+           if ( VecClose(QPImage, SImage->Vertices + 3*EImage->iQP, Tol) )
+            MatchSign=+1;
+           else if ( EImage->iQM!=-1 && VecClose(QPImage, SImage->Vertices + 3*EImage->iQM, Tol) )
+            MatchSign=-1;
+           else
+            return false;
+           nMatch = GEOffset[p->ns] + p->ne;
+         };
+        if (nMatch==-1)
+         return false;
+
+        Image[GEOffset[ns] + ne] = nMatch;
+        Sign[GEOffset[ns] + ne]  = MatchSign;
+      };
+   };
+
+  return true;
+}
+
+/***************************************************************/
+/* set up the data needed to block-diagonalize the BEM system  */
+/* of a compact geometry using the group generated by the      */
+/* mirror planes listed in MirrorPlanes, a string like "xz,yz" */
+/* (the planes all pass through the origin). If MirrorPlanes   */
+/* is NULL or "auto", we use all coordinate planes under which */
+/* the geometry is found to be symmetric, returning NULL if    */
+/* there are none.                                             */
+/***************************************************************/
+SymmetryData *RWGGeometry::CreateSymmetryData(const char *MirrorPlanes)
+{
+  if (LBasis!=0)
+   ErrExit("%s:%i: symmetry reduction not available for periodic geometries",__FILE__,__LINE__);
+  if (Substrate)
+   ErrExit("%s:%i: symmetry reduction not yet available for geometries with substrates",__FILE__,__LINE__);
+  if (UseHRWGFunctions && NumMMJs>0)
+   ErrExit("%s:%i: symmetry reduction not available with multi-material junctions",__FILE__,__LINE__);
+
+  /*--------------------------------------------------------------*/
+  /*- parse the list of mirror planes ----------------------------*/
+  /*--------------------------------------------------------------*/
+  bool AutoDetect = (MirrorPlanes==0 || !strcasecmp(MirrorPlanes,"auto"));
+  int NumCandidates=0, Candidates[MAXPLANES];
+  if (AutoDetect)
+   { for(int Axis=0; Axis<3; Axis++)
+      Candidates[NumCandidates++]=Axis;
+   }
+  else
+   { char *s=strdupEC(MirrorPlanes);
+     char *Tokens[MAXPLANES+1];
+     int NumTokens=Tokenize(s, Tokens, MAXPLANES+1, ", ");
+     if (NumTokens>MAXPLANES)
+      ErrExit("too many mirror planes in %s",MirrorPlanes);
+     for(int nt=0; nt<NumTokens; nt++)
+      { int Axis=-1;
+        if ( !strcasecmp(Tokens[nt],"yz") || !strcasecmp(Tokens[nt],"zy") )
+         Axis=0;
+        else if ( !strcasecmp(Tokens[nt],"xz") || !strcasecmp(Tokens[nt],"zx") )
+         Axis=1;
+        else if ( !strcasecmp(Tokens[nt],"xy") || !strcasecmp(Tokens[nt],"yx") )
+         Axis=2;
+        else
+         ErrExit("unknown mirror plane %s (should be xy, yz, or xz)",Tokens[nt]);
+        for(int nc=0; nc<NumCandidates; nc++)
+         if (Candidates[nc]==Axis)
+          ErrExit("mirror plane %s specified more than once",Tokens[nt]);
+        Candidates[NumCandidates++]=Axis;
+      };
+     free(s);
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- sort interior edges by centroid x-coordinate for fast       */
+  /*- matching of edges with their mirror images                  */
+  /*--------------------------------------------------------------*/
+  int *GEOffset=(int *)mallocEC((NumSurfaces+1)*sizeof(int));
+  GEOffset[0]=0;
+  for(int ns=0; ns<NumSurfaces; ns++)
+   GEOffset[ns+1] = GEOffset[ns] + Surfaces[ns]->NumEdges;
+  int NumEdges=GEOffset[NumSurfaces];
+
+  SortedCentroid *SC=(SortedCentroid *)mallocEC(NumEdges*sizeof(SortedCentroid));
+  for(int ns=0; ns<NumSurfaces; ns++)
+   for(int ne=0; ne<Surfaces[ns]->NumEdges; ne++)
+    { SortedCentroid *p=SC + GEOffset[ns] + ne;
+      p->x  = Surfaces[ns]->Edges[ne]->Centroid[0];
+      p->ns = ns;
+      p->ne = ne;
+    };
+  std::sort(SC, SC+NumEdges);
+
+  SymmetryData *SD=(SymmetryData *)mallocEC(sizeof(SymmetryData));
+  SD->NumEdges=NumEdges;
+  SD->NumPlanes=0;
+  for(int nc=0; nc<NumCandidates; nc++)
+   { int p=SD->NumPlanes;
+     SD->EdgeImage[p] = (int *)mallocEC(2*NumEdges*sizeof(int));
+     SD->EdgeSign[p]  = SD->EdgeImage[p] + NumEdges;
+     if ( GetMirrorImages(this, Candidates[nc], SC, GEOffset, SD->EdgeImage[p], SD->EdgeSign[p]) )
+      { SD->Axes[p]=Candidates[nc];
+        SD->NumPlanes++;
+      }
+     else if (AutoDetect)
+      free(SD->EdgeImage[p]);
+     else
+      ErrExit("geometry %s is not symmetric under reflection through the %s plane",
+               GeoFileName, Candidates[nc]==0 ? "yz" : Candidates[nc]==1 ? "xz" : "xy");
+   };
+  free(SC);
+
+  if (SD->NumPlanes==0)
+   { Log("no mirror symmetries found in geometry %s",GeoFileName);
+     free(GEOffset);
+     free(SD);
+     return 0;
+   };
+  SD->NumOps = 1<<SD->NumPlanes;
+
+  /*--------------------------------------------------------------*/
+  /*- BF <--> edge bookkeeping -----------------------------------*/
+  /*--------------------------------------------------------------*/
+  int N = SD->NumBFs = TotalBFs;
+  SD->EdgeBFOffset = (int *)mallocEC(NumEdges*sizeof(int));
+  SD->BFEdge       = (int *)mallocEC(2*N*sizeof(int));
+  SD->BFComponent  = SD->BFEdge + N;
+  for(int ns=0; ns<NumSurfaces; ns++)
+   { int BFPE = (Surfaces[ns]->IsPEC ? 1 : 2);
+     for(int ne=0; ne<Surfaces[ns]->NumEdges; ne++)
+      { int nge = GEOffset[ns] + ne, nbf = BFIndexOffset[ns] + BFPE*ne;
+        SD->EdgeBFOffset[nge]=nbf;
+        for(int x=0; x<BFPE; x++)
+         { SD->BFEdge[nbf+x]=nge;
+           SD->BFComponent[nbf+x]=x;
+         };
+      };
+   };
+  free(GEOffset);
+
+  /*--------------------------------------------------------------*/
+  /*- partition the BFs into orbits -------------------------------*/
+  /*--------------------------------------------------------------*/
+  int NumOps=SD->NumOps;
+  SD->Reps      = (int *)mallocEC(6*N*sizeof(int));
+  SD->RepOf     = SD->Reps + N;
+  SD->OpOf      = SD->RepOf + N;
+  SD->SignOf    = SD->OpOf + N;
+  SD->OrbitSize = SD->SignOf + N;
+  SD->StabSign  = (int *)mallocEC(N*NumOps*sizeof(int));
+  for(int nbf=0; nbf<N; nbf++)
+   SD->RepOf[nbf]=-1;
+
+  int NumReps=0;
+  for(int nbf=0; nbf<N; nbf++)
+   { if (SD->RepOf[nbf]!=-1)
+      continue;
+     int nr=NumReps++;
+     SD->Reps[nr]=nbf;
+     SD->OrbitSize[nr]=0;
+     for(int g=0; g<NumOps; g++)
+      { int Sign, nbfImage=ApplyOp(SD, g, nbf, &Sign);
+        SD->StabSign[nr*NumOps + g] = (nbfImage==nbf) ? Sign : 0;
+        if (SD->RepOf[nbfImage]==-1)
+         { SD->RepOf[nbfImage]=nr;
+           SD->OpOf[nbfImage]=g;
+           SD->SignOf[nbfImage]=Sign;
+           SD->OrbitSize[nr]++;
+         }
+        else if (SD->RepOf[nbfImage]!=nr)
+         ErrExit("%s:%i: internal error (inconsistent mirror images)",__FILE__,__LINE__);
+      };
+   };
+  SD->NumReps=NumReps;
+
+  /*--------------------------------------------------------------*/
+  /*- an orbit contributes a basis vector to irrep I unless some  */
+  /*- group element that fixes the representative BF acts on it   */
+  /*- with a sign other than its character in I                   */
+  /*--------------------------------------------------------------*/
+  SD->NumIrreps     = NumOps;
+  SD->IrrepDims     = (int *)mallocEC(NumOps*sizeof(int));
+  SD->IrrepPosition = (int **)mallocEC(NumOps*sizeof(int *));
+  SD->MI            = (HMatrix **)mallocEC(NumOps*sizeof(HMatrix *));
+  int TotalDim=0;
+  for(int I=0; I<NumOps; I++)
+   { SD->IrrepPosition[I] = (int *)mallocEC(NumReps*sizeof(int));
+     int Dim=0;
+     for(int nr=0; nr<NumReps; nr++)
+      { bool Vanishes=false;
+        for(int g=0; g<NumOps && !Vanishes; g++)
+         { int Sign=SD->StabSign[nr*NumOps + g];
+           if ( Sign!=0 && Sign*Chi(I,g)!=1 )
+            Vanishes=true;
+         };
+        SD->IrrepPosition[I][nr] = Vanishes ? -1 : Dim++;
+      };
+     SD->IrrepDims[I]=Dim;
+     SD->MI[I]=0;
+     TotalDim+=Dim;
+   };
+  if (TotalDim!=N)
+   ErrExit("%s:%i: internal error (%i!=%i)",__FILE__,__LINE__,TotalDim,N);
+
+  char DimStr[MAXSTR]="";
+  for(int I=0; I<NumOps; I++)
+   snprintf(DimStr + strlen(DimStr), MAXSTR-strlen(DimStr), " %i",SD->IrrepDims[I]);
+  Log("symmetry group of order %i: %i orbits, irrep dimensions%s",NumOps,NumReps,DimStr);
+
+  return SD;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void DestroySymmetryData(SymmetryData *SD)
+{
+  if (!SD) return;
+  for(int I=0; I<SD->NumIrreps; I++)
+   { if (SD->MI[I]) delete SD->MI[I];
+     free(SD->IrrepPosition[I]);
+   };
+  free(SD->MI);
+  free(SD->IrrepPosition);
+  free(SD->IrrepDims);
+  free(SD->StabSign);
+  free(SD->Reps);
+  free(SD->BFEdge);
+  free(SD->EdgeBFOffset);
+  for(int p=0; p<SD->NumPlanes; p++)
+   free(SD->EdgeImage[p]);
+  free(SD);
+}
+
+int GetNumIrreps(SymmetryData *SD)
+{ return SD->NumIrreps; }
+
+int GetIrrepDimension(SymmetryData *SD, int nIrrep)
+{ return SD->IrrepDims[nIrrep]; }
+
+HMatrix *GetIrrepBEMMatrix(SymmetryData *SD, int nIrrep)
+{ return SD->MI[nIrrep]; }
+
+/***************************************************************/
+/* assemble the BEM matrix blocks for all irreps from the rows */
+/* of the full BEM matrix for the orbit representatives.       */
+/***************************************************************/
+void RWGGeometry::AssembleIrrepBEMMatrices(cdouble Omega, SymmetryData *SD)
+{
+  if (SD->NumBFs!=TotalBFs)
+   ErrExit("%s:%i: SymmetryData does not match geometry",__FILE__,__LINE__);
+
+  Log("Assembling symmetry-reduced BEM matrix at Omega=%s",z2s(Omega));
+  HMatrix *R=AssembleBEMMatrixRows(Omega, SD->NumReps, SD->Reps);
+
+  int NumReps=SD->NumReps, N=SD->NumBFs;
+  int NumThreads=GetNumThreads();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int I=0; I<SD->NumIrreps; I++)
+   {
+     int Dim=SD->IrrepDims[I];
+     if (Dim==0) continue;
+     if (SD->MI[I]==0)
+      SD->MI[I]=new HMatrix(Dim, Dim, LHM_COMPLEX);
+     HMatrix *MI=SD->MI[I];
+     MI->Zero();
+
+     int *Position=SD->IrrepPosition[I];
+     for(int nc=0; nc<N; nc++)
+      { int j=Position[SD->RepOf[nc]];
+        if (j==-1) continue;
+        double c = Chi(I, SD->OpOf[nc]) * SD->SignOf[nc];
+        for(int nr=0; nr<NumReps; nr++)
+         { int i=Position[nr];
+           if (i!=-1)
+            MI->AddEntry(i, j, c*R->GetEntry(nr, nc));
+         };
+      };
+
+     for(int nrj=0; nrj<NumReps; nrj++)
+      { int j=Position[nrj];
+        if (j==-1) continue;
+        for(int nri=0; nri<NumReps; nri++)
+         { int i=Position[nri];
+           if (i==-1) continue;
+           double Scale=sqrt( ((double)SD->OrbitSize[nri]) / ((double)SD->OrbitSize[nrj]) );
+           MI->SetEntry(i, j, Scale*MI->GetEntry(i, j));
+         };
+      };
+   };
+
+  delete R;
+}
+
+/***************************************************************/
+/* the irrep blocks are complex-symmetric, like the full BEM   */
+/* matrix, since the symmetry-adapted basis is real-orthogonal */
+/***************************************************************/
+void FactorizeIrrepBEMMatrices(SymmetryData *SD)
+{
+  for(int I=0; I<SD->NumIrreps; I++)
+   if (SD->MI[I])
+    SD->MI[I]->LDLFactorize();
+}
+
+/***************************************************************/
+/* VI = component of V in irrep nIrrep, expressed in the       */
+/* symmetry-adapted basis                                      */
+/***************************************************************/
+HVector *ProjectOntoIrrep(SymmetryData *SD, int nIrrep, HVector *V, HVector *VI)
+{
+  int Dim=SD->IrrepDims[nIrrep];
+  if ( VI && VI->N!=Dim )
+   { delete VI;
+     VI=0;
+   };
+  if (VI==0)
+   VI=new HVector(Dim, LHM_COMPLEX);
+  VI->Zero();
+
+  int *Position=SD->IrrepPosition[nIrrep];
+  for(int nbf=0; nbf<SD->NumBFs; nbf++)
+   { int nr=SD->RepOf[nbf], i=Position[nr];
+     if (i==-1) continue;
+     double c = Chi(nIrrep, SD->OpOf[nbf]) * SD->SignOf[nbf] / sqrt((double)SD->OrbitSize[nr]);
+     VI->AddEntry(i, c*V->GetEntry(nbf));
+   };
+  return VI;
+}
+
+/***************************************************************/
+/* V += the vector whose components in the symmetry-adapted    */
+/* basis for irrep nIrrep are VI                               */
+/***************************************************************/
+void AddIrrepComponent(SymmetryData *SD, int nIrrep, HVector *VI, HVector *V)
+{
+  int *Position=SD->IrrepPosition[nIrrep];
+  for(int nbf=0; nbf<SD->NumBFs; nbf++)
+   { int nr=SD->RepOf[nbf], i=Position[nr];
+     if (i==-1) continue;
+     double c = Chi(nIrrep, SD->OpOf[nbf]) * SD->SignOf[nbf] / sqrt((double)SD->OrbitSize[nr]);
+     V->AddEntry(nbf, c*VI->GetEntry(i));
+   };
+}
+
+/***************************************************************/
+/* on entry KN is the RHS vector; on return it is the solution */
+/* of the BEM system, obtained by solving each irrep block     */
+/* separately. FactorizeIrrepBEMMatrices must have been called.*/
+/***************************************************************/
+void SolveIrrepBEMSystems(SymmetryData *SD, HVector *KN)
+{
+  HVector *RHS=new HVector(KN);
+  KN->Zero();
+  HVector *VI=0;
+  for(int I=0; I<SD->NumIrreps; I++)
+   { if (SD->IrrepDims[I]==0) continue;
+     VI=ProjectOntoIrrep(SD, I, RHS, VI);
+     SD->MI[I]->LUSolve(VI);
+     AddIrrepComponent(SD, I, VI, KN);
+   };
+  if (VI) delete VI;
+  delete RHS;
+}
+
+} // namespace scuff
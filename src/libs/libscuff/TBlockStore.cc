@@ -0,0 +1,864 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * TBlockStore.cc -- an on-disk store of diagonal BEM-matrix blocks
+ *                -- ('T-blocks'), so that the self-interaction blocks
+ *                -- of surfaces that recur from one run to the next
+ *                -- need only be assembled once
+ *
+ * The store is enabled by setting the environment variable
+ * SCUFF_TBLOCK_PATH to the name of a directory. Other knobs:
+ *
+ *  SCUFF_TBLOCK_READPATH  a second, read-only store that is
+ *                         consulted if a block is not found in
+ *                         SCUFF_TBLOCK_PATH
+ *
+ *  SCUFF_TBLOCK_MAXGB     size cap for SCUFF_TBLOCK_PATH (default
+ *                         20 GB; 0 = no cap). when the cap is
+ *                         exceeded the least recently used
+ *                         blocks are deleted.
+ *
+ *  SCUFF_TBLOCK_COMPRESS  =1 to deflate blocks before writing them
+ *                         (requires zlib at build time)
+ *
+ *  SCUFF_TBLOCK_QUEUEMB   upper limit on the memory occupied by
+ *                         blocks waiting to be written by the
+ *                         background writer thread (default
+ *                         2048 MB; 0 = write synchronously)
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <vector>
+#include <algorithm>
+
+#if defined(HAVE_LIBZ) && defined(HAVE_ZLIB_H)
+#  include <zlib.h>
+#  define TBS_ZLIB
+#endif
+
+#if defined(USE_OPENMP) || defined(USE_PTHREAD)
+#  include <pthread.h>
+#  define TBS_THREADS
+#endif
+
+#include <libhrutil.h>
+#include <libhmat.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+namespace scuff {
+
+/***************************************************************/
+/* Each block is stored in its own file, whose name is the     */
+/* 128-bit content key of the block in hexadecimal; the first  */
+/* two hex digits name a subdirectory of the store.            */
+/*                                                             */
+/* The key is a hash of everything the block depends on: the   */
+/* mesh (panel vertices and basis-function layout), the        */
+/* material properties of the two regions at Omega (which also */
+/* captures regions that have been zeroed), the surface        */
+/* impedance if any, Omega, kBloch, and the lattice vectors.   */
+/* For compact geometries the vertices are hashed in the frame */
+/* of the mesh file, so a block can be reused after the        */
+/* surface has been displaced or rotated.                      */
+/*                                                             */
+/* Each file consists of a TBSHeader followed by the (possibly */
+/* compressed) column-major matrix data. The checksum of the   */
+/* uncompressed data is verified on every read; blocks that    */
+/* fail verification are deleted.                              */
+/***************************************************************/
+#define TBS_SIGNATURE "SCUFFTBLOCK"
+#define TBS_VERSION   1
+#define TBS_ENDIANTAG 0x01020304
+
+#define TBS_DEFAULT_MAXGB   20.0
+#define TBS_DEFAULT_QUEUEMB 2048.0
+
+// after exceeding the size cap, we evict down to this fraction of it
+#define TBS_EVICT_FRACTION 0.9
+
+// temporary files left behind by dead processes are removed
+// once they are this old (seconds)
+#define TBS_STALE_TMP_AGE 3600
+
+// vertex coordinates are rounded to multiples of this fraction
+// of the shortest edge in the surface before hashing
+#define TBS_QUANTUM 1.0e-9
+
+#define TBS_COMPRESS_NONE 0
+#define TBS_COMPRESS_ZLIB 1
+
+typedef struct TBSHeader
+ { char Signature[16];
+   uint32_t Version;
+   uint32_t EndianTag;
+   uint64_t Key[2];
+   int32_t NR, NC;
+   int32_t RealComplex;
+   int32_t Compression;
+   uint64_t RawSize;
+   uint64_t StoredSize;
+   uint64_t DataChecksum;
+   uint64_t HeaderChecksum;
+ } TBSHeader;
+
+/***************************************************************/
+/* a block waiting to be written by the background writer      */
+/***************************************************************/
+typedef struct TBSJob
+ { uint64_t Key[2];
+   int NR, NC, RealComplex;
+   void *Data;
+   size_t DataSize;
+   struct TBSJob *Next;
+ } TBSJob;
+
+/***************************************************************/
+/* process-wide state of the store                             */
+/***************************************************************/
+typedef struct TBStore
+ {
+   char *Dir;             // writable store (may be NULL)
+   char *ReadDir;         // read-only store (may be NULL)
+   double MaxBytes;       // size cap for Dir (0 = none)
+   double UsedBytes;      // running estimate of size of Dir (-1 = unknown)
+   bool Compress;
+   size_t MaxQueueBytes;
+
+   // write-behind queue; Head is the job currently being
+   // written, and stays on the queue (visible to readers)
+   // until its file is complete
+   TBSJob *Head, *Tail;
+   size_t QueueBytes;
+
+#ifdef TBS_THREADS
+   pthread_mutex_t Mutex;
+   pthread_cond_t QueueCond, DrainCond;
+   pthread_t Writer;
+   bool WriterStarted, WriterFailed, Quit;
+#endif
+
+ } TBStore;
+
+static TBStore *TheStore=0;
+static bool StoreInitialized=false;
+
+#ifdef TBS_THREADS
+static pthread_mutex_t InitMutex=PTHREAD_MUTEX_INITIALIZER;
+static inline void LockStore(TBStore *S)   { pthread_mutex_lock(&(S->Mutex)); }
+static inline void UnlockStore(TBStore *S) { pthread_mutex_unlock(&(S->Mutex)); }
+#else
+static inline void LockStore(TBStore *S)   { (void) S; }
+static inline void UnlockStore(TBStore *S) { (void) S; }
+#endif
+
+/***************************************************************/
+/* hashing: keys use two independent 64-bit multiplicative     */
+/* lanes; data checksums use 64-bit FNV-1a on 8-byte words.    */
+/***************************************************************/
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME  1099511628211ULL
+#define LANE2_OFFSET 0x84222325CBF29CE4ULL
+#define LANE2_PRIME  0x9E3779B97F4A7C15ULL
+
+static void AddToKey(uint64_t Key[2], const void *Data, size_t Size)
+{
+  const unsigned char *p=(const unsigned char *)Data;
+  for(size_t n=0; n<Size; n++)
+   { Key[0] = (Key[0] ^ p[n]) * FNV_PRIME;
+     Key[1] = (Key[1] ^ p[n]) * LANE2_PRIME;
+     Key[1] ^= (Key[1] >> 29);
+   };
+}
+
+static void AddToKey(uint64_t Key[2], double x)
+ { AddToKey(Key, &x, sizeof(double)); }
+
+static void AddToKey(uint64_t Key[2], cdouble z)
+ { AddToKey(Key, real(z)); AddToKey(Key, imag(z)); }
+
+static void AddToKey(uint64_t Key[2], int i)
+ { AddToKey(Key, &i, sizeof(int)); }
+
+static uint64_t GetDataChecksum(const void *Data, size_t Size)
+{
+  uint64_t Hash=FNV_OFFSET;
+  const uint64_t *W=(const uint64_t *)Data;
+  size_t NW=Size/sizeof(uint64_t);
+  for(size_t nw=0; nw<NW; nw++)
+   Hash = (Hash ^ W[nw]) * FNV_PRIME;
+  const unsigned char *p=(const unsigned char *)(W + NW);
+  for(size_t n=NW*sizeof(uint64_t); n<Size; n++, p++)
+   Hash = (Hash ^ (*p)) * FNV_PRIME;
+  return Hash;
+}
+
+static uint64_t GetHeaderChecksum(TBSHeader *Header)
+{
+  TBSHeader Copy=*Header;
+  Copy.HeaderChecksum=0;
+  return GetDataChecksum(&Copy, sizeof(Copy));
+}
+
+/***************************************************************/
+/* compute the content key of the diagonal block for surface ns*/
+/* returns false if the block cannot be stored.                */
+/***************************************************************/
+static bool GetTBlockKey(RWGGeometry *G, int ns, cdouble Omega,
+                         double *kBloch, int RealComplex,
+                         uint64_t Key[2])
+{
+  // the substrate Green's function depends on the absolute
+  // position of the surface and on the layer stack, which
+  // we do not attempt to hash
+  if (G->Substrate)
+   return false;
+
+  RWGSurface *S=G->Surfaces[ns];
+  Key[0]=FNV_OFFSET;
+  Key[1]=LANE2_OFFSET;
+
+  int Version=TBS_VERSION;
+  AddToKey(Key, Version);
+  AddToKey(Key, RealComplex);
+  AddToKey(Key, S->NumBFs);
+  AddToKey(Key, Omega);
+
+  /*--------------------------------------------------------------*/
+  /*- lattice ----------------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  AddToKey(Key, G->LDim);
+  for(int nd=0; nd<G->LDim; nd++)
+   { AddToKey(Key, kBloch[nd]);
+     for(int Mu=0; Mu<3; Mu++)
+      AddToKey(Key, G->LBasis->GetEntryD(Mu,nd));
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- materials on either side of the surface --------------------*/
+  /*--------------------------------------------------------------*/
+  AddToKey(Key, S->IsPEC);
+  for(int nr=0; nr<2; nr++)
+   { int RegionIndex=S->RegionIndices[nr];
+     AddToKey(Key, RegionIndex==-1 ? 0 : 1);
+     if (RegionIndex==-1) continue;
+     cdouble Eps, Mu;
+     G->RegionMPs[RegionIndex]->GetEpsMu(Omega, &Eps, &Mu);
+     AddToKey(Key, Eps);
+     AddToKey(Key, Mu);
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- panel vertices, in the frame of the mesh file for compact   */
+  /*- geometries (in which T-blocks are invariant under rigid     */
+  /*- motions) and in the lab frame for periodic geometries.      */
+  /*--------------------------------------------------------------*/
+  double MinLength=HUGE_VAL;
+  for(int ne=0; ne<S->NumEdges; ne++)
+   MinLength=fmin(MinLength, S->Edges[ne]->Length);
+  for(int ne=0; ne<S->NumExteriorEdges; ne++)
+   MinLength=fmin(MinLength, S->ExteriorEdges[ne]->Length);
+  double Quantum = TBS_QUANTUM*MinLength;
+
+  GTransformation *GT = (G->LBasis==0 ? S->GT : 0);
+  AddToKey(Key, S->NumPanels);
+  for(int np=0; np<S->NumPanels; np++)
+   for(int nv=0; nv<3; nv++)
+    { double V[3];
+      memcpy(V, S->Vertices + 3*(S->Panels[np]->VI[nv]), 3*sizeof(double));
+      if (GT) GT->UnApply(V);
+      for(int Mu=0; Mu<3; Mu++)
+       { long long QV=(long long)floor(V[Mu]/Quantum + 0.5);
+         AddToKey(Key, &QV, sizeof(QV));
+       };
+    };
+
+  /*--------------------------------------------------------------*/
+  /*- basis-function layout --------------------------------------*/
+  /*--------------------------------------------------------------*/
+  AddToKey(Key, S->NumEdges);
+  for(int ne=0; ne<S->NumEdges; ne++)
+   { RWGEdge *E=S->Edges[ne];
+     int Data[4]={E->iPPanel, E->iMPanel, E->iQP, E->iQM};
+     AddToKey(Key, Data, 4*sizeof(int));
+   };
+  AddToKey(Key, S->NumExteriorEdges);
+  for(int ne=0; ne<S->NumExteriorEdges; ne++)
+   { RWGEdge *E=S->ExteriorEdges[ne];
+     int Data[4]={E->iPPanel, E->iMPanel, E->iQP, E->iQM};
+     AddToKey(Key, Data, 4*sizeof(int));
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- surface impedance: hash its values at the points at which   */
+  /*- it is sampled during matrix assembly                        */
+  /*--------------------------------------------------------------*/
+  if (S->SurfaceZeta)
+   { int NX=S->NumEdges + S->NumPanels;
+     double **X = new double *[NX];
+     for(int ne=0; ne<S->NumEdges; ne++)
+      X[ne]=S->Edges[ne]->Centroid;
+     for(int np=0; np<S->NumPanels; np++)
+      X[S->NumEdges + np]=S->Panels[np]->Centroid;
+     cdouble *Zeta = new cdouble[NX];
+     S->GetSurfaceZeta(Omega, NX, X, Zeta);
+     for(int nx=0; nx<NX; nx++)
+      AddToKey(Key, Zeta[nx]);
+     delete[] Zeta;
+     delete[] X;
+   };
+
+  return true;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+static void GetBlockFileName(const char *Dir, uint64_t Key[2],
+                             char *FileName, size_t Size)
+{
+  snprintf(FileName, Size, "%s/%02x/%016llx%016llx.tblk", Dir,
+           (unsigned)(Key[0]>>56),
+           (unsigned long long)Key[0], (unsigned long long)Key[1]);
+}
+
+/***************************************************************/
+/* copy the NRxNC block of M at (RowOffset,ColOffset) into a   */
+/* column-major buffer, or vice versa                          */
+/***************************************************************/
+static void CopyBlock(HMatrix *M, int RowOffset, int ColOffset,
+                      int NR, int NC, void *Data, bool ToBuffer)
+{
+  size_t EntrySize = (M->RealComplex==LHM_COMPLEX) ? sizeof(cdouble) : sizeof(double);
+  if (M->StorageType==LHM_NORMAL)
+   { char *MData = (M->RealComplex==LHM_COMPLEX) ? (char *)M->ZM : (char *)M->DM;
+     for(int nc=0; nc<NC; nc++)
+      { char *MColumn = MData + EntrySize*( ((size_t)(ColOffset+nc))*M->NR + RowOffset);
+        char *BColumn = ((char *)Data) + EntrySize*((size_t)nc)*NR;
+        if (ToBuffer)
+         memcpy(BColumn, MColumn, NR*EntrySize);
+        else
+         memcpy(MColumn, BColumn, NR*EntrySize);
+      };
+   }
+  else
+   { HMatrix B(NR, NC, M->RealComplex, LHM_NORMAL, Data);
+     if (ToBuffer)
+      M->ExtractBlock(RowOffset, ColOffset, &B);
+     else
+      M->InsertBlock(&B, RowOffset, ColOffset);
+   };
+}
+
+/***************************************************************/
+/* size accounting and LRU eviction. files are touched when    */
+/* they are read, so modification times order them by recency  */
+/* of use.                                                     */
+/***************************************************************/
+typedef struct TBSFileInfo
+ { time_t MTime;
+   off_t Size;
+   char *Name;
+ } TBSFileInfo;
+
+static bool OlderFirst(const TBSFileInfo &F1, const TBSFileInfo &F2)
+ { return F1.MTime < F2.MTime; }
+
+static bool HasSuffix(const char *s, const char *Suffix)
+{ size_t ls=strlen(s), lSuffix=strlen(Suffix);
+  return ls>=lSuffix && !strcmp(s + ls - lSuffix, Suffix);
+}
+
+static void EnforceSizeCap(TBStore *Store)
+{
+  if (Store->MaxBytes==0.0)
+   return;
+  if (Store->UsedBytes>=0.0 && Store->UsedBytes<=Store->MaxBytes)
+   return;
+
+  /*--------------------------------------------------------------*/
+  /*- rescan the store, since other processes may be writing to  -*/
+  /*- it as well                                                 -*/
+  /*--------------------------------------------------------------*/
+  std::vector<TBSFileInfo> Files;
+  double TotalBytes=0.0;
+  time_t Now=time(0);
+  DIR *TopDir=opendir(Store->Dir);
+  if (TopDir==0) return;
+  struct dirent *TopEntry;
+  while( (TopEntry=readdir(TopDir)) )
+   { if (strlen(TopEntry->d_name)!=2) continue;
+     char *SubDirName=vstrdup("%s/%s",Store->Dir,TopEntry->d_name);
+     DIR *SubDir=opendir(SubDirName);
+     if (SubDir)
+      { struct dirent *Entry;
+        while( (Entry=readdir(SubDir)) )
+         { bool IsBlock = HasSuffix(Entry->d_name, ".tblk");
+           bool IsTmp   = HasSuffix(Entry->d_name, ".tmp");
+           if (!IsBlock && !IsTmp) continue;
+           TBSFileInfo Info;
+           Info.Name=vstrdup("%s/%s",SubDirName,Entry->d_name);
+           struct stat st;
+           if (stat(Info.Name, &st)!=0)
+            { free(Info.Name); continue; }
+           if (IsTmp)
+            { if ( (Now - st.st_mtime) > TBS_STALE_TMP_AGE )
+               unlink(Info.Name);
+              free(Info.Name);
+              continue;
+            };
+           Info.MTime=st.st_mtime;
+           Info.Size=st.st_size;
+           TotalBytes+=(double)st.st_size;
+           Files.push_back(Info);
+         };
+        closedir(SubDir);
+      };
+     free(SubDirName);
+   };
+  closedir(TopDir);
+
+  /*--------------------------------------------------------------*/
+  /*- evict least recently used blocks ---------------------------*/
+  /*--------------------------------------------------------------*/
+  if (TotalBytes > Store->MaxBytes)
+   { std::sort(Files.begin(), Files.end(), OlderFirst);
+     double Target=TBS_EVICT_FRACTION*Store->MaxBytes;
+     int NumEvicted=0;
+     double BytesEvicted=0.0;
+     for(size_t nf=0; nf<Files.size() && TotalBytes>Target; nf++)
+      if (unlink(Files[nf].Name)==0)
+       { TotalBytes-=(double)Files[nf].Size;
+         BytesEvicted+=(double)Files[nf].Size;
+         NumEvicted++;
+       };
+     Log("T-block store %s: evicted %i blocks (%.1f MB)",
+          Store->Dir,NumEvicted,BytesEvicted/1048576.0);
+   };
+  for(size_t nf=0; nf<Files.size(); nf++)
+   free(Files[nf].Name);
+
+  Store->UsedBytes=TotalBytes;
+}
+
+/***************************************************************/
+/* write one block to disk. the file is written under a        */
+/* temporary name and renamed when complete, so readers in     */
+/* other processes never see partial files.                    */
+/***************************************************************/
+static void WriteJob(TBStore *Store, TBSJob *Job)
+{
+  char FileName[1024];
+  GetBlockFileName(Store->Dir, Job->Key, FileName, 1024);
+
+  // create the subdirectory if necessary
+  char *SubDirName=strdupEC(FileName);
+  *(strrchr(SubDirName,'/'))=0;
+  mkdir(SubDirName, 0755);
+  free(SubDirName);
+
+  TBSHeader Header;
+  memset(&Header, 0, sizeof(Header));
+  strncpy(Header.Signature, TBS_SIGNATURE, 16);
+  Header.Version      = TBS_VERSION;
+  Header.EndianTag    = TBS_ENDIANTAG;
+  Header.Key[0]       = Job->Key[0];
+  Header.Key[1]       = Job->Key[1];
+  Header.NR           = Job->NR;
+  Header.NC           = Job->NC;
+  Header.RealComplex  = Job->RealComplex;
+  Header.Compression  = TBS_COMPRESS_NONE;
+  Header.RawSize      = Job->DataSize;
+  Header.StoredSize   = Job->DataSize;
+  Header.DataChecksum = GetDataChecksum(Job->Data, Job->DataSize);
+
+  void *Payload=Job->Data;
+  void *CompressedData=0;
+#ifdef TBS_ZLIB
+  if (Store->Compress)
+   { uLongf CompressedSize=compressBound(Job->DataSize);
+     CompressedData=malloc(CompressedSize);
+     if (    CompressedData
+          && compress2( (Bytef *)CompressedData, &CompressedSize,
+                        (const Bytef *)Job->Data, Job->DataSize, 1)==Z_OK
+          && CompressedSize < Job->DataSize
+        )
+      { Payload=CompressedData;
+        Header.Compression=TBS_COMPRESS_ZLIB;
+        Header.StoredSize=CompressedSize;
+      };
+   };
+#endif
+  Header.HeaderChecksum=GetHeaderChecksum(&Header);
+
+  char TmpFileName[1100];
+  snprintf(TmpFileName,1100,"%s.%i.tmp",FileName,(int)getpid());
+  FILE *f=fopen(TmpFileName,"w");
+  bool Success = (f!=0);
+  if (Success)
+   { Success = (fwrite(&Header, sizeof(Header), 1, f)==1)
+                && (fwrite(Payload, 1, Header.StoredSize, f)==Header.StoredSize);
+     Success = (fclose(f)==0) && Success;
+   };
+  if (Success)
+   Success = (rename(TmpFileName, FileName)==0);
+
+  if (Success)
+   { Log("Wrote T-block (%ix%i) to %s (%.1f MB%s)",Job->NR,Job->NC,FileName,
+          ((double)Header.StoredSize)/1048576.0,
+          Header.Compression==TBS_COMPRESS_ZLIB ? ", compressed" : "");
+     if (Store->UsedBytes>=0.0)
+      Store->UsedBytes += (double)(sizeof(Header) + Header.StoredSize);
+     EnforceSizeCap(Store);
+   }
+  else
+   { Warn("could not write T-block to %s (%s)",FileName,strerror(errno));
+     unlink(TmpFileName);
+   };
+
+  if (CompressedData) free(CompressedData);
+}
+
+/***************************************************************/
+/* background writer thread ************************************/
+/***************************************************************/
+#ifdef TBS_THREADS
+static void *WriterThread(void *pStore)
+{
+  TBStore *Store=(TBStore *)pStore;
+  LockStore(Store);
+  while(true)
+   { while( Store->Head==0 && !(Store->Quit) )
+      pthread_cond_wait(&(Store->QueueCond), &(Store->Mutex));
+     if (Store->Head==0)
+      break;
+     TBSJob *Job=Store->Head;
+     UnlockStore(Store);
+
+     WriteJob(Store, Job);
+
+     LockStore(Store);
+     Store->Head=Job->Next;
+     if (Store->Head==0) Store->Tail=0;
+     Store->QueueBytes-=Job->DataSize;
+     free(Job->Data);
+     free(Job);
+     pthread_cond_broadcast(&(Store->DrainCond));
+   };
+  UnlockStore(Store);
+  return 0;
+}
+
+static void ShutdownTBlockStore()
+{
+  TBStore *Store=TheStore;
+  if (Store==0 || !(Store->WriterStarted)) return;
+  LockStore(Store);
+  Store->Quit=true;
+  pthread_cond_signal(&(Store->QueueCond));
+  UnlockStore(Store);
+  pthread_join(Store->Writer, 0);
+  Store->WriterStarted=false;
+}
+#endif
+
+/***************************************************************/
+/* initialize the store from environment variables on first    */
+/* use; returns NULL if the store is not enabled.              */
+/***************************************************************/
+static TBStore *GetStore()
+{
+#ifdef TBS_THREADS
+  pthread_mutex_lock(&InitMutex);
+#endif
+  if (!StoreInitialized)
+   { StoreInitialized=true;
+     char *Dir=getenv("SCUFF_TBLOCK_PATH");
+     char *ReadDir=getenv("SCUFF_TBLOCK_READPATH");
+     if (Dir || ReadDir)
+      { TBStore *Store=(TBStore *)mallocEC(sizeof(TBStore));
+        memset(Store, 0, sizeof(TBStore));
+        Store->Dir     = Dir     ? strdupEC(Dir)     : 0;
+        Store->ReadDir = ReadDir ? strdupEC(ReadDir) : 0;
+        if (Store->Dir) mkdir(Store->Dir, 0755);
+
+        double MaxGB=TBS_DEFAULT_MAXGB;
+        char *s=getenv("SCUFF_TBLOCK_MAXGB");
+        if (s && 1!=sscanf(s,"%le",&MaxGB))
+         ErrExit("invalid value %s for SCUFF_TBLOCK_MAXGB",s);
+        Store->MaxBytes=MaxGB*1073741824.0;
+        Store->UsedBytes=-1.0;
+
+        s=getenv("SCUFF_TBLOCK_COMPRESS");
+        Store->Compress = (s && s[0]=='1');
+#ifndef TBS_ZLIB
+        if (Store->Compress)
+         Warn("SCUFF_TBLOCK_COMPRESS ignored (scuff-em was built without zlib)");
+#endif
+
+        double QueueMB=TBS_DEFAULT_QUEUEMB;
+        s=getenv("SCUFF_TBLOCK_QUEUEMB");
+        if (s && 1!=sscanf(s,"%le",&QueueMB))
+         ErrExit("invalid value %s for SCUFF_TBLOCK_QUEUEMB",s);
+        Store->MaxQueueBytes=(size_t)(QueueMB*1048576.0);
+
+#ifdef TBS_THREADS
+        pthread_mutex_init(&(Store->Mutex),0);
+        pthread_cond_init(&(Store->QueueCond),0);
+        pthread_cond_init(&(Store->DrainCond),0);
+#endif
+        Log("T-block store: %s%s%s (cap %g GB%s)",
+             Dir ? Dir : "", (Dir && ReadDir) ? ", read-only " : "",
+             ReadDir ? ReadDir : "", MaxGB,
+             Store->Compress ? ", compressed" : "");
+        TheStore=Store;
+      };
+   };
+#ifdef TBS_THREADS
+  pthread_mutex_unlock(&InitMutex);
+#endif
+  return TheStore;
+}
+
+/***************************************************************/
+/* attempt to read a block from one store directory.           */
+/***************************************************************/
+static bool ReadBlockFile(const char *Dir, bool Writable, uint64_t Key[2],
+                          int NR, int NC, int RealComplex, void *Data, size_t DataSize)
+{
+  char FileName[1024];
+  GetBlockFileName(Dir, Key, FileName, 1024);
+  FILE *f=fopen(FileName,"r");
+  if (!f) return false;
+
+  TBSHeader Header;
+  const char *Problem=0;
+  void *CompressedData=0;
+  if ( fread(&Header, sizeof(Header), 1, f)!=1 )
+   Problem="truncated header";
+  else if (    strncmp(Header.Signature, TBS_SIGNATURE, 16)
+            || Header.Version!=TBS_VERSION
+            || Header.EndianTag!=TBS_ENDIANTAG
+            || Header.HeaderChecksum!=GetHeaderChecksum(&Header)
+          )
+   Problem="invalid header";
+  else if (    Header.Key[0]!=Key[0] || Header.Key[1]!=Key[1]
+            || Header.NR!=NR || Header.NC!=NC || Header.RealComplex!=RealComplex
+            || Header.RawSize!=DataSize
+          )
+   Problem="header does not match block";
+  else if (Header.Compression==TBS_COMPRESS_NONE)
+   { if ( fread(Data, 1, DataSize, f)!=DataSize )
+      Problem="truncated data";
+   }
+#ifdef TBS_ZLIB
+  else if (Header.Compression==TBS_COMPRESS_ZLIB)
+   { CompressedData=malloc(Header.StoredSize);
+     uLongf UncompressedSize=DataSize;
+     if (CompressedData==0)
+      Problem="insufficient memory";
+     else if ( fread(CompressedData, 1, Header.StoredSize, f)!=Header.StoredSize )
+      Problem="truncated data";
+     else if (    uncompress( (Bytef *)Data, &UncompressedSize,
+                              (const Bytef *)CompressedData, Header.StoredSize)!=Z_OK
+               || UncompressedSize!=DataSize
+             )
+      Problem="decompression failed";
+   }
+#endif
+  else
+   Problem="unsupported compression";
+  fclose(f);
+  if (CompressedData) free(CompressedData);
+
+  if (Problem==0 && Header.DataChecksum!=GetDataChecksum(Data, DataSize))
+   Problem="checksum mismatch";
+
+  if (Problem)
+   { Warn("discarding T-block file %s (%s)",FileName,Problem);
+     if (Writable) unlink(FileName);
+     return false;
+   };
+
+  // mark as recently used
+  if (Writable) utime(FileName, 0);
+  Log("Read T-block (%ix%i) from %s",NR,NC,FileName);
+  return true;
+}
+
+/***************************************************************/
+/* Fetch the diagonal block for surface ns at (Omega, kBloch)  */
+/* from the store and stamp it into M at (RowOffset,ColOffset).*/
+/* Returns false if the block was not available.              */
+/***************************************************************/
+bool ReadTBlock(RWGGeometry *G, int ns, cdouble Omega, double *kBloch,
+                HMatrix *M, int RowOffset, int ColOffset)
+{
+  TBStore *Store=GetStore();
+  if (Store==0) return false;
+
+  uint64_t Key[2];
+  if ( !GetTBlockKey(G, ns, Omega, kBloch, M->RealComplex, Key) )
+   return false;
+
+  int NBF=G->Surfaces[ns]->NumBFs;
+  size_t EntrySize = (M->RealComplex==LHM_COMPLEX) ? sizeof(cdouble) : sizeof(double);
+  size_t DataSize = EntrySize * ((size_t)NBF) * ((size_t)NBF);
+
+  /*--------------------------------------------------------------*/
+  /*- blocks that are still waiting to be written are served from-*/
+  /*- memory                                                     -*/
+  /*--------------------------------------------------------------*/
+  bool Found=false;
+  LockStore(Store);
+  for(TBSJob *Job=Store->Head; Job && !Found; Job=Job->Next)
+   if (    Job->Key[0]==Key[0] && Job->Key[1]==Key[1]
+        && Job->NR==NBF && Job->RealComplex==M->RealComplex
+      )
+    { CopyBlock(M, RowOffset, ColOffset, NBF, NBF, Job->Data, false);
+      Found=true;
+    };
+  UnlockStore(Store);
+  if (Found)
+   { Log("Read T-block (%ix%i) from write-behind queue",NBF,NBF);
+     return true;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  void *Data=malloc(DataSize);
+  if (Data==0)
+   { Log("insufficient memory to read T-block (%ix%i)",NBF,NBF);
+     return false;
+   };
+
+  if (Store->Dir)
+   Found=ReadBlockFile(Store->Dir, true, Key, NBF, NBF, M->RealComplex, Data, DataSize);
+  if (!Found && Store->ReadDir)
+   Found=ReadBlockFile(Store->ReadDir, false, Key, NBF, NBF, M->RealComplex, Data, DataSize);
+  if (Found)
+   CopyBlock(M, RowOffset, ColOffset, NBF, NBF, Data, false);
+
+  free(Data);
+  return Found;
+}
+
+/***************************************************************/
+/* Save the diagonal block for surface ns, which occupies the  */
+/* block of M at (RowOffset, ColOffset), to the store. The     */
+/* block is copied and the copy is written to disk by the      */
+/* background writer thread, so this returns immediately       */
+/* unless the write-behind queue is full.                      */
+/***************************************************************/
+void WriteTBlock(RWGGeometry *G, int ns, cdouble Omega, double *kBloch,
+                 HMatrix *M, int RowOffset, int ColOffset)
+{
+  TBStore *Store=GetStore();
+  if (Store==0 || Store->Dir==0) return;
+
+  TBSJob *Job=(TBSJob *)mallocEC(sizeof(TBSJob));
+  if ( !GetTBlockKey(G, ns, Omega, kBloch, M->RealComplex, Job->Key) )
+   { free(Job);
+     return;
+   };
+
+  int NBF=G->Surfaces[ns]->NumBFs;
+  size_t EntrySize = (M->RealComplex==LHM_COMPLEX) ? sizeof(cdouble) : sizeof(double);
+  Job->NR=Job->NC=NBF;
+  Job->RealComplex=M->RealComplex;
+  Job->DataSize=EntrySize * ((size_t)NBF) * ((size_t)NBF);
+  Job->Data=malloc(Job->DataSize);
+  Job->Next=0;
+  if (Job->Data==0)
+   { Log("insufficient memory to save T-block (%ix%i)",NBF,NBF);
+     free(Job);
+     return;
+   };
+  CopyBlock(M, RowOffset, ColOffset, NBF, NBF, Job->Data, true);
+
+#ifdef TBS_THREADS
+  // the writer thread is started on the first write, so runs
+  // that only read from the store never create it
+  LockStore(Store);
+  if (!(Store->WriterStarted) && !(Store->WriterFailed) && Store->MaxQueueBytes>0)
+   { Store->WriterStarted
+      = (0==pthread_create(&(Store->Writer), 0, WriterThread, (void *)Store));
+     Store->WriterFailed = !(Store->WriterStarted);
+     if (Store->WriterStarted)
+      atexit(ShutdownTBlockStore);
+   };
+  UnlockStore(Store);
+
+  if (Store->WriterStarted)
+   { LockStore(Store);
+     while(    Store->QueueBytes>0
+            && Store->QueueBytes + Job->DataSize > Store->MaxQueueBytes
+          )
+      pthread_cond_wait(&(Store->DrainCond), &(Store->Mutex));
+     if (Store->Tail)
+      Store->Tail->Next=Job;
+     else
+      Store->Head=Job;
+     Store->Tail=Job;
+     Store->QueueBytes+=Job->DataSize;
+     pthread_cond_signal(&(Store->QueueCond));
+     UnlockStore(Store);
+     return;
+   };
+#endif
+
+  LockStore(Store);
+  WriteJob(Store, Job);
+  UnlockStore(Store);
+  free(Job->Data);
+  free(Job);
+}
+
+/***************************************************************/
+/* wait for all pending writes to complete *********************/
+/***************************************************************/
+void FlushTBlockStore()
+{
+#ifdef TBS_THREADS
+  TBStore *Store=TheStore;
+  if (Store==0) return;
+  LockStore(Store);
+  while(Store->Head)
+   pthread_cond_wait(&(Store->DrainCond), &(Store->Mutex));
+  UnlockStore(Store);
+#endif
+}
+
+} // namespace scuff
@@ -186,6 +186,11 @@ class RWGSurface
    double GetOverlap(int neAlpha, int neBeta, double *pOTimes = NULL);
    void GetOverlaps(int neAlpha, int neBeta, double *Overlaps);
 
+   /* get the dimensionless surface impedance at frequency Omega  */
+   /* at a single point X, or at the NX points X[0..NX-1]         */
+   cdouble GetSurfaceZeta(cdouble Omega, double *X);
+   void GetSurfaceZeta(cdouble Omega, int NX, double **X, cdouble *Zeta);
+
    /* apply a general transformation (rotation+displacement) to the surface */
    void Transform(const GTransformation *GT);
    void Transform(const char *format, ...);
@@ -270,6 +275,7 @@ class RWGSurface
    /* user-specified function of frequency and position (w,x,y,z) */
    /* describing surface impedance in units of ZVAC               */
    void *SurfaceZeta;
+   void *SurfaceZetaProgram; // compiled version of SurfaceZeta
 
    // the following fields are used to pass some data items up to the 
    // higher-level routine that calls the RWGSurface constructor
@@ -308,6 +314,14 @@ typedef struct MMJData
    int *SurfaceIndices, *EdgeIndices;
  } MMJData;
 
+// opaque data structure for FMM-accelerated BEM matrix-vector products
+typedef struct FMMBEMData FMMBEMData;
+
+// opaque data structure for symmetry-reduced BEM systems
+typedef struct SymmetryData SymmetryData;
+class CubatureCache;
+class PPIMemo;
+
 /*************************** ***********************************/
 /* an RWGGeometry is a collection of regions with interfaces   */
 /* described by RWGSurfaces.                                   */
@@ -331,11 +345,42 @@ class RWGGeometry
    HMatrix *AllocateBEMMatrix(bool PureImagFreq = false, bool Packed = false);
    HMatrix *AssembleBEMMatrix(cdouble Omega, double *kBloch, HMatrix *M = NULL);
    HMatrix *AssembleBEMMatrix(cdouble Omega, HMatrix *M = NULL);
+   bool BEMMatrixIsSymmetric(double *kBloch = 0);
+
+   /* assembly overlapped with LU factorization (PipelinedLU.cc) */
+   HMatrix *AssembleAndFactorizeBEMMatrix(cdouble Omega, double *kBloch, HMatrix *M = NULL);
+   HMatrix *AssembleAndFactorizeBEMMatrix(cdouble Omega, HMatrix *M = NULL);
+
+   /* BEM matrix with off-diagonal blocks compressed by ACA */
+   LRBlockMatrix *AssembleCompressedBEMMatrix(cdouble Omega, double ACATol = 1.0e-6);
+
+   /* hierarchical-matrix (H-matrix) BEM matrix */
+   HierMatrix *AllocateHierBEMMatrix(int LeafSize = 64, double Eta = 2.0);
+   HierMatrix *AssembleBEMMatrix(cdouble Omega, HierMatrix *H, double Tol = 1.0e-6);
+
+   /* BEM matrix stored out of core, in a scratch file */
+   OOCMatrix *AllocateOOCBEMMatrix(const char *ScratchDir = 0, double MemoryGB = 0.0);
+   OOCMatrix *AssembleBEMMatrix(cdouble Omega, OOCMatrix *M);
+
+   /* BEM matrix-vector products by the fast multipole method */
+   FMMBEMData *AllocateFMMBEMData(int LeafSize = 64, int Order = 5);
+   void AssembleFMMBEMData(cdouble Omega, FMMBEMData *Data);
+   void ApplyBEMMatrixFMM(FMMBEMData *Data, HVector *X, HVector *Y);
+   void ApplyFMMPreconditioner(FMMBEMData *Data, HVector *X, HVector *Y);
+
+   /* selected rows of the BEM matrix */
+   HMatrix *AssembleBEMMatrixRows(cdouble Omega, int NumRows, int *Rows, HMatrix *B = NULL);
+
+   /* block-diagonalized BEM system for geometries with mirror symmetry */
+   SymmetryData *CreateSymmetryData(const char *MirrorPlanes = 0);
+   void AssembleIrrepBEMMatrices(cdouble Omega, SymmetryData *SD);
 
    HVector *AllocateRHSVector(bool PureImagFreq = false );
    HVector *AssembleRHSVector(cdouble Omega, double *kBloch,
                               IncField *IF, HVector *RHS = NULL);
    HVector *AssembleRHSVector(cdouble Omega, IncField *IF, HVector *RHS = NULL);
+   HMatrix *AssembleRHSVectors(cdouble Omega, double *kBloch,
+                               IncField **IFs, int NIF, HMatrix *RHS = NULL);
 
    /*--------------------------------------------------------------*/
    /*- post-processing routines for computing fields               */
@@ -455,6 +500,8 @@ class RWGGeometry
                                void *ABMBCache=0, bool CacheTranspose=false,
                                int NumTorqueAxes=0, HMatrix **dMdT=0,
                                double *GammaMatrix=0);
+   LRMatrix *AssembleBEMMatrixBlockACA(int nsa, int nsb, cdouble Omega,
+                                       double Tol=1.0e-6, int MaxRank=0);
    void *CreateABMBAccelerator(int nsa, int nsb, bool PureImagFreq=false,
                                bool NeedZDerivative=false);
    void DestroyABMBAccelerator(void *Accelerator);
@@ -465,11 +512,24 @@ class RWGGeometry
                         HMatrix *RFMatrix=0, bool MinuskBloch=false,
                         int ColumnOffset=0);
 
-   // helper function for accelerating periodic GF calculations
-   GBarAccelerator *CreateRegionGBA(int nr, cdouble Omega, double *kBloch, int ns1, int ns2);
-   GBarAccelerator *CreateRegionGBA(int nr, cdouble Omega, double *kBloch, HMatrix *XMatrix);
+   // helper function for accelerating periodic GF calculations;
+   // accelerators obtained with Pooled=true belong to GBAPool
+   // and must not be destroyed by the caller, nor used after a
+   // later pooled request for the same region (which may rebuild
+   // the table; see GetPooledGBA)
+   GBarAccelerator *CreateRegionGBA(int nr, cdouble Omega, double *kBloch, int ns1, int ns2,
+                                    bool Pooled=false);
+   GBarAccelerator *CreateRegionGBA(int nr, cdouble Omega, double *kBloch, HMatrix *XMatrix,
+                                    bool Pooled=false);
    GBarAccelerator *CreateRegionGBA(int nr, cdouble Omega, double *kBloch,
-                                    double RMin[3], double RMax[3], bool ExcludeInnerCells);
+                                    double RMin[3], double RMax[3], bool ExcludeInnerCells,
+                                    bool Pooled=false);
+   void ClearGBAPool();
+   GBarAccelerator *GetPooledGBA(int nr, cdouble Omega, cdouble k,
+                                 double *kBloch, HMatrix *GBA_LBasis,
+                                 double RhoMin, double RhoMax,
+                                 double RelTol, bool ExcludeInnerCells,
+                                 int LMDILogLevel);
 
    void GetUnitCellRepresentative(const double X[3], double XBar[3],
                                   bool WignerSeitz=false);
@@ -516,6 +576,23 @@ class RWGGeometry
    char *GeoFileName;
 
    void **FIBBICaches;
+   static bool BulkFIBBIs; // precompute all FIBBI records at startup
+
+   // frequency-independent panel-panel cubature data, used to
+   // speed up BEM matrix assembly in frequency sweeps (0 if
+   // disabled); CubatureCacheMB caps its memory footprint
+   CubatureCache *CCache;
+   static double CubatureCacheMB;
+
+   // complete panel-panel integrals for congruent near-field panel
+   // pairs at the current frequency (0 if disabled); PPIMemoMB
+   // caps its memory footprint
+   PPIMemo *PMemo;
+   static double PPIMemoMB;
+
+   // periodic-GF interpolation tables at the current frequency,
+   // shared among BEM matrix blocks and field evaluations
+   GBarAcceleratorPool *GBAPool;
 
    /**************************************************************/
    /* LDim=0 for compact geometries.                             */
@@ -593,6 +670,18 @@ void InitRWGPanel(RWGPanel *P, double *Vertices);
 int CountCommonRegions(RWGSurface *Sa, RWGSurface *Sb, 
                        int CommonRegionIndices[2], double Signs[2]);
 
+void DestroyFMMBEMData(FMMBEMData *Data);
+
+/* routines for working with symmetry-reduced BEM systems */
+void DestroySymmetryData(SymmetryData *SD);
+int GetNumIrreps(SymmetryData *SD);
+int GetIrrepDimension(SymmetryData *SD, int nIrrep);
+HMatrix *GetIrrepBEMMatrix(SymmetryData *SD, int nIrrep);
+void FactorizeIrrepBEMMatrices(SymmetryData *SD);
+void SolveIrrepBEMSystems(SymmetryData *SD, HVector *KN);
+HVector *ProjectOntoIrrep(SymmetryData *SD, int nIrrep, HVector *V, HVector *VI=0);
+void AddIrrepComponent(SymmetryData *SD, int nIrrep, HVector *VI, HVector *V);
+
 /* routines for creating the 'Gamma Matrix' used for torque calculations */
 void CreateGammaMatrix(double *TorqueAxis, double *GammaMatrix);
 void CreateGammaMatrix(double TorqueAxisX, double TorqueAxisY, 
@@ -606,6 +695,7 @@ void *CreateFIBBICache(char *MeshFileName);
 void DestroyFIBBICache(void *pCache);
 int GetFIBBICacheSize(void *pCache, int *pHits, int *pMisses);
 void StoreFIBBICache(void *pCache, const char *MeshFileName);
+void PrecomputeFIBBIData(void *pCache, RWGSurface *S);
 void GetFIBBIData(void *pCache,
                   RWGSurface *SA, int neA, RWGSurface *SB, int neB,
                   double *FIBBIs);
@@ -613,8 +703,9 @@ void GetFIBBIData(void *pCache,
 /*--------------------------------------------------------------*/
 /*--------------------------------------------------------------*/
 /*--------------------------------------------------------------*/
-void PreloadCache(const char *FileName);
-void StoreCache(const char *FileName);
+void PreloadCache(const char *FileName, RWGGeometry *G=0);
+void StoreCache(const char *FileName, RWGGeometry *G=0);
+void FlushTBlockStore(); // wait for pending T-block writes
 void CheckLattice(HMatrix *LBasis);
 
 /***************************************************************/
@@ -36,13 +36,14 @@ namespace scuff {
 
 // values for the WhichAlgorithm field in the PanelPanelInteractions structure
 // (low-order cubature, high-order cubature, taylor-duffy, high-k taylor-duffy, 
-//  or desingularization)
+//  desingularization, or lookup in a PPIMemo)
 #define PPIALG_LOCUBATURE    0
 #define PPIALG_HOCUBATURE    1
 #define PPIALG_TD            2
 #define PPIALG_HKTD          3
 #define PPIALG_DESING        4
-#define NUMPPIALGORITHMS     5
+#define PPIALG_MEMO          5
+#define NUMPPIALGORITHMS     6
 
 /***************************************************************/ 
 /* 1. argument structures for routines whose input/output      */
@@ -77,6 +78,8 @@ typedef struct GetPPIArgStruct
    int ForceTaylorDuffy;
    double *GammaMatrix;
    void *opFC; // 'opaque pointer to FIPPI cache'
+   void *opCC; // 'opaque pointer to cubature cache'
+   void *opPM; // 'opaque pointer to PPI memo'
 
    // this is an optional 3-vector displacement applied to object b
    double *Displacement;
@@ -111,6 +114,16 @@ void GetPanelPanelInteractions(GetPPIArgStruct *Args,
                                cdouble *GradH,
                                cdouble *dHdT);
 
+/*--------------------------------------------------------------*/
+/*- batched Helmholtz kernels for fixed-order cubature (in      */
+/*- HelmholtzKernel.cc); complex arrays of length N are stored  */
+/*- as N real parts followed by N imaginary parts               */
+/*--------------------------------------------------------------*/
+void GetHelmholtzKernels(int N, cdouble k, const double *r, const double *W,
+                         bool DeSingularize,
+                         double *Phi, double *Psi, double *Zeta=0);
+cdouble KernelDot(int N, const double *K, const double *A=0, const double *B=0);
+
 /*--------------------------------------------------------------*/
 /*- GetEdgeEdgeInteractions() ----------------------------------*/
 /*--------------------------------------------------------------*/
@@ -137,6 +150,8 @@ typedef struct GetEEIArgStruct
    double *Displacement;
 
    void *opFC; // 'opaque pointer to FIPPI cache'
+   void *opCC; // 'opaque pointer to cubature cache'
+   void *opPM; // 'opaque pointer to PPI memo'
 
    // this is used to force the code to use a specific
    // panel-integration algorithm; for diagnostic purposes only
@@ -264,6 +279,9 @@ typedef struct GetSSIArgStruct
 
 void InitGetSSIArgs(GetSSIArgStruct *Args);
 void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args);
+void GetSurfaceSurfaceInteractionsTile(GetSSIArgStruct *Args,
+                                       int neaStart, int neaEnd,
+                                       int nebStart, int nebEnd);
 void AddSurfaceZetaContributionToBEMMatrix(GetSSIArgStruct *Args);
 
 /***************************************************************/
@@ -327,14 +345,24 @@ class FIPPICache
     FIPPICache();
     ~FIPPICache();
 
-    // store/retrieve cache to/from binary file
-    void Store(const char *FileName);
-    void PreLoad(const char *FileName);
+    // store/retrieve cache to/from binary file. PreLoad() maps
+    // the file into memory rather than reading it, and may be
+    // called for several files. G, if given, is used to record
+    // and check the geometry for which the file was written.
+    void Store(const char *FileName, RWGGeometry *G=0);
+    void PreLoad(const char *FileName, RWGGeometry *G=0);
     
     // look up an entry 
     QIFIPPIData *GetQIFIPPIData(double **OVa, double **OVb, int ncv);
 
-    int Hits, Misses;
+    // lookup statistics, summed over all threads. 'Waits' counts
+    // lookups that found the record still being computed by
+    // another thread. ResetStatistics() should not be called
+    // while other threads are using the cache.
+    void GetStatistics(int *Hits, int *Misses, int *Waits=0);
+    void ResetStatistics();
+
+    unsigned int NumRecords();
 
   private:
 
@@ -345,7 +373,11 @@ class FIPPICache
     // implementation 
     void *opTable;
 
-    rwlock FCLock;
+    // per-thread lookup counters
+    void *opStats;
+
+    // list of cache files mapped into memory by PreLoad()
+    void *opFiles;
 
     char *PreloadFileName;
     unsigned int RecordsPreloaded;
@@ -358,6 +390,165 @@ class FIPPICache
 /***************************************************************/   
 extern FIPPICache GlobalFIPPICache;
 
+/***************************************************************/
+/* 2b. data structures for caching the frequency-independent   */
+/*     parts of the fixed-order panel-panel cubature           */
+/***************************************************************/
+
+// a 'CCRecord' holds everything about the low-order cubature
+// in GetPanelPanelInteractions() for one panel pair and one
+// choice of RWG source/sink vertices that does not depend on k:
+// the point-point distances R and the cubature-weighted
+// polynomial factors hDot = F.F', hTimes = (FxF').R, each an
+// array of NumPts^2 doubles. for desingularized panel pairs
+// we also store the Q-dependent FIPPI data.
+#define CCREC_NONE   0  // not cacheable (common-panel pair)
+#define CCREC_FAR    1  // plain cubature
+#define CCREC_DESING 2  // desingularized cubature + FIPPIs
+typedef struct CCRecord
+ { 
+   int Type;
+   int ncv;
+   double RMax;      // larger of the two panel radii
+   QDFIPPIData QDFD;
+   double *R, *hDot, *hTimes;
+
+ } CCRecord;
+
+/*--------------------------------------------------------------*/
+/* 'CubatureCache' stores CCRecords for the panel pairs of one  */
+/* RWGGeometry, organized in one table per pair of surfaces.    */
+/* the memory used by the cache is capped at MaxMB megabytes;   */
+/* once the cap is reached, no further records are stored and   */
+/* GetPanelPanelInteractions() falls back to computing          */
+/* everything from scratch for the remaining panel pairs.       */
+/*                                                              */
+/* records for pairs of panels on the same surface are          */
+/* invariant under rigid transformations of that surface and   */
+/* are shared by identical (mate) surfaces. records for pairs   */
+/* of panels on different surfaces are discarded by            */
+/* PrepareBlock() if either surface has moved since they were   */
+/* computed.                                                    */
+/*--------------------------------------------------------------*/
+class CubatureCache
+ {
+  public:
+
+    CubatureCache(RWGGeometry *G, double MaxMB);
+    ~CubatureCache();
+
+    // must be called, from a single thread, before the cache is
+    // used for panel pairs on surfaces Sa and Sb
+    void PrepareBlock(RWGSurface *Sa, RWGSurface *Sb);
+
+    // look up a record; returns 0 if there is none
+    CCRecord *GetRecord(RWGSurface *Sa, int npa, int iQa,
+                        RWGSurface *Sb, int npb, int iQb);
+
+    // allocate a new record of the given type, or return 0 if
+    // the memory cap has been reached; the record must then be
+    // filled in and handed to AddRecord()
+    CCRecord *NewRecord(int Type);
+
+    // add a record to the cache and return it, or, if another
+    // thread got there first, free Record and return the
+    // existing record
+    CCRecord *AddRecord(RWGSurface *Sa, int npa, int iQa,
+                        RWGSurface *Sb, int npb, int iQb,
+                        CCRecord *Record);
+
+    int NumPts;    // points in the one-panel cubature rule
+    double *TCR;   // the rule itself
+    double *WW;    // WW[NumPts*np + npp] = w_np * w_npp
+
+  private:
+
+    void *GetBlock(RWGSurface *Sa, RWGSurface *Sb);
+
+    RWGGeometry *G;
+    void **Blocks;  // Blocks[nsa*NumSurfaces + nsb]
+    size_t MaxBytes, BytesUsed;
+    rwlock CCLock;
+
+ };
+
+/***************************************************************/
+/* 2c. data structures for memoizing complete panel-panel      */
+/*     integrals at a single frequency                         */
+/***************************************************************/
+
+// a 'PMKey' identifies a panel-panel integral by the relative
+// geometry of the two panels and the wavenumber. dV holds the
+// vertices of panel b and vertices 1,2 of panel a, in the order
+// in which they are stored in the panels and measured from
+// vertex 0 of panel a, rounded to multiples of a fixed length
+// quantum. two panel pairs that are translates of each other
+// thus have the same key.
+typedef struct PMKey
+ { 
+   long long dV[15];
+   double kRe, kIm;
+   char iQa, iQb;
+   char NumGradientComponents;
+   char ForceTaylorDuffy;
+
+ } PMKey;
+
+/*--------------------------------------------------------------*/
+/* 'PPIMemo' stores the full outputs of                         */
+/* GetPanelPanelInteractions() (H and, if requested, GradH) for */
+/* panel pairs near enough to need singularity handling, so     */
+/* that congruent panel pairs (as in regular triangulations and */
+/* arrays of identical unit cells) are only computed once per   */
+/* frequency. the memo is emptied whenever it is used at a new  */
+/* frequency, and its memory footprint is capped at MaxMB       */
+/* megabytes; once the cap is reached no further records are    */
+/* stored.                                                      */
+/*--------------------------------------------------------------*/
+class PPIMemo
+ {
+  public:
+
+    PPIMemo(RWGGeometry *G, double MaxMB);
+    ~PPIMemo();
+
+    // must be called, from a single thread, before the memo is
+    // used at angular frequency Omega
+    void PrepareFrequency(cdouble Omega);
+
+    // construct the search key for the panel pair described by Args
+    void GetKey(GetPPIArgStruct *Args, PMKey *Key);
+
+    // look up a record and, if there is one, copy it into the
+    // output fields of Args and return true
+    bool GetRecord(PMKey *Key, GetPPIArgStruct *Args);
+
+    // store the output fields of Args under Key
+    void AddRecord(PMKey *Key, GetPPIArgStruct *Args);
+
+    size_t NumRecords();
+
+  private:
+
+    void *opTable;
+    double LengthQuantum;
+    cdouble Omega;
+    size_t MaxRecords;
+    rwlock PMLock;
+
+ };
+
+/***************************************************************/
+/* 2d. on-disk store of diagonal BEM-matrix blocks (T-blocks), */
+/*     keyed by a hash of the mesh, materials, Omega, and      */
+/*     kBloch (see TBlockStore.cc for the environment variables*/
+/*     that configure it)                                      */
+/***************************************************************/
+bool ReadTBlock(RWGGeometry *G, int ns, cdouble Omega, double *kBloch,
+                HMatrix *M, int RowOffset, int ColOffset);
+void WriteTBlock(RWGGeometry *G, int ns, cdouble Omega, double *kBloch,
+                 HMatrix *M, int RowOffset, int ColOffset);
+
 /****************************************************************/
 /*- 3. Utility routines for analyzing geometrical data          */
 /*-    associated with SCUFF geometries.                        */
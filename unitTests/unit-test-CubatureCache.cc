@@ -0,0 +1,175 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-CubatureCache.cc -- SCUFF-EM unit test comparing BEM matrices
+ *                            -- assembled with the cubature cache, after
+ *                            -- the cache has been filled at another
+ *                            -- frequency and the geometry transformed,
+ *                            -- against matrices assembled without it
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+using namespace scuff;
+
+#define II cdouble(0.0,1.0)
+
+// the cached records hold exactly the quantities that are otherwise
+// recomputed, so the matrices agree to roundoff
+#define CACHE_TOL 1.0e-10
+
+// cap small enough that the cache fills up partway through assembly
+#define SMALL_CACHE_MB 0.25
+
+/***************************************************************/
+/* number of cached records for pairs of panels on surface ns  */
+/***************************************************************/
+int CountRecords(RWGGeometry *G, int ns)
+{
+  RWGSurface *S=G->Surfaces[ns];
+  int NumRecords=0;
+  for(int npa=0; npa<S->NumPanels; npa++)
+   for(int npb=0; npb<S->NumPanels; npb++)
+    for(int iQa=0; iQa<3; iQa++)
+     for(int iQb=0; iQb<3; iQb++)
+      if ( G->CCache->GetRecord(S, npa, iQa, S, npb, iQb) )
+       NumRecords++;
+  return NumRecords;
+}
+
+/***************************************************************/
+/* apply the same rotation and displacement to surface Label   */
+/* of both geometries                                          */
+/***************************************************************/
+void TransformSurface(RWGGeometry *G, RWGGeometry *GRef, const char *Label)
+{
+  double ZHat[3]={1.0, 0.0, 0.0}, DX[3]={0.0, 0.3, 0.5};
+  GTransformation GT;
+  GT.Rotate(ZHat, 30.0);
+  GT.Displace(DX);
+
+  char *SurfaceLabel=(char *)Label;
+  GTComplex GTC;
+  GTC.Tag=(char *)"CubatureCacheTest";
+  GTC.NumSurfacesAffected=1;
+  GTC.SurfaceLabel=&SurfaceLabel;
+  GTC.GT=&GT;
+  G->Transform(&GTC);
+  GRef->Transform(&GTC);
+}
+
+/***************************************************************/
+/* relative (Frobenius-norm) difference between two matrices   */
+/***************************************************************/
+double GetRelDiff(HMatrix *M, HMatrix *MRef)
+{
+  double Diff=0.0, Norm=0.0;
+  for(int nr=0; nr<M->NR; nr++)
+   for(int nc=0; nc<M->NC; nc++)
+    { Diff += norm( M->GetEntry(nr,nc) - MRef->GetEntry(nr,nc) );
+      Norm += norm( MRef->GetEntry(nr,nc) );
+    };
+  return sqrt(Diff/Norm);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+#define NUMTESTS 3
+int main(int argc, char *argv[])
+{
+  SetLogFileName("scuff-test-CubatureCache.log");
+  Log("SCUFF-EM cubature cache unit test running on %s",GetHostName());
+
+  /***************************************************************/
+  /* the second and third geometries consist of two mate spheres;*/
+  /* the upper sphere is rotated and displaced between the two   */
+  /* assemblies, so its records for panel pairs on the same      */
+  /* surface (which it shares with the lower sphere) remain      */
+  /* valid while those for pairs on different surfaces go stale  */
+  /***************************************************************/
+  const char *TestNames[NUMTESTS]={ "single surface",
+                                    "mate surfaces, transformed",
+                                    "cache cap reached" };
+  const char *GeoFiles[NUMTESTS]={ "PECSphere_255.scuffgeo",
+                                   "PECSpheres_255.scuffgeo",
+                                   "PECSpheres_255.scuffgeo" };
+  const char *Transformed[NUMTESTS]={ 0, "UpperSphere", "UpperSphere" };
+  double CacheMB[NUMTESTS]={ 512.0, 512.0, SMALL_CACHE_MB };
+  // for the capped case, the test with the same geometry and no cap
+  int UncappedTest[NUMTESTS]={ -1, -1, 1 };
+  int NumRecords[NUMTESTS];
+  cdouble Omega1=0.7, Omega2=cdouble(1.3,0.2);
+
+  // isolate the cubature cache from the PPI memo
+  RWGGeometry::PPIMemoMB=0.0;
+
+  bool Success=true;
+  for(int nt=0; nt<NUMTESTS; nt++)
+   {
+     RWGGeometry::CubatureCacheMB=0.0;
+     RWGGeometry *GRef = new RWGGeometry(GeoFiles[nt]);
+     RWGGeometry::CubatureCacheMB=CacheMB[nt];
+     RWGGeometry *G = new RWGGeometry(GeoFiles[nt]);
+     HMatrix *MRef = GRef->AllocateBEMMatrix();
+     HMatrix *M    = G->AllocateBEMMatrix();
+
+     // fill the cache at the first frequency
+     G->AssembleBEMMatrix(Omega1, M);
+     NumRecords[nt]=CountRecords(G, 0);
+
+     if (Transformed[nt])
+      TransformSurface(G, GRef, Transformed[nt]);
+
+     GRef->AssembleBEMMatrix(Omega2, MRef);
+     G->AssembleBEMMatrix(Omega2, M);
+     double RelDiff=GetRelDiff(M, MRef);
+
+     // the cache must have been used, and in the capped case
+     // must have run out of room before the end of the assembly
+     bool Used = (NumRecords[nt]>0);
+     if ( UncappedTest[nt]!=-1 && NumRecords[nt]>=NumRecords[UncappedTest[nt]] )
+      Used=false;
+
+     printf("Test %i (%s, %s): ",nt+1,TestNames[nt],GeoFiles[nt]);
+     if (RelDiff<CACHE_TOL && Used)
+      printf(" PASSED ");
+     else
+      { printf(" FAILED ");
+        Success=false;
+      };
+     printf(" (rel diff %.1e, %i records)\n",RelDiff,NumRecords[nt]);
+
+     delete M;
+     delete MRef;
+     delete G;
+     delete GRef;
+   };
+
+  if (Success)
+   exit(0);
+  else
+   exit(1);
+}
@@ -0,0 +1,152 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-FIBBIBulk.cc -- SCUFF-EM unit test for the bulk FIBBI table
+ *                        -- (SCUFF_BULK_FIBBI=1) on a mesh with boundary
+ *                        -- edges, with and without half-RWG functions
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+namespace scuff {
+void ComputeFIBBIData(RWGSurface *Sa, int nea,
+                      RWGSurface *Sb, int neb,
+                      double *FIBBIs);
+}
+
+using namespace scuff;
+
+#define GEOFILE    "PECSquare_40.scuffgeo"
+#define TABLEFILE  "Square_40.fibbitable"
+#define NUMFIBBIS  51
+
+#define TESTNAME1  "full RWG functions"
+#define TESTNAME2  "half-RWG functions, table computed"
+#define TESTNAME3  "half-RWG functions, table loaded from file"
+#define NUMTESTS   3
+
+/***************************************************************/
+/* compare bulk-table FIBBI records against direct computation */
+/* for all pairs of full-RWG edges sharing a vertex.           */
+/***************************************************************/
+bool CheckFIBBIs(RWGGeometry *G, int *NumPairs, double *MaxRelError)
+{
+  RWGSurface *S = G->Surfaces[0];
+  void *Cache   = G->FIBBICaches[0];
+
+  *NumPairs=0;
+  *MaxRelError=0.0;
+  for(int nea=0; nea<S->NumEdges; nea++)
+   for(int neb=0; neb<S->NumEdges; neb++)
+    { 
+      RWGEdge *EA=S->Edges[nea], *EB=S->Edges[neb];
+      if (EA->iQM==-1 || EB->iQM==-1)
+       continue;
+      int iVA[4]={EA->iQP, EA->iV1, EA->iV2, EA->iQM};
+      int iVB[4]={EB->iQP, EB->iV1, EB->iV2, EB->iQM};
+      bool Neighbors=false;
+      for(int m=0; m<4; m++)
+       for(int n=0; n<4; n++)
+        if (iVA[m]==iVB[n]) Neighbors=true;
+      if (!Neighbors)
+       continue;
+
+      double FIBBIs[NUMFIBBIS], FIBBIsRef[NUMFIBBIS];
+      GetFIBBIData(Cache, S, nea, S, neb, FIBBIs);
+      ComputeFIBBIData(S, nea, S, neb, FIBBIsRef);
+      for(int n=0; n<NUMFIBBIS; n++)
+       { double Scale = fmax(1.0, fabs(FIBBIsRef[n]));
+         *MaxRelError = fmax(*MaxRelError, fabs(FIBBIs[n]-FIBBIsRef[n])/Scale);
+       };
+      (*NumPairs)++;
+    };
+
+  return (*NumPairs)>0 && (*MaxRelError)<1.0e-10;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+  SetLogFileName("scuff-test-FIBBIBulk.log");
+  Log("SCUFF-EM bulk FIBBI unit test running on %s",GetHostName());
+
+  bool Test1=false, Test2=false, Test3=false;
+  /* name        type    #args  max_instances  storage    count  description*/
+  OptStruct OSArray[]=
+   { 
+     {"Test1",     PA_BOOL, 0, 1, (void *)&Test1,     0, TESTNAME1},
+     {"Test2",     PA_BOOL, 0, 1, (void *)&Test2,     0, TESTNAME2},
+     {"Test3",     PA_BOOL, 0, 1, (void *)&Test3,     0, TESTNAME3},
+     {0,0,0,0,0,0,0}
+   };
+  ProcessOptions(argc, argv, OSArray);
+  bool AllTests = (argc==1);
+  if (Test3) Test2=true; // test 3 reads the file written by test 2
+
+  bool DoTest[NUMTESTS]         = {Test1 || AllTests, Test2 || AllTests, Test3 || AllTests};
+  bool HalfRWG[NUMTESTS]        = {false, true, true};
+  const char *TestNames[NUMTESTS] = {TESTNAME1, TESTNAME2, TESTNAME3};
+
+  /***************************************************************/
+  /***************************************************************/
+  /***************************************************************/
+  unlink(TABLEFILE);
+  RWGGeometry::BulkFIBBIs=true;
+  bool Success=true;
+  for(int nt=0; nt<NUMTESTS; nt++)
+   { 
+     if (!DoTest[nt]) continue;
+
+     RWGGeometry::UseHRWGFunctions=HalfRWG[nt];
+     RWGGeometry *G = new RWGGeometry(GEOFILE);
+     printf("Test %i (%s): \n",nt+1,TestNames[nt]);
+
+     RWGSurface *S = G->Surfaces[0];
+     if ( HalfRWG[nt] && S->NumExteriorEdges==0 )
+      ErrExit("%s: no half-RWG functions present",GEOFILE);
+
+     int NumPairs;
+     double MaxRelError;
+     if ( CheckFIBBIs(G, &NumPairs, &MaxRelError) )
+      printf(" PASSED ");
+     else
+      { printf(" FAILED ");
+        Success=false;
+      };
+     printf(" (%i pairs, max rel error %.1e)\n",NumPairs,MaxRelError);
+
+     delete G;
+   };
+  unlink(TABLEFILE);
+
+  if (Success) 
+   exit(0);
+  else
+   exit(1);
+}
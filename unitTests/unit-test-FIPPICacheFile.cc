@@ -0,0 +1,211 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-FIPPICacheFile.cc -- SCUFF-EM unit test checking that
+ *                             -- FIPPI cache files written by Store()
+ *                             -- are used by PreLoad(), and that
+ *                             -- truncated files and files with a
+ *                             -- corrupted index are rejected
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+using namespace scuff;
+
+#define CACHEFILE "scuff-test-FIPPICacheFile.fippicache"
+#define BADFILE   "scuff-test-FIPPICacheFile.bad.fippicache"
+
+// layout of the FIPPICF_Header structure in FIPPICache.cc: the
+// NumBuckets field is at byte 40 and the index follows the header
+#define NUMBUCKETS_OFFSET 40
+#define HEADER_SIZE       88
+
+// number of panels whose neighbor pairs we look up
+#define NUMPANELS 100
+
+#define TESTNAME1 "intact cache file"
+#define TESTNAME2 "truncated cache file"
+#define TESTNAME3 "index entries out of range"
+#define TESTNAME4 "index with no empty slots"
+#define NUMTESTS  4
+
+/***************************************************************/
+/* look up FIPPI data for all pairs of panels with common      */
+/* vertices, with the first of the two panels among the first  */
+/* NUMPANELS panels; returns the number of pairs.              */
+/***************************************************************/
+int GetFIPPIData(RWGSurface *S, FIPPICache *FC, QDFIPPIData *QDFDs)
+{
+  int NumPairs=0;
+  for(int npa=0; npa<NUMPANELS; npa++)
+   for(int npb=0; npb<S->NumPanels; npb++)
+    { double rRel, *Va[3], *Vb[3];
+      int ncv=AssessPanelPair(S, npa, S, npb, &rRel, Va, Vb);
+      if (ncv==0) continue;
+      if (QDFDs)
+       GetQDFIPPIData(Va, Va[2], Vb, Vb[2], ncv, (void *)FC, QDFDs+NumPairs);
+      NumPairs++;
+    };
+  return NumPairs;
+}
+
+/***************************************************************/
+/* write a copy of the cache file with the first NumBytes      */
+/* bytes, optionally overwriting the index                     */
+/***************************************************************/
+#define INDEX_INTACT     0
+#define INDEX_OUTOFRANGE 1
+#define INDEX_FULL       2
+void WriteBadFile(size_t NumBytes, int IndexMode)
+{
+  FILE *f=fopen(CACHEFILE,"r");
+  if (!f) ErrExit("could not open %s",CACHEFILE);
+  char *Buffer=(char *)mallocEC(NumBytes);
+  if ( 1!=fread(Buffer, NumBytes, 1, f) )
+   ErrExit("could not read %s",CACHEFILE);
+  fclose(f);
+
+  uint64_t NumBuckets;
+  memcpy(&NumBuckets, Buffer+NUMBUCKETS_OFFSET, sizeof(uint64_t));
+  uint64_t *Index=(uint64_t *)(Buffer + HEADER_SIZE);
+  for(uint64_t nb=0; nb<NumBuckets && IndexMode!=INDEX_INTACT; nb++)
+   { if (IndexMode==INDEX_FULL)
+      Index[nb]=1;
+     else if (Index[nb]!=0)
+      Index[nb]=0x0123456789ABCDEFULL;
+   };
+
+  f=fopen(BADFILE,"w");
+  if (!f) ErrExit("could not open %s",BADFILE);
+  fwrite(Buffer, NumBytes, 1, f);
+  fclose(f);
+  free(Buffer);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+  SetLogFileName("scuff-test-FIPPICacheFile.log");
+  Log("SCUFF-EM FIPPI cache file unit test running on %s",GetHostName());
+
+  bool Test1=false, Test2=false, Test3=false, Test4=false;
+  /* name        type    #args  max_instances  storage    count  description*/
+  OptStruct OSArray[]=
+   {
+     {"Test1",     PA_BOOL, 0, 1, (void *)&Test1,     0, TESTNAME1},
+     {"Test2",     PA_BOOL, 0, 1, (void *)&Test2,     0, TESTNAME2},
+     {"Test3",     PA_BOOL, 0, 1, (void *)&Test3,     0, TESTNAME3},
+     {"Test4",     PA_BOOL, 0, 1, (void *)&Test4,     0, TESTNAME4},
+     {0,0,0,0,0,0,0}
+   };
+  ProcessOptions(argc, argv, OSArray);
+  bool AllTests = (argc==1);
+
+  bool DoTest[NUMTESTS] = {Test1 || AllTests, Test2 || AllTests,
+                           Test3 || AllTests, Test4 || AllTests};
+  const char *TestNames[NUMTESTS] = {TESTNAME1, TESTNAME2, TESTNAME3, TESTNAME4};
+
+  /***************************************************************/
+  /* compute reference FIPPI data and write the cache file       */
+  /***************************************************************/
+  RWGGeometry *G = new RWGGeometry("PECSphere_255.scuffgeo");
+  RWGSurface *S  = G->Surfaces[0];
+
+  int NumPairs = GetFIPPIData(S, 0, 0);
+  QDFIPPIData *QDFDRef = (QDFIPPIData *)mallocEC(NumPairs*sizeof(QDFIPPIData));
+  QDFIPPIData *QDFD    = (QDFIPPIData *)mallocEC(NumPairs*sizeof(QDFIPPIData));
+
+  FIPPICache *FC = new FIPPICache();
+  GetFIPPIData(S, FC, QDFDRef);
+  int HitsRef, MissesRef;
+  FC->GetStatistics(&HitsRef, &MissesRef);
+  FC->Store(CACHEFILE, G);
+  delete FC;
+
+  FILE *f=fopen(CACHEFILE,"r");
+  if (!f) ErrExit("could not open %s",CACHEFILE);
+  fseek(f, 0, SEEK_END);
+  size_t FileSize=ftell(f);
+  fclose(f);
+
+  /***************************************************************/
+  /* preload each file into a fresh cache and look up the same   */
+  /* panel pairs: records from the intact file must all be hits, */
+  /* and the damaged files must be skipped, so that we get only  */
+  /* the hits of the original run (panel pairs sharing a key).   */
+  /* in all cases the data must agree.                           */
+  /***************************************************************/
+  bool Success=true;
+  for(int nt=0; nt<NUMTESTS; nt++)
+   {
+     if (!DoTest[nt]) continue;
+
+     const char *FileName=BADFILE;
+     if (nt==0)
+      FileName=CACHEFILE;
+     else if (nt==1)
+      WriteBadFile(FileSize - 100, INDEX_INTACT);
+     else if (nt==2)
+      WriteBadFile(FileSize, INDEX_OUTOFRANGE);
+     else
+      WriteBadFile(FileSize, INDEX_FULL);
+
+     FC = new FIPPICache();
+     FC->PreLoad(FileName, G);
+     GetFIPPIData(S, FC, QDFD);
+     int Hits, Misses;
+     FC->GetStatistics(&Hits, &Misses);
+     delete FC;
+
+     int NumMismatched=0;
+     for(int np=0; np<NumPairs; np++)
+      if ( memcmp(QDFD+np, QDFDRef+np, sizeof(QDFIPPIData)) )
+       NumMismatched++;
+
+     int ExpectedHits = (nt==0) ? NumPairs : HitsRef;
+     printf("Test %i (%s): ",nt+1,TestNames[nt]);
+     if (NumMismatched==0 && Hits==ExpectedHits)
+      printf(" PASSED ");
+     else
+      { printf(" FAILED ");
+        Success=false;
+      };
+     printf(" (%i pairs, %i hits, %i mismatched)\n",NumPairs,Hits,NumMismatched);
+   };
+
+  remove(CACHEFILE);
+  remove(BADFILE);
+  free(QDFD);
+  free(QDFDRef);
+  delete G;
+
+  if (Success)
+   exit(0);
+  else
+   exit(1);
+}
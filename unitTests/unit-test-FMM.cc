@@ -0,0 +1,114 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-FMM.cc -- SCUFF-EM unit test comparing fast-multipole
+ *                  -- BEM matrix-vector products against products
+ *                  -- with the dense BEM matrix
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+
+using namespace scuff;
+
+#define II cdouble(0.0,1.0)
+
+#define FMM_LEAFSIZE 16
+#define FMM_ORDER    5
+#define FMM_TOL      1.0e-4
+
+/***************************************************************/
+/* relative difference between FMM and dense products M*X for  */
+/* a random vector X                                           */
+/***************************************************************/
+double CompareMatVecs(RWGGeometry *G, cdouble Omega)
+{
+  HMatrix *M = G->AllocateBEMMatrix();
+  G->AssembleBEMMatrix(Omega, M);
+
+  FMMBEMData *Data = G->AllocateFMMBEMData(FMM_LEAFSIZE, FMM_ORDER);
+  G->AssembleFMMBEMData(Omega, Data);
+
+  HVector *X    = G->AllocateRHSVector();
+  HVector *YRef = G->AllocateRHSVector();
+  HVector *YFMM = G->AllocateRHSVector();
+  for(int n=0; n<X->N; n++)
+   X->SetEntry(n, cdouble(randU(-1.0,1.0), randU(-1.0,1.0)));
+
+  M->Apply(X, YRef);
+  G->ApplyBEMMatrixFMM(Data, X, YFMM);
+
+  double Diff=0.0, Norm=0.0;
+  for(int n=0; n<X->N; n++)
+   { Diff += norm( YFMM->GetEntry(n) - YRef->GetEntry(n) );
+     Norm += norm( YRef->GetEntry(n) );
+   };
+
+  delete X;
+  delete YRef;
+  delete YFMM;
+  DestroyFMMBEMData(Data);
+  delete M;
+
+  return sqrt(Diff/Norm);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+#define NUMTESTS 6
+int main(int argc, char *argv[])
+{
+  SetLogFileName("scuff-test-FMM.log");
+  Log("SCUFF-EM FMM unit test running on %s",GetHostName());
+  srandom(0);
+
+  const char *GeoFiles[NUMTESTS]={ "PECSphere_255.scuffgeo",
+                                   "PECSphere_255.scuffgeo",
+                                   "SiSphere_255.scuffgeo",
+                                   "SiSphere_255.scuffgeo",
+                                   "SiSpheres_255.scuffgeo",
+                                   "SiSpheres_255.scuffgeo" };
+  cdouble Omegas[NUMTESTS]={ 1.0, 1.0*II, 1.0, 0.1*II, 1.0, 1.0*II };
+
+  bool Success=true;
+  for(int nt=0; nt<NUMTESTS; nt++)
+   {
+     RWGGeometry *G = new RWGGeometry(GeoFiles[nt]);
+     double RelDiff = CompareMatVecs(G, Omegas[nt]);
+     printf("Test %i (%s, Omega=%s): ",nt+1,GeoFiles[nt],z2s(Omegas[nt]));
+     if (RelDiff < FMM_TOL)
+      printf(" PASSED ");
+     else
+      { printf(" FAILED ");
+        Success=false;
+      };
+     printf(" (rel diff %.1e)\n",RelDiff);
+     delete G;
+   };
+
+  if (Success)
+   exit(0);
+  else
+   exit(1);
+}
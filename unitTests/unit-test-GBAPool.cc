@@ -0,0 +1,111 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-GBAPool.cc -- SCUFF-EM unit test checking that assembling
+ *                      -- the BEM matrix of a periodic geometry again
+ *                      -- at the same (Omega, kBloch), after an
+ *                      -- assembly at another kBloch, reuses the
+ *                      -- pooled GBar interpolation tables and gives
+ *                      -- the same matrix
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "GBarAccelerator.h"
+
+using namespace scuff;
+
+// pooled tables are tagged by setting their LMax field (which is
+// 1e87 for real k and only bounds the table range) to this value
+#define LMAX_TAG 1.0e86
+
+/***************************************************************/
+/* tag the pooled tables for the diagonal block of surface 0,  */
+/* or count how many of them carry the tag                     */
+/***************************************************************/
+int TagPooledGBAs(RWGGeometry *G, cdouble Omega, double *kBloch, bool Tag)
+{
+  int NumTagged=0;
+  for(int nr=0; nr<G->NumRegions; nr++)
+   { GBarAccelerator *GBA=G->CreateRegionGBA(nr, Omega, kBloch, 0, 0, true);
+     if (GBA==0) continue;
+     if (Tag)
+      GBA->LMax=LMAX_TAG;
+     if (GBA->LMax==LMAX_TAG)
+      NumTagged++;
+   };
+  return NumTagged;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+#define NUMTESTS 2
+int main(int argc, char *argv[])
+{
+  SetLogFileName("scuff-test-GBAPool.log");
+  Log("SCUFF-EM GBar accelerator pool unit test running on %s",GetHostName());
+
+  const char *GeoFiles[NUMTESTS]={ "PECPlate_40.scuffgeo", "SiSlab_40.scuffgeo" };
+  cdouble Omega=1.0;
+  double kBloch1[2]={0.3, 0.2}, kBloch2[2]={0.1, 0.0};
+
+  bool Success=true;
+  for(int nt=0; nt<NUMTESTS; nt++)
+   {
+     RWGGeometry *G = new RWGGeometry(GeoFiles[nt]);
+     HMatrix *M1 = G->AllocateBEMMatrix();
+     HMatrix *M2 = G->AllocateBEMMatrix();
+
+     G->AssembleBEMMatrix(Omega, kBloch1, M1);
+     int NumTagged=TagPooledGBAs(G, Omega, kBloch1, true);
+     G->AssembleBEMMatrix(Omega, kBloch2, M2);
+     G->AssembleBEMMatrix(Omega, kBloch1, M2);
+     bool Reused = (NumTagged>0 && TagPooledGBAs(G, Omega, kBloch1, false)==NumTagged);
+
+     bool Identical=true;
+     for(int nr=0; nr<M1->NR; nr++)
+      for(int nc=0; nc<M1->NC; nc++)
+       if ( M1->GetEntry(nr,nc) != M2->GetEntry(nr,nc) )
+        Identical=false;
+
+     printf("Test %i (%s, %i pooled tables): ",nt+1,GeoFiles[nt],NumTagged);
+     if (Reused && Identical)
+      printf(" PASSED ");
+     else
+      { printf(" FAILED ");
+        Success=false;
+      };
+     printf(" (%s, %s)\n",Reused ? "reused" : "rebuilt",
+                          Identical ? "identical" : "different");
+
+     delete M1;
+     delete M2;
+     delete G;
+   };
+
+  if (Success)
+   exit(0);
+  else
+   exit(1);
+}
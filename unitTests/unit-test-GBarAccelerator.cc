@@ -0,0 +1,138 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-GBarAccelerator.cc -- SCUFF-EM unit test comparing the
+ *                              -- periodic Green's function and its
+ *                              -- gradient interpolated from the
+ *                              -- adaptively refined GBarAccelerator
+ *                              -- table against direct Ewald summation
+ *                              -- (GBarVDEwald) at random points
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "GBarAccelerator.h"
+
+using namespace scuff;
+
+#define II cdouble(0.0,1.0)
+
+#define NUMPOINTS 200
+
+// table tolerance, and the tolerance on the interpolated values:
+// the table is refined on a few sample lines per axis, so errors
+// at arbitrary points may exceed the table tolerance somewhat
+#define GBA_RELTOL 1.0e-4
+#define GBA_TOL    2.0e-4
+
+#define RHOMIN 0.0
+#define RHOMAX 0.5
+
+/***************************************************************/
+/* maximum relative errors in GBar and its gradient at random  */
+/* points with x (and y) in the central cell and its neighbors */
+/* and transverse distance Rho in [RHOMIN, RHOMAX]. gradient   */
+/* errors are relative to |GBar| or |grad GBar|, whichever is  */
+/* larger, since the gradient vanishes on symmetry lines.      */
+/***************************************************************/
+void CheckGBA(int LDim, cdouble k, double *kBloch,
+              double *MaxGError, double *MaxdGError)
+{
+  HMatrix *LBasis = new HMatrix(3, LDim, LHM_REAL);
+  double LBV[2][3]={ {1.0, 0.0, 0.0}, {0.0, 1.0, 0.0} };
+  for(int nd=0; nd<LDim; nd++)
+   for(int j=0; j<3; j++)
+    LBasis->SetEntry(j, nd, LBV[nd][j]);
+
+  GBarAccelerator *GBA = CreateGBarAccelerator(LBasis, RHOMIN, RHOMAX,
+                                               k, kBloch, GBA_RELTOL, true);
+
+  *MaxGError=*MaxdGError=0.0;
+  for(int np=0; np<NUMPOINTS; np++)
+   {
+     double R[3], Rho=randU(RHOMIN, RHOMAX);
+     R[0] = randU(-1.5, 1.5);
+     if (LDim==2)
+      { R[1] = randU(-1.5, 1.5);
+        R[2] = (np%2) ? Rho : -Rho;
+      }
+     else
+      { double Theta = randU(0.0, 2.0*M_PI);
+        R[1] = Rho*cos(Theta);
+        R[2] = Rho*sin(Theta);
+      };
+
+     cdouble GRef[8];
+     GBarVDEwald(R, k, kBloch, LBV, LDim, -1.0, true, GRef);
+
+     cdouble dG[3];
+     cdouble G=GetGBar(R, GBA, dG);
+
+     *MaxGError=fmax(*MaxGError, abs(G-GRef[0]) / abs(GRef[0]));
+     for(int Mu=0; Mu<3; Mu++)
+      { double Scale = fmax( abs(GRef[1+Mu]), abs(GRef[0]) );
+        *MaxdGError=fmax(*MaxdGError, abs(dG[Mu]-GRef[1+Mu]) / Scale);
+      };
+   };
+
+  DestroyGBarAccelerator(GBA);
+  delete LBasis;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+#define NUMTESTS 4
+int main(int argc, char *argv[])
+{
+  SetLogFileName("scuff-test-GBarAccelerator.log");
+  Log("SCUFF-EM GBarAccelerator unit test running on %s",GetHostName());
+  srandom(0);
+
+  int LDims[NUMTESTS]={ 1, 1, 2, 2 };
+  cdouble kValues[NUMTESTS]={ 5.0, cdouble(2.0,0.5), 5.0, cdouble(2.0,0.5) };
+  double kBlochs[NUMTESTS][2]={ {0.4, 0.0}, {0.0, 0.0}, {0.4, 0.7}, {1.1, 0.0} };
+
+  bool Success=true;
+  for(int nt=0; nt<NUMTESTS; nt++)
+   {
+     double MaxGError, MaxdGError;
+     CheckGBA(LDims[nt], kValues[nt], kBlochs[nt], &MaxGError, &MaxdGError);
+
+     printf("Test %i (%iD lattice, k=%s, kBloch={%g,%g}): ",
+             nt+1,LDims[nt],CD2S(kValues[nt]),kBlochs[nt][0],kBlochs[nt][1]);
+     if (MaxGError < GBA_TOL && MaxdGError < GBA_TOL)
+      printf(" PASSED ");
+     else
+      { printf(" FAILED ");
+        Success=false;
+      };
+     printf(" (max rel error %.1e in GBar, %.1e in gradient)\n",
+             MaxGError,MaxdGError);
+   };
+
+  if (Success)
+   exit(0);
+  else
+   exit(1);
+}
@@ -0,0 +1,168 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-GBarEwald.cc -- SCUFF-EM unit test comparing the batched
+ *                        -- Ewald summation (GBarVDEwaldBatch) against
+ *                        -- the single-point version (GBarVDEwald),
+ *                        -- including Bloch vectors at Wood anomalies
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "GBarAccelerator.h"
+
+using namespace scuff;
+
+#define NSUM 8
+
+#define TESTNAME1  "2D lattice, generic Bloch vector"
+#define TESTNAME2  "2D lattice, Wood anomaly"
+#define TESTNAME3  "1D lattice, generic Bloch vector"
+#define TESTNAME4  "1D lattice, Wood anomaly"
+#define NUMTESTS   4
+
+/***************************************************************/
+/* evaluation points are arranged in groups sharing the same z */
+/* (LDim==2) or the same Rho (LDim==1), so that the batched    */
+/* code sums the spectral series for several points at once.   */
+/***************************************************************/
+int GetEvalPoints(int LDim, double *R)
+{
+  int NR=0;
+  double ZRho[4]={0.0, 0.05, 0.2, 0.5};
+  for(int ng=0; ng<4; ng++)
+   for(int np=0; np<6; np++)
+    { double x = -0.45 + 0.17*np, Theta = 0.4*np;
+      R[3*NR+0] = x;
+      if (LDim==2)
+       { R[3*NR+1] = 0.35 - 0.13*np;
+         R[3*NR+2] = ZRho[ng];
+       }
+      else
+       { R[3*NR+1] = ZRho[ng]*cos(Theta);
+         R[3*NR+2] = ZRho[ng]*sin(Theta);
+       };
+      NR++;
+    };
+  return NR;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+bool CheckBatch(int LDim, cdouble k, double *kBloch, double *MaxRelError)
+{
+  double LBV[2][3]={ {1.0, 0.0, 0.0}, {0.0, 1.0, 0.0} };
+
+  double R[3*24];
+  int NR=GetEvalPoints(LDim, R);
+
+  cdouble *GBatch = new cdouble[NSUM*NR];
+  GBarVDEwaldBatch(NR, R, k, kBloch, LBV, LDim, -1.0, false, GBatch);
+
+  *MaxRelError=0.0;
+  for(int nr=0; nr<NR; nr++)
+   { cdouble GSingle[NSUM];
+     GBarVDEwald(R+3*nr, k, kBloch, LBV, LDim, -1.0, false, GSingle);
+     for(int ns=0; ns<NSUM; ns++)
+      { double Scale = fmax(1.0, abs(GSingle[ns]));
+        *MaxRelError = fmax(*MaxRelError, abs(GBatch[NSUM*nr+ns]-GSingle[ns])/Scale);
+      };
+   };
+
+  delete[] GBatch;
+  return (*MaxRelError)<1.0e-6;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+  SetLogFileName("scuff-test-GBarEwald.log");
+  Log("SCUFF-EM Ewald-summation unit test running on %s",GetHostName());
+
+  bool Test1=false, Test2=false, Test3=false, Test4=false;
+  /* name        type    #args  max_instances  storage    count  description*/
+  OptStruct OSArray[]=
+   {
+     {"Test1",     PA_BOOL, 0, 1, (void *)&Test1,     0, TESTNAME1},
+     {"Test2",     PA_BOOL, 0, 1, (void *)&Test2,     0, TESTNAME2},
+     {"Test3",     PA_BOOL, 0, 1, (void *)&Test3,     0, TESTNAME3},
+     {"Test4",     PA_BOOL, 0, 1, (void *)&Test4,     0, TESTNAME4},
+     {0,0,0,0,0,0,0}
+   };
+  ProcessOptions(argc, argv, OSArray);
+  bool AllTests = (argc==1);
+
+  bool DoTest[NUMTESTS] = {Test1 || AllTests, Test2 || AllTests,
+                           Test3 || AllTests, Test4 || AllTests};
+  const char *TestNames[NUMTESTS] = {TESTNAME1, TESTNAME2, TESTNAME3, TESTNAME4};
+  int LDims[NUMTESTS] = {2, 2, 1, 1};
+
+  /***************************************************************/
+  /* the Wood-anomaly cases have |kBloch - G| = k for some       */
+  /* reciprocal-lattice vector G: G=(2*pi,0) in the first two    */
+  /* cases and G=(10*pi,0), which lies in an outer shell of the  */
+  /* spectral sum, in the third.                                 */
+  /***************************************************************/
+  bool Success=true;
+  for(int nt=0; nt<NUMTESTS; nt++)
+   {
+     if (!DoTest[nt]) continue;
+     printf("Test %i (%s): \n",nt+1,TestNames[nt]);
+
+     int LDim = LDims[nt];
+     int NumCases;
+     cdouble kValues[3];
+     double kBlochValues[3][2];
+     if (nt==0 || nt==2)
+      { NumCases=2;
+        kValues[0]=1.7;                kBlochValues[0][0]=0.3;  kBlochValues[0][1]=LDim==2 ? 0.8 : 0.0;
+        kValues[1]=cdouble(2.1,0.4);   kBlochValues[1][0]=-1.2; kBlochValues[1][1]=LDim==2 ? 0.2 : 0.0;
+      }
+     else
+      { NumCases=3;
+        kValues[0]=2.0*M_PI;           kBlochValues[0][0]=0.0;  kBlochValues[0][1]=0.0;
+        kValues[1]=2.0*M_PI-0.5;       kBlochValues[1][0]=0.5;  kBlochValues[1][1]=0.0;
+        kValues[2]=1.3;                kBlochValues[2][0]=5.0*2.0*M_PI+1.3; kBlochValues[2][1]=0.0;
+      };
+
+     for(int nc=0; nc<NumCases; nc++)
+      { double MaxRelError;
+        if ( CheckBatch(LDim, kValues[nc], kBlochValues[nc], &MaxRelError) )
+         printf(" PASSED ");
+        else
+         { printf(" FAILED ");
+           Success=false;
+         };
+        printf(" (k=%s, kBloch=(%g,%g): max rel error %.1e)\n",
+                 CD2S(kValues[nc]),kBlochValues[nc][0],kBlochValues[nc][1],MaxRelError);
+      };
+   };
+
+  if (Success)
+   exit(0);
+  else
+   exit(1);
+}
@@ -0,0 +1,225 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-HelmholtzKernel.cc -- SCUFF-EM unit test comparing the
+ *                              -- batched Helmholtz kernels
+ *                              -- (GetHelmholtzKernels / KernelDot)
+ *                              -- against the scalar panel-panel
+ *                              -- integrand (AssembleInnerPPIIntegrand)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "libscuffInternals.h"
+#include "GBarAccelerator.h"
+
+namespace scuff {
+void AssembleInnerPPIIntegrand(double wp, double *R, double *X,
+                               double *F, double *FP, cdouble k,
+                               GBarAccelerator *GBA, bool ForceFullEwald,
+                               int DeSingularize,
+                               int NumTorqueAxes, double *GammaMatrix,
+                               cdouble *HInner, cdouble *GradHInner, cdouble *dHdTInner);
+}
+
+using namespace scuff;
+
+#define II cdouble(0.0,1.0)
+
+// more than one SIMD block and not a multiple of the vector length
+#define NUMPAIRS      301
+#define NUMTORQUEAXES 2
+
+// number of integrand components: H[2], GradH[6], dHdT[2*NUMTORQUEAXES]
+#define NUMCOMPONENTS (2 + 6 + 2*NUMTORQUEAXES)
+
+#define KERNEL_TOL 1.0e-10
+
+/***************************************************************/
+/* random point pairs (X, XP) in a cube of side L, with random */
+/* RWG source vertices Q, QP and cubature weights W            */
+/***************************************************************/
+typedef struct PointPairs
+ { double X[NUMPAIRS][3], XP[NUMPAIRS][3];
+   double F[NUMPAIRS][3], FP[NUMPAIRS][3], R[NUMPAIRS][3];
+   double W[NUMPAIRS];
+ } PointPairs;
+
+void GetPointPairs(double L, PointPairs *PP)
+{
+  for(int n=0; n<NUMPAIRS; n++)
+   { for(int Mu=0; Mu<3; Mu++)
+      { PP->X[n][Mu]  = randU(0.0, L);
+        PP->XP[n][Mu] = randU(0.0, L);
+        PP->F[n][Mu]  = PP->X[n][Mu]  - randU(0.0, L);
+        PP->FP[n][Mu] = PP->XP[n][Mu] - randU(0.0, L);
+        PP->R[n][Mu]  = PP->X[n][Mu]  - PP->XP[n][Mu];
+      };
+     PP->W[n] = randU(0.0, 1.0);
+   };
+}
+
+/***************************************************************/
+/* integrand components summed over all point pairs, computed  */
+/* pair-by-pair with AssembleInnerPPIIntegrand(). Scale is the */
+/* sum of the magnitudes of the individual contributions.      */
+/***************************************************************/
+void GetScalarSums(PointPairs *PP, cdouble k, int DeSingularize,
+                   double *GammaMatrix, cdouble *Sum, double *Scale)
+{
+  for(int nc=0; nc<NUMCOMPONENTS; nc++)
+   { Sum[nc]=0.0;
+     Scale[nc]=0.0;
+   };
+
+  for(int n=0; n<NUMPAIRS; n++)
+   { cdouble Terms[NUMCOMPONENTS];
+     for(int nc=0; nc<NUMCOMPONENTS; nc++)
+      Terms[nc]=0.0;
+     AssembleInnerPPIIntegrand(PP->W[n], PP->R[n], PP->X[n], PP->F[n], PP->FP[n],
+                               k, 0, false, DeSingularize,
+                               NUMTORQUEAXES, GammaMatrix,
+                               Terms, Terms+2, Terms+8);
+     for(int nc=0; nc<NUMCOMPONENTS; nc++)
+      { Sum[nc]   += Terms[nc];
+        Scale[nc] += abs(Terms[nc]);
+      };
+   };
+}
+
+/***************************************************************/
+/* the same sums computed with GetHelmholtzKernels() and       */
+/* KernelDot(), contracted as in GetPPIs_CubatureBatched()     */
+/***************************************************************/
+void GetBatchedSums(PointPairs *PP, cdouble k, int DeSingularize,
+                    double *GammaMatrix, cdouble *Sum)
+{
+  int N=NUMPAIRS;
+  double r[NUMPAIRS], FdotFP[NUMPAIRS], hTimes[NUMPAIRS];
+  double R[3][NUMPAIRS], FxFP[3][NUMPAIRS];
+  double Puv[NUMTORQUEAXES][NUMPAIRS], dFdotFP[NUMTORQUEAXES][NUMPAIRS];
+  double dhTimes[NUMTORQUEAXES][NUMPAIRS];
+  for(int n=0; n<N; n++)
+   { double *X=PP->X[n], *F=PP->F[n], *FP=PP->FP[n], *Rn=PP->R[n], FxFPn[3];
+     VecCross(F, FP, FxFPn);
+     r[n]      = VecNorm(Rn);
+     FdotFP[n] = VecDot(F, FP);
+     hTimes[n] = VecDot(FxFPn, Rn);
+     for(int Mu=0; Mu<3; Mu++)
+      { R[Mu][n]    = Rn[Mu];
+        FxFP[Mu][n] = FxFPn[Mu];
+      };
+     for(int nta=0; nta<NUMTORQUEAXES; nta++)
+      { double dX[3]={0.0, 0.0, 0.0}, dF[3]={0.0, 0.0, 0.0}, dFxFP[3];
+        for(int Mu=0; Mu<3; Mu++)
+         for(int Nu=0; Nu<3; Nu++)
+          { dX[Mu]+=GammaMatrix[9*nta + Mu + 3*Nu]*X[Nu];
+            dF[Mu]+=GammaMatrix[9*nta + Mu + 3*Nu]*F[Nu];
+          };
+        Puv[nta][n]     = VecDot(Rn, dX);
+        dFdotFP[nta][n] = VecDot(dF, FP);
+        dhTimes[nta][n] = VecDot(VecCross(dF,FP,dFxFP),Rn) + VecDot(FxFPn,dX);
+      };
+   };
+
+  double Phi[2*NUMPAIRS], Psi[2*NUMPAIRS], Zeta[2*NUMPAIRS];
+  GetHelmholtzKernels(N, k, r, PP->W, DeSingularize, Phi, Psi, Zeta);
+
+  cdouble ik=II*k, FourOverIK2=4.0/(ik*ik);
+  Sum[0] = KernelDot(N, Phi, FdotFP) + FourOverIK2*KernelDot(N, Phi);
+  Sum[1] = KernelDot(N, Psi, hTimes);
+  for(int Mu=0; Mu<3; Mu++)
+   { Sum[2+2*Mu+0] =  KernelDot(N, Psi, R[Mu], FdotFP)
+                     +FourOverIK2*KernelDot(N, Psi, R[Mu]);
+     Sum[2+2*Mu+1] =  KernelDot(N, Zeta, R[Mu], hTimes)
+                     +KernelDot(N, Psi, FxFP[Mu]);
+   };
+  for(int nta=0; nta<NUMTORQUEAXES; nta++)
+   { Sum[8+2*nta+0] =  KernelDot(N, Psi, Puv[nta], FdotFP)
+                      +FourOverIK2*KernelDot(N, Psi, Puv[nta])
+                      +KernelDot(N, Phi, dFdotFP[nta]);
+     Sum[8+2*nta+1] =  KernelDot(N, Zeta, Puv[nta], hTimes)
+                      +KernelDot(N, Psi, dhTimes[nta]);
+   };
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+#define NUMTESTS 7
+int main(int argc, char *argv[])
+{
+  SetLogFileName("scuff-test-HelmholtzKernel.log");
+  Log("SCUFF-EM Helmholtz kernel unit test running on %s",GetHostName());
+  srandom(0);
+
+  /***************************************************************/
+  /* the last two cases have k*r up to ~1e4 and ~1e8, to exercise*/
+  /* the argument reduction in the sine and cosine routines      */
+  /***************************************************************/
+  const char *TestNames[NUMTESTS]={ "real k",
+                                    "imaginary k",
+                                    "complex k",
+                                    "complex k, desingularized",
+                                    "real k, desingularized",
+                                    "real k, large k*r",
+                                    "real k, very large k*r" };
+  cdouble kValues[NUMTESTS]={ 1.3, 2.7*II, cdouble(1.5,0.6), cdouble(1.5,0.6),
+                              0.8, 3.0e3, 1.0e6 };
+  double LValues[NUMTESTS]={ 1.0, 1.0, 1.0, 0.2, 0.2, 2.0, 100.0 };
+  int DeSingularize[NUMTESTS]={ 0, 0, 0, 1, 1, 0, 0 };
+
+  double GammaMatrix[9*NUMTORQUEAXES];
+  for(int n=0; n<9*NUMTORQUEAXES; n++)
+   GammaMatrix[n]=randU(-1.0,1.0);
+
+  PointPairs PP;
+  bool Success=true;
+  for(int nt=0; nt<NUMTESTS; nt++)
+   {
+     GetPointPairs(LValues[nt], &PP);
+
+     cdouble SumRef[NUMCOMPONENTS], Sum[NUMCOMPONENTS];
+     double Scale[NUMCOMPONENTS];
+     GetScalarSums(&PP, kValues[nt], DeSingularize[nt], GammaMatrix, SumRef, Scale);
+     GetBatchedSums(&PP, kValues[nt], DeSingularize[nt], GammaMatrix, Sum);
+
+     double MaxRelError=0.0;
+     for(int nc=0; nc<NUMCOMPONENTS; nc++)
+      MaxRelError=fmax(MaxRelError, abs(Sum[nc]-SumRef[nc])/Scale[nc]);
+
+     printf("Test %i (%s, k=%s): ",nt+1,TestNames[nt],CD2S(kValues[nt]));
+     if (MaxRelError < KERNEL_TOL)
+      printf(" PASSED ");
+     else
+      { printf(" FAILED ");
+        Success=false;
+      };
+     printf(" (max rel error %.1e)\n",MaxRelError);
+   };
+
+  if (Success)
+   exit(0);
+  else
+   exit(1);
+}
@@ -0,0 +1,111 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-PPIMemo.cc -- SCUFF-EM unit test comparing BEM matrices
+ *                      -- assembled with and without the memo of
+ *                      -- panel-panel integrals for congruent panel
+ *                      -- pairs
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+using namespace scuff;
+
+#define II cdouble(0.0,1.0)
+
+// memoized integrals were computed for a translated copy of the
+// panel pair, so they agree with direct computation only to
+// cubature accuracy
+#define MEMO_TOL 1.0e-8
+
+/***************************************************************/
+/* max over entries of |M1-M2| relative to the largest entry    */
+/***************************************************************/
+double MaxRelDiff(HMatrix *M1, HMatrix *M2)
+{
+  double MaxDiff=0.0, MaxEntry=0.0;
+  for(int nr=0; nr<M1->NR; nr++)
+   for(int nc=0; nc<M1->NC; nc++)
+    { MaxDiff  = fmax(MaxDiff, abs(M1->GetEntry(nr,nc) - M2->GetEntry(nr,nc)));
+      MaxEntry = fmax(MaxEntry, abs(M2->GetEntry(nr,nc)));
+    };
+  return MaxDiff/MaxEntry;
+}
+
+/***************************************************************/
+/* the meshes are regular triangulations with many congruent   */
+/* panel pairs. with the memo we first assemble at a different */
+/* frequency, to check that the memo is refilled when the      */
+/* frequency changes.                                          */
+/***************************************************************/
+#define NUMTESTS 3
+int main(int argc, char *argv[])
+{
+  SetLogFileName("scuff-test-PPIMemo.log");
+  Log("SCUFF-EM PPI memo unit test running on %s",GetHostName());
+
+  const char *GeoFiles[NUMTESTS]={ "PECSquare_40.scuffgeo",
+                                   "PECSquare_40.scuffgeo",
+                                   "PECDiamond_64.scuffgeo" };
+  cdouble Omegas[NUMTESTS]={ 1.0, 2.0*II, cdouble(1.5,0.2) };
+
+  double SaveMB=RWGGeometry::PPIMemoMB;
+  bool Success=true;
+  for(int nt=0; nt<NUMTESTS; nt++)
+   {
+     RWGGeometry::PPIMemoMB=0.0;
+     RWGGeometry *GRef = new RWGGeometry(GeoFiles[nt]);
+     HMatrix *MRef = GRef->AllocateBEMMatrix();
+     GRef->AssembleBEMMatrix(Omegas[nt], MRef);
+     bool NoMemo = (GRef->PMemo==0);
+     delete GRef;
+
+     RWGGeometry::PPIMemoMB=SaveMB;
+     RWGGeometry *G = new RWGGeometry(GeoFiles[nt]);
+     HMatrix *M = G->AllocateBEMMatrix();
+     G->AssembleBEMMatrix(0.5*Omegas[nt], M);
+     G->AssembleBEMMatrix(Omegas[nt], M);
+     size_t NumRecords = G->PMemo ? G->PMemo->NumRecords() : 0;
+
+     double RelDiff=MaxRelDiff(M, MRef);
+     printf("Test %i (%s, Omega=%s): ",nt+1,GeoFiles[nt],z2s(Omegas[nt]));
+     if (NoMemo && NumRecords>0 && RelDiff < MEMO_TOL)
+      printf(" PASSED ");
+     else
+      { printf(" FAILED ");
+        Success=false;
+      };
+     printf(" (%lu memo records, max rel diff %.1e)\n",(unsigned long)NumRecords,RelDiff);
+
+     delete M;
+     delete MRef;
+     delete G;
+   };
+
+  if (Success)
+   exit(0);
+  else
+   exit(1);
+}
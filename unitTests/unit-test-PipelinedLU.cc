@@ -0,0 +1,119 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-PipelinedLU.cc -- SCUFF-EM unit test comparing the pipelined
+ *                          -- assembly and factorization of the BEM
+ *                          -- matrix (AssembleAndFactorizeBEMMatrix)
+ *                          -- against assembly followed by LUFactorize()
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+
+using namespace scuff;
+
+#define II cdouble(0.0,1.0)
+
+// GetEdgeEdgeInteractions() is symmetric in its two edges only to
+// cubature accuracy (~1e-8 relative for some distant pairs), and the
+// pipelined and conventional assembly compute different orderings of
+// some edge pairs, so the two matrices, and hence the solutions, agree
+// to this level rather than to roundoff
+#define LU_TOL 1.0e-5
+
+/***************************************************************/
+/* relative difference between the solutions of M*X=B obtained */
+/* with the two factorizations, for a random RHS vector B      */
+/***************************************************************/
+double CompareFactorizations(RWGGeometry *G, cdouble Omega)
+{
+  HMatrix *MRef = G->AllocateBEMMatrix();
+  G->AssembleBEMMatrix(Omega, MRef);
+  MRef->LUFactorize();
+
+  HMatrix *M = G->AllocateBEMMatrix();
+  G->AssembleAndFactorizeBEMMatrix(Omega, M);
+
+  HVector *XRef = G->AllocateRHSVector();
+  HVector *X    = G->AllocateRHSVector();
+  for(int n=0; n<X->N; n++)
+   { cdouble B = cdouble(randU(-1.0,1.0), randU(-1.0,1.0));
+     XRef->SetEntry(n, B);
+     X->SetEntry(n, B);
+   };
+  MRef->LUSolve(XRef);
+  M->LUSolve(X);
+
+  double Diff=0.0, Norm=0.0;
+  for(int n=0; n<X->N; n++)
+   { Diff += norm( X->GetEntry(n) - XRef->GetEntry(n) );
+     Norm += norm( XRef->GetEntry(n) );
+   };
+
+  delete X;
+  delete XRef;
+  delete M;
+  delete MRef;
+
+  return sqrt(Diff/Norm);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+#define NUMTESTS 5
+int main(int argc, char *argv[])
+{
+  SetLogFileName("scuff-test-PipelinedLU.log");
+  Log("SCUFF-EM pipelined LU unit test running on %s",GetHostName());
+  srandom(0);
+
+  const char *GeoFiles[NUMTESTS]={ "PECSphere_255.scuffgeo",
+                                   "PECSpheres_255.scuffgeo",
+                                   "SiSphere_255.scuffgeo",
+                                   "SiSphere_255.scuffgeo",
+                                   "SiSpheres_255.scuffgeo" };
+  cdouble Omegas[NUMTESTS]={ 1.0, 1.0, 1.0, 0.1*II, 1.0*II };
+
+  bool Success=true;
+  for(int nt=0; nt<NUMTESTS; nt++)
+   {
+     RWGGeometry *G = new RWGGeometry(GeoFiles[nt]);
+     double RelDiff = CompareFactorizations(G, Omegas[nt]);
+     printf("Test %i (%s, %i BFs, Omega=%s): ",
+             nt+1,GeoFiles[nt],G->TotalBFs,z2s(Omegas[nt]));
+     if (RelDiff < LU_TOL)
+      printf(" PASSED ");
+     else
+      { printf(" FAILED ");
+        Success=false;
+      };
+     printf(" (rel diff %.1e)\n",RelDiff);
+     delete G;
+   };
+
+  if (Success)
+   exit(0);
+  else
+   exit(1);
+}
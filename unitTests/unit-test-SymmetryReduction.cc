@@ -0,0 +1,128 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-SymmetryReduction.cc -- SCUFF-EM unit test comparing the
+ *                                -- solution of the BEM system obtained
+ *                                -- by solving the irrep blocks of a
+ *                                -- mirror-symmetric geometry against
+ *                                -- the solution obtained from the LU
+ *                                -- factorization of the full BEM matrix
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+
+using namespace scuff;
+
+#define II cdouble(0.0,1.0)
+
+// as in unit-test-PipelinedLU: the full and irrep-block matrices are
+// assembled from different orderings of some edge pairs, which agree
+// only to cubature accuracy
+#define SYM_TOL 1.0e-5
+
+/***************************************************************/
+/* relative difference between the solutions of M*X=B obtained */
+/* from the full BEM matrix and from the irrep blocks, for a   */
+/* random RHS vector B                                         */
+/***************************************************************/
+double CompareSolutions(RWGGeometry *G, SymmetryData *SD, cdouble Omega)
+{
+  HMatrix *M = G->AllocateBEMMatrix();
+  G->AssembleBEMMatrix(Omega, M);
+  M->LUFactorize();
+
+  G->AssembleIrrepBEMMatrices(Omega, SD);
+  FactorizeIrrepBEMMatrices(SD);
+
+  HVector *XRef = G->AllocateRHSVector();
+  HVector *X    = G->AllocateRHSVector();
+  for(int n=0; n<X->N; n++)
+   { cdouble B = cdouble(randU(-1.0,1.0), randU(-1.0,1.0));
+     XRef->SetEntry(n, B);
+     X->SetEntry(n, B);
+   };
+  M->LUSolve(XRef);
+  SolveIrrepBEMSystems(SD, X);
+
+  double Diff=0.0, Norm=0.0;
+  for(int n=0; n<X->N; n++)
+   { Diff += norm( X->GetEntry(n) - XRef->GetEntry(n) );
+     Norm += norm( XRef->GetEntry(n) );
+   };
+
+  delete X;
+  delete XRef;
+  delete M;
+
+  return sqrt(Diff/Norm);
+}
+
+/***************************************************************/
+/* the meshes are symmetric under reflection through all three */
+/* coordinate planes. the last case is an open surface with    */
+/* half-RWG basis functions on its exterior edges.             */
+/***************************************************************/
+#define NUMTESTS 5
+int main(int argc, char *argv[])
+{
+  SetLogFileName("scuff-test-SymmetryReduction.log");
+  Log("SCUFF-EM symmetry reduction unit test running on %s",GetHostName());
+  srandom(0);
+
+  const char *GeoFiles[NUMTESTS]={ "PECOctSphere_200.scuffgeo",
+                                   "PECOctSphere_200.scuffgeo",
+                                   "SiOctSphere_200.scuffgeo",
+                                   "SiOctSphere_200.scuffgeo",
+                                   "PECDiamond_64.scuffgeo" };
+  const char *MirrorPlanes[NUMTESTS]={ "xy", "xy,yz", "xz", "xz,yz", "xz,yz" };
+  cdouble Omegas[NUMTESTS]={ 1.0, 1.0, 1.0, 1.0*II, 1.0 };
+  bool HalfRWG[NUMTESTS]={ false, false, false, false, true };
+
+  bool Success=true;
+  for(int nt=0; nt<NUMTESTS; nt++)
+   {
+     RWGGeometry::UseHRWGFunctions=HalfRWG[nt];
+     RWGGeometry *G = new RWGGeometry(GeoFiles[nt]);
+     SymmetryData *SD = G->CreateSymmetryData(MirrorPlanes[nt]);
+     double RelDiff = CompareSolutions(G, SD, Omegas[nt]);
+     printf("Test %i (%s, %s%s, %i irreps, Omega=%s): ",
+             nt+1,GeoFiles[nt],MirrorPlanes[nt],HalfRWG[nt] ? ", half-RWG" : "",
+             GetNumIrreps(SD),z2s(Omegas[nt]));
+     if (RelDiff < SYM_TOL)
+      printf(" PASSED ");
+     else
+      { printf(" FAILED ");
+        Success=false;
+      };
+     printf(" (rel diff %.1e)\n",RelDiff);
+     DestroySymmetryData(SD);
+     delete G;
+   };
+  RWGGeometry::UseHRWGFunctions=false;
+
+  if (Success)
+   exit(0);
+  else
+   exit(1);
+}
@@ -0,0 +1,271 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-TBlockStore.cc -- SCUFF-EM unit test checking that T-blocks
+ *                          -- written to the on-disk store are reused,
+ *                          -- that corrupted blocks are recomputed,
+ *                          -- and that the content key is unchanged by
+ *                          -- rigid motions but changed by a change of
+ *                          -- material
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+
+using namespace scuff;
+
+#define STOREDIR "scuff-test-TBlockStore.store"
+#define GEOFILE  "SiOctSphere_200.scuffgeo"
+
+// copy of the TBSHeader structure in TBlockStore.cc; the block
+// data follow the header in uncompressed files
+typedef struct TBSHeader
+ { char Signature[16];
+   uint32_t Version;
+   uint32_t EndianTag;
+   uint64_t Key[2];
+   int32_t NR, NC;
+   int32_t RealComplex;
+   int32_t Compression;
+   uint64_t RawSize;
+   uint64_t StoredSize;
+   uint64_t DataChecksum;
+   uint64_t HeaderChecksum;
+ } TBSHeader;
+
+// value planted in the stored block to check that it is used
+#define MARKER cdouble(12345.0,-6789.0)
+
+#define TESTNAME1 "stored block is reused"
+#define TESTNAME2 "corrupted block is recomputed"
+#define TESTNAME3 "transformed surface has the same key"
+#define TESTNAME4 "changed material gives a new key"
+#define NUMTESTS  4
+
+/***************************************************************/
+/* the checksum used by TBlockStore.cc (64-bit FNV-1a on       */
+/* 8-byte words)                                               */
+/***************************************************************/
+uint64_t GetChecksum(const void *Data, size_t Size)
+{
+  uint64_t Hash=14695981039346656037ULL;
+  const uint64_t *W=(const uint64_t *)Data;
+  size_t NW=Size/sizeof(uint64_t);
+  for(size_t nw=0; nw<NW; nw++)
+   Hash = (Hash ^ W[nw]) * 1099511628211ULL;
+  const unsigned char *p=(const unsigned char *)(W + NW);
+  for(size_t n=NW*sizeof(uint64_t); n<Size; n++, p++)
+   Hash = (Hash ^ (*p)) * 1099511628211ULL;
+  return Hash;
+}
+
+/***************************************************************/
+/* count the block files in the store, returning the name of   */
+/* the last one found; if Remove==true, delete them instead,   */
+/* together with their subdirectories                          */
+/***************************************************************/
+int ScanStore(char *FileName, bool Remove=false)
+{
+  int NumFiles=0;
+  DIR *Dir=opendir(STOREDIR);
+  if (!Dir) return 0;
+  struct dirent *Entry;
+  while( (Entry=readdir(Dir)) )
+   { if (Entry->d_name[0]=='.') continue;
+     char SubDirName[1024];
+     snprintf(SubDirName,1024,"%s/%s",STOREDIR,Entry->d_name);
+     DIR *SubDir=opendir(SubDirName);
+     if (!SubDir) continue;
+     struct dirent *SubEntry;
+     while( (SubEntry=readdir(SubDir)) )
+      { if (SubEntry->d_name[0]=='.') continue;
+        char Name[2048];
+        snprintf(Name,2048,"%s/%s",SubDirName,SubEntry->d_name);
+        if (Remove)
+         unlink(Name);
+        else if ( strstr(Name,".tblk") )
+         { if (FileName) strcpy(FileName, Name);
+           NumFiles++;
+         };
+      };
+     closedir(SubDir);
+     if (Remove) rmdir(SubDirName);
+   };
+  closedir(Dir);
+  if (Remove) rmdir(STOREDIR);
+  return NumFiles;
+}
+
+/***************************************************************/
+/* overwrite the first entry of the stored block with Value;   */
+/* if FixChecksums==false the file is left with a checksum     */
+/* mismatch                                                    */
+/***************************************************************/
+void PlantValue(const char *FileName, cdouble Value, bool FixChecksums)
+{
+  FILE *f=fopen(FileName,"r");
+  if (!f) ErrExit("could not open %s",FileName);
+  TBSHeader Header;
+  if ( 1!=fread(&Header, sizeof(Header), 1, f) )
+   ErrExit("could not read %s",FileName);
+  char *Data=(char *)mallocEC(Header.StoredSize);
+  if ( 1!=fread(Data, Header.StoredSize, 1, f) )
+   ErrExit("could not read %s",FileName);
+  fclose(f);
+
+  if (Header.Compression!=0)
+   ErrExit("%s: unexpected compressed block",FileName);
+  memcpy(Data, &Value, sizeof(cdouble));
+  if (FixChecksums)
+   { Header.DataChecksum=GetChecksum(Data, Header.StoredSize);
+     Header.HeaderChecksum=0;
+     Header.HeaderChecksum=GetChecksum(&Header, sizeof(Header));
+   };
+
+  f=fopen(FileName,"w");
+  if (!f) ErrExit("could not open %s",FileName);
+  fwrite(&Header, sizeof(Header), 1, f);
+  fwrite(Data, Header.StoredSize, 1, f);
+  fclose(f);
+  free(Data);
+}
+
+/***************************************************************/
+/* assemble the BEM matrix of a new geometry, optionally with  */
+/* its surface rotated and displaced or its material changed   */
+/***************************************************************/
+HMatrix *Assemble(cdouble Omega, bool Transform=false, bool NewEps=false)
+{
+  RWGGeometry *G = new RWGGeometry(GEOFILE);
+  if (Transform)
+   { G->Surfaces[0]->Transform("ROTATED 40 ABOUT 1 1 0");
+     G->Surfaces[0]->Transform("DISPLACED 0.1 0.2 0.3");
+   };
+  if (NewEps)
+   G->SetEps("TheSphere", 4.0);
+  HMatrix *M = G->AllocateBEMMatrix();
+  G->AssembleBEMMatrix(Omega, M);
+  delete G;
+  return M;
+}
+
+double GetRelDiff(HMatrix *M, HMatrix *MRef)
+{
+  double Diff=0.0, Norm=0.0;
+  for(int nr=0; nr<M->NR; nr++)
+   for(int nc=0; nc<M->NC; nc++)
+    { Diff += norm( M->GetEntry(nr,nc) - MRef->GetEntry(nr,nc) );
+      Norm += norm( MRef->GetEntry(nr,nc) );
+    };
+  return sqrt(Diff/Norm);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+  SetLogFileName("scuff-test-TBlockStore.log");
+  Log("SCUFF-EM T-block store unit test running on %s",GetHostName());
+
+  // start from an empty store, and write blocks synchronously
+  ScanStore(0, true);
+  setenv("SCUFF_TBLOCK_PATH", STOREDIR, 1);
+  setenv("SCUFF_TBLOCK_QUEUEMB", "0", 1);
+  unsetenv("SCUFF_TBLOCK_READPATH");
+  unsetenv("SCUFF_TBLOCK_COMPRESS");
+
+  const char *TestNames[NUMTESTS] = {TESTNAME1, TESTNAME2, TESTNAME3, TESTNAME4};
+  cdouble Omega=0.8;
+
+  /***************************************************************/
+  /* reference matrix; its diagonal block goes into the store    */
+  /***************************************************************/
+  HMatrix *MRef=Assemble(Omega);
+  char FileName[2048];
+  if ( ScanStore(FileName)!=1 )
+   ErrExit("T-block was not written to %s",STOREDIR);
+
+  bool Success=true;
+  for(int nt=0; nt<NUMTESTS; nt++)
+   {
+     HMatrix *M=0;
+     bool Passed=false;
+     double RelDiff=0.0;
+     char NewFileName[2048];
+     if (nt==0)
+      { // a block we have tampered with, but with valid checksums,
+        // must be loaded as is
+        PlantValue(FileName, MARKER, true);
+        M=Assemble(Omega);
+        bool Loaded = (M->GetEntry(0,0)==MARKER);
+        M->SetEntry(0, 0, MRef->GetEntry(0,0));
+        RelDiff=GetRelDiff(M, MRef);
+        Passed = Loaded && (RelDiff==0.0) && ScanStore(NewFileName)==1;
+      }
+     else if (nt==1)
+      { // a block that fails verification must be recomputed
+        // and written again
+        PlantValue(FileName, 2.0*MARKER, false);
+        M=Assemble(Omega);
+        RelDiff=GetRelDiff(M, MRef);
+        Passed = (RelDiff<1.0e-12) && ScanStore(NewFileName)==1
+                 && !strcmp(NewFileName, FileName);
+      }
+     else if (nt==2)
+      { // the block for the displaced and rotated surface must
+        // be found under the same key
+        M=Assemble(Omega, true);
+        RelDiff=GetRelDiff(M, MRef);
+        Passed = (RelDiff<1.0e-12) && ScanStore(NewFileName)==1
+                 && !strcmp(NewFileName, FileName);
+      }
+     else
+      { // a different material must give a new block
+        M=Assemble(Omega, false, true);
+        RelDiff=GetRelDiff(M, MRef);
+        Passed = (RelDiff>1.0e-3) && ScanStore(NewFileName)==2;
+      };
+
+     printf("Test %i (%s): ",nt+1,TestNames[nt]);
+     if (Passed)
+      printf(" PASSED ");
+     else
+      { printf(" FAILED ");
+        Success=false;
+      };
+     printf(" (rel diff %.1e)\n",RelDiff);
+     delete M;
+   };
+
+  delete MRef;
+  ScanStore(0, true);
+
+  if (Success)
+   exit(0);
+  else
+   exit(1);
+}